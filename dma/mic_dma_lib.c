@@ -46,6 +46,8 @@
 #include<linux/interrupt.h>
 #include<linux/proc_fs.h>
 #include<linux/bitops.h>
+#include<linux/seq_file.h>
+#include<linux/ktime.h>
 #ifdef _MIC_SCIF_
 #include <asm/mic/mic_common.h>
 #endif
@@ -63,6 +65,9 @@
 #include <mic/micscif_smpt.h>
 #include <mic/micsboxdefine.h>
 
+#define CREATE_TRACE_POINTS
+#include <mic/mic_dma_trace.h>
+
 MODULE_LICENSE("GPL");
 
 #ifdef MIC_IS_EMULATION
@@ -126,6 +131,26 @@ struct intr_compl_buf_ring {
 
 struct mic_dma_ctx_t;			/* Forward Declaration */
 
+/*
+ * Per channel counters exported through debugfs. Submission side counters
+ * are only updated by the current owner of the channel and completion side
+ * counters only from the interrupt handler, so no locking is required.
+ * @busy_ns accumulates the time from the first interrupt descriptor queued
+ * on an idle channel until the interrupt that retires the last outstanding
+ * mark. Polled only traffic is not timed as no interrupt would stop the clock.
+ */
+struct dma_chan_stats {
+	uint64_t submissions;
+	uint64_t descriptors;
+	uint64_t bytes;
+	uint64_t completions;
+	uint64_t stalls;
+	uint64_t stall_ns;
+	uint64_t busy_ns;
+	uint64_t timeouts;
+	ktime_t busy_since;
+};
+
 struct dma_channel {
 	int ch_num;/*Duplicated in md_mic_dma_chan struct too*/
 	struct md_mic_dma_chan *chan;
@@ -139,6 +164,7 @@ struct dma_channel {
 	struct intr_compl_buf_ring intr_ring;
 	struct compl_buf_ring poll_ring;
 	struct mic_dma_ctx_t *dma_ctx;	  /* Pointer to parent DMA context */
+	struct dma_chan_stats stats;
 };
 
 /* Per MIC device (per MIC board) DMA context */
@@ -147,8 +173,10 @@ struct mic_dma_ctx_t {
 	int			last_allocated_dma_channel_num;
 	struct mic_dma_device	dma_dev;
 	int			device_num;
+	int			numa_node;	/* Node of the card, -1 on the card */
 	atomic_t		ref_count;	/* Reference count */
 	atomic_t		ch_num;
+	struct dentry		*dbg_dir;
 };
 
 /* DMA Library Init/Uninit Routines */
@@ -187,6 +215,44 @@ static inline bool verify_next_write_index(struct dma_channel *ch)
 	return ret;
 }
 
+static void
+mic_dma_timeout(struct dma_channel *ch, const char *where)
+{
+	ch->stats.timeouts++;
+	trace_mic_dma_timeout(ch->dma_ctx->device_num, ch->ch_num, where);
+}
+
+/* Account a ring full stall which started at @start */
+static void
+mic_dma_ring_stall(struct dma_channel *ch, ktime_t start, uint32_t required)
+{
+	uint64_t ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	ch->stats.stalls++;
+	ch->stats.stall_ns += ns;
+	trace_mic_dma_ring_full(ch->dma_ctx->device_num, ch->ch_num, required, ns);
+}
+
+/*
+ * Hand the descriptors between @start and next_write_index to the
+ * hardware by updating the head pointer. @intr tells whether they end
+ * with an interrupt descriptor.
+ */
+static void
+mic_dma_write_head(struct dma_channel *ch, uint64_t start, bool intr)
+{
+	uint32_t ndesc = (uint32_t)((ch->next_write_index + ch->chan->num_desc_in_ring -
+				start) % ch->chan->num_desc_in_ring);
+
+	if (intr && !ktime_to_ns(ch->stats.busy_since))
+		ch->stats.busy_since = ktime_get();
+	ch->stats.descriptors += ndesc;
+	trace_mic_dma_head_write(ch->dma_ctx->device_num, ch->ch_num,
+				 (uint32_t)ch->next_write_index, ndesc);
+	md_mic_dma_chan_write_head(&ch->dma_ctx->dma_dev, ch->chan,
+				   (uint32_t)ch->next_write_index);
+}
+
 /* TODO:
  * See if we can use __get_free_pages or something similar
  * get_free_pages expects a power of 2 number of pages
@@ -200,8 +266,9 @@ alloc_dma_desc_ring_mem(struct dma_channel *ch, struct mic_dma_ctx_t *dma_ctx)
 	/* Is there any kernel allocator which provides the
 	 * option to give the alignment??
 	 */
-	ch->desc_ring = kzalloc(
-			(DMA_DESC_RING_SIZE * sizeof(*ch->desc_ring)) + PAGE_SIZE, GFP_KERNEL);
+	ch->desc_ring = kzalloc_node(
+			(DMA_DESC_RING_SIZE * sizeof(*ch->desc_ring)) + PAGE_SIZE, GFP_KERNEL,
+			dma_ctx->numa_node);
 	ch->desc_ring_bak = ch->desc_ring;
 	ch->desc_ring = (union md_mic_dma_desc *)ALIGN(
 			(uint64_t)ch->desc_ring, PAGE_SIZE);
@@ -247,6 +314,15 @@ mic_dma_lib_interrupt_handler(struct dma_channel *chan)
 	}
 	chan->intr_ring.old_tail = new_tail;
 	update_tail(&chan->intr_ring.ring, new_tail);
+	chan->stats.completions += i;
+	if (new_tail == chan->intr_ring.ring.head &&
+	    ktime_to_ns(chan->stats.busy_since)) {
+		chan->stats.busy_ns += ktime_to_ns(ktime_sub(ktime_get(),
+					chan->stats.busy_since));
+		chan->stats.busy_since = ktime_set(0, 0);
+	}
+	trace_mic_dma_complete(chan->dma_ctx->device_num, chan->ch_num,
+			       new_tail, i);
 	wake_up(&chan->intr_wq);
 	if (i == ring_size && old_tail != new_tail) {
 		printk(KERN_ERR PR_PREFIX "Something went wrong, old tail = %d, new tail = %d\n", 
@@ -254,6 +330,25 @@ mic_dma_lib_interrupt_handler(struct dma_channel *chan)
 	}
 }
 
+#ifdef MIC_DMA_EMULATION
+/*
+ * Completion interrupt raised by the software DMA engine. Mirrors what
+ * the card and host interrupt handlers do for a real channel interrupt.
+ */
+static void
+mic_dma_emul_interrupt_handler(struct mic_dma_device *dma_dev, int chan_num)
+{
+	struct mic_dma_ctx_t *dma_ctx =
+		container_of(dma_dev, struct mic_dma_ctx_t, dma_dev);
+	struct dma_channel *chan = &dma_ctx->dma_channels[chan_num];
+
+	if (!chan->desc_ring)
+		return;
+	ack_dma_interrupt(chan);
+	mic_dma_lib_interrupt_handler(chan);
+}
+#endif
+
 #ifdef _MIC_SCIF_
 /*
  * TODO;
@@ -309,7 +404,8 @@ mi_mic_dma_chan_setup(struct dma_channel *ch, struct mic_dma_ctx_t *dma_ctx)
 	init_ring(&ch->poll_ring, MAX_POLLING_BUFFERS, dma_ctx->device_num);
 
 	ch->intr_ring.comp_cb_array =
-		kzalloc(sizeof(*ch->intr_ring.comp_cb_array) * NUM_COMP_BUFS, GFP_KERNEL);
+		kzalloc_node(sizeof(*ch->intr_ring.comp_cb_array) * NUM_COMP_BUFS,
+			     GFP_KERNEL, dma_ctx->numa_node);
 	init_ring(&ch->intr_ring.ring, NUM_COMP_BUFS, dma_ctx->device_num);
 	ch->intr_ring.old_tail = 0;
 }
@@ -326,16 +422,22 @@ int
 open_dma_device(int device_num, uint8_t *mmio_va_base, mic_dma_handle_t* dma_handle)
 {
 	int result = 0;
+	int numa_node = -1;
 
 	if (device_num >= MAX_BOARD_SUPPORTED)
 		return -EINVAL;
 
+#ifndef _MIC_SCIF_
+	numa_node = micscif_numa_node(device_num);
+#endif
 	mutex_lock(&lock_dma_dev_init[device_num]);
 	if (!mic_dma_context[device_num]) {
-		mic_dma_context[device_num] = kzalloc(sizeof(struct mic_dma_ctx_t), GFP_KERNEL);
+		mic_dma_context[device_num] = kzalloc_node(sizeof(struct mic_dma_ctx_t),
+							   GFP_KERNEL, numa_node);
 		BUG_ON(!mic_dma_context[device_num]);
 
 		mic_dma_context[device_num]->device_num = device_num;
+		mic_dma_context[device_num]->numa_node = numa_node;
 
 		result = mic_dma_lib_init(mmio_va_base, mic_dma_context[device_num]);
 		BUG_ON(result);
@@ -378,7 +480,8 @@ void mi_mic_dma_chan_set_dstat_wb(struct mic_dma_ctx_t *dma_ctx,
 	struct pci_dev *pdev;
 #endif
 	if (!chan->dstat_wb_phys) {
-		chan->dstat_wb_loc = kzalloc(sizeof(uint32_t), GFP_KERNEL);
+		chan->dstat_wb_loc = kzalloc_node(sizeof(uint32_t), GFP_KERNEL,
+						  dma_ctx->numa_node);
 
 #ifdef _MIC_SCIF_
 		chan->dstat_wb_phys = virt_to_phys(chan->dstat_wb_loc);
@@ -419,8 +522,11 @@ int
 mic_dma_lib_init(uint8_t *mmio_va_base, struct mic_dma_ctx_t *dma_ctx)
 {
 	int i;
-#ifdef _MIC_SCIF_
+#if defined(_MIC_SCIF_) && !defined(MIC_DMA_EMULATION)
 	int ret_value;
+#endif
+#ifdef MIC_DMA_EMULATION
+	int ret;
 #endif
 	struct dma_channel *ch;
 	enum md_mic_dma_chan_owner owner, currentOwner;
@@ -431,6 +537,11 @@ mic_dma_lib_init(uint8_t *mmio_va_base, struct mic_dma_ctx_t *dma_ctx)
 
 	// TODO: multi-card support
 	md_mic_dma_init(&dma_ctx->dma_dev, mmio_va_base);
+#ifdef MIC_DMA_EMULATION
+	if ((ret = md_mic_dma_emul_init(&dma_ctx->dma_dev, dma_ctx->device_num,
+					mic_dma_emul_interrupt_handler)))
+		return ret;
+#endif
 
 	for (i = 0 ; i < MAX_NUM_DMA_CHAN; i++) {
 		ch = &dma_ctx->dma_channels[i];
@@ -459,7 +570,8 @@ mic_dma_lib_init(uint8_t *mmio_va_base, struct mic_dma_ctx_t *dma_ctx)
 		if (currentOwner == owner) {
 			alloc_dma_desc_ring_mem(ch, dma_ctx);
 
-#ifdef _MIC_SCIF_ // DMA now shares the IRQ handler with other system interrupts
+#if defined(_MIC_SCIF_) && !defined(MIC_DMA_EMULATION)
+			// DMA now shares the IRQ handler with other system interrupts
 			ret_value = request_irq(i, dma_interrupt_handler, IRQF_DISABLED,
 						"dma channel", ch);
 			ret_value = ret_value;
@@ -503,7 +615,20 @@ mic_dma_lib_uninit(struct mic_dma_ctx_t *dma_ctx)
 		drain_dma_intr(ch);
 		/* Request the channel but don't free it. Errors are okay */
 		request_dma_channel(ch);
-#ifdef _MIC_SCIF_ // DMA now shares the IRQ handler with other system interrupts
+	}
+#ifdef MIC_DMA_EMULATION
+	/*
+	 * The emulator thread walks every channel's descriptor ring, so it
+	 * has to be gone before any ring is torn down below.
+	 */
+	md_mic_dma_emul_stop(&dma_ctx->dma_dev);
+#endif
+	for (i = 0 ; i < MAX_NUM_DMA_CHAN; i++) {
+		ch = &dma_ctx->dma_channels[i];
+		if (!ch->desc_ring)
+			continue;
+#if defined(_MIC_SCIF_) && !defined(MIC_DMA_EMULATION)
+		// DMA now shares the IRQ handler with other system interrupts
 		free_irq(i, ch);
 #endif
 		mi_mic_dma_chan_destroy(ch, dma_ctx);
@@ -531,6 +656,9 @@ mic_dma_lib_uninit(struct mic_dma_ctx_t *dma_ctx)
 #ifndef MIC_IS_EMULATION
 	/* Ensure that all waiters for DMA channels time out */
 	msleep(DMA_TO/HZ * 1000);
+#endif
+#ifdef MIC_DMA_EMULATION
+	md_mic_dma_emul_uninit(&dma_ctx->dma_dev);
 #endif
 	md_mic_dma_uninit(&dma_ctx->dma_dev);
 	//pr_debug(PR_PREFIX "Uninitialized the dma channels\n");
@@ -630,6 +758,7 @@ int request_dma_channel(struct dma_channel *chan)
 		CHAN_AVAILABLE, CHAN_INUSE), DMA_TO);
 	if (!ret) {
 		printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+		mic_dma_timeout(chan, __func__);
 		ret = -EBUSY;
 	}
 	if (ret > 0)
@@ -638,6 +767,24 @@ int request_dma_channel(struct dma_channel *chan)
 }
 EXPORT_SYMBOL(request_dma_channel);
 
+/*
+ * try_request_dma_channel - Request a specific DMA channel if it is free.
+ *
+ * @chan - the dma_channel pointer to acquire
+ *
+ * Returns: 0 on success and -EBUSY if the channel is in use.
+ *
+ * NOTE: Same rules as request_dma_channel, minus the wait.
+ */
+int try_request_dma_channel(struct dma_channel *chan)
+{
+	if (CHAN_AVAILABLE == atomic_cmpxchg(&chan->flags,
+		CHAN_AVAILABLE, CHAN_INUSE))
+		return 0;
+	return -EBUSY;
+}
+EXPORT_SYMBOL(try_request_dma_channel);
+
 /*
  * free_dma_channel - after allocating a channel, used to
  *                 free the channel after DMAs are submitted
@@ -676,6 +823,8 @@ program_memcpy_descriptors(struct dma_channel *chan, uint64_t src, uint64_t dst,
 	size_t current_transfer_len;
 	bool is_astep = false;
 	unsigned long ts = jiffies;
+	ktime_t stall_start;
+	bool stalled;
 
 	if (mic_hw_family(chan->dma_ctx->device_num) == FAMILY_KNC) {
 		if (mic_hw_stepping(chan->dma_ctx->device_num) == KNC_A_STEP)
@@ -688,13 +837,21 @@ program_memcpy_descriptors(struct dma_channel *chan, uint64_t src, uint64_t dst,
 					MAX_DMA_XFER_SIZE : len;
 
 		ts = jiffies;
+		stalled = false;
 		while (!md_avail_desc_ring_space(&chan->dma_ctx->dma_dev, is_astep, chan->chan,
 						  (uint32_t)chan->next_write_index, 1)) {
+				if (!stalled) {
+					stalled = true;
+					stall_start = ktime_get();
+				}
 				if (time_after(jiffies,ts + DMA_TO)) {
 					printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+					mic_dma_timeout(chan, __func__);
 					return -ENOMEM;
 				}
 		}
+		if (stalled)
+			mic_dma_ring_stall(chan, stall_start, 1);
 
 		//pr_debug("src_phys=0x%llx, dst_phys=0x%llx, size=0x%zx\n", src_phys_addr, dst_phys_addr, current_transfer_len);
 		md_mic_dma_memcpy_desc(&chan->desc_ring[chan->next_write_index],
@@ -747,6 +904,9 @@ do_dma(struct dma_channel *chan, int flags, uint64_t src,
 	uint32_t num_status_desc = 0;
 	bool is_astep = false;
 	unsigned long ts = jiffies;
+	uint64_t start_index;
+	ktime_t stall_start;
+	bool stalled = false;
 
 	might_sleep();
 	if (flags & DO_DMA_INTR && !comp_cb)
@@ -763,6 +923,7 @@ do_dma(struct dma_channel *chan, int flags, uint64_t src,
 		DMA_TO);
 		if (!err) {
 			printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+			mic_dma_timeout(chan, __func__);
 			err = -ENOMEM;
 		}
 		if (err > 0)
@@ -786,6 +947,7 @@ do_dma(struct dma_channel *chan, int flags, uint64_t src,
 		num_status_desc++;
 		//pr_debug(PR_PREFIX "polling poll_ring_index=%d\n", poll_ring_index);
 	}
+	start_index = chan->next_write_index;
 	if (len && -ENOMEM == program_memcpy_descriptors(chan, src, dst, len)) {
 		//pr_debug(PR_PREFIX "ERROR: do_dma: No available space from program_memcpy_descriptors\n");
 		return -ENOMEM;
@@ -802,12 +964,19 @@ do_dma(struct dma_channel *chan, int flags, uint64_t src,
 
 	while (num_status_desc && num_status_desc > md_avail_desc_ring_space(&chan->dma_ctx->dma_dev,
 						is_astep, chan->chan, (uint32_t)chan->next_write_index, num_status_desc)) {
+		if (!stalled) {
+			stalled = true;
+			stall_start = ktime_get();
+		}
 		if (time_after(jiffies,ts + DMA_TO)) {
 			printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+			mic_dma_timeout(chan, __func__);
 			return -ENOMEM;
 		}
 		//pr_debug(PR_PREFIX "ERROR: do_dma: No available space from md_avail_desc_ring_space\n");
 	}
+	if (stalled)
+		mic_dma_ring_stall(chan, stall_start, num_status_desc);
 
 	if (flags & DO_DMA_POLLING) {
 		incr_head(&chan->poll_ring);
@@ -841,8 +1010,12 @@ do_dma(struct dma_channel *chan, int flags, uint64_t src,
 	 * TODO:
 	 * Maybe it is better if we update the head pointer for every descriptor??
 	 */
-	md_mic_dma_chan_write_head(&chan->dma_ctx->dma_dev, chan->chan, (uint32_t)chan->next_write_index);
+	mic_dma_write_head(chan, start_index, !!(flags & DO_DMA_INTR));
 	//pr_debug(PR_PREFIX "in HW chan->next_write_index=%lld\n", chan->next_write_index);
+	chan->stats.submissions++;
+	chan->stats.bytes += len;
+	trace_mic_dma_submit(chan->dma_ctx->device_num, chan->ch_num, src, dst, len,
+			     flags, (flags & DO_DMA_POLLING) ? poll_ring_index : intr_ring_index);
 
 	if (DO_DMA_POLLING & flags)
 		return poll_ring_index;
@@ -893,6 +1066,9 @@ int do_status_update(struct dma_channel *chan, uint64_t phys, uint64_t value)
 {
 	unsigned long ts = jiffies;
 	bool is_astep = false;
+	uint64_t start_index;
+	ktime_t stall_start;
+	bool stalled = false;
 
 	if (!verify_next_write_index(chan))
 		return -ENODEV;
@@ -911,12 +1087,20 @@ int do_status_update(struct dma_channel *chan, uint64_t phys, uint64_t value)
 	while (!md_avail_desc_ring_space(&chan->dma_ctx->dma_dev,
 		is_astep, chan->chan, (uint32_t) chan->next_write_index, 1)) {
 		cpu_relax();
+		if (!stalled) {
+			stalled = true;
+			stall_start = ktime_get();
+		}
 		if (time_after(jiffies,ts + DMA_TO)) {
 			printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+			mic_dma_timeout(chan, __func__);
 			return -EBUSY;
 		}
 	}
+	if (stalled)
+		mic_dma_ring_stall(chan, stall_start, 1);
 
+	start_index = chan->next_write_index;
 	md_mic_dma_prep_status_desc(&chan->desc_ring[chan->next_write_index],
 			value,
 			phys,
@@ -925,8 +1109,7 @@ int do_status_update(struct dma_channel *chan, uint64_t phys, uint64_t value)
 	chan->next_write_index = incr_rb_index((int)chan->next_write_index,
 			chan->chan->num_desc_in_ring);
 
-	md_mic_dma_chan_write_head(&chan->dma_ctx->dma_dev,
-			chan->chan, (uint32_t)chan->next_write_index);
+	mic_dma_write_head(chan, start_index, false);
 	return 0;
 }
 EXPORT_SYMBOL(do_status_update);
@@ -967,6 +1150,9 @@ int program_dma_mark(struct dma_channel *chan)
 	unsigned long ts = jiffies;
 	uint32_t num_status_desc = 1;
 	bool is_astep = false;
+	uint64_t start_index;
+	ktime_t stall_start;
+	bool stalled = false;
 
 	if (!verify_next_write_index(chan))
 		return -ENODEV;
@@ -981,8 +1167,10 @@ int program_dma_mark(struct dma_channel *chan)
 	err = wait_event_interruptible_timeout(chan->intr_wq, 
 	(-1 != (intr_ring_index = allocate_buffer(&chan->intr_ring.ring))), 
 	DMA_TO);
-	if (!err)
+	if (!err) {
+		mic_dma_timeout(chan, __func__);
 		err = -EBUSY;
+	}
 	if (err > 0)
 		err = 0;
 	if (err)
@@ -995,12 +1183,20 @@ int program_dma_mark(struct dma_channel *chan)
 	while (num_status_desc > md_avail_desc_ring_space(&chan->dma_ctx->dma_dev,
 			is_astep, chan->chan, (uint32_t)chan->next_write_index, num_status_desc)) {
 		cpu_relax();
+		if (!stalled) {
+			stalled = true;
+			stall_start = ktime_get();
+		}
 		if (time_after(jiffies,ts + DMA_TO)) {
 			printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+			mic_dma_timeout(chan, __func__);
 			return -EBUSY;
 		}
 	}
+	if (stalled)
+		mic_dma_ring_stall(chan, stall_start, num_status_desc);
 
+	start_index = chan->next_write_index;
 	chan->intr_ring.comp_cb_array[intr_ring_index] = NULL;
 
 	incr_head(&chan->intr_ring.ring);
@@ -1019,7 +1215,7 @@ int program_dma_mark(struct dma_channel *chan)
 	chan->next_write_index = incr_rb_index((int)chan->next_write_index,
 			chan->chan->num_desc_in_ring);
 
-	md_mic_dma_chan_write_head(&chan->dma_ctx->dma_dev, chan->chan, (uint32_t)chan->next_write_index);
+	mic_dma_write_head(chan, start_index, true);
 	return intr_ring_index;
 }
 EXPORT_SYMBOL(program_dma_mark);
@@ -1075,6 +1271,7 @@ int dma_mark_wait(struct dma_channel *chan, int mark, bool is_interruptible)
 				is_dma_mark_processed(chan, mark), DMA_TO);
 		if (!err) {
 			printk(KERN_ERR "%s %d TO chan 0x%x\n", __func__, __LINE__, chan->ch_num);
+			mic_dma_timeout(chan, __func__);
 			err = -EBUSY;
 		}
 		if (err > 0)
@@ -1468,6 +1665,45 @@ mic_dma_proc_read_registers_fn(char *buf, char **start, off_t offset, int count,
 	return len;
 }
 
+static int mic_dma_stats_seq_show(struct seq_file *s, void *pos)
+{
+	struct mic_dma_ctx_t *dma_ctx = s->private;
+	struct dma_chan_stats *stats;
+	int i;
+
+	seq_printf(s, "%-5s %-12s %-14s %-16s %-12s %-10s %-14s %-14s %-8s\n",
+		   "chan", "submissions", "descriptors", "bytes", "completions",
+		   "stalls", "stall_ns", "busy_ns", "timeouts");
+	for (i = first_dma_chan(); i <= last_dma_chan(); i++) {
+		if (!dma_ctx->dma_channels[i].desc_ring)
+			continue;
+		stats = &dma_ctx->dma_channels[i].stats;
+		seq_printf(s, "%-5d %-12llu %-14llu %-16llu %-12llu %-10llu %-14llu %-14llu %-8llu\n",
+			   i, stats->submissions, stats->descriptors, stats->bytes,
+			   stats->completions, stats->stalls, stats->stall_ns,
+			   stats->busy_ns, stats->timeouts);
+	}
+	return 0;
+}
+
+static int mic_dma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mic_dma_stats_seq_show, inode->i_private);
+}
+
+static int mic_dma_stats_release(struct inode *inode, struct file *file)
+{
+	return single_release(inode, file);
+}
+
+static struct file_operations mic_dma_stats_ops = {
+	.owner   = THIS_MODULE,
+	.open    = mic_dma_stats_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = mic_dma_stats_release
+};
+
 static void
 mic_dma_proc_init(struct mic_dma_ctx_t *dma_ctx)
 {
@@ -1485,6 +1721,10 @@ mic_dma_proc_init(struct mic_dma_ctx_t *dma_ctx)
 		dma_proc->data      = dma_ctx;
 	}
 
+	snprintf(name, 63, "mic_dma%d", dma_ctx->device_num);
+	if ((dma_ctx->dbg_dir = debugfs_create_dir(name, NULL)))
+		debugfs_create_file("stats", 0444, dma_ctx->dbg_dir,
+				    dma_ctx, &mic_dma_stats_ops);
 }
 
 static void
@@ -1492,6 +1732,8 @@ mic_dma_proc_uninit(struct mic_dma_ctx_t *dma_ctx)
 {
 	char name[64];
 
+	debugfs_remove_recursive(dma_ctx->dbg_dir);
+	dma_ctx->dbg_dir = NULL;
 	snprintf(name, 63, "%s%d", proc_dma_reg, dma_ctx->device_num);
 	remove_proc_entry(name, NULL);
 	snprintf(name, 63, "%s%d", proc_dma_ring, dma_ctx->device_num);
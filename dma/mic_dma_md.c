@@ -228,6 +228,9 @@ void md_mic_dma_enable_chan(struct mic_dma_device *dma_dev,
 		dcr &= ~(2 << (chan_num << 1));
 	}
 	mic_sbox_write_mmio(dma_dev->mm_sbox, SBOX_DCR, dcr);
+#ifdef MIC_DMA_EMULATION
+	md_mic_dma_emul_kick(dma_dev);
+#endif
 }
 
 #if 0
@@ -0,0 +1,399 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Software DMA engine model. See include/mic/mic_dma_emul.h.
+ *
+ * The emulator keeps the SBOX DMA register layout so that mic_dma_md.c and
+ * mic_dma_lib.c run unmodified on top of it. Descriptor addresses are
+ * translated the same way the SBOX would: MIC system addresses go through
+ * the host SMPT shadow table and everything else is treated as card memory,
+ * which on the host is reached through the aperture mapping of the card.
+ * The emulator assumes DMA addresses equal physical addresses, i.e. no
+ * IOMMU remapping is in place.
+ */
+
+#include<linux/module.h>
+#include<linux/slab.h>
+#include<linux/kthread.h>
+#include<linux/delay.h>
+#include<asm/io.h>
+#include<linux/kernel.h>
+
+#ifndef _MIC_SCIF_
+#include <mic/micscif.h>
+#include "mic_common.h"
+#endif
+
+#include <mic/micscif_smpt.h>
+#include <mic/micbaseaddressdefine.h>
+#include <mic/mic_dma_md.h>
+#include <mic/mic_dma_emul.h>
+
+#define PR_PREFIX "DMA_EMUL:"
+
+/* Size of the emulated SBOX register file, large enough for SBOX_DCR */
+#define DMA_EMUL_REG_SPACE	PAGE_ALIGN(SBOX_DCR + sizeof(uint32_t))
+
+#define SBOX_DCAR_IM0		(0x1 << 24)	// APIC Interrupt mask bit
+#define SBOX_DCAR_IM1		(0x1 << 25)	// MSI-X Interrupt mask bit
+#define SBOX_DCAR_IS0		(0x1 << 26)	// Interrupt status
+
+#define SBOX_DRARHI_SYS_MASK	(0x1 << 26)
+#define DSTAT_WB_ERROR		(0x1 << 31)
+
+enum mic_dma_emul_desc_type {
+	EMUL_DESC_NOP = 0,
+	EMUL_DESC_MEMCOPY,
+	EMUL_DESC_STATUS,
+	EMUL_DESC_GENERAL
+};
+
+static unsigned int dma_emul_bw_mbps;
+module_param(dma_emul_bw_mbps, uint, 0600);
+MODULE_PARM_DESC(dma_emul_bw_mbps,
+	"Emulated DMA bandwidth per channel in MB/s, 0 for unthrottled");
+
+static unsigned int dma_emul_latency_us;
+module_param(dma_emul_latency_us, uint, 0600);
+MODULE_PARM_DESC(dma_emul_latency_us,
+	"Emulated DMA latency in usecs between a head pointer update and "
+	"the start of descriptor processing");
+
+/*
+ * struct mic_dma_emul - Emulator state, one per DMA device
+ * @dma_dev - DMA device whose register file is being emulated
+ * @device_num - DMA library device number, 0 on the card, bid + 1 on the host
+ * @regs - Emulated SBOX register file
+ * @thread - Thread executing descriptors
+ * @wq - Wait queue the thread sleeps on until a head pointer is written
+ * @kick - Set when new work may have been posted
+ * @intr_handler - Completion interrupt callback into the DMA library
+ */
+struct mic_dma_emul {
+	struct mic_dma_device	*dma_dev;
+	int			device_num;
+	void			*regs;
+	struct task_struct	*thread;
+	wait_queue_head_t	wq;
+	atomic_t		kick;
+	mic_dma_emul_intr_t	intr_handler;
+};
+
+static void mic_dma_emul_delay(uint64_t ns)
+{
+	if (!ns)
+		return;
+	if (ns >= 2 * NSEC_PER_MSEC)
+		msleep(ns / NSEC_PER_MSEC);
+	else if (ns >= NSEC_PER_USEC)
+		udelay(ns / NSEC_PER_USEC);
+	else
+		ndelay(ns);
+}
+
+/*
+ * Translate an address as seen by the DMA engine into a kernel
+ * virtual address. Returns NULL if the address cannot be reached.
+ */
+static void *
+mic_dma_emul_addr_to_virt(struct mic_dma_emul *emul, uint64_t addr)
+{
+#ifndef _MIC_SCIF_
+	mic_ctx_t *mic_ctx = get_per_dev_ctx(emul->device_num - 1);
+
+	if (is_syspa(addr))
+		return phys_to_virt(mic_to_dma_addr(emul->device_num - 1, addr));
+	if (!mic_ctx->aper.va || addr >= mic_ctx->aper.len)
+		return NULL;
+	return (uint8_t *)mic_ctx->aper.va + addr;
+#else
+	/* System memory is only reachable through a real PCIe link */
+	if (addr >= MIC_SYSTEM_BASE)
+		return NULL;
+	return phys_to_virt(addr);
+#endif
+}
+
+static uint64_t
+mic_dma_emul_ring_addr(struct mic_dma_device *dma_dev, int ch)
+{
+	uint32_t drar_hi = md_mic_dma_read_mmio(dma_dev, ch, REG_DRAR_HI);
+	uint64_t addr = md_mic_dma_read_mmio(dma_dev, ch, REG_DRAR_LO);
+
+	if (drar_hi & SBOX_DRARHI_SYS_MASK) {
+		addr |= (uint64_t)(drar_hi & 0x3) << 32;
+		addr += MIC_SYSTEM_BASE +
+			((uint64_t)((drar_hi >> 21) & 0x1f) << MIC_SYSTEM_PAGE_SHIFT);
+	} else {
+		addr |= (uint64_t)(drar_hi & 0xf) << 32;
+	}
+	return addr;
+}
+
+static void
+mic_dma_emul_error(struct mic_dma_emul *emul, int ch, uint64_t addr)
+{
+	struct md_mic_dma_chan *chan = &emul->dma_dev->chan_info[ch];
+
+	printk(KERN_ERR PR_PREFIX "chan %d unreachable address 0x%llx\n",
+		ch, (unsigned long long)addr);
+	if (chan->dstat_wb_loc)
+		*(volatile uint32_t *)chan->dstat_wb_loc |= DSTAT_WB_ERROR;
+}
+
+static void
+mic_dma_emul_raise_intr(struct mic_dma_emul *emul, int ch)
+{
+	struct mic_dma_device *dma_dev = emul->dma_dev;
+	uint32_t dcar = md_mic_dma_read_mmio(dma_dev, ch, REG_DCAR);
+	uint32_t mask = (MIC_DMA_CHAN_MIC_OWNED == dma_dev->chan_info[ch].owner) ?
+				SBOX_DCAR_IM0 : SBOX_DCAR_IM1;
+	unsigned long flags;
+
+	md_mic_dma_write_mmio(dma_dev, ch, REG_DCAR, dcar | SBOX_DCAR_IS0);
+	if ((dcar & mask) || !emul->intr_handler)
+		return;
+	/* Completion callbacks expect to run in interrupt context */
+	local_irq_save(flags);
+	emul->intr_handler(dma_dev, ch);
+	local_irq_restore(flags);
+}
+
+/*
+ * Execute all descriptors between the tail and the head of a channel.
+ * Returns true if any descriptor was processed.
+ */
+static bool
+mic_dma_emul_run_chan(struct mic_dma_emul *emul, int ch)
+{
+	struct mic_dma_device *dma_dev = emul->dma_dev;
+	struct md_mic_dma_chan *chan = &dma_dev->chan_info[ch];
+	union md_mic_dma_desc *ring, *desc;
+	uint32_t dcr, head, tail, num_desc;
+	uint64_t ring_addr;
+	size_t len;
+	void *src, *dst;
+	bool intr;
+
+	dcr = mic_sbox_read_mmio(dma_dev->mm_sbox, SBOX_DCR);
+	if (!(dcr & (2 << (ch << 1))))
+		return false;
+
+	head = md_mic_dma_read_mmio(dma_dev, ch, REG_DHPR);
+	tail = md_mic_dma_read_mmio(dma_dev, ch, REG_DTPR);
+	num_desc = (md_mic_dma_read_mmio(dma_dev, ch, REG_DRAR_HI) >> 4) & 0x1ffff;
+	if (head == tail || !num_desc)
+		return false;
+
+	ring_addr = mic_dma_emul_ring_addr(dma_dev, ch);
+	if (!(ring = mic_dma_emul_addr_to_virt(emul, ring_addr))) {
+		mic_dma_emul_error(emul, ch, ring_addr);
+		return false;
+	}
+
+	mic_dma_emul_delay((uint64_t)dma_emul_latency_us * NSEC_PER_USEC);
+
+	while (tail != head) {
+		desc = &ring[tail];
+		intr = false;
+		rmb();
+
+		switch (desc->desc.nop.type) {
+		case EMUL_DESC_MEMCOPY:
+			len = (size_t)desc->desc.memcopy.length << L1_CACHE_SHIFT;
+			src = mic_dma_emul_addr_to_virt(emul, desc->desc.memcopy.sap);
+			dst = mic_dma_emul_addr_to_virt(emul, desc->desc.memcopy.dap);
+			if (!src || !dst) {
+				mic_dma_emul_error(emul, ch, !src ?
+					desc->desc.memcopy.sap : desc->desc.memcopy.dap);
+				break;
+			}
+			memcpy(dst, src, len);
+			if (dma_emul_bw_mbps)
+				mic_dma_emul_delay((uint64_t)len * NSEC_PER_USEC /
+							dma_emul_bw_mbps);
+			break;
+		case EMUL_DESC_STATUS:
+			if (!(dst = mic_dma_emul_addr_to_virt(emul, desc->desc.status.dap))) {
+				mic_dma_emul_error(emul, ch, desc->desc.status.dap);
+				break;
+			}
+			*(volatile uint64_t *)dst = desc->desc.status.data;
+			intr = desc->desc.status.intr;
+			break;
+		case EMUL_DESC_GENERAL:
+			if (!(dst = mic_dma_emul_addr_to_virt(emul, desc->desc.general.dap))) {
+				mic_dma_emul_error(emul, ch, desc->desc.general.dap);
+				break;
+			}
+			*(volatile uint32_t *)dst = desc->desc.general.data;
+			break;
+		case EMUL_DESC_NOP:
+		default:
+			break;
+		}
+
+		tail = (tail + 1) % num_desc;
+		/* Make the descriptor side effects visible before the tail moves */
+		wmb();
+		md_mic_dma_write_mmio(dma_dev, ch, REG_DTPR, tail);
+		md_mic_dma_write_mmio(dma_dev, ch, REG_DSTAT, tail & HW_CMP_CNT_MASK);
+		if (chan->dstat_wb_loc)
+			*(volatile uint32_t *)chan->dstat_wb_loc =
+				(*(volatile uint32_t *)chan->dstat_wb_loc & DSTAT_WB_ERROR) |
+				(tail & HW_CMP_CNT_MASK);
+		if (intr)
+			mic_dma_emul_raise_intr(emul, ch);
+		/* Pick up descriptors posted while this batch was running */
+		if (tail == head)
+			head = md_mic_dma_read_mmio(dma_dev, ch, REG_DHPR);
+	}
+	return true;
+}
+
+static int
+mic_dma_emul_thread(void *data)
+{
+	struct mic_dma_emul *emul = data;
+	bool progress;
+	int i;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(emul->wq,
+			atomic_xchg(&emul->kick, 0) || kthread_should_stop());
+		do {
+			progress = false;
+			for (i = 0; i < MAX_NUM_DMA_CHAN; i++)
+				progress |= mic_dma_emul_run_chan(emul, i);
+			cond_resched();
+		} while (progress && !kthread_should_stop());
+	}
+	return 0;
+}
+
+/**
+ * md_mic_dma_emul_init - Switch a DMA device over to the emulated engine
+ * @dma_dev: DMA device already initialized by md_mic_dma_init()
+ * @device_num: DMA library device number
+ * @intr_handler: Called for every completion interrupt
+ *
+ * Must be called before any channel is programmed.
+ */
+int md_mic_dma_emul_init(struct mic_dma_device *dma_dev, int device_num,
+			 mic_dma_emul_intr_t intr_handler)
+{
+	struct mic_dma_emul *emul;
+	int err;
+
+	if (!(emul = kzalloc(sizeof(*emul), GFP_KERNEL)))
+		return -ENOMEM;
+	if (!(emul->regs = kzalloc(DMA_EMUL_REG_SPACE, GFP_KERNEL))) {
+		err = -ENOMEM;
+		goto free_emul;
+	}
+	emul->dma_dev = dma_dev;
+	emul->device_num = device_num;
+	emul->intr_handler = intr_handler;
+	init_waitqueue_head(&emul->wq);
+	atomic_set(&emul->kick, 0);
+
+	dma_dev->mm_sbox = emul->regs;
+	dma_dev->emul = emul;
+
+	emul->thread = kthread_run(mic_dma_emul_thread, emul,
+				   "mic_dma_emul%d", device_num);
+	if (IS_ERR(emul->thread)) {
+		err = PTR_ERR(emul->thread);
+		goto free_regs;
+	}
+	printk(KERN_INFO PR_PREFIX "device %d using emulated DMA engine "
+		"bw %u MB/s latency %u us\n", device_num,
+		dma_emul_bw_mbps, dma_emul_latency_us);
+	return 0;
+free_regs:
+	dma_dev->emul = NULL;
+	dma_dev->mm_sbox = NULL;
+	kfree(emul->regs);
+free_emul:
+	kfree(emul);
+	return err;
+}
+
+/*
+ * md_mic_dma_emul_stop - Stop executing descriptors. The register file
+ * stays valid until md_mic_dma_emul_uninit() so that the channels can
+ * still be torn down through it.
+ */
+void md_mic_dma_emul_stop(struct mic_dma_device *dma_dev)
+{
+	struct mic_dma_emul *emul = dma_dev->emul;
+
+	if (!emul || !emul->thread)
+		return;
+	kthread_stop(emul->thread);
+	emul->thread = NULL;
+}
+
+void md_mic_dma_emul_uninit(struct mic_dma_device *dma_dev)
+{
+	struct mic_dma_emul *emul = dma_dev->emul;
+
+	if (!emul)
+		return;
+	md_mic_dma_emul_stop(dma_dev);
+	dma_dev->emul = NULL;
+	dma_dev->mm_sbox = NULL;
+	kfree(emul->regs);
+	kfree(emul);
+}
+
+/*
+ * md_mic_dma_emul_kick - Notify the emulator that a head pointer or
+ * channel enable bit may have changed.
+ */
+void md_mic_dma_emul_kick(struct mic_dma_device *dma_dev)
+{
+	struct mic_dma_emul *emul = dma_dev->emul;
+
+	if (!emul)
+		return;
+	atomic_set(&emul->kick, 1);
+	wake_up(&emul->wq);
+}
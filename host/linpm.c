@@ -195,6 +195,8 @@ int micpm_suspend_noirq(struct device *pdev) {
 		 * for a discussion on this issue.
 		 */
 		if (mic_ctx->msie) {
+			mic_irq_affinity_hint(mic_ctx,
+				bd_info->bi_msix_entries[0].vector, false);
 			free_irq(bd_info->bi_msix_entries[0].vector, &bd_info->bi_ctx);
 		}
 	}
@@ -228,6 +230,8 @@ int micpm_resume_noirq(struct device *pdev) {
 						__func__, __LINE__);
 				return 0;
 			}
+			mic_irq_affinity_hint(mic_ctx,
+				bd_info->bi_msix_entries[0].vector, true);
 		}
 
 	}
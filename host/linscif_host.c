@@ -65,8 +65,10 @@ micscif_init(void)
 	spin_lock_init(&ms_info.mi_rmalock);
 	mutex_init (&ms_info.mi_fencelock);
 	mutex_init (&ms_info.mi_event_cblock);
+	mutex_init (&ms_info.mi_epoll_lock);
 	INIT_LIST_HEAD(&ms_info.mi_uaccept);
 	INIT_LIST_HEAD(&ms_info.mi_listen);
+	INIT_LIST_HEAD(&ms_info.mi_dgram);
 	INIT_LIST_HEAD(&ms_info.mi_zombie);
 	INIT_LIST_HEAD(&ms_info.mi_connected);
 	INIT_LIST_HEAD(&ms_info.mi_disconnected);
@@ -95,6 +97,8 @@ micscif_init(void)
 #endif
 	ms_info.mi_misc_wq = create_singlethread_workqueue("SCIF_MISC");
 	INIT_WORK(&ms_info.mi_misc_work, micscif_misc_handler);
+	ms_info.mi_lane_wq = create_workqueue("SCIF_LANES");
+	ms_info.mi_rma_async_wq = create_workqueue("SCIF_RMA_ASYNC");
 #ifdef CONFIG_MMU_NOTIFIER
 	ms_info.mi_mmu_notif_wq = create_singlethread_workqueue("SCIF_MMU");
 	INIT_WORK(&ms_info.mi_mmu_notif_work, micscif_mmu_notif_handler);
@@ -113,7 +117,19 @@ micscif_init(void)
 	mutex_init (&scif_dev[SCIF_HOST_NODE].sd_lock);
 	ms_info.mi_rma_tc_limit = SCIF_RMA_TEMP_CACHE_LIMIT;
 	ms_info.mi_proxy_dma_threshold = SCIF_PROXY_DMA_THRESHOLD;
+	ms_info.mi_endpt_qp_size = ENDPT_QP_DEFAULT_SIZE;
+	ms_info.mi_qp_notify_pct = SCIF_QP_NOTIFY_PCT;
+	ms_info.mi_rndv_threshold = SCIF_RNDV_THRESHOLD;
+	ms_info.mi_busy_poll_us = 0;
+	ms_info.mi_nodeqp_lanes = SCIF_NODEQP_LANES;
+	ms_info.mi_qp_pool_size = SCIF_QP_POOL_DEFAULT;
+	ms_info.mi_rma_dma_chans = SCIF_RMA_DMA_CHANS;
+	ms_info.mi_rma_stripe_threshold = SCIF_RMA_STRIPE_THRESHOLD;
 	ms_info.en_msg_log = 0;
+	ms_info.en_rtt_stats = 0;
+	ms_info.en_nodeqp_stats = 0;
+	ms_info.en_loopb_direct = 1;
+	ms_info.en_rb_nt_copy = 1;
 	scif_proc_init();
 	return 0;
 }
@@ -126,6 +142,8 @@ micscif_destroy(void)
 #ifdef CONFIG_MMU_NOTIFIER
 	destroy_workqueue(ms_info.mi_mmu_notif_wq);
 #endif
+	destroy_workqueue(ms_info.mi_rma_async_wq);
+	destroy_workqueue(ms_info.mi_lane_wq);
 	destroy_workqueue(ms_info.mi_misc_wq);
 	micscif_destroy_loopback_qp(&scif_dev[SCIF_HOST_NODE]);
 	scif_proc_cleanup();
@@ -136,6 +154,7 @@ micscif_destroy(void)
 		kfree(temp);
 	}
 	mutex_destroy(&ms_info.mi_event_cblock);
+	mutex_destroy(&ms_info.mi_epoll_lock);
 }
 
 int
@@ -170,6 +189,8 @@ micscif_probe(mic_ctx_t *mic_ctx)
 	init_waitqueue_head(&scifdev->sd_wq);
 	mutex_init (&scifdev->sd_lock);
 	INIT_LIST_HEAD(&scifdev->sd_p2p);
+	micscif_qp_pool_init(scifdev);
+	micscif_dgram_init(scifdev);
 
 	init_waitqueue_head(&scifdev->sd_watchdog_wq);
 	snprintf(scifdev->sd_ln_wqname, sizeof(scifdev->sd_intr_wqname),
@@ -221,6 +242,9 @@ micscif_remove(mic_ctx_t *mic_ctx)
 	struct micscif_dev *scifdev = &scif_dev[mic_ctx->bi_id + 1];
 	struct micscif_qp *qp = &scifdev->qpairs[0];
 
+	micscif_nodeqp_lanes_uninit(scifdev);
+	micscif_dgram_stop(scifdev);
+	micscif_qp_pool_drain(scifdev);
 	destroy_workqueue(scifdev->sd_intr_wq);
 	scifdev->sd_intr_wq = 0;
 	cancel_delayed_work_sync(&scifdev->sd_watchdog_work);
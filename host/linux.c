@@ -38,6 +38,7 @@
  */
 
 #include <linux/string.h>
+#include <linux/vmalloc.h>
 
 #include "mic/micscif_kmem_cache.h"
 #include "micint.h"
@@ -86,6 +87,10 @@ bool mic_msi_enable = 1;
 module_param_named(msi, mic_msi_enable, bool, 0600);
 MODULE_PARM_DESC(mic_msi_enable, "To enable MSIx in the driver.");
 
+bool mic_numa_affinity = 1;
+module_param_named(numa_affinity, mic_numa_affinity, bool, 0600);
+MODULE_PARM_DESC(mic_numa_affinity, "Place per card memory and interrupts on the card's NUMA node.");
+
 int mic_pm_qos_cpu_dma_lat = -1;
 module_param_named(pm_qos_cpu_dma_lat, mic_pm_qos_cpu_dma_lat, int, 0600);
 MODULE_PARM_DESC(mic_pm_qos_cpu_dma_lat, "PM QoS CPU DMA latency in usecs.");
@@ -98,6 +103,23 @@ extern bool mic_crash_dump_enabled;
 module_param_named(crash_dump, mic_crash_dump_enabled, bool, 0600);
 MODULE_PARM_DESC(mic_crash_dump_enabled, "MIC Crash Dump enabled.");
 
+#ifdef MIC_DMA_EMULATION
+static unsigned int dma_emul_cards;
+module_param(dma_emul_cards, uint, 0400);
+MODULE_PARM_DESC(dma_emul_cards,
+	"Number of host memory backed boards to probe when no MIC board is present");
+
+static unsigned int dma_emul_card_mem_mb = 64;
+module_param(dma_emul_card_mem_mb, uint, 0400);
+MODULE_PARM_DESC(dma_emul_card_mem_mb,
+	"Size in MB of the card memory of each emulated board");
+
+/* Size of the KNC MMIO BAR, covers the DBOX and SBOX register ranges */
+#define MIC_EMUL_MMIO_LEN	(HOST_SBOX_BASE_ADDRESS + 0x10000)
+/* Post code a card reports once its bootstrap is waiting for an image */
+#define MIC_EMUL_POSTCODE	('F' | ('F' << 8))
+#endif
+
 #define GET_FILE_SIZE_FROM_INODE(fp) i_size_read((fp)->f_path.dentry->d_inode)
 
 int usagemode_param = 0;
@@ -227,6 +249,20 @@ mic_flush(struct file *f, fl_owner_t id)
 	return -EINVAL;
 }
 
+/*
+ * Hint that the interrupt of the board should be serviced by CPUs of the
+ * NUMA node the board is attached to. Must be cleared before free_irq().
+ */
+void
+mic_irq_affinity_hint(mic_ctx_t *mic_ctx, unsigned int irq, bool set)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,35)) || defined(RHEL_RELEASE_CODE)
+	if (mic_ctx->numa_node == -1)
+		return;
+	irq_set_affinity_hint(irq, set ? cpumask_of_node(mic_ctx->numa_node) : NULL);
+#endif
+}
+
 irqreturn_t
 mic_irq_isr(int irq, void *data)
 {
@@ -255,7 +291,8 @@ mic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 #ifdef CONFIG_PCI_MSI
 	int i=0;
 #endif
-	if ((bd_info = (bd_info_t *)kzalloc(sizeof(bd_info_t), GFP_KERNEL)) == NULL) {
+	if ((bd_info = (bd_info_t *)kzalloc_node(sizeof(bd_info_t), GFP_KERNEL,
+			mic_numa_affinity ? dev_to_node(&pdev->dev) : -1)) == NULL) {
 		printk("MIC: probe failed allocating memory for bd_info\n");
 		return -ENOSPC;
 	}
@@ -265,6 +302,7 @@ mic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 	mic_ctx->bi_id = brdnum;
 	mic_ctx->bi_pdev = pdev;
 	mic_ctx->msie = 0;
+	mic_ctx->numa_node = mic_numa_affinity ? dev_to_node(&pdev->dev) : -1;
 	mic_data.dd_bi[brdnum] = bd_info;
 
 	if ((err = pci_enable_device(pdev))) {
@@ -321,6 +359,8 @@ mic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 				printk("MIC: Error in request_irq %d\n", err);
 				goto probe_relaper;
 			}
+			mic_irq_affinity_hint(mic_ctx,
+				bd_info->bi_msix_entries[0].vector, true);
 			mic_ctx->msie = 1;
 		}
 	}
@@ -352,7 +392,8 @@ mic_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 				       IRQF_SHARED, "mic", mic_ctx)) != 0) {
 			printk("MIC: Error in request_irq %d\n", err);
 			goto probe_unmapaper;
-		}
+		} else
+			mic_irq_affinity_hint(mic_ctx, mic_ctx->bi_pdev->irq, true);
 
 	adapter_probe(&bd_info->bi_ctx);
 
@@ -389,6 +430,129 @@ probe_freebd:
 	return err;
 }
 
+#ifdef MIC_DMA_EMULATION
+/*
+ * Boards probed by mic_emul_probe() have no PCI function behind them. The
+ * pci_dev only exists so that the DMA mapping API and the code looking at
+ * the device ID have something to work with.
+ */
+struct mic_emul_pdev {
+	struct pci_dev	pdev;
+	struct pci_bus	bus;
+};
+
+static void
+mic_emul_pdev_release(struct device *dev)
+{
+	kfree(container_of(to_pci_dev(dev), struct mic_emul_pdev, pdev));
+}
+
+static void
+mic_emul_free(bd_info_t *bd_info)
+{
+	mic_ctx_t *mic_ctx = &bd_info->bi_ctx;
+
+	vfree(mic_ctx->aper.va);
+	vfree(mic_ctx->mmio.va);
+	put_device(&mic_ctx->bi_pdev->dev);
+	kfree(bd_info);
+}
+
+/*
+ * mic_emul_probe - Probe a board backed by host memory
+ *
+ * The MMIO BAR is a zeroed buffer which the emulated DMA engine and the
+ * rest of the driver use as the card's register file, and the aperture is
+ * a buffer of dma_emul_card_mem_mb MB standing in for GDDR. The registers
+ * read during reset are preset so that the board comes up in the ready
+ * state. There is no uOS and no interrupt line, so the board never boots,
+ * but SCIF and vnet probe it and micmem can drive its DMA channels.
+ */
+static int
+mic_emul_probe(void)
+{
+	int brdnum = mic_data.dd_numdevs;
+	struct mic_emul_pdev *emul;
+	struct pci_dev *pdev;
+	bd_info_t *bd_info;
+	mic_ctx_t *mic_ctx;
+	int err = -ENOMEM;
+
+	if (!(emul = kzalloc(sizeof(*emul), GFP_KERNEL)))
+		return -ENOMEM;
+	pdev = &emul->pdev;
+	pdev->bus = &emul->bus;
+	pdev->bus->number = 0xff;
+	pdev->vendor = PCI_VENDOR_ID_INTEL;
+	pdev->device = PCI_DEVICE_KNC_2250;
+	pdev->dma_mask = DMA_BIT_MASK(64);
+	device_initialize(&pdev->dev);
+	pdev->dev.release = mic_emul_pdev_release;
+	pdev->dev.dma_mask = &pdev->dma_mask;
+	pdev->dev.coherent_dma_mask = DMA_BIT_MASK(64);
+	dev_set_name(&pdev->dev, "mic_emul%d", brdnum);
+
+	if (!(bd_info = kzalloc(sizeof(bd_info_t), GFP_KERNEL)))
+		goto emul_putdev;
+
+	mic_ctx = &bd_info->bi_ctx;
+	mic_ctx->bd_info = bd_info;
+	mic_ctx->bi_id = brdnum;
+	mic_ctx->bi_pdev = pdev;
+	mic_ctx->bi_emul = true;
+	mic_ctx->numa_node = -1;
+	mic_data.dd_bi[brdnum] = bd_info;
+
+	mic_ctx->mmio.len = MIC_EMUL_MMIO_LEN;
+	mic_ctx->aper.len = (uint64_t)dma_emul_card_mem_mb << 20;
+	if (!(mic_ctx->mmio.va = vmalloc(mic_ctx->mmio.len)) ||
+	    !(mic_ctx->aper.va = vmalloc(mic_ctx->aper.len))) {
+		printk("mic %d: failed to allocate emulated board memory\n", brdnum);
+		goto emul_free;
+	}
+	memset(mic_ctx->mmio.va, 0, mic_ctx->mmio.len);
+	memset(mic_ctx->aper.va, 0, mic_ctx->aper.len);
+	DBOX_WRITE(MIC_EMUL_POSTCODE, mic_ctx->mmio.va, MICREG_POSTCODE);
+	SBOX_WRITE(0x1, mic_ctx->mmio.va, SBOX_SCRATCH2);
+
+	if ((err = adapter_init_device(mic_ctx)) != 0) {
+		printk("MIC: Adapter init device failed %d\n", err);
+		goto emul_free;
+	}
+
+	set_sysfs_entries(mic_ctx);
+
+	bd_info->bi_sysfsdev = device_create(mic_lindata.dd_class, NULL,
+			mic_lindata.dd_dev + 2 + mic_ctx->bi_id,
+			NULL, "mic%d", mic_ctx->bi_id);
+	err = sysfs_create_group(&bd_info->bi_sysfsdev->kobj, &bd_attr_group);
+	mic_ctx->sysfs_state = sysfs_get_dirent(bd_info->bi_sysfsdev->kobj.sd,
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2,6,35))
+				NULL,
+#endif
+				"state");
+
+	dev_set_drvdata(bd_info->bi_sysfsdev, mic_ctx);
+
+	adapter_probe(mic_ctx);
+	adapter_wait_reset(mic_ctx);
+
+	list_add_tail(&bd_info->bi_list, &mic_data.dd_bdlist);
+	mic_data.dd_numdevs++;
+	printk("mic_probe emulated board #%d with %u MB of memory\n",
+	       brdnum, dma_emul_card_mem_mb);
+	return 0;
+
+emul_free:
+	mic_data.dd_bi[brdnum] = NULL;
+	mic_emul_free(bd_info);
+	return err;
+emul_putdev:
+	put_device(&pdev->dev);
+	return err;
+}
+#endif
+
 static void
 mic_remove(struct pci_dev *pdev)
 {
@@ -427,10 +591,20 @@ mic_remove(struct pci_dev *pdev)
 
 	mic_disable_interrupts(&bd_info->bi_ctx);
 
+#ifdef MIC_DMA_EMULATION
+	if (bd_info->bi_ctx.bi_emul) {
+		adapter_remove(&bd_info->bi_ctx);
+		mic_emul_free(bd_info);
+		return;
+	}
+#endif
 	if (!bd_info->bi_ctx.msie) {
+		mic_irq_affinity_hint(&bd_info->bi_ctx, bd_info->bi_ctx.bi_pdev->irq, false);
 		free_irq(bd_info->bi_ctx.bi_pdev->irq, &bd_info->bi_ctx);
 #ifdef CONFIG_PCI_MSI
 	} else {
+		mic_irq_affinity_hint(&bd_info->bi_ctx,
+			bd_info->bi_msix_entries[0].vector, false);
 		free_irq(bd_info->bi_msix_entries[0].vector, &bd_info->bi_ctx);
 		pci_disable_msix(bd_info->bi_ctx.bi_pdev);
 #endif
@@ -607,6 +781,12 @@ mic_init(void)
 		goto clean_unregister;
 	}
 
+#ifdef MIC_DMA_EMULATION
+	if (!mic_data.dd_numdevs)
+		for (i = 0; i < min_t(int, dma_emul_cards, MAX_BOARD_SUPPORTED); i++)
+			if (mic_emul_probe())
+				break;
+#endif
 	if (!mic_data.dd_numdevs) {
 		printk("mic: No MIC boards present.  SCIF available in loopback mode\n");
 	} else {
@@ -670,6 +850,11 @@ mic_exit(void)
 #endif
 
 	pci_unregister_driver(&mic_lindata.dd_pcidriver);
+#ifdef MIC_DMA_EMULATION
+	/* Emulated boards are only ever probed when there is no real one */
+	while (mic_data.dd_numdevs)
+		mic_remove(get_per_dev_ctx(mic_data.dd_numdevs - 1)->bi_pdev);
+#endif
 	micpm_uninit();
 
 	/* Uninit data structures for PM disconnect */
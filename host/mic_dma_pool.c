@@ -0,0 +1,304 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Per card pools of pre-mapped DMA buffers, see mic/mic_dma_pool.h.
+ */
+
+#include <linux/percpu.h>
+#include <linux/dma-mapping.h>
+#include "mic_common.h"
+
+/*
+ * Buffers allocated for each class when the card is initialized and the
+ * number of idle buffers a class keeps before releasing those put.
+ */
+static const struct {
+	int order;
+	int prealloc;
+	int max_free;
+} mic_dma_pool_cfg[MIC_DMA_POOL_NUM_CLASSES] = {
+	[MIC_DMA_POOL_4K]	= { 0, 32, 256 },
+	[MIC_DMA_POOL_64K]	= { 4, 16, 64 },
+	[MIC_DMA_POOL_2M]	= { 9, 0, 4 },
+};
+
+static struct mic_dma_buf *
+mic_dma_buf_alloc(mic_ctx_t *mic_ctx, int class)
+{
+	struct mic_dma_pool_class *cls = &mic_ctx->dma_pool.cls[class];
+	struct mic_dma_buf *buf;
+	unsigned long flags;
+
+	if (!(buf = kmalloc(sizeof(*buf), GFP_KERNEL)))
+		return NULL;
+	buf->size = PAGE_SIZE << cls->order;
+	buf->class = class;
+	/*
+	 * The CPU and the card take turns on a buffer for as long as it is
+	 * pooled, so it has to be coherent rather than streaming mapped.
+	 */
+	if (!(buf->va = dma_alloc_coherent(&mic_ctx->bi_pdev->dev, buf->size,
+					&buf->dma_addr, GFP_KERNEL)))
+		goto free_buf;
+	buf->mic_addr = mic_map(mic_ctx->bi_id, buf->dma_addr, buf->size);
+	if (mic_map_error(buf->mic_addr))
+		goto free_pages;
+
+	spin_lock_irqsave(&cls->lock, flags);
+	cls->nr_total++;
+	spin_unlock_irqrestore(&cls->lock, flags);
+	return buf;
+free_pages:
+	dma_free_coherent(&mic_ctx->bi_pdev->dev, buf->size, buf->va,
+			buf->dma_addr);
+free_buf:
+	kfree(buf);
+	return NULL;
+}
+
+static void
+mic_dma_buf_free(mic_ctx_t *mic_ctx, struct mic_dma_buf *buf)
+{
+	mic_unmap(mic_ctx->bi_id, buf->mic_addr, buf->size);
+	dma_free_coherent(&mic_ctx->bi_pdev->dev, buf->size, buf->va,
+			buf->dma_addr);
+	kfree(buf);
+}
+
+/*
+ * mic_dma_buf_get - Get a pre-mapped buffer of at least size bytes
+ *
+ * Tries the per-CPU cache, then the class free list and finally maps a
+ * new buffer. May sleep. Returns NULL if size exceeds the largest class
+ * or memory could not be allocated.
+ */
+struct mic_dma_buf *
+mic_dma_buf_get(mic_ctx_t *mic_ctx, size_t size)
+{
+	struct mic_dma_pool_class *cls;
+	struct mic_dma_pool_cpu *cache;
+	struct mic_dma_buf *buf = NULL;
+	unsigned long flags;
+	int class;
+
+	for (class = 0; class < MIC_DMA_POOL_NUM_CLASSES; class++)
+		if (size <= (PAGE_SIZE << mic_dma_pool_cfg[class].order))
+			break;
+	if (class == MIC_DMA_POOL_NUM_CLASSES)
+		return NULL;
+	cls = &mic_ctx->dma_pool.cls[class];
+
+	if (cls->cpu) {
+		local_irq_save(flags);
+		cache = per_cpu_ptr(cls->cpu, smp_processor_id());
+		if (cache->count)
+			buf = cache->bufs[--cache->count];
+		local_irq_restore(flags);
+		if (buf)
+			return buf;
+	}
+
+	spin_lock_irqsave(&cls->lock, flags);
+	if (!list_empty(&cls->free)) {
+		buf = list_first_entry(&cls->free, struct mic_dma_buf, list);
+		list_del(&buf->list);
+		cls->nr_free--;
+	}
+	spin_unlock_irqrestore(&cls->lock, flags);
+
+	if (!buf)
+		buf = mic_dma_buf_alloc(mic_ctx, class);
+	return buf;
+}
+
+/*
+ * Release the buffers put beyond max_free. Freeing coherent memory is not
+ * allowed in interrupt context, where mic_dma_buf_put() may be called.
+ */
+static void
+mic_dma_pool_trim(struct work_struct *work)
+{
+	struct mic_dma_pool *pool =
+		container_of(work, struct mic_dma_pool, trim_work);
+	mic_ctx_t *mic_ctx = container_of(pool, mic_ctx_t, dma_pool);
+	struct mic_dma_pool_class *cls;
+	struct mic_dma_buf *buf, *tmp;
+	unsigned long flags;
+	LIST_HEAD(trim);
+	int class, nr;
+
+	for (class = 0; class < MIC_DMA_POOL_NUM_CLASSES; class++) {
+		cls = &pool->cls[class];
+		spin_lock_irqsave(&cls->lock, flags);
+		list_splice_init(&cls->trim, &trim);
+		spin_unlock_irqrestore(&cls->lock, flags);
+
+		nr = 0;
+		list_for_each_entry_safe(buf, tmp, &trim, list) {
+			list_del(&buf->list);
+			mic_dma_buf_free(mic_ctx, buf);
+			nr++;
+		}
+		spin_lock_irqsave(&cls->lock, flags);
+		cls->nr_total -= nr;
+		spin_unlock_irqrestore(&cls->lock, flags);
+	}
+}
+
+/*
+ * mic_dma_buf_put - Return a buffer obtained with mic_dma_buf_get
+ *
+ * Safe to call from interrupt context. Buffers the pool does not keep
+ * are released later by its trim_work.
+ */
+void
+mic_dma_buf_put(mic_ctx_t *mic_ctx, struct mic_dma_buf *buf)
+{
+	struct mic_dma_pool_class *cls = &mic_ctx->dma_pool.cls[buf->class];
+	struct mic_dma_pool_cpu *cache;
+	unsigned long flags;
+
+	if (cls->cpu) {
+		local_irq_save(flags);
+		cache = per_cpu_ptr(cls->cpu, smp_processor_id());
+		if (cache->count < MIC_DMA_POOL_CPU_CACHE) {
+			cache->bufs[cache->count++] = buf;
+			buf = NULL;
+		}
+		local_irq_restore(flags);
+		if (!buf)
+			return;
+	}
+
+	spin_lock_irqsave(&cls->lock, flags);
+	if (cls->nr_free < cls->max_free) {
+		list_add(&buf->list, &cls->free);
+		cls->nr_free++;
+		buf = NULL;
+	} else {
+		list_add(&buf->list, &cls->trim);
+	}
+	spin_unlock_irqrestore(&cls->lock, flags);
+
+	if (buf)
+		schedule_work(&mic_ctx->dma_pool.trim_work);
+}
+
+/*
+ * Called once per board after the SMPT has been initialized. Failing to
+ * preallocate is not fatal, buffers are then mapped on first use.
+ */
+int
+mic_dma_pool_init(mic_ctx_t *mic_ctx)
+{
+	struct mic_dma_pool_class *cls;
+	struct mic_dma_buf *buf;
+	int class, i, err = 0;
+
+	INIT_WORK(&mic_ctx->dma_pool.trim_work, mic_dma_pool_trim);
+	for (class = 0; class < MIC_DMA_POOL_NUM_CLASSES; class++) {
+		cls = &mic_ctx->dma_pool.cls[class];
+		cls->order = mic_dma_pool_cfg[class].order;
+		cls->max_free = mic_dma_pool_cfg[class].max_free;
+		cls->nr_free = 0;
+		cls->nr_total = 0;
+		spin_lock_init(&cls->lock);
+		INIT_LIST_HEAD(&cls->free);
+		INIT_LIST_HEAD(&cls->trim);
+		if (!(cls->cpu = alloc_percpu(struct mic_dma_pool_cpu)))
+			err = -ENOMEM;
+	}
+
+	for (class = 0; class < MIC_DMA_POOL_NUM_CLASSES; class++) {
+		cls = &mic_ctx->dma_pool.cls[class];
+		for (i = 0; i < mic_dma_pool_cfg[class].prealloc; i++) {
+			if (!(buf = mic_dma_buf_alloc(mic_ctx, class))) {
+				err = -ENOMEM;
+				break;
+			}
+			list_add(&buf->list, &cls->free);
+			cls->nr_free++;
+		}
+	}
+
+	if (err)
+		printk(KERN_ERR "mic %d: failed to preallocate DMA buffer pool\n",
+			mic_ctx->bi_id);
+	return err;
+}
+
+/*
+ * Called during adapter removal once all users of the pool are gone.
+ */
+void
+mic_dma_pool_uninit(mic_ctx_t *mic_ctx)
+{
+	struct mic_dma_pool_class *cls;
+	struct mic_dma_pool_cpu *cache;
+	struct mic_dma_buf *buf, *tmp;
+	int class, cpu;
+
+	cancel_work_sync(&mic_ctx->dma_pool.trim_work);
+	mic_dma_pool_trim(&mic_ctx->dma_pool.trim_work);
+	for (class = 0; class < MIC_DMA_POOL_NUM_CLASSES; class++) {
+		cls = &mic_ctx->dma_pool.cls[class];
+		if (cls->cpu) {
+			for_each_possible_cpu(cpu) {
+				cache = per_cpu_ptr(cls->cpu, cpu);
+				while (cache->count) {
+					buf = cache->bufs[--cache->count];
+					list_add(&buf->list, &cls->free);
+				}
+			}
+			free_percpu(cls->cpu);
+			cls->cpu = NULL;
+		}
+		list_for_each_entry_safe(buf, tmp, &cls->free, list) {
+			list_del(&buf->list);
+			mic_dma_buf_free(mic_ctx, buf);
+			cls->nr_total--;
+		}
+		cls->nr_free = 0;
+		if (cls->nr_total)
+			printk(KERN_ERR "mic %d: %d DMA pool buffers of %lu bytes "
+				"still in use\n", mic_ctx->bi_id, cls->nr_total,
+				PAGE_SIZE << cls->order);
+	}
+}
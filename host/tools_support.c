@@ -383,7 +383,7 @@ int get_cardside_mem(mic_ctx_t *mic_ctx, uint64_t start, uint64_t size, void *de
 {
 	int32_t status = 0;
 	uint64_t len;
-	uint64_t dest_pa;
+	struct mic_dma_buf *dma_buf = NULL;
 	struct dma_channel *ch = NULL;
 	int flags = 0;
 	int poll_cookie;
@@ -422,6 +422,12 @@ int get_cardside_mem(mic_ctx_t *mic_ctx, uint64_t start, uint64_t size, void *de
 	if (status)
 		goto exit;
 
+	/* DMA each page into a pre-mapped buffer and copy it out */
+	if (!(dma_buf = mic_dma_buf_get(mic_ctx, PAGE_SIZE))) {
+		status = -ENOMEM;
+		goto put_ref;
+	}
+
 	while ((dma_ret = allocate_dma_channel(mic_ctx->dma_handle, &ch)) != 0) {
 			if (dma_ret == -ENODEV) {
 				printk("No device present\n");
@@ -439,11 +445,10 @@ int get_cardside_mem(mic_ctx_t *mic_ctx, uint64_t start, uint64_t size, void *de
 	for(j = 0; j < num_pages; j++) {
 		i = 0;
 		pg_virt_add = lowmem_page_address(pages[j]);
-		/* get card side address */
-		dest_pa = mic_ctx_map_single(mic_ctx, pg_virt_add, PAGE_SIZE);
 
 		/* do dma and keep polling for completion */
-		poll_cookie = do_dma(ch, flags, card_pa + next_page, dest_pa, PAGE_SIZE, NULL);
+		poll_cookie = do_dma(ch, flags, card_pa + next_page,
+				dma_buf->mic_addr, PAGE_SIZE, NULL);
 		pr_debug("Poll cookie %d\n", poll_cookie);
 		if (0 > poll_cookie) {
 			printk("Error programming the dma descriptor\n");
@@ -451,6 +456,7 @@ int get_cardside_mem(mic_ctx_t *mic_ctx, uint64_t start, uint64_t size, void *de
 			goto put_ref;
 		} else if (-2 == poll_cookie) {
 			printk( "Copy was done successfully, check for validity\n");
+			memcpy(pg_virt_add, dma_buf->va, PAGE_SIZE);
 		} else if(-1 != poll_cookie) {
 			while (i < 10000 && 1 != poll_dma_completion(poll_cookie, ch)) {
 				i++;
@@ -459,14 +465,16 @@ int get_cardside_mem(mic_ctx_t *mic_ctx, uint64_t start, uint64_t size, void *de
 				printk("DMA timed out \n");
 			} else {
 				pr_debug("DMA SUCCESS at %d\n", i);
+				memcpy(pg_virt_add, dma_buf->va, PAGE_SIZE);
 				/* increment by PAGE_SIZE on DMA SUCCESS to transfer next page */
 				next_page = next_page + PAGE_SIZE;
 			}
 		}
-		mic_ctx_unmap_single(mic_ctx, (dma_addr_t)dest_pa, PAGE_SIZE);
 	}
 
 put_ref:
+	if (dma_buf)
+		mic_dma_buf_put(mic_ctx, dma_buf);
 	micpm_put_reference(mic_ctx);
 exit:
 	mic_unpin_user_pages(pages, nf_pages);
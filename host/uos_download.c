@@ -912,6 +912,13 @@ adapter_reset(mic_ctx_t *mic_ctx, int wait_reset, int reattempt)
 	resetReg = SBOX_READ(mic_ctx->mmio.va, SBOX_RGCR);
 	resetReg |= 0x1;
 	SBOX_WRITE(resetReg, mic_ctx->mmio.va, SBOX_RGCR);
+#ifdef MIC_DMA_EMULATION
+	/* Nothing runs behind an emulated board, act as its bootstrap */
+	if (mic_ctx->bi_emul) {
+		SBOX_WRITE(resetReg & ~0x1, mic_ctx->mmio.va, SBOX_RGCR);
+		SBOX_WRITE(0x1, mic_ctx->mmio.va, SBOX_SCRATCH2);
+	}
+#endif
 
 	/* At least of KNF it seems we really want to delay at least 1 second */
 	/* after touching reset to prevent a lot of problems. */
@@ -1018,10 +1025,16 @@ adapter_remove(mic_ctx_t *mic_ctx)
 
 	ramoops_remove(mic_ctx);
 	vmcore_remove(mic_ctx);
+	mic_dma_pool_uninit(mic_ctx);
 	mic_smpt_uninit(mic_ctx);
 	/* Make sure that no reset timer is running after the workqueue is destroyed */
 	destroy_reset_workqueue(mic_ctx);
 
+#ifdef MIC_DMA_EMULATION
+	/* The backing memory of emulated boards is owned by mic_emul_free() */
+	if (mic_ctx->bi_emul)
+		return 0;
+#endif
 	if (mic_ctx->mmio.va) {
 		iounmap((void *)mic_ctx->mmio.va);
 		mic_ctx->mmio.va = 0;
@@ -1392,6 +1405,11 @@ adapter_init_device(mic_ctx_t *mic_ctx)
 	device_id = mic_ctx->bi_pdev->device;
 	mic_ctx->bi_family = get_product_family(device_id);
 
+#ifdef MIC_DMA_EMULATION
+	/* Emulated boards come with both BARs already backed by host memory */
+	if (mic_ctx->bi_emul)
+		goto adap_init_mapped;
+#endif
 	if ((mic_ctx->mmio.va = ioremap_nocache(mic_ctx->mmio.pa, 
 						mic_ctx->mmio.len)) == NULL) {
 		printk("mic %d: failed to map mmio space\n", mic_ctx->bi_id);
@@ -1431,8 +1449,12 @@ adapter_init_device(mic_ctx_t *mic_ctx)
 		}
 	}
 
+#ifdef MIC_DMA_EMULATION
+adap_init_mapped:
+#endif
 	mic_debug_init(mic_ctx);
 	mic_smpt_init(mic_ctx);
+	mic_dma_pool_init(mic_ctx);
 #ifdef USE_VCONSOLE
 	// Allocate memory for PCI serial console
 	mic_ctx->bi_vcons.dc_buf_virt = (void *)get_zeroed_page(GFP_KERNEL);
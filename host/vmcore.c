@@ -83,48 +83,40 @@ ssize_t mic_copy_oldmem_page(mic_ctx_t *mic_ctx,
 		unsigned long pfn, char *buf,
 		size_t csize, unsigned long offset, int userbuf)
 {
-	void  *vaddr, *tmp;
+	void  *vaddr;
 	int err;
 	struct dma_channel *dma_chan;
-	dma_addr_t mic_dst_phys_addr;
+	struct mic_dma_buf *dma_buf;
 
 	vaddr = mic_ctx->aper.va + (pfn << PAGE_SHIFT);
 
 	if (!csize)
 		return 0;
 	if (csize == PAGE_SIZE && !offset) {
-		if (!(tmp = (void*)__get_free_pages(GFP_KERNEL, get_order(PAGE_SIZE)))) {
+		if (!(dma_buf = mic_dma_buf_get(mic_ctx, csize))) {
 			printk(KERN_ERR "%s: tmp buffer allocation failed\n", __func__);
 			return -ENOMEM;
 		}
-		mic_dst_phys_addr = mic_ctx_map_single(mic_ctx, tmp, csize);
-		if (mic_map_error(mic_dst_phys_addr)) {
-			printk(KERN_ERR "%s: mic_ctx_map_single failed\n", __func__);
-			free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
-			return -ENOMEM;
-		}
 
 		if ((allocate_dma_channel(mic_ctx->dma_handle, &dma_chan))) {
 			printk(KERN_ERR "%s: allocate_dma_channel failed\n", __func__);
-			mic_ctx_unmap_single(mic_ctx, mic_dst_phys_addr, csize);
-			free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
+			mic_dma_buf_put(mic_ctx, dma_buf);
 			return -EBUSY;
 		}
 
 		err = do_dma(dma_chan,
 				0,
 				pfn << PAGE_SHIFT,
-				mic_dst_phys_addr,
+				dma_buf->mic_addr,
 				csize,
 				NULL);
 		if (err) {
 			printk(KERN_ERR "DMA do_dma err %s %d err %d src 0x%lx "
 				"dst 0x%llx csize 0x%lx\n", 
 				__func__, __LINE__, err, pfn << PAGE_SHIFT, 
-				mic_dst_phys_addr, csize);
+				dma_buf->mic_addr, csize);
 			free_dma_channel(dma_chan);
-			mic_ctx_unmap_single(mic_ctx, mic_dst_phys_addr, csize);
-			free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
+			mic_dma_buf_put(mic_ctx, dma_buf);
 			return err;
 		}
 		free_dma_channel(dma_chan);
@@ -133,23 +125,20 @@ ssize_t mic_copy_oldmem_page(mic_ctx_t *mic_ctx,
 			printk(KERN_ERR "DMA poll err %s %d err %d src 0x%lx i"
 				"dst 0x%llx csize 0x%lx\n", 
 				__func__, __LINE__, err, pfn << PAGE_SHIFT, 
-				mic_dst_phys_addr, csize);
-			mic_ctx_unmap_single(mic_ctx, mic_dst_phys_addr, csize);
-			free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
+				dma_buf->mic_addr, csize);
+			mic_dma_buf_put(mic_ctx, dma_buf);
 			return err;
 		}
 		if (userbuf) {
-			if (copy_to_user(buf, tmp, csize)) {
-				mic_ctx_unmap_single(mic_ctx, mic_dst_phys_addr, csize);
-				free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
+			if (copy_to_user(buf, dma_buf->va, csize)) {
+				mic_dma_buf_put(mic_ctx, dma_buf);
 				return -EFAULT;
 			}
 		} else {
-			memcpy(buf, tmp, csize);
+			memcpy(buf, dma_buf->va, csize);
 		}
 		smp_mb();
-		mic_ctx_unmap_single(mic_ctx, mic_dst_phys_addr, csize);
-		free_pages((unsigned long)tmp, get_order(PAGE_SIZE));
+		mic_dma_buf_put(mic_ctx, dma_buf);
 	} else {
 		if (userbuf) {
 			if (copy_to_user(buf, vaddr + offset, csize))
@@ -102,11 +102,15 @@ static __always_inline void init_ring(struct compl_buf_ring *ring, int size,
 {
 #ifndef _MIC_SCIF_
 	struct pci_dev *pdev;
+	int numa_node = micscif_numa_node(device_num);
+#else
+	int numa_node = -1;
 #endif
 	ring->head = 0;
 	ring->tail = 0;
 	ring->size = size;
-	ring->tail_location = (uint64_t) kmalloc(sizeof(uint64_t), GFP_ATOMIC);
+	ring->tail_location = (uint64_t) kmalloc_node(sizeof(uint64_t), GFP_ATOMIC,
+						     numa_node);
 	BUG_ON(!ring->tail_location);
 	*(int*)ring->tail_location = -1;
 #ifdef _MIC_SCIF_
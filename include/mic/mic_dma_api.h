@@ -99,6 +99,17 @@ int allocate_dma_channel(mic_dma_handle_t dma_handle, struct dma_channel **chan)
  */
 int request_dma_channel(struct dma_channel *chan);
 
+/*
+ * try_request_dma_channel - Request a specific DMA channel without waiting.
+ *
+ * @chan - the dma_channel pointer to acquire
+ *
+ * Returns: 0 on success and -EBUSY if the channel is in use.
+ *
+ * NOTE: Same rules as request_dma_channel once acquired.
+ */
+int try_request_dma_channel(struct dma_channel *chan);
+
 /*
  * free_dma_channel - after allocating a channel, used to 
  *                 free the channel after DMAs are submitted
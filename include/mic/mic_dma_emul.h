@@ -0,0 +1,69 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+#ifndef MIC_DMA_EMUL_H
+#define MIC_DMA_EMUL_H
+
+/*
+ * Software model of the SBOX DMA engine.
+ *
+ * When the driver is built with MIC_DMA_EMULATION the DMA library programs
+ * a private copy of the SBOX DMA register file instead of the card MMIO
+ * space. A kernel thread per DMA device watches the head pointers, executes
+ * memory copy, status and general purpose descriptors with the CPU and then
+ * advances the tail pointers exactly like the hardware would. This allows
+ * the DMA library and its users to be exercised and benchmarked on a system
+ * without a physical card.
+ */
+
+struct mic_dma_device;
+
+/*
+ * Interrupt callback invoked by the emulator after processing a status
+ * descriptor with the interrupt bit set on an unmasked channel.
+ */
+typedef void (*mic_dma_emul_intr_t)(struct mic_dma_device *dma_dev, int chan_num);
+
+int md_mic_dma_emul_init(struct mic_dma_device *dma_dev, int device_num,
+			 mic_dma_emul_intr_t intr_handler);
+void md_mic_dma_emul_stop(struct mic_dma_device *dma_dev);
+void md_mic_dma_emul_uninit(struct mic_dma_device *dma_dev);
+void md_mic_dma_emul_kick(struct mic_dma_device *dma_dev);
+
+#endif /* MIC_DMA_EMUL_H */
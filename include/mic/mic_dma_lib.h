@@ -93,6 +93,7 @@ struct dma_completion_cb {
 	dma_addr_t temp_phys;
 	int remote_node;
 	int header_padding;
+	struct mic_dma_buf *dma_buf;
 };
 
 int get_chan_num(struct dma_channel *chan);
@@ -42,6 +42,9 @@
 
 #include "mic_sbox_md.h"
 #include "micsboxdefine.h"
+#ifdef MIC_DMA_EMULATION
+#include "mic_dma_emul.h"
+#endif
 
 #define MAX_NUM_DMA_CHAN 8
 /*
@@ -167,10 +170,14 @@ struct md_mic_dma_chan {
  * struct mic_dma_device - MIC DMA Device specific structure
  * @chan_info - static array of MIC DMA channel specific structures
  * @lock - MTX_DEF lock to synchronize allocation/deallocation of DMA channels
+ * @emul - software DMA engine state when built with MIC_DMA_EMULATION
  */
 struct mic_dma_device {
 	struct md_mic_dma_chan chan_info[MAX_NUM_DMA_CHAN];
 	void *mm_sbox;
+#ifdef MIC_DMA_EMULATION
+	struct mic_dma_emul *emul;
+#endif
 };
 
 
@@ -345,6 +352,9 @@ md_mic_dma_chan_write_head(struct mic_dma_device *dma_dev,
 		"head 0x%x > num_desc_in_ring 0x%x chan_num %d\n",
 		head, chan->num_desc_in_ring, chan_num);
 	md_mic_dma_write_mmio(dma_dev, chan_num, REG_DHPR, head);
+#ifdef MIC_DMA_EMULATION
+	md_mic_dma_emul_kick(dma_dev);
+#endif
 }
 
 uint32_t md_mic_dma_chan_read_head(struct mic_dma_device *dma_dev, struct md_mic_dma_chan *chan);
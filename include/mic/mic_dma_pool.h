@@ -0,0 +1,126 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Per card pools of coherent DMA buffers which stay SMPT mapped for the
+ * lifetime of the card. Paths which DMA through a short lived bounce
+ * buffer take one from here and copy instead of mapping and unmapping
+ * memory for every operation.
+ */
+
+#ifndef MIC_DMA_POOL_H
+#define MIC_DMA_POOL_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+/* Buffer size classes, each class holds buffers of 1 << order pages */
+#define MIC_DMA_POOL_4K		0
+#define MIC_DMA_POOL_64K	1
+#define MIC_DMA_POOL_2M		2
+#define MIC_DMA_POOL_NUM_CLASSES	3
+
+/* Buffers kept in each per-CPU cache of a class */
+#define MIC_DMA_POOL_CPU_CACHE	4
+
+/*
+ * struct mic_dma_buf - A pre-mapped DMA buffer
+ * @list - free list linkage, owned by the pool
+ * @va - kernel virtual address
+ * @dma_addr - bus address of the coherent allocation
+ * @mic_addr - address of the buffer as seen by the card DMA engine
+ * @size - usable size of the buffer in bytes
+ * @class - size class the buffer belongs to
+ */
+struct mic_dma_buf {
+	struct list_head list;
+	void *va;
+	dma_addr_t dma_addr;
+	dma_addr_t mic_addr;
+	size_t size;
+	int class;
+};
+
+struct mic_dma_pool_cpu {
+	int count;
+	struct mic_dma_buf *bufs[MIC_DMA_POOL_CPU_CACHE];
+};
+
+/*
+ * struct mic_dma_pool_class - One size class of a card DMA pool
+ * @lock - protects free, trim, nr_free and nr_total
+ * @free - buffers not held by a per-CPU cache or a user
+ * @trim - buffers put beyond max_free, waiting for the pool's trim_work
+ * @nr_free - length of free
+ * @nr_total - buffers currently allocated for this class
+ * @max_free - buffers beyond this count are released after put
+ * @cpu - per-CPU caches, accessed with interrupts disabled
+ */
+struct mic_dma_pool_class {
+	int order;
+	spinlock_t lock;
+	struct list_head free;
+	struct list_head trim;
+	int nr_free;
+	int nr_total;
+	int max_free;
+	struct mic_dma_pool_cpu *cpu;
+};
+
+/*
+ * struct mic_dma_pool - DMA buffer pool of a card
+ * @cls - size classes
+ * @trim_work - releases the buffers on the trim lists, which put cannot
+ *              do itself since it may be called from interrupt context
+ */
+struct mic_dma_pool {
+	struct mic_dma_pool_class cls[MIC_DMA_POOL_NUM_CLASSES];
+	struct work_struct trim_work;
+};
+
+struct _mic_ctx_t;
+
+int mic_dma_pool_init(struct _mic_ctx_t *mic_ctx);
+void mic_dma_pool_uninit(struct _mic_ctx_t *mic_ctx);
+struct mic_dma_buf *mic_dma_buf_get(struct _mic_ctx_t *mic_ctx, size_t size);
+void mic_dma_buf_put(struct _mic_ctx_t *mic_ctx, struct mic_dma_buf *buf);
+
+#endif /* MIC_DMA_POOL_H */
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Static tracepoints for the MIC DMA library.
+ *
+ * Enable with e.g. "perf record -e mic_dma:*" or
+ * "trace-cmd record -e mic_dma". Every event carries the DMA device
+ * number and channel number so that PCIe traffic can be attributed to
+ * the channel users (SCIF RMA, micmem, vnet).
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mic_dma
+
+#if !defined(MIC_DMA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define MIC_DMA_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* do_dma() queued a transfer; cookie is the poll or interrupt ring index */
+TRACE_EVENT(mic_dma_submit,
+	TP_PROTO(int dev, int chan, uint64_t src, uint64_t dst,
+		 size_t len, int flags, int cookie),
+	TP_ARGS(dev, chan, src, dst, len, flags, cookie),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(int, chan)
+		__field(uint64_t, src)
+		__field(uint64_t, dst)
+		__field(size_t, len)
+		__field(int, flags)
+		__field(int, cookie)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->chan = chan;
+		__entry->src = src;
+		__entry->dst = dst;
+		__entry->len = len;
+		__entry->flags = flags;
+		__entry->cookie = cookie;
+	),
+	TP_printk("dev=%d chan=%d src=0x%llx dst=0x%llx len=%zu flags=0x%x cookie=%d",
+		  __entry->dev, __entry->chan,
+		  (unsigned long long)__entry->src,
+		  (unsigned long long)__entry->dst,
+		  __entry->len, __entry->flags, __entry->cookie)
+);
+
+/* The head pointer register was written, handing descriptors to the h/w */
+TRACE_EVENT(mic_dma_head_write,
+	TP_PROTO(int dev, int chan, uint32_t head, uint32_t ndesc),
+	TP_ARGS(dev, chan, head, ndesc),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(int, chan)
+		__field(uint32_t, head)
+		__field(uint32_t, ndesc)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->chan = chan;
+		__entry->head = head;
+		__entry->ndesc = ndesc;
+	),
+	TP_printk("dev=%d chan=%d head=0x%x ndesc=%u",
+		  __entry->dev, __entry->chan, __entry->head, __entry->ndesc)
+);
+
+/* Completion interrupt processed; cookie is the last completed mark */
+TRACE_EVENT(mic_dma_complete,
+	TP_PROTO(int dev, int chan, int cookie, int ncompleted),
+	TP_ARGS(dev, chan, cookie, ncompleted),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(int, chan)
+		__field(int, cookie)
+		__field(int, ncompleted)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->chan = chan;
+		__entry->cookie = cookie;
+		__entry->ncompleted = ncompleted;
+	),
+	TP_printk("dev=%d chan=%d cookie=%d completed=%d",
+		  __entry->dev, __entry->chan, __entry->cookie,
+		  __entry->ncompleted)
+);
+
+/* The descriptor ring was full and the submitter had to spin */
+TRACE_EVENT(mic_dma_ring_full,
+	TP_PROTO(int dev, int chan, uint32_t required, uint64_t stall_ns),
+	TP_ARGS(dev, chan, required, stall_ns),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(int, chan)
+		__field(uint32_t, required)
+		__field(uint64_t, stall_ns)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->chan = chan;
+		__entry->required = required;
+		__entry->stall_ns = stall_ns;
+	),
+	TP_printk("dev=%d chan=%d required=%u stall_ns=%llu",
+		  __entry->dev, __entry->chan, __entry->required,
+		  (unsigned long long)__entry->stall_ns)
+);
+
+/* A wait on the channel gave up after DMA_TO */
+TRACE_EVENT(mic_dma_timeout,
+	TP_PROTO(int dev, int chan, const char *where),
+	TP_ARGS(dev, chan, where),
+	TP_STRUCT__entry(
+		__field(int, dev)
+		__field(int, chan)
+		__string(where, where)
+	),
+	TP_fast_assign(
+		__entry->dev = dev;
+		__entry->chan = chan;
+		__assign_str(where, where);
+	),
+	TP_printk("dev=%d chan=%d in %s",
+		  __entry->dev, __entry->chan, __get_str(where))
+);
+
+#endif /* MIC_DMA_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH mic
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mic_dma_trace
+#include <trace/define_trace.h>
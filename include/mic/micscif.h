@@ -122,6 +122,16 @@
  */
 #define SCIF_PROXY_DMA_THRESHOLD (32 * 1024ULL)
 
+/*
+ * DMA channels, its own included, an endpoint may stripe one RMA of at
+ * least mi_rma_stripe_threshold bytes across. Capped at half of the four
+ * channels each side owns (see __LAST_HOST_CHAN_NUM in mic_dma_md.h) so
+ * that a single endpoint cannot occupy all of them.
+ */
+#define SCIF_RMA_DMA_CHAN_MAX	2
+#define SCIF_RMA_DMA_CHANS	2
+#define SCIF_RMA_STRIPE_THRESHOLD	0x100000
+
 //#define RMA_DEBUG 0
 
 /* Pre-defined L1_CACHE_SHIFT is 6 on RH and 7 on Suse */
@@ -133,6 +143,31 @@
 #define MI_EPLOCK_HELD  (true)
 #define MAX_RDMASR	8
 
+/*
+ * Extra node QPs (lanes) set up with each remote node in addition to
+ * qpairs[0], for SCIF_CLIENT_SENT/RCVD. 0 keeps everything on qpairs[0].
+ */
+#define SCIF_NODEQP_MAX_LANES	8
+#define SCIF_NODEQP_LANES	4
+
+/*
+ * Endpoint QPs with their receive ring already mapped for the peer, kept
+ * per remote node for scif_connect() and scif_accept().
+ */
+#define SCIF_QP_POOL_MAX	64
+#define SCIF_QP_POOL_DEFAULT	8
+
+/*
+ * How the reply which completed a scif_send() to scif_recv() round trip
+ * was picked up: already in the ring, by busy polling, or after sleeping.
+ */
+enum micscif_rtt_type {
+	SCIF_RTT_READY = 0,
+	SCIF_RTT_POLLED,
+	SCIF_RTT_SLEPT,
+	SCIF_RTT_MAX
+};
+
 // Device wide SCIF information
 struct micscif_info {
 	uint32_t	 mi_nodeid;	// Node ID this node is to others.
@@ -150,11 +185,13 @@ struct micscif_info {
 					// windows to be destroyed.
 	struct mutex	 mi_fencelock;  // Synchronize access to list of remote fences requested.
 	struct mutex	 mi_event_cblock;
+	struct mutex	 mi_epoll_lock;	// Serializes scif_epoll_ctl() and endpoint close
 	struct list_head mi_uaccept;	// List of user acceptreq waiting for acceptreg
 	struct list_head mi_listen;	// List of listening end points
 	struct list_head mi_zombie;	// List of zombie end points with pending RMA's.
 	struct list_head mi_connected;	// List of end points in connected state
 	struct list_head mi_disconnected;	// List of end points in disconnected state
+	struct list_head mi_dgram;	// List of datagram end points, under mi_eplock
 	struct list_head mi_rma;	// List of temporary registered windows to be destroyed.
 	struct list_head mi_rma_tc;	// List of temporary
 					// registered & cached windows
@@ -189,6 +226,8 @@ struct micscif_info {
 	int		mi_watchdog_enabled;	// Watchdog timeout enabled
 	int		mi_watchdog_auto_reboot;	// Watchdog auto reboot enabled
 	struct workqueue_struct *mi_misc_wq;  // Workqueue for miscellaneous SCIF tasks.
+	struct workqueue_struct *mi_lane_wq;  // Per CPU workqueue draining node QP lanes.
+	struct workqueue_struct *mi_rma_async_wq;  // Workqueue running scif_*_async() RMAs.
 	struct work_struct	mi_misc_work;
 #ifdef CONFIG_MMU_NOTIFIER
 	struct workqueue_struct *mi_mmu_notif_wq;  // Workqueue for MMU notifier cleanup tasks.
@@ -198,9 +237,33 @@ struct micscif_info {
 	uint64_t	nr_2mb_pages;  // Debug Counter for number of 2mb pages.
 	uint64_t	nr_4k_pages; // Debug Counter for number of 4K pages
 	uint8_t		en_msg_log;
+	uint8_t		en_rtt_stats;
+	uint8_t		en_nodeqp_stats;
+	uint8_t		en_loopb_direct;
+	uint8_t		en_rb_nt_copy;
+	/* scif_send() to scif_recv() round trips, see micscif_rtt_account() */
+	atomic_long_t	mi_rtt_cnt[SCIF_RTT_MAX];
+	atomic_long_t	mi_rtt_ns[SCIF_RTT_MAX];
 	wait_queue_head_t mi_exitwq;
 	unsigned long	mi_rma_tc_limit;
 	uint64_t	mi_proxy_dma_threshold;
+	uint32_t	mi_endpt_qp_size;	// Endpoint RB size asked for on connect
+	uint32_t	mi_qp_notify_pct;	// % of RB consumed before a forced RCVD
+	uint32_t	mi_rndv_threshold;	// Min user send size pulled by the peer
+	uint32_t	mi_busy_poll_us;	// Default recv busy poll time for new endpoints
+	uint32_t	mi_nodeqp_lanes;	// Extra node QPs asked for per remote node
+	uint32_t	mi_qp_pool_size;	// Pre-mapped endpoint QPs kept per remote node
+	uint32_t	mi_rma_dma_chans;	// DMA channels reserved per new endpoint
+	uint64_t	mi_rma_stripe_threshold;	// Min RMA size striped across them
+	atomic_long_t	mi_qp_pool_hit;
+	atomic_long_t	mi_qp_pool_miss;
+	atomic_long_t	mi_dgram_sent;
+	atomic_long_t	mi_dgram_rcvd;
+	atomic_long_t	mi_dgram_drop;
+	/* Temp registration cache lookups and LRU evictions */
+	atomic_long_t	mi_rma_tc_hit;
+	atomic_long_t	mi_rma_tc_miss;
+	atomic_long_t	mi_rma_tc_evict;
 #ifdef RMA_DEBUG
 	atomic_long_t	rma_unaligned_cpu_cnt;
 	atomic_long_t	rma_alloc_cnt;
@@ -246,6 +309,8 @@ struct scif_p2p_info {
 	struct list_head   ppi_list;
 };
 
+#define SCIF_EP_STATS_NR	(sizeof(struct scif_ep_stats) / sizeof(uint64_t))
+
 /* one per remote node */
 struct micscif_dev {
 	uint16_t		sd_node;
@@ -275,6 +340,36 @@ struct micscif_dev {
 							 * There is single qp established
 							 * with this remote node
 							 */
+	/*
+	 * Extra node QPs for endpoint notifications negotiated once
+	 * qpairs[0] is up. The first sd_nr_lanes are online. Online lanes
+	 * are looked up under rcu_read_lock(), see micscif_nodeqp_lane_get().
+	 */
+	struct micscif_nodeqp_lane	*sd_lanes[SCIF_NODEQP_MAX_LANES];
+	volatile int		sd_nr_lanes;
+
+	/*
+	 * Endpoint QP pool, see micscif_qp_pool_get(). Entries are only
+	 * taken and returned while sd_qp_pool_on is set.
+	 */
+	spinlock_t		sd_qp_pool_lock;
+	struct micscif_qp	*sd_qp_pool[SCIF_QP_POOL_MAX];
+	int			sd_qp_pool_cnt;
+	bool			sd_qp_pool_on;
+	struct work_struct	sd_qp_pool_work;
+
+	/*
+	 * Datagram QP shared by all datagram endpoints, see
+	 * micscif_dgram_send(). Senders use sd_dgram_qp under
+	 * sd_dgram_lock, the receiver under sd_dgram_mutex.
+	 */
+	struct micscif_qp	*sd_dgram_qp;
+	struct micscif_qp	*sd_dgram_offer;	/* Waiting for the ACK */
+	spinlock_t		sd_dgram_lock;
+	struct mutex		sd_dgram_mutex;
+
+	/* struct scif_ep_stats of endpoints to this node which were closed */
+	atomic_long_t		sd_ep_stats[SCIF_EP_STATS_NR];
 
 	struct workqueue_struct       *sd_intr_wq;		/* sd_intr_wq & sd_intr_bh
 							 * together constitute the workqueue
@@ -291,6 +386,8 @@ struct micscif_dev {
 	char			sd_loopb_wqname[16];
 	struct work_struct		sd_loopb_work;
 	struct list_head	sd_loopb_recv_q;
+	/* Loopback messages in the RB or on sd_loopb_recv_q */
+	atomic_t		sd_loopb_pending;
 	/* Lock to synchronize remote node state transitions */
 	struct mutex		sd_lock;
 	/*
@@ -381,7 +478,8 @@ enum endptstate {
 	SCIFEP_CLOSING,		// Internal state
 	SCIFEP_CLLISTEN,	// Internal state
 	SCIFEP_DISCONNECTED,	// Internal state
-	SCIFEP_ZOMBIE		// Internal state
+	SCIFEP_ZOMBIE,		// Internal state
+	SCIFEP_DGRAM		// External state
 };
 
 extern char *scif_ep_states[];
@@ -395,8 +493,154 @@ struct conreq {
 
 /* Size of the RB for the Node QP */
 #define NODE_QP_SIZE    0x10000
-/* Size of the RB for the Endpoint QP */
+/*
+ * Size of the RB for the Endpoint QP. ENDPT_QP_SIZE is the size assumed
+ * for peers which do not advertise one, ms_info.mi_endpt_qp_size is the
+ * size new connections ask for.
+ */
 #define ENDPT_QP_SIZE   0x1000
+#define ENDPT_QP_DEFAULT_SIZE	0x10000
+#define ENDPT_QP_MAX_SIZE	0x100000
+
+/*
+ * The receive ring size an endpoint wants is advertised in payload[2] of
+ * SCIF_CNCT_REQ and SCIF_CNCT_GNT. Older peers leave that word
+ * uninitialized, so it is only trusted when it carries the tag. Bits
+ * 32-47 carry SCIF_QP_CAP_* flags for endpoint QP features both sides
+ * must agree on.
+ */
+#define SCIF_QP_SIZE_TAG	(0x5153ULL << 48)
+#define SCIF_QP_TAG_MASK	(0xffffULL << 48)
+#define SCIF_QP_SIZE_MASK	0xffffffffULL
+#define SCIF_QP_CAP_SHIFT	32
+#define SCIF_QP_CAP_MASK	0xffffULL
+
+/* Peer sets peer_{recv,send}_waiting and only expects notifications then */
+#define SCIF_QP_CAP_CREDIT	0x1
+/* Peer understands SCIF_RNDV_REQ/ACK/CANCEL */
+#define SCIF_QP_CAP_RNDV	0x2
+/* Peer sets peer_recv_polling while busy polling for SCIF_CLIENT_SENT */
+#define SCIF_QP_CAP_BUSY_POLL	0x4
+/* Peer keeps the ring pointers and flags in its QP's ctrl page */
+#define SCIF_QP_CAP_MMAP	0x8
+#define SCIF_QP_CAPS		(SCIF_QP_CAP_CREDIT | SCIF_QP_CAP_RNDV | \
+				SCIF_QP_CAP_BUSY_POLL | SCIF_QP_CAP_MMAP)
+
+static inline uint64_t micscif_encode_qp_size(uint32_t size)
+{
+	return SCIF_QP_SIZE_TAG |
+		((uint64_t)SCIF_QP_CAPS << SCIF_QP_CAP_SHIFT) | size;
+}
+
+static inline uint32_t micscif_decode_qp_size(uint64_t payload)
+{
+	uint32_t size = (uint32_t)(payload & SCIF_QP_SIZE_MASK);
+
+	if ((payload & SCIF_QP_TAG_MASK) != SCIF_QP_SIZE_TAG ||
+		size < ENDPT_QP_SIZE || size > ENDPT_QP_MAX_SIZE ||
+		(size & (size - 1)))
+		return ENDPT_QP_SIZE;
+	return size;
+}
+
+/*
+ * With SCIF_QP_CAP_CREDIT a receiver which is not being waited on still
+ * sends SCIF_CLIENT_RCVD after consuming this percentage of the ring, so
+ * a sender polling without blocking sees space being freed. 0 disables
+ * batching and notifies for every transfer.
+ */
+#define SCIF_QP_NOTIFY_PCT	25
+
+/*
+ * Blocking user mode sends of at least this many bytes are registered and
+ * pulled by the receiver with RMA instead of being copied through the
+ * endpoint ring. 0 disables the rendezvous path.
+ */
+#define SCIF_RNDV_THRESHOLD	0x40000
+
+/*
+ * Upper bound in usecs on how long a blocking scif_recv() spins on the
+ * endpoint ring before sleeping, see scif_busy_poll().
+ */
+#define SCIF_BUSY_POLL_MAX_US	10000
+
+/*
+ * Size of the datagram RB to each remote node, and how many unread
+ * datagrams an endpoint holds before further ones are dropped.
+ */
+#define SCIF_DGRAM_QP_SIZE	0x10000
+#define SCIF_DGRAM_QLEN		256
+
+/* A datagram as it sits in the RB, followed by len bytes of data */
+struct micscif_dgram_hdr {
+	uint16_t	src_port;
+	uint16_t	dst_port;
+	uint32_t	len;
+};
+
+/* A datagram queued on the receiving endpoint */
+struct micscif_dgram {
+	struct list_head	list;
+	struct scif_portID	src;
+	uint16_t		dst_port;
+	int			len;
+	char			data[0];
+};
+
+static inline uint32_t micscif_decode_qp_caps(uint64_t payload)
+{
+	if ((payload & SCIF_QP_TAG_MASK) != SCIF_QP_SIZE_TAG)
+		return 0;
+	return (uint32_t)((payload >> SCIF_QP_CAP_SHIFT) & SCIF_QP_CAP_MASK) &
+		SCIF_QP_CAPS;
+}
+
+/*
+ * A send buffer advertised with SCIF_RNDV_REQ. The sender tracks its own
+ * in rndv_tx, the receiver the peer's in rndv_rx.
+ */
+enum micscif_rndv_state {
+	RNDV_IDLE = 0,
+	RNDV_PENDING,	/* Advertised and not finished */
+	RNDV_PULLING,	/* Receiver is copying from it */
+	RNDV_CANCEL,	/* Sender cancelled while the receiver was copying */
+	RNDV_DONE	/* Sender got SCIF_RNDV_ACK */
+};
+
+struct micscif_rndv {
+	enum micscif_rndv_state	state;
+	off_t			offset;	/* Of the first byte in the peer's window */
+	size_t			len;
+	size_t			done;	/* Bytes the receiver has pulled */
+};
+
+/*
+ * A readiness set from scif_epoll_create(). Endpoint wakeups put the
+ * items they concern on rdllist, so scif_epoll_wait() only looks at
+ * endpoints which may have become ready since it last did.
+ */
+struct micscif_epset {
+	struct mutex		mtx;		/* Serializes scans and item removal */
+	spinlock_t		lock;		/* Protects rdllist */
+	struct list_head	rdllist;
+	struct list_head	items;
+	wait_queue_head_t	wq;
+};
+
+#define MICSCIF_EPITEM_NWAIT	3
+
+/* An endpoint in a set, linked on both under mi_epoll_lock */
+struct micscif_epitem {
+	struct list_head	setlink;
+	struct list_head	eplink;
+	struct list_head	rdllink;	/* On set->rdllist if maybe ready */
+	struct micscif_epset	*set;
+	struct endpt		*ep;
+	struct scif_epoll_event	event;
+	int			nwait;
+	wait_queue_t		wait[MICSCIF_EPITEM_NWAIT];
+	wait_queue_head_t	*whead[MICSCIF_EPITEM_NWAIT];
+};
 
 struct endpt_qp_info {
 	/* Qpair for this endpoint */
@@ -412,6 +656,8 @@ struct endpt_qp_info {
 	 * physical address of the remote_qp.
 	 */
 	dma_addr_t cnct_gnt_payload;
+	/* SCIF_QP_CAP_* flags advertised in the SCIF_CNCT_GNT message */
+	uint32_t cnct_gnt_caps;
 };
 
 #define SCIFEP_MAGIC	0x5c1f000000005c1f
@@ -462,7 +708,51 @@ struct endpt {
 	wait_queue_head_t	recvwq;
 	struct mutex		sendlock;
 	struct mutex		recvlock;
+	/*
+	 * Each direction of the endpoint QP has one producer and one
+	 * consumer. Concurrent senders and concurrent receivers serialize
+	 * on these without disabling interrupts; ep->lock is only taken
+	 * for state changes. Nest outside ep->lock.
+	 */
+	spinlock_t		tx_lock;
+	spinlock_t		rx_lock;
 	struct list_head	list;
+	/*
+	 * Large send this endpoint advertised and the one its peer
+	 * advertised, both protected by lock.
+	 */
+	struct micscif_rndv	rndv_tx;
+	struct micscif_rndv	rndv_rx;
+	/*
+	 * Datagrams waiting for scif_recvfrom(), protected by lock.
+	 */
+	struct list_head	dgram_q;
+	int			dgram_cnt;
+	/*
+	 * Usecs a blocking recv spins on the ring before sleeping, and
+	 * when the oldest unanswered send was committed (for rtt stats).
+	 */
+	uint32_t		busy_poll_us;
+	ktime_t			rtt_start;
+	/*
+	 * Plain counters written under a lock the path holds anyway: tx_*
+	 * under tx_lock but tx_rndv_bytes under lock, rx_* under rx_lock
+	 * and the RMA ones under rma_info.rma_lock. Readers take unlocked
+	 * snapshots.
+	 */
+	struct scif_ep_stats	stats;
+	/* micscif_epitem of the sets this endpoint is in */
+	struct list_head	epitems;
+	/*
+	 * While qp_mapped a process drives the QP through micscif_qp_mmap()
+	 * and kernel send/recv back off. It is changed holding tx_lock,
+	 * rx_lock and lock. qp_mmap_lock serializes faults with revocation.
+	 */
+	bool			qp_mapped;
+	int			qp_mmap_cnt;
+	uint64_t		qp_mmap_off;	/* Handed out by SCIF_QP_INFO */
+	struct mutex		qp_mmap_lock;
+	struct address_space	*qp_mmap_mapping;
 
 #ifdef CONFIG_MMU_NOTIFIER
 	struct list_head	mmu_list;
@@ -475,6 +765,20 @@ struct endpt {
 	struct endpt		*listenep;	/* associated listen ep */
 };
 
+/*
+ * Wait for senders and receivers which found @ep connected to be done
+ * with its QP. ep->state must no longer be SCIFEP_CONNECTED so that
+ * nobody gets in afterwards.
+ */
+static __always_inline void
+micscif_ep_quiesce(struct endpt *ep)
+{
+	spin_lock(&ep->tx_lock);
+	spin_unlock(&ep->tx_lock);
+	spin_lock(&ep->rx_lock);
+	spin_unlock(&ep->rx_lock);
+}
+
 static __always_inline void
 micscif_queue_for_cleanup(struct reg_range_t *window, struct list_head *list)
 {
@@ -490,7 +794,10 @@ micscif_queue_for_cleanup(struct reg_range_t *window, struct list_head *list)
 static __always_inline void
 __micscif_rma_destroy_tcw_helper(struct reg_range_t *window)
 {
-	list_del(&window->list_member);
+	struct endpt *ep = (struct endpt *)window->ep;
+	list_del(&window->tc_lru);
+	ep->rma_info.tc_lru_pages -= window->nr_pages;
+	micscif_remove_window(window);
 	micscif_queue_for_cleanup(window, &ms_info.mi_rma_tc);
 }
 
@@ -507,6 +814,8 @@ void scif_proc_init(void);
 void scif_proc_cleanup(void);
 int scif_user_send(scif_epd_t epd, void *msg, int len, int flags);
 int scif_user_recv(scif_epd_t epd, void *msg, int len, int flags);
+int scif_user_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
+int scif_user_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
 int __scif_pin_pages(void *addr, size_t len, int *out_prot,
 	int map_flags, scif_pinned_pages_t *pages);
 scif_epd_t __scif_open(void);
@@ -518,6 +827,23 @@ int __scif_accept(scif_epd_t epd, struct scif_portID *peer, scif_epd_t
 int __scif_close(scif_epd_t epd);
 int __scif_send(scif_epd_t epd, void *msg, int len, int flags);
 int __scif_recv(scif_epd_t epd, void *msg, int len, int flags);
+int __scif_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
+int __scif_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
+int __scif_busy_poll(scif_epd_t epd, int usecs);
+int __scif_dgram_bind(scif_epd_t epd, uint16_t pn);
+int scif_user_sendto(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *dst);
+int scif_user_recvfrom(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *src);
+void micscif_dgram_deliver(struct micscif_dgram *dg);
+int scif_user_qp_info(scif_epd_t epd, struct scifioctl_qp_info *info);
+int scif_user_qp_notify(scif_epd_t epd, int flags);
+int __scif_get_stats(scif_epd_t epd, struct scif_ep_stats *stats);
+void micscif_ep_stats_fold(struct endpt *ep);
+void micscif_qp_mmap_revoke(struct endpt *ep);
+int __scif_epoll_ctl(scif_epset_t set, int op, scif_epd_t epd,
+struct scif_epoll_event *event);
+void micscif_epoll_ep_close(struct endpt *ep);
 off_t __scif_register(scif_epd_t epd, void *addr, size_t len, off_t offset,
 int prot_flags, int map_flags);
 int __scif_unregister(scif_epd_t epd, off_t offset, size_t len);
@@ -541,6 +867,8 @@ void micscif_misc_handler(struct work_struct *work);
 uint16_t rsrv_scif_port(uint16_t port);
 uint16_t get_scif_port(void);
 void put_scif_port(uint16_t port);
+int scif_port_bench(char *buf, int len);
+int scif_window_bench(char *buf, int len);
 
 void micscif_send_exit(void);
 
@@ -806,7 +1134,7 @@ scif_invalidate_connected_ep(int node)
 			ep->state = SCIFEP_DISCONNECTED;
 			list_add_tail(&ep->list, &ms_info.mi_disconnected);
 			ep->sd_state = SCIFDEV_STOPPED;
-			wake_up_interruptible(&ep->sendwq);
+			wake_up(&ep->sendwq);
 			wake_up_interruptible(&ep->recvwq);
 			wake_up_interruptible(&ep->conwq);
 			spin_unlock(&ep->lock);
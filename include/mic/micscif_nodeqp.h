@@ -40,6 +40,7 @@
 #ifndef MICSCIF_NODEQP
 #define MICSCIF_NODEQP
 
+#include <linux/completion.h>
 #include "micscif_rb.h"
 
 				   /* Payload Description */
@@ -111,7 +112,16 @@
 #define SCIF_NODE_ADD_NACK	60 /* SCIF_NODE_ADD failed report to the waiting thread(s) */
 #define SCIF_GET_NODE_INFO	61 /* Get current node mask from the host*/
 #define SCIF_TEST		62 /* Test value Used for test only */
-#define SCIF_MAX_MSG		SCIF_TEST
+#define SCIF_RNDV_REQ		63 /* Advertise a registered send buffer for the peer to pull */
+#define SCIF_RNDV_ACK		64 /* Peer is done pulling from an advertised send buffer */
+#define SCIF_RNDV_CANCEL	65 /* Sender gave up on an advertised send buffer */
+#define SCIF_NODEQP_ADD		66 /* Lane index and phys addr of an extra node QP */
+#define SCIF_NODEQP_ADD_ACK	67 /* Lane index and phys addr of the peer's end */
+#define SCIF_NODEQP_ADD_NACK	68 /* Peer does not want that many lanes */
+#define SCIF_DGRAM_QP		69 /* Phys addr of our end of the datagram QP */
+#define SCIF_DGRAM_QP_ACK	70 /* Phys addr of the peer's end of the datagram QP */
+#define SCIF_DGRAM_SENT		71 /* Datagrams were written to the datagram QP */
+#define SCIF_MAX_MSG		SCIF_DGRAM_SENT
 
 
 /*
@@ -134,6 +144,32 @@ struct nodemsg {
 } __attribute__ ((packed));
 
 
+/*
+ * Node QP messages are dispatched in one of two classes. SCIF_MSG_PRIO_HIGH
+ * messages are picked out of the ring ahead of SCIF_MSG_PRIO_LOW ones which
+ * were written before them. Only messages which do not depend on an earlier
+ * message from the same node having been handled may be SCIF_MSG_PRIO_HIGH.
+ */
+#define SCIF_MSG_PRIO_LOW	0
+#define SCIF_MSG_PRIO_HIGH	1
+
+/* How many messages past the read offset the high class is looked for */
+#define SCIF_NODEQP_LOOKAHEAD	BITS_PER_LONG
+
+/*
+ * Per message type dispatch statistics, see /sys/kernel/debug/mic_debug.
+ * Handling time is only accounted with enable_nodeqp_stats set.
+ */
+struct micscif_msg_stats {
+	atomic_long_t	cnt;		/* Messages handled */
+	atomic_long_t	ahead;		/* ... of which out of ring order */
+	atomic_long_t	ns;		/* Total time in the handler */
+	long		max_ns;		/* Longest time in the handler */
+};
+
+extern struct micscif_msg_stats micscif_msg_stats[SCIF_MAX_MSG + 1];
+extern const uint8_t micscif_msg_prio[SCIF_MAX_MSG + 1];
+
 /*
  * Generic state used for certain node QP message exchanges
  * like Unregister, Alloc etc.
@@ -157,6 +193,20 @@ struct allocmsg {
 	wait_queue_head_t	allocwq;
 };
 
+/*
+ * The words of an endpoint QP which the peer writes: the write pointer of
+ * our inbound ring, the read pointer of our outbound ring and the flags
+ * described with peer_recv_waiting below. Mirrored by struct scif_qp_ctrl
+ * for user space.
+ */
+struct micscif_qp_ctrl {
+	volatile uint32_t	write;
+	volatile uint32_t	read;
+	volatile uint32_t	recv_waiting;
+	volatile uint32_t	send_waiting;
+	volatile uint32_t	recv_polling;
+};
+
 /* Interesting structure -- a little difficult because we can only
  * write across the PCIe, so any r/w pointer we need to read is
  * local.  We only need to read the read pointer on the inbound_q
@@ -181,8 +231,51 @@ struct micscif_qp {
 	volatile uint32_t	qp_state;
 #define QP_OFFLINE	0xdead
 #define QP_ONLINE	0xc0de
+	/*
+	 * Endpoint QPs only. Set by the peer in our copy of the QP before
+	 * it blocks waiting for data from us (peer_recv_waiting) or for us
+	 * to free space in its outbound ring (peer_send_waiting), so that
+	 * SCIF_CLIENT_SENT/RCVD can be skipped while nobody is waiting.
+	 * The waiter clears its flag once it has made progress. The peer
+	 * sets peer_recv_polling while it busy polls the ring, in which
+	 * case it does not need SCIF_CLIENT_SENT either.
+	 */
+	volatile uint32_t	peer_recv_waiting;
+	volatile uint32_t	peer_send_waiting;
+	volatile uint32_t	peer_recv_polling;
+	uint32_t		caps;		/* SCIF_QP_CAP_* of the peer */
+	uint32_t		rcvd_pending;	/* Bytes consumed since last RCVD */
+	uint32_t		recv_armed;	/* We set the peer's recv flag */
+	uint32_t		send_armed;	/* We set the peer's send flag */
+	dma_addr_t		remote_qp_addr;	/* What remote_qp maps */
+	/*
+	 * With SCIF_QP_CAP_MMAP the peer keeps the ring pointers and flags
+	 * above in here instead. It is alone on the last page of the QP so
+	 * that it can be mapped into user space, see micscif_qp_mmap().
+	 */
+	struct micscif_qp_ctrl	ctrl __attribute__((aligned(PAGE_SIZE)));
 };
 
+/*
+ * The ring pointers and flags of @qp which the peer writes, and those of
+ * the peer's QP which we write. Both sides agree on SCIF_QP_CAP_MMAP
+ * before the rings are set up.
+ */
+#define __micscif_qp_word(q, caps, cw, w) \
+	(((caps) & SCIF_QP_CAP_MMAP) ? &(q)->ctrl.cw : &(q)->w)
+#define micscif_qp_local_write(qp) \
+	__micscif_qp_word(qp, (qp)->caps, write, local_write)
+#define micscif_qp_local_read(qp) \
+	__micscif_qp_word(qp, (qp)->caps, read, local_read)
+#define micscif_qp_remote_write(qp) \
+	__micscif_qp_word((qp)->remote_qp, (qp)->caps, write, local_write)
+#define micscif_qp_remote_read(qp) \
+	__micscif_qp_word((qp)->remote_qp, (qp)->caps, read, local_read)
+#define micscif_qp_flag(qp, f) \
+	(*__micscif_qp_word(qp, (qp)->caps, f, peer_##f))
+#define micscif_qp_remote_flag(qp, f) \
+	(*__micscif_qp_word((qp)->remote_qp, (qp)->caps, f, peer_##f))
+
 /*
  * An element in the loopback Node QP message list.
  */
@@ -191,10 +284,32 @@ struct loopb_msg {
 	struct list_head	list_member;
 };
 
+/*
+ * An extra node QP to a remote node. Endpoint notifications are hashed
+ * onto the lanes of a node so that they do not all serialize on the
+ * send lock and the interrupt work of qpairs[0]. Each lane is drained
+ * by its own work item, on a CPU of its own where there are enough.
+ * Users which sleep on an online lane hold a reference to it, the one
+ * taken at allocation is dropped when the lanes are torn down.
+ */
+struct micscif_nodeqp_lane {
+	struct micscif_qp	*qp;
+	struct micscif_dev	*scifdev;
+	int			idx;
+	int			cpu;
+	struct mutex		lock;		/* Serializes readers of the lane */
+	struct work_struct	work;
+	atomic_t		ref;
+	struct completion	released;	/* ref dropped to zero */
+};
+
+struct micscif_dgram;
+
 struct micscif_qp *micscif_nodeqp_nextmsg(struct micscif_dev *scifdev);
 int micscif_nodeqp_send(struct micscif_dev *scifdev, struct nodemsg *msg, struct endpt *ep);
 int micscif_nodeqp_intrhandler(struct micscif_dev *scifdev, struct micscif_qp *qp);
 int micscif_loopb_msg_handler(struct micscif_dev *scifdev, struct micscif_qp *qp);
+const char *micscif_msg_name(uint32_t uop);
 
 // Card side only functions
 int micscif_setup_card_qp(phys_addr_t host_phys, struct micscif_dev *dev);
@@ -205,7 +320,18 @@ int micscif_setup_qp_accept(struct micscif_qp *qp, dma_addr_t *qp_offset, dma_ad
 int micscif_setup_qp_connect_response(struct micscif_dev *scifdev, struct micscif_qp *qp, uint64_t payload);
 int micscif_setup_loopback_qp(struct micscif_dev *scifdev);
 int micscif_destroy_loopback_qp(struct micscif_dev *scifdev);
+int micscif_teardown_qp(struct micscif_qp *qp, struct micscif_dev *dev);
 int micscif_teardown_ep(void *endpt);
+void micscif_nodeqp_lanes_init(struct micscif_dev *scifdev);
+void micscif_nodeqp_lanes_uninit(struct micscif_dev *scifdev);
+void micscif_qp_pool_init(struct micscif_dev *scifdev);
+void micscif_qp_pool_fill(struct micscif_dev *scifdev);
+void micscif_qp_pool_drain(struct micscif_dev *scifdev);
+struct micscif_qp *micscif_qp_pool_get(struct micscif_dev *scifdev, uint32_t size);
+void micscif_dgram_init(struct micscif_dev *scifdev);
+void micscif_dgram_start(struct micscif_dev *scifdev);
+void micscif_dgram_stop(struct micscif_dev *scifdev);
+int micscif_dgram_send(struct micscif_dev *scifdev, struct micscif_dgram *dg);
 void micscif_add_epd_to_zombie_list(struct endpt *ep, bool mi_eplock_held);
 
 #endif  /* MICSCIF_NODEQP */
@@ -100,6 +100,7 @@ struct micscif_rb {
 	uint32_t current_write_offset;	/* cache it to improve performance */
 	uint32_t old_current_read_offset;
 	uint32_t old_current_write_offset;
+	uint32_t nt_copy;	/* rb_base is remote WC memory, see micscif_rb_set_nt() */
 };
 
 /**
@@ -112,6 +113,10 @@ void micscif_rb_init(struct micscif_rb *rb, volatile uint32_t *read_ptr,
 /**
  * writer-only methods
  */
+/*
+ * Write messages with non-temporal stores, the ring lives across the bus
+ */
+void micscif_rb_set_nt(struct micscif_rb *rb, bool nt_copy);
 /*
  * write a new command, then micscif_rb_commit()
  */
@@ -124,6 +129,10 @@ void micscif_rb_commit(struct micscif_rb *rb);
  * used on power state change to reset cached pointers
  */
 void micscif_rb_reset(struct micscif_rb *rb);
+/*
+ * reload cached pointers after the RB was driven from user space
+ */
+void micscif_rb_resync(struct micscif_rb *rb);
 
 /*
  * Query space available for writing to a RB.
@@ -148,6 +157,12 @@ int micscif_rb_space(struct micscif_rb *rb);
  */
 int micscif_rb_get_next (struct micscif_rb *rb, void *msg, uint32_t size, bool touser);
 
+/*
+ * Copy out the message skip bytes past the next one to be read without
+ * consuming anything. Returns size if it is there, 0 otherwise.
+ */
+int micscif_rb_peek(struct micscif_rb *rb, uint32_t skip, void *msg, uint32_t size);
+
 /*
  * updates the control block read pointer,
  * which will be visible to the writer so it can re-use the space
@@ -72,11 +72,13 @@
 #include <linux/sched.h>
 #include <linux/delay.h>
 #include <linux/wait.h>
+#include <linux/completion.h>
 #include <asm/bug.h>
 #include <linux/pci.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/workqueue.h>
 #include <linux/interrupt.h>
 #include <asm/atomic.h>
@@ -91,6 +93,8 @@ struct rma_mmu_notifier {
 	bool			ep_mn_registered;
 	/* List of temp registration windows for self */
 	struct list_head	tc_reg_list;
+	/* tc_reg_list indexed by va_for_temp */
+	struct rb_root		tc_reg_tree;
 	struct mm_struct	*mm;
 	struct endpt		*ep;
 	struct list_head	list_member;
@@ -102,6 +106,9 @@ struct endpt_rma_info {
 	struct list_head	reg_list;
 	/* List of registration windows for peer */
 	struct list_head	remote_reg_list;
+	/* reg_list and remote_reg_list indexed by offset */
+	struct rb_root		reg_tree;
+	struct rb_root		remote_reg_tree;
 	/* Offset generator */
 	struct va_gen_addr	va_gen;
 	/*
@@ -115,6 +122,13 @@ struct endpt_rma_info {
 	 * for SCIF Registration Caching.
 	 */
 	spinlock_t		tc_lock;
+	/*
+	 * Cached temporary windows of every mmu notifier of this endpoint,
+	 * least recently used first, and the number of pages they pin.
+	 * Protected by tc_lock.
+	 */
+	struct list_head	tc_lru;
+	int64_t			tc_lru_pages;
 	/*
 	 * Synchronizes access to the list of MMU notifiers
 	 * registered for this SCIF endpoint.
@@ -154,8 +168,40 @@ struct endpt_rma_info {
 	 * DMA channel used for all DMA transfers for this endpoint.
 	 */
 	struct dma_channel	*dma_chan;
+	/*
+	 * Further channels large RMAs are striped across when they are
+	 * idle, see micscif_rma_list_dma_copy_striped().
+	 */
+	struct dma_channel	*dma_chan_extra[SCIF_RMA_DMA_CHAN_MAX - 1];
+	int			nr_dma_chan_extra;
 	/* Detect asynchronous list entry deletion */
 	int			async_list_del;
+	/*
+	 * RMAs queued by scif_readfrom_async()/scif_writeto_async() and not
+	 * yet started, those the DMA engine is still working on and those
+	 * completed which the user has not reaped yet, oldest first, see
+	 * struct micscif_rma_async. All three and the counters are protected
+	 * by async_lock. async_work runs the RMAs on mi_rma_async_wq and
+	 * async_wq is woken whenever an RMA completes. Rather than waiting
+	 * for the DMA, async_work is queued again by async_dma_cb, which
+	 * follows every mark on the interrupt ring; async_dma_cbs counts
+	 * those the engine has not reached yet plus one held by the endpoint
+	 * until micscif_rma_async_drain(). Whoever drops it to zero completes
+	 * async_dma_done.
+	 */
+	spinlock_t		async_lock;
+	struct list_head	async_pending;
+	struct list_head	async_inflight;
+	struct list_head	async_cq;
+	uint64_t		async_cookie;
+	int			async_nr;
+	int			async_busy;
+	int			async_again;
+	struct work_struct	async_work;
+	wait_queue_head_t	async_wq;
+	struct dma_completion_cb	async_dma_cb;
+	atomic_t		async_dma_cbs;
+	struct completion	async_dma_done;
 #ifdef _MIC_SCIF_
 	/* Local P2P proxy DMA virtual address for SUD updates by peer */
 	void			*proxy_dma_va;
@@ -260,6 +306,8 @@ struct reg_range_t {
 	void			*va_for_temp;
 	/* Used for temporary windows*/
 	int			dma_mark;
+	/* Position in the endpoint temp cache LRU, see endpt_rma_info */
+	struct list_head	tc_lru;
 	/*
 	 * Pointer to EP. Useful for passing EP around
 	 * with messages to avoid expensive list
@@ -269,6 +317,18 @@ struct reg_range_t {
 
 	struct list_head	list_member;
 
+	/*
+	 * Interval tree node mirroring list_member. rb_start/rb_end is the
+	 * [offset, offset + len) or, for temp windows, the virtual address
+	 * range the window is keyed by and rb_max_end the largest rb_end
+	 * in this subtree. rb_tree is NULL when not on a tree.
+	 */
+	struct rb_node		rb_node;
+	struct rb_root		*rb_tree;
+	uint64_t		rb_start;
+	uint64_t		rb_end;
+	uint64_t		rb_max_end;
+
 	enum rma_window_type	type;
 
 	/*
@@ -372,6 +432,23 @@ enum rma_direction {
 	REMOTE_TO_LOCAL
 };
 
+/* Most asynchronous RMAs an endpoint may have queued or unreaped */
+#define SCIF_RMA_ASYNC_MAX	1024
+
+/* An RMA queued by scif_readfrom_async() or scif_writeto_async() */
+struct micscif_rma_async {
+	struct list_head	list_member;
+	uint64_t		cookie;
+	off_t			loffset;
+	size_t			len;
+	off_t			roffset;
+	int			flags;
+	enum rma_direction	dir;
+	/* DMA mark the RMA completes with, -1 if it already has */
+	int			mark;
+	int			status;
+};
+
 /* Initialize RMA for this EP */
 int micscif_rma_ep_init(struct endpt *ep);
 
@@ -447,6 +524,13 @@ int micscif_send_fence_signal(scif_epd_t epd, off_t roff, uint64_t rval,
 /* Setup a DMA mark for an endpoint */
 int micscif_fence_mark(scif_epd_t epd);
 
+/* Asynchronous RMAs with completion cookies */
+int micscif_rma_async_submit(struct endpt *ep, off_t loffset, size_t len,
+	off_t roffset, int flags, enum rma_direction dir, uint64_t *cookie);
+int micscif_rma_async_reap(struct endpt *ep,
+	struct scif_rma_completion *comp, int nr, long timeout, bool touser);
+void micscif_rma_async_drain(struct endpt *ep);
+
 void ep_unregister_mmu_notifier(struct endpt *ep);
 #ifdef CONFIG_MMU_NOTIFIER
 void micscif_mmu_notif_handler(struct work_struct *work);
@@ -614,6 +698,7 @@ vwriteto_err:
 void micscif_rma_completion_cb(uint64_t data);
 
 int micscif_pci_dev(uint16_t node, struct pci_dev **pdev);
+int micscif_numa_node(uint16_t node);
 #ifndef _MIC_SCIF_
 int micscif_pci_info(uint16_t node, struct scif_pci_info *dev);
 #endif
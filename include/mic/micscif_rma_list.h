@@ -69,6 +69,7 @@ struct micscif_rma_req {
 	int prot;
 	enum range_request type;
 	struct list_head *head;
+	struct rb_root *tree;
 	void *va_for_temp;
 };
 
@@ -120,9 +121,12 @@ struct mic_copy_work {
 };
 
 /* Insert */
-void micscif_insert_window(struct reg_range_t *window, struct list_head *head);
+void micscif_insert_window(struct reg_range_t *window, struct list_head *head,
+				struct rb_root *tree);
 void micscif_insert_tcw(struct reg_range_t *window,
-					struct list_head *head);
+			struct list_head *head, struct rb_root *tree);
+/* Remove from the list and tree the window was inserted on */
+void micscif_remove_window(struct reg_range_t *window);
 
 /* Query */
 int micscif_query_window(struct micscif_rma_req *request);
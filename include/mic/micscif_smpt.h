@@ -83,14 +83,39 @@
 #define MIC_SYSTEM_PAGE_SHIFT 	34ULL
 #define MIC_SYSTEM_PAGE_MASK 	((1ULL << MIC_SYSTEM_PAGE_SHIFT) - 1ULL)
 
+/* Buckets in the dma_addr to SMPT entry lookup hash, must be a power of 2 */
+#define SMPT_HASH_BITS		5
+#define SMPT_HASH_SIZE		(1 << SMPT_HASH_BITS)
+
 struct _mic_ctx_t;
 struct pci_dev;
+struct scatterlist;
 
+/*
+ * @hash_next - next SMPT entry in the same lookup hash bucket or -1
+ */
 typedef struct mic_smpt {
 	dma_addr_t dma_addr; 
 	int64_t ref_count;
+	int hash_next;
 } mic_smpt_t;
 
+/*
+ * struct mic_smpt_stats - SMPT allocator statistics, protected by smpt_lock
+ * @map_count - number of successful range mappings
+ * @unmap_count - number of range unmappings
+ * @reuse_count - mappings served by entries already pointing at the range
+ * @alloc_count - mappings which had to program free entries
+ * @fail_count - mappings which found neither a matching nor a free range
+ */
+struct mic_smpt_stats {
+	uint64_t map_count;
+	uint64_t unmap_count;
+	uint64_t reuse_count;
+	uint64_t alloc_count;
+	uint64_t fail_count;
+};
+
 
 /* Sbox Smpt Reg Bits:
  * Bits 	31:2	Host address
@@ -109,6 +134,10 @@ dma_addr_t mic_map_single(int bid, struct pci_dev *hwdev, void *p, size_t size);
 void mic_unmap_single(int bid, struct pci_dev *hwdev, dma_addr_t mic_addr,
 		size_t size);
 
+int mic_map_sg(int bid, struct pci_dev *hwdev, struct scatterlist *sg, int nents);
+void mic_unmap_sg(int bid, struct pci_dev *hwdev, struct scatterlist *sg,
+		int nents, int mapped);
+
 dma_addr_t mic_ctx_map_single(struct _mic_ctx_t *mic_ctx, void *p, size_t size);
 void mic_ctx_unmap_single(struct _mic_ctx_t *mic_ctx, dma_addr_t dma_addr,
 		size_t size);
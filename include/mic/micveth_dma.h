@@ -184,6 +184,7 @@ struct sched_node {
 	uint64_t		 dma_size;
 	uint64_t		 dma_offset;
 	uint64_t		 dst_phys;
+	struct mic_dma_buf	*dma_buf;	/* Host only: pre-mapped copy of the skb */
 };
 
 struct obj_list {
@@ -88,6 +88,7 @@ extern "C" {
 #include <mic/io_interface.h>
 #include <mic/mic_pm.h>
 #include <mic/mic_dma_api.h>
+#include <mic/mic_dma_pool.h>
 #include <mic/micveth_common.h>
 #include <mic/micscif_nm.h>
 
@@ -422,6 +423,12 @@ typedef struct _mic_ctx_t {
 	uint32_t		boot_mem;
 	mic_smpt_t		*mic_smpt;
 	spinlock_t		smpt_lock;
+	/* SMPT entries with a non zero reference count */
+	unsigned long		smpt_busy[BITS_TO_LONGS(NUM_SMPT_ENTRIES_IN_USE)];
+	/* Heads of the dma_addr to SMPT entry hash chains */
+	int			smpt_hash[SMPT_HASH_SIZE];
+	struct mic_smpt_stats	smpt_stats;
+	struct mic_dma_pool	dma_pool;
 	uint32_t		sdbic1;
 	int64_t			etc_comp;
 	spinlock_t		ramoops_lock;
@@ -447,7 +454,10 @@ typedef struct _mic_ctx_t {
 	char			sku_name[SKU_NAME_LEN];
 	atomic_t		disconn_rescnt;
 	atomic_t		gate_interrupt;
-	uint16_t            numa_node;
+	int			numa_node;	/* Node DMA-visible memory is placed on, or -1 */
+#ifdef MIC_DMA_EMULATION
+	bool			bi_emul;	/* MMIO and aperture are host memory, see mic_emul_probe() */
+#endif
 } mic_ctx_t;
 
 typedef struct mic_irqhander {
@@ -110,6 +110,7 @@ int micpm_suspend_noirq(struct device *pdev);
 int micpm_resume_noirq(struct device *pdev);
 int micpm_notifier_block(struct notifier_block *nb, unsigned long event, void *dummy);
 irqreturn_t mic_irq_isr(int irq, void *data);
+void mic_irq_affinity_hint(mic_ctx_t *mic_ctx, unsigned int irq, bool set);
 
 int mic_psmi_init(mic_ctx_t *mic_ctx);
 void mic_psmi_uninit(mic_ctx_t *mic_ctx);
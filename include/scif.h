@@ -49,6 +49,7 @@
 #include <linux/errno.h>
 #include <linux/poll.h>
 #include <linux/pci.h>
+#include <linux/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -99,6 +100,18 @@ enum {
 #define SCIF_POLLERR		POLLERR
 #define SCIF_POLLHUP		POLLHUP
 #define SCIF_POLLNVAL		POLLNVAL
+#define SCIF_POLLRMA		POLLPRI
+
+/* scif_epoll_ctl() operations */
+#define SCIF_EPOLL_CTL_ADD	1
+#define SCIF_EPOLL_CTL_DEL	2
+#define SCIF_EPOLL_CTL_MOD	3
+
+/* Report an endpoint once per wakeup instead of while it stays ready */
+#define SCIF_EPOLLET		(1U << 31)
+
+/* Largest message carried by scif_sendto() */
+#define SCIF_DGRAM_MAX_LEN	2048
 
 /* SCIF Reserved Ports */
 /* COI */
@@ -211,6 +224,8 @@ typedef struct endpt *scif_epd_t;
 
 typedef struct scif_pinned_pages *scif_pinned_pages_t;
 
+typedef struct micscif_epset *scif_epset_t;
+
 struct scif_range {
 	void *cookie;		/* cookie */
 	int nr_pages;		/* Number of Pages */
@@ -229,6 +244,38 @@ struct scif_pollepd {
 	short events;     /* requested events */
 	short revents;    /* returned events */
 };
+
+struct scif_epoll_event {
+	uint32_t events;  /* requested or returned events */
+	uint32_t pad;     /* same layout for 32 and 64 bit callers */
+	uint64_t data;    /* caller cookie returned with the events */
+};
+
+/* Traffic of an endpoint, see scif_get_stats() */
+struct scif_ep_stats {
+	uint64_t tx_bytes;	  /* bytes written to the send queue */
+	uint64_t tx_msgs;	  /* writes to the send queue */
+	uint64_t tx_full;	  /* sends which found the send queue full */
+	uint64_t tx_notify;	  /* notification interrupts for sent data */
+	uint64_t tx_rndv_bytes;	  /* bytes of large sends the peer pulled */
+	uint64_t rx_bytes;	  /* bytes read from the receive queue */
+	uint64_t rx_msgs;	  /* reads from the receive queue */
+	uint64_t rx_empty;	  /* receives which found the queue empty */
+	uint64_t rx_notify;	  /* notification interrupts for freed space */
+	uint64_t rx_rndv_bytes;	  /* bytes pulled from the peer's large sends */
+	uint64_t rma_calls;	  /* scif_readfrom() and friends */
+	uint64_t rma_bytes;	  /* bytes they transferred */
+	uint64_t reg_cache_hits;  /* scif_v*() finding a cached registration */
+	uint64_t reg_cache_misses;/* scif_v*() registering the buffer */
+};
+
+/* An RMA completed, see scif_rma_completions() */
+struct scif_rma_completion {
+	uint64_t cookie;	/* returned by scif_readfrom/writeto_async() */
+	int status;		/* 0 or the negative error the RMA failed with */
+	int reserved;
+};
+
 enum scif_event_type {
 	SCIF_NODE_ADDED = 1<<0,
 	SCIF_NODE_REMOVED = 1<<1
@@ -640,6 +687,226 @@ int scif_send(scif_epd_t epd, void *msg, int len, int flags);
  */
 int scif_recv(scif_epd_t epd, void *msg, int len, int flags);
 
+/**
+ * scif_sendmsg - Send a message gathered from several buffers
+ *	\param epd		endpoint descriptor
+ *	\param iov		array of buffers
+ *	\param iovcnt		number of buffers in iov
+ *	\param flags		blocking mode flags
+ *
+ * scif_sendmsg() behaves like scif_send() called with the concatenation of
+ * the iovcnt buffers described by iov. The data is written to the send queue
+ * in a single operation, so the peer is notified once rather than once per
+ * buffer and a header and payload pair need not be copied into one buffer
+ * first. The sum of the buffer lengths is limited like the len argument of
+ * scif_send().
+ *
+ * The flags argument is formed by ORing together zero or more of the following
+ * values:
+ *- SCIF_SEND_BLOCK: block until the entire message is sent.
+ *
+ *\return
+ * Upon successful completion, scif_sendmsg() returns the number of bytes
+ * sent; otherwise: in user mode -1 is returned and errno is set to indicate
+ * the error; in kernel mode the negative of one of the following errors is
+ * returned.
+ *
+ *\par Errors:
+ * The errors of scif_send(), and
+ *- EINVAL
+ * - iovcnt is negative or greater than UIO_MAXIOV, or
+ * - the total length of the buffers does not fit in an int
+ */
+int scif_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
+
+/**
+ * scif_recvmsg - Receive a message scattered to several buffers
+ *	\param epd		endpoint descriptor
+ *	\param iov		array of buffers
+ *	\param iovcnt		number of buffers in iov
+ *	\param flags		blocking mode flags
+ *
+ * scif_recvmsg() behaves like scif_recv() called with the concatenation of
+ * the iovcnt buffers described by iov, filling each buffer in turn. The
+ * sum of the buffer lengths is limited like the len argument of scif_recv().
+ *
+ * The flags argument is formed by ORing together zero or more of the following
+ * values:
+ *- SCIF_RECV_BLOCK: block until the entire message is received.
+ *
+ *\return
+ * Upon successful completion, scif_recvmsg() returns the number of bytes
+ * received; otherwise: in user mode -1 is returned and errno is set to
+ * indicate the error; in kernel mode the negative of one of the following
+ * errors is returned.
+ *
+ *\par Errors:
+ * The errors of scif_recv(), and
+ *- EINVAL
+ * - iovcnt is negative or greater than UIO_MAXIOV, or
+ * - the total length of the buffers does not fit in an int
+ */
+int scif_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags);
+
+/**
+ * scif_busy_poll - Set the receive busy poll time of an endpoint
+ *	\param epd		endpoint descriptor
+ *	\param usecs		time to poll for in microseconds
+ *
+ * A blocking scif_recv() or scif_recvmsg() on epd which finds no data
+ * normally sleeps until the peer's notification interrupt. With usecs
+ * greater than zero it first polls the receive queue for up to usecs,
+ * during which the peer does not send a notification, trading CPU time
+ * for latency on request/response traffic. New endpoints take the default
+ * from the busy_poll attribute of the scif device, and endpoints returned
+ * by scif_accept() inherit the setting of the listening endpoint.
+ *
+ *\return
+ * Upon successful completion, scif_busy_poll() returns 0; otherwise: in user
+ * mode -1 is returned and errno is set to indicate the error; in kernel mode
+ * the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EINVAL
+ * - usecs is negative or greater than 10000
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_busy_poll(scif_epd_t epd, int usecs);
+
+/**
+ * scif_dgram_bind - Bind an endpoint to a port for datagrams
+ *	\param epd		endpoint descriptor
+ *	\param pn		port number
+ *
+ * scif_dgram_bind() binds endpoint epd to port pn like scif_bind() and
+ * makes it a datagram endpoint. A datagram endpoint is never connected;
+ * it exchanges messages of up to SCIF_DGRAM_MAX_LEN bytes with any other
+ * datagram endpoint through scif_sendto() and scif_recvfrom(). Messages
+ * between a pair of nodes share one queue, so there is no per endpoint
+ * setup on either side.
+ *
+ *\return
+ * Upon successful completion, scif_dgram_bind() returns the port number
+ * to which epd is bound; otherwise: in user mode -1 is returned and errno
+ * is set to indicate the error; in kernel mode the negative of one of the
+ * following errors is returned.
+ *
+ *\par Errors:
+ * The errors of scif_bind().
+ */
+int scif_dgram_bind(scif_epd_t epd, uint16_t pn);
+
+/**
+ * scif_sendto - Send a datagram
+ *	\param epd		endpoint descriptor
+ *	\param msg		message buffer address
+ *	\param len		message length
+ *	\param flags		must be 0
+ *	\param dst		node and port of the destination endpoint
+ *
+ * scif_sendto() queues the len bytes at msg for the datagram endpoint
+ * bound to dst. It never blocks. Delivery is not guaranteed: a message
+ * is dropped without an error if the queue to the destination node is
+ * full, if no datagram endpoint is bound to the destination port, or if
+ * that endpoint already holds too many unread messages. Messages from one
+ * endpoint to another which are not dropped arrive in order.
+ *
+ *\return
+ * Upon successful completion, scif_sendto() returns len; otherwise: in
+ * user mode -1 is returned and errno is set to indicate the error; in
+ * kernel mode the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EFAULT
+ * - An invalid address was specified for a parameter.
+ *- EINVAL
+ * - epd is not a datagram endpoint, or
+ * - flags is invalid, or
+ * - len is not between 1 and SCIF_DGRAM_MAX_LEN
+ *- ENODEV
+ * - The destination node does not exist, or
+ * - The remote node is lost.
+ *- ENOMEM
+ * - Not enough space.
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_sendto(scif_epd_t epd, void *msg, int len, int flags,
+		struct scif_portID *dst);
+
+/**
+ * scif_recvfrom - Receive a datagram
+ *	\param epd		endpoint descriptor
+ *	\param msg		message buffer address
+ *	\param len		message buffer length
+ *	\param flags		blocking mode flags
+ *	\param src		returns node and port of the sending endpoint
+ *
+ * scif_recvfrom() takes the oldest message queued for datagram endpoint
+ * epd and copies up to len bytes of it to msg. The rest of a message
+ * longer than len is discarded. If src is not NULL the sender's node and
+ * port are stored there.
+ *
+ * The flags argument is formed by ORing together zero or more of the following
+ * values:
+ *- SCIF_RECV_BLOCK: block until a message is available.
+ *
+ *\return
+ * Upon successful completion, scif_recvfrom() returns the number of bytes
+ * copied to msg; otherwise: in user mode -1 is returned and errno is set
+ * to indicate the error; in kernel mode the negative of one of the
+ * following errors is returned.
+ *
+ *\par Errors:
+ *- EAGAIN
+ * - SCIF_RECV_BLOCK is not set and no message is queued.
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EFAULT
+ * - An invalid address was specified for a parameter.
+ *- EINTR
+ * - Interrupted function
+ *- EINVAL
+ * - epd is not a datagram endpoint, or
+ * - flags is invalid, or
+ * - len is negative.
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_recvfrom(scif_epd_t epd, void *msg, int len, int flags,
+		struct scif_portID *src);
+
+/**
+ * scif_get_stats - Read the traffic counters of an endpoint
+ *	\param epd		endpoint descriptor
+ *	\param stats		returns the counters
+ *
+ * scif_get_stats() copies the counters of epd, which start at zero when
+ * it is opened or accepted, to stats. The counters are updated without
+ * locks of their own, so a snapshot taken while traffic is flowing is not
+ * necessarily consistent across fields. The totals of all endpoints per
+ * remote node, including closed ones, are in the ep_stats debugfs file.
+ *
+ *\return
+ * Upon successful completion, scif_get_stats() returns 0; otherwise: in
+ * user mode -1 is returned and errno is set to indicate the error; in
+ * kernel mode the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EFAULT
+ * - An invalid address was specified for a parameter.
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_get_stats(scif_epd_t epd, struct scif_ep_stats *stats);
+
 /**
  * scif_register - Mark a memory region for remote access.
  *	\param epd		endpoint descriptor
@@ -666,7 +933,8 @@ int scif_recv(scif_epd_t epd, void *msg, int len, int flags);
  * offset+len-1] intersects an existing window.
  * Note: When SCIF_MAP_FIXED is set the current implementation limits
  * offset to the range [0..2^62-1] and returns EADDRINUSE if the offset
- * requested with SCIF_MAP_FIXED is in the range [2^62..2^63-1].
+ * requested with SCIF_MAP_FIXED is in the range [2^62..2^63-1]. Offsets
+ * from SCIF_QP_MMAP_BASE up are reserved for mapping the endpoint's QP.
  *
  * When SCIF_MAP_FIXED is not set, the implementation uses offset in an
  * implementation-defined manner to arrive at po. The po value so chosen will
@@ -1287,6 +1555,125 @@ int scif_fence_wait(scif_epd_t epd, int mark);
 int scif_fence_signal(scif_epd_t epd, off_t loff, uint64_t lval, off_t roff,
 uint64_t rval, int flags);
 
+/**
+ * scif_readfrom_async - Queue a copy from a remote address space
+ *	\param epd		endpoint descriptor
+ *	\param loffset		offset in local registered address space to
+ *				which to copy
+ *	\param len		length of range to copy
+ *	\param roffset		offset in remote registered address space
+ *				from which to copy
+ *	\param rma_flags	transfer mode flags
+ *	\param cookie		returns the handle of the RMA
+ *
+ * scif_readfrom_async() queues the copy scif_readfrom() would perform with
+ * the same arguments and returns at once, without waiting for the copy to
+ * start. The copy is identified by the value returned at cookie, which is
+ * unique for the lifetime of epd, and its result is reported by
+ * scif_rma_completions() once it has completed. SCIF_RMA_SYNC has no effect.
+ * RMAs queued on the same endpoint are started in the order they were queued
+ * but may complete in any order.
+ *
+ * Errors in the arguments, such as ranges outside the registered address
+ * spaces, are detected when the copy is started and are reported through
+ * scif_rma_completions(). An endpoint may have at most 1024 RMAs queued and
+ * not yet reaped by scif_rma_completions(). Closing epd waits for queued RMAs
+ * to complete and discards their completions.
+ *
+ *\return
+ * Upon successful completion, scif_readfrom_async() returns 0; otherwise: in
+ * user mode -1 is returned and errno is set to indicate the error; in kernel
+ * mode the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EAGAIN
+ * - epd already has the maximum number of RMAs queued or unreaped
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- ECONNRESET
+ * - A connection was forcibly closed by a peer.
+ *- EFAULT
+ * - An invalid address was specified for a parameter.
+ *- EINVAL
+ * - epd is not a valid endpoint descriptor, or
+ * - rma_flags is invalid
+ *- ENODEV
+ * - The remote node is lost.
+ *- ENOMEM
+ * - Insufficient kernel memory was available.
+ *- ENOTCONN
+ * - The endpoint is not connected
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_readfrom_async(scif_epd_t epd, off_t loffset, size_t len,
+off_t roffset, int rma_flags, uint64_t *cookie);
+
+/**
+ * scif_writeto_async - Queue a copy to a remote address space
+ *	\param epd		endpoint descriptor
+ *	\param loffset		offset in local registered address space
+ *				from which to copy
+ *	\param len		length of range to copy
+ *	\param roffset		offset in remote registered address space to
+ *				which to copy
+ *	\param rma_flags	transfer mode flags
+ *	\param cookie		returns the handle of the RMA
+ *
+ * scif_writeto_async() queues the copy scif_writeto() would perform with the
+ * same arguments and returns at once, as described for scif_readfrom_async().
+ *
+ *\return
+ * Upon successful completion, scif_writeto_async() returns 0; otherwise: in
+ * user mode -1 is returned and errno is set to indicate the error; in kernel
+ * mode the negative of one of the errors listed for scif_readfrom_async() is
+ * returned.
+ */
+int scif_writeto_async(scif_epd_t epd, off_t loffset, size_t len,
+off_t roffset, int rma_flags, uint64_t *cookie);
+
+/**
+ * scif_rma_completions - Reap completed asynchronous RMAs
+ *	\param epd		endpoint descriptor
+ *	\param comp		returns the completions
+ *	\param nr		number of entries in comp
+ *	\param timeout		Upper limit on time for which
+ *				scif_rma_completions() will block, in
+ *				milliseconds
+ *
+ * scif_rma_completions() stores up to nr completions of RMAs queued on epd by
+ * scif_readfrom_async() or scif_writeto_async() in comp, in the order the RMAs
+ * completed. Each completion holds the cookie of the RMA and its status, 0 if
+ * the copy succeeded or the negative of one of the errors scif_readfrom() or
+ * scif_writeto() would have returned. Every completion is returned once;
+ * those which could not be stored in comp are returned by a later call.
+ *
+ * If no RMA has completed, scif_rma_completions() blocks until one does or
+ * timeout milliseconds have passed. A timeout of 0 returns at once and a
+ * negative timeout waits without limit. scif_poll() with SCIF_POLLRMA may be
+ * used to wait for completions on several endpoints.
+ *
+ *\return
+ * Upon successful completion, scif_rma_completions() returns the number of
+ * completions stored in comp, 0 if the timeout expired first; otherwise: in
+ * user mode -1 is returned and errno is set to indicate the error; in kernel
+ * mode the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EFAULT
+ * - An invalid address was specified for a parameter.
+ *- EINTR
+ * - Interrupted function
+ *- EINVAL
+ * - nr is not positive
+ *- ENOTTY
+ * - epd is not a valid endpoint descriptor
+ */
+int scif_rma_completions(scif_epd_t epd, struct scif_rma_completion *comp,
+int nr, long timeout);
+
 /**
  * scif_get_nodeIDs - Return information about online nodes
  * 	\param nodes 		array in which to return online node IDs
@@ -1599,6 +1986,9 @@ int scif_put_pages(
  *- SCIF_POLLOUT: Data may be sent without blocking. For a connected endpoint,
  *  this means that scif_send() may be called without blocking. This bit value
  *  has no meaning for a listening endpoint and is ignored if specified.
+ *- SCIF_POLLRMA: An RMA queued by scif_readfrom_async() or scif_writeto_async()
+ *  has completed, so scif_rma_completions() returns without blocking. This bit
+ *  value has no meaning for a listening endpoint and is ignored if specified.
  *
  * The following bits are only returned in revents, and are ignored if set in
  * events:
@@ -1632,6 +2022,101 @@ scif_poll(
 	unsigned int nepds,
 	long timeout);
 
+/**
+ * scif_epoll_create - Create an endpoint readiness set
+ *
+ * scif_epoll_create() returns an empty set of endpoints to be watched with
+ * scif_epoll_wait(). Unlike scif_poll(), which examines and waits on every
+ * endpoint it is passed on each call, a set stays registered with its
+ * endpoints and keeps a list of the ones which may be ready, so the cost of
+ * scif_epoll_wait() depends on the number of ready endpoints rather than the
+ * number watched.
+ *
+ *\return
+ * Upon successful completion, scif_epoll_create() returns a set descriptor;
+ * otherwise NULL is returned.
+ */
+scif_epset_t scif_epoll_create(void);
+
+/**
+ * scif_epoll_ctl - Add, modify or remove an endpoint of a readiness set
+ *	\param set		set descriptor returned by scif_epoll_create()
+ *	\param op		SCIF_EPOLL_CTL_ADD, SCIF_EPOLL_CTL_MOD or
+ *				SCIF_EPOLL_CTL_DEL
+ *	\param epd		endpoint descriptor
+ *	\param event		events of interest and cookie, ignored for
+ *				SCIF_EPOLL_CTL_DEL
+ *
+ * The events field of event takes the events of scif_poll(), optionally
+ * ORed with SCIF_EPOLLET. SCIF_POLLERR and SCIF_POLLHUP are always
+ * reported. The data field is returned with the events of epd by
+ * scif_epoll_wait(). Only connected and listening endpoints may be added.
+ * Closing an endpoint removes it from all sets.
+ *
+ *\return
+ * Upon successful completion, scif_epoll_ctl() returns 0; otherwise: in user
+ * mode -1 is returned and errno is set to indicate the error; in kernel mode
+ * the negative of one of the following errors is returned.
+ *
+ *\par Errors:
+ *- EBADF
+ * - epd is not a valid endpoint descriptor
+ *- EEXIST
+ * - op is SCIF_EPOLL_CTL_ADD and epd is already in set
+ *- EINVAL
+ * - op is not a valid operation, or
+ * - epd is neither connected nor listening
+ *- ENOENT
+ * - op is SCIF_EPOLL_CTL_MOD or SCIF_EPOLL_CTL_DEL and epd is not in set
+ *- ENOMEM
+ * - Not enough space
+ */
+int scif_epoll_ctl(scif_epset_t set, int op, scif_epd_t epd,
+		struct scif_epoll_event *event);
+
+/**
+ * scif_epoll_wait - Wait for events on the endpoints of a readiness set
+ *	\param set		set descriptor returned by scif_epoll_create()
+ *	\param events		array receiving the ready endpoints
+ *	\param maxevents	length of events
+ *	\param timeout		upper limit on time for which scif_epoll_wait()
+ *				will block, in milliseconds
+ *
+ * scif_epoll_wait() fills events with up to maxevents endpoints of set which
+ * have any of their requested events, or an error or hangup, pending. Each
+ * entry has the pending events in events and the cookie given to
+ * scif_epoll_ctl() in data. Endpoints are reported for as long as they
+ * stay ready, unless they were added with SCIF_EPOLLET. If none is ready,
+ * scif_epoll_wait() blocks until one is or timeout expires. A negative
+ * timeout means an infinite timeout.
+ *
+ *\return
+ * Upon successful completion, scif_epoll_wait() returns the number of entries
+ * filled, 0 if the call timed out. Otherwise: in user mode -1 is returned and
+ * errno is set to indicate the error; in kernel mode the negative of one of
+ * the following errors is returned.
+ *
+ *\par Errors:
+ *- EINTR
+ * - A signal occurred before any requested event.
+ *- EINVAL
+ * - maxevents is not greater than zero
+ */
+int scif_epoll_wait(scif_epset_t set, struct scif_epoll_event *events,
+		int maxevents, long timeout);
+
+/**
+ * scif_epoll_close - Release a readiness set
+ *	\param set		set descriptor returned by scif_epoll_create()
+ *
+ * scif_epoll_close() removes all endpoints from set and frees it. The
+ * endpoints themselves are not affected.
+ *
+ *\return
+ * 0
+ */
+int scif_epoll_close(scif_epset_t set);
+
 /**
  * scif_event_register - Register an event handler
  *	\param handler		Event handler to be registered
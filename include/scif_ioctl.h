@@ -94,6 +94,103 @@ struct scifioctl_msg {
 	int		out_len;
 };
 
+/**
+ * struct scifioctl_iovec:
+ *
+ * \param base			segment address
+ * \param len			segment length
+ */
+struct scifioctl_iovec {
+	void		* ptr64_t base;
+	uint64_t	len;
+};
+
+/**
+ * struct scifioctl_msgv:
+ *
+ * \param iov			array of segments
+ * \param iovcnt		number of segments
+ * \param flags			flags
+ * \param out_len		Number of bytes sent/received.
+ *
+ * This structure is used for SCIF_SENDMSG/SCIF_RECVMSG IOCTL.
+ */
+struct scifioctl_msgv {
+	struct scifioctl_iovec	* ptr64_t iov;
+	int			iovcnt;
+	int			flags;
+	int			out_len;
+};
+
+/**
+ * struct scifioctl_dgram:
+ *
+ * \param peer			destination (sendto) or source (recvfrom)
+ * \param msg			message buffer address
+ * \param len			message length
+ * \param flags			flags
+ * \param out_len		Number of bytes sent/received.
+ *
+ * This structure is used for SCIF_SENDTO/SCIF_RECVFROM IOCTL.
+ */
+struct scifioctl_dgram {
+	struct scif_portID	peer;
+	void			* ptr64_t msg;
+	int			len;
+	int			flags;
+	int			out_len;
+};
+
+/**
+ * struct scifioctl_epoll_ctl:
+ *
+ * \param op			SCIF_EPOLL_CTL_ADD/MOD/DEL
+ * \param fd			file descriptor of the endpoint
+ * \param events		events of interest
+ * \param pad			must be 0, aligns data for 32 bit callers
+ * \param data			cookie returned with the events
+ *
+ * This structure is used for SCIF_EPOLL_CTL IOCTL. The set is kept by the
+ * file descriptor the IOCTL is issued on.
+ */
+struct scifioctl_epoll_ctl {
+	int		op;
+	int		fd;
+	uint32_t	events;
+	uint32_t	pad;
+	uint64_t	data;
+};
+
+/**
+ * struct scifioctl_epoll_event:
+ *
+ * \param events		pending events
+ * \param pad			aligns data for 32 bit callers
+ * \param data			cookie given to SCIF_EPOLL_CTL
+ */
+struct scifioctl_epoll_event {
+	uint32_t	events;
+	uint32_t	pad;
+	uint64_t	data;
+};
+
+/**
+ * struct scifioctl_epoll_wait:
+ *
+ * \param events		array receiving the ready endpoints
+ * \param maxevents		length of events
+ * \param timeout		timeout in milliseconds, negative for infinite
+ * \param out_count		Number of entries filled.
+ *
+ * This structure is used for SCIF_EPOLL_WAIT IOCTL.
+ */
+struct scifioctl_epoll_wait {
+	struct scifioctl_epoll_event	* ptr64_t events;
+	int				maxevents;
+	int				timeout;
+	int				out_count;
+};
+
 /**
  * struct scifioctl_reg:
  *
@@ -151,6 +248,45 @@ struct scifioctl_copy {
 	int		flags;
 };
 
+/**
+ * struct scifioctl_rma_async:
+ *
+ * \param loffset	offset in local registered address space to/from
+which to copy
+ * \param len		length of range to copy
+ * \param roffset	offset in remote registered address space to/from
+which to copy
+ * \param flags		flags
+ * \param cookie	Handle of the queued RMA returned by reference.
+ *
+ * This structure is used for SCIF_READFROM_ASYNC and SCIF_WRITETO_ASYNC
+ * IOCTL's.
+ */
+struct scifioctl_rma_async {
+	off_t		loffset;
+	uint64_t	len;
+	off_t		roffset;
+	int		flags;
+	uint64_t	cookie;
+};
+
+/**
+ * struct scifioctl_rma_completions:
+ *
+ * \param comp		array receiving the completions
+ * \param nr		length of comp
+ * \param timeout	timeout in milliseconds, negative for infinite
+ * \param out_count	Number of entries filled.
+ *
+ * This structure is used for SCIF_RMA_COMPLETIONS IOCTL.
+ */
+struct scifioctl_rma_completions {
+	struct scif_rma_completion	* ptr64_t comp;
+	int				nr;
+	int				timeout;
+	int				out_count;
+};
+
 /**
  * struct scifioctl_fence_mark:
  *
@@ -198,6 +334,90 @@ struct scifioctl_nodeIDs {
 	uint16_t * ptr64_t self;
 };
 
+/*
+ * A connected endpoint's QP can be mmap'd so that messages are exchanged
+ * without a system call. Each region is mapped on its own, MAP_SHARED and
+ * with exactly its size, at the offset SCIF_QP_INFO returns plus:
+ * (offsets from SCIF_QP_MMAP_BASE up are never used by registered windows,
+ * scif_register() refuses SCIF_MAP_FIXED ranges reaching them)
+ *
+ * SCIF_QP_MMAP_LOCAL_CTRL	our struct scif_qp_ctrl, read only. The peer
+ *				stores the write pointer of the recv ring and
+ *				the read pointer of the send ring here.
+ * SCIF_QP_MMAP_REMOTE_CTRL	the peer's struct scif_qp_ctrl, read/write.
+ *				We store the read pointer of the recv ring,
+ *				the write pointer of the send ring and the
+ *				waiting flags here.
+ * SCIF_QP_MMAP_RECV_RING	recv_size bytes, read only
+ * SCIF_QP_MMAP_SEND_RING	send_size bytes, write only
+ *
+ * Pointers are byte offsets into the rings, which are power of two sized
+ * and hold one byte less than their size. Data must be globally visible
+ * (sfence on the host, the remote mappings are write combining) before the
+ * pointer covering it is stored. After storing a pointer the peer needs a
+ * SCIF_QP_NOTIFY unless SCIF_QP_INFO_CREDIT is set, in which case only if
+ * the matching *_waiting flag in the local ctrl page is set. Before
+ * sleeping in poll() set the own *_waiting flag in the remote ctrl page,
+ * and clear it again once the ring moved.
+ *
+ * The kernel send and recv calls fail with EBUSY while any of the regions
+ * is mapped. Mappings are revoked, and raise SIGBUS, on disconnect.
+ */
+#define SCIF_QP_MMAP_BASE		0x7f00000000000000ULL
+#define SCIF_QP_MMAP_LOCAL_CTRL		0x00000000ULL
+#define SCIF_QP_MMAP_REMOTE_CTRL	0x10000000ULL
+#define SCIF_QP_MMAP_RECV_RING		0x20000000ULL
+#define SCIF_QP_MMAP_SEND_RING		0x30000000ULL
+#define SCIF_QP_MMAP_SPAN		0x40000000ULL
+
+/**
+ * struct scif_qp_ctrl:
+ *
+ * \param write			write pointer of the owner's recv ring
+ * \param read			read pointer of the owner's send ring
+ * \param recv_waiting		other side's receiver sleeps, wants SENT
+ * \param send_waiting		other side's sender sleeps, wants RCVD
+ * \param recv_polling		other side's receiver spins, SENT optional
+ *
+ * Layout of the SCIF_QP_MMAP_*_CTRL pages. Each is written by the side
+ * which does not own it.
+ */
+struct scif_qp_ctrl {
+	volatile uint32_t	write;
+	volatile uint32_t	read;
+	volatile uint32_t	recv_waiting;
+	volatile uint32_t	send_waiting;
+	volatile uint32_t	recv_polling;
+};
+
+#define SCIF_QP_INFO_CREDIT	0x1	/* Notify only on *_waiting */
+#define SCIF_QP_INFO_BUSY_POLL	0x2	/* Peer honours recv_polling */
+
+/**
+ * struct scifioctl_qp_info:
+ *
+ * \param offset		mmap offset of the regions of this endpoint
+ * \param recv_size		size of SCIF_QP_MMAP_RECV_RING
+ * \param send_size		size of SCIF_QP_MMAP_SEND_RING
+ * \param flags			SCIF_QP_INFO_*
+ * \param recv_read		current read pointer of the recv ring
+ * \param send_write		current write pointer of the send ring
+ *
+ * This structure is used for SCIF_QP_INFO IOCTL. The pointers are the
+ * ones the kernel left behind, a process picks up from there.
+ */
+struct scifioctl_qp_info {
+	uint64_t	offset;
+	uint32_t	recv_size;
+	uint32_t	send_size;
+	uint32_t	flags;
+	uint32_t	recv_read;
+	uint32_t	send_write;
+};
+
+#define SCIF_QP_NOTIFY_SENT	0x1	/* Data was written to the send ring */
+#define SCIF_QP_NOTIFY_RCVD	0x2	/* Data was consumed from the recv ring */
+
 
 #define SCIF_BIND		_IOWR('s', 1, int *)
 #define SCIF_LISTEN		_IOW('s', 2, int)
@@ -216,4 +436,18 @@ struct scifioctl_nodeIDs {
 #define SCIF_FENCE_MARK		_IOWR('s', 15, struct scifioctl_fence_mark *)
 #define SCIF_FENCE_WAIT		_IOWR('s', 16, int)
 #define SCIF_FENCE_SIGNAL	_IOWR('s', 17, struct scifioctl_fence_signal *)
+#define SCIF_SENDMSG		_IOWR('s', 18, struct scifioctl_msgv *)
+#define SCIF_RECVMSG		_IOWR('s', 19, struct scifioctl_msgv *)
+#define SCIF_BUSY_POLL		_IOW('s', 20, int)
+#define SCIF_EPOLL_CTL		_IOW('s', 21, struct scifioctl_epoll_ctl *)
+#define SCIF_EPOLL_WAIT		_IOWR('s', 22, struct scifioctl_epoll_wait *)
+#define SCIF_DGRAM_BIND		_IOWR('s', 23, int *)
+#define SCIF_SENDTO		_IOWR('s', 24, struct scifioctl_dgram *)
+#define SCIF_RECVFROM		_IOWR('s', 25, struct scifioctl_dgram *)
+#define SCIF_QP_INFO		_IOR('s', 26, struct scifioctl_qp_info *)
+#define SCIF_QP_NOTIFY		_IOW('s', 27, int)
+#define SCIF_GET_STATS		_IOR('s', 28, struct scif_ep_stats *)
+#define SCIF_READFROM_ASYNC	_IOWR('s', 29, struct scifioctl_rma_async *)
+#define SCIF_WRITETO_ASYNC	_IOWR('s', 30, struct scifioctl_rma_async *)
+#define SCIF_RMA_COMPLETIONS	_IOWR('s', 31, struct scifioctl_rma_completions *)
 
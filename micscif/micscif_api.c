@@ -60,7 +60,8 @@ char *scif_ep_states[] = {
 	"Closing",
 	"Close Listening",
 	"Disconnected",
-	"Zombie"};
+	"Zombie",
+	"Datagram"};
 
 /**
  * scif_open() - Create a SCIF end point
@@ -88,6 +89,11 @@ __scif_open(void)
 	spin_lock_init(&ep->lock);
 	mutex_init (&ep->sendlock);
 	mutex_init (&ep->recvlock);
+	spin_lock_init(&ep->tx_lock);
+	spin_lock_init(&ep->rx_lock);
+	ep->busy_poll_us = ms_info.mi_busy_poll_us;
+	INIT_LIST_HEAD(&ep->epitems);
+	mutex_init(&ep->qp_mmap_lock);
 
 	if (micscif_rma_ep_init(ep) < 0) {
 		printk(KERN_ERR "SCIFAPI _open: RMA EP Init failed\n");
@@ -142,6 +148,10 @@ __scif_close(scif_epd_t epd)
 
 	might_sleep();
 
+	micscif_epoll_ep_close(ep);
+	micscif_ep_stats_fold(ep);
+	micscif_rma_async_drain(ep);
+
 	micscif_inc_node_refcnt(ep->remote_dev, 1);
 
 	spin_lock_irqsave(&ep->lock, sflags);
@@ -197,6 +207,8 @@ __scif_close(scif_epd_t epd)
 		init_waitqueue_head(&ep->disconwq);	// Wait for connection queue
 		spin_unlock_irqrestore(&ep->lock, sflags);
 
+		/* Senders must be out of the peer's ring before it is told */
+		micscif_ep_quiesce(ep);
 		micscif_unregister_all_windows(epd);
 
 		// Remove from the connected list
@@ -243,10 +255,28 @@ __scif_close(scif_epd_t epd)
 
 		if (!err)
 			/* Now wait for the remote node to respond */
-			wait_event_timeout(ep->disconwq, 
+			wait_event_timeout(ep->disconwq,
 				(ep->state == SCIFEP_DISCONNECTED), NODE_ALIVE_TIMEOUT);
 		break;
 	}
+	case SCIFEP_DGRAM:
+	{
+		struct micscif_dgram *dg, *tmpdg;
+
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		spin_lock_irqsave(&ms_info.mi_eplock, sflags);
+		list_del(&ep->list);
+		spin_unlock_irqrestore(&ms_info.mi_eplock, sflags);
+
+		// Nothing can be delivered to the end point any more
+		list_for_each_entry_safe(dg, tmpdg, &ep->dgram_q, list) {
+			list_del(&dg->list);
+			kfree(dg);
+		}
+		ep->dgram_cnt = 0;
+		wake_up_interruptible(&ep->recvwq);
+		break;
+	}
 	case SCIFEP_LISTENING:
 	case SCIFEP_CLLISTEN:
 	{
@@ -435,7 +465,7 @@ __scif_flush(scif_epd_t epd)
 		ep->state = SCIFEP_DISCONNECTED;
 		spin_unlock_irqrestore(&ep->lock, sflags);
 		// Wake up threads blocked in send and recv
-		wake_up_interruptible(&ep->sendwq);
+		wake_up(&ep->sendwq);
 		wake_up_interruptible(&ep->recvwq);
 		break;
 	}
@@ -584,6 +614,9 @@ __scif_listen(scif_epd_t epd, int backlog)
 	case SCIFEP_MAPPING:
 		spin_unlock_irqrestore(&ep->lock, sflags);
 		return -EISCONN;
+	case SCIFEP_DGRAM:
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		return -EOPNOTSUPP;
 	case SCIFEP_BOUND:
 		break;
 	}
@@ -691,6 +724,8 @@ __scif_connect(scif_epd_t epd, struct scif_portID *dst)
 	unsigned long sflags;
 	int err = 0;
 	int term_sent = 0;
+	uint32_t qp_size;
+	struct micscif_qp *qp;
 #ifdef _MIC_SCIF_
 	struct micscif_dev *remote_dev;
 #endif
@@ -726,6 +761,7 @@ __scif_connect(scif_epd_t epd, struct scif_portID *dst)
 		goto connect_simple_unlock;
 	case SCIFEP_LISTENING:
 	case SCIFEP_CLLISTEN:
+	case SCIFEP_DGRAM:
 		err = -EOPNOTSUPP;
 		goto connect_simple_unlock;
 	case SCIFEP_CONNECTED:
@@ -762,8 +798,21 @@ __scif_connect(scif_epd_t epd, struct scif_portID *dst)
 		goto connect_error_simple;
 	}
 	// Initiate the first part of the endpoint QP setup
+	qp_size = ms_info.mi_endpt_qp_size;
+	if ((qp = micscif_qp_pool_get(ep->remote_dev, qp_size))) {
+		qp->ep = (uint64_t)ep;
+		kfree(ep->qp_info.qp);
+		ep->qp_info.qp = qp;
+	}
 	err = micscif_setup_qp_connect(ep->qp_info.qp, &ep->qp_info.qp_offset,
-			ENDPT_QP_SIZE, ep->remote_dev);
+			qp_size, ep->remote_dev);
+	if (err == -ENOMEM && !ep->qp_info.qp->inbound_q.rb_base &&
+		qp_size > ENDPT_QP_SIZE) {
+		// Fall back to the smallest ring if a larger one is not available
+		qp_size = ENDPT_QP_SIZE;
+		err = micscif_setup_qp_connect(ep->qp_info.qp,
+				&ep->qp_info.qp_offset, qp_size, ep->remote_dev);
+	}
 	if (err) {
 		printk(KERN_ERR "%s err %d qp_offset 0x%llx\n", 
 			__func__, err, ep->qp_info.qp_offset);
@@ -779,6 +828,7 @@ __scif_connect(scif_epd_t epd, struct scif_portID *dst)
 	msg.uop = SCIF_CNCT_REQ;
 	msg.payload[0] = (uint64_t)ep;
 	msg.payload[1] = ep->qp_info.qp_offset;
+	msg.payload[2] = micscif_encode_qp_size(qp_size);
 	if ((err = micscif_nodeqp_send(ep->remote_dev, &msg, ep))) {
 		micscif_dec_node_refcnt(ep->remote_dev, 1);
 		goto connect_error_simple;
@@ -832,9 +882,14 @@ retry:
 	}
 
 	if (ep->state == SCIFEP_MAPPING) {
+		/* The caps decide where the ring pointers live */
+		ep->qp_info.qp->caps = ep->qp_info.cnct_gnt_caps;
 		err = micscif_setup_qp_connect_response(ep->remote_dev,
 			ep->qp_info.qp, ep->qp_info.cnct_gnt_payload);
 		ep->remote_ep = ep->qp_info.qp->remote_qp->ep;
+		ep->qp_info.qp->recv_armed = 0;
+		ep->qp_info.qp->send_armed = 0;
+		ep->qp_info.qp->rcvd_pending = 0;
 
 		// If the resource to map the queue are not available then we need
 		// to tell the other side to terminate the accept
@@ -932,6 +987,7 @@ __scif_accept(scif_epd_t epd, struct scif_portID *peer, scif_epd_t *newepd, int
 	struct nodemsg msg;
 	unsigned long sflags;
 	int err;
+	uint32_t qp_size;
 
 	pr_debug("SCIFAPI accept: ep %p %s\n", lep, scif_ep_states[lep->state]);
 
@@ -1002,6 +1058,11 @@ retry_connection:
 	spin_lock_init(&cep->lock);
 	mutex_init (&cep->sendlock);
 	mutex_init (&cep->recvlock);
+	spin_lock_init(&cep->tx_lock);
+	spin_lock_init(&cep->rx_lock);
+	cep->busy_poll_us = lep->busy_poll_us;
+	INIT_LIST_HEAD(&cep->epitems);
+	mutex_init(&cep->qp_mmap_lock);
 	cep->state = SCIFEP_CONNECTING;
 	cep->remote_dev = &scif_dev[peer->node];
 	cep->remote_ep = conreq->msg.payload[0];
@@ -1024,7 +1085,15 @@ retry_connection:
 		goto scif_accept_error_qpalloc;
 	}
 
-	cep->qp_info.qp = (struct micscif_qp *)kzalloc(sizeof(struct micscif_qp), GFP_KERNEL);
+	/*
+	 * Size our receive ring as the peer asked, bounded by the local
+	 * setting. Peers which do not advertise a size get ENDPT_QP_SIZE.
+	 */
+	qp_size = min(micscif_decode_qp_size(conreq->msg.payload[2]),
+			ms_info.mi_endpt_qp_size);
+	if (!(cep->qp_info.qp = micscif_qp_pool_get(cep->remote_dev, qp_size)))
+		cep->qp_info.qp = (struct micscif_qp *)kzalloc_node(sizeof(struct micscif_qp),
+			GFP_KERNEL, micscif_numa_node(cep->remote_dev->sd_node));
 	if (!cep->qp_info.qp) {
 		printk(KERN_ERR "Port Qp Allocation Failed\n");
 		err = -ENOMEM;
@@ -1033,8 +1102,10 @@ retry_connection:
 
 	cep->qp_info.qp->magic = SCIFEP_MAGIC;
 	cep->qp_info.qp->ep = (uint64_t)cep;
+	/* The caps decide where the ring pointers live */
+	cep->qp_info.qp->caps = micscif_decode_qp_caps(conreq->msg.payload[2]);
 	err = micscif_setup_qp_accept(cep->qp_info.qp, &cep->qp_info.qp_offset,
-		conreq->msg.payload[1], ENDPT_QP_SIZE, cep->remote_dev);
+		conreq->msg.payload[1], qp_size, cep->remote_dev);
 	if (err) {
 		pr_debug("SCIFAPI accept: ep %p new %p micscif_setup_qp_accept %d qp_offset 0x%llx\n", 
 			    lep, cep, err, cep->qp_info.qp_offset);
@@ -1056,6 +1127,7 @@ retry_connection:
 	msg.src = cep->port;
 	msg.payload[0] = cep->remote_ep;
 	msg.payload[1] = cep->qp_info.qp_offset;
+	msg.payload[2] = micscif_encode_qp_size(qp_size);
 
 	err = micscif_nodeqp_send(cep->remote_dev, &msg, cep);
 
@@ -1188,11 +1260,246 @@ err_ret:
 #endif
 #endif
 
+/*
+ * Credit based SCIF_CLIENT_SENT/RCVD suppression.
+ *
+ * A side about to block on an endpoint QP sets the matching waiting flag
+ * in the peer's copy of the QP, reads it back so the posted write has
+ * landed, and only then rechecks the ring. The other side moves its ring
+ * pointer, reads that pointer back and then tests its local flag. Either
+ * the waiter sees the new pointer or the notifier sees the flag, so a
+ * wakeup cannot be lost. The flag stays set until the waiter has made
+ * progress, so waits for more than one transfer keep being woken. Ring
+ * transitions from empty (send) or full (recv) always notify, as does
+ * consuming mi_qp_notify_pct of the ring, for senders which poll without
+ * ever blocking. The empty transition is exempt while the receiver says
+ * it is busy polling (peer_recv_polling).
+ *
+ * All of these are called on a connected endpoint with ep->rx_lock held
+ * for the recv side and ep->tx_lock for the send side.
+ */
+static __always_inline void
+micscif_qp_set_waiting(volatile uint32_t *flag, uint32_t *armed)
+{
+	*flag = 1;
+	wmb();
+	(void)*flag;
+	smp_mb();
+	*armed = 1;
+}
+
+static __always_inline void
+micscif_qp_wait_recv(struct micscif_qp *qp)
+{
+	if ((qp->caps & SCIF_QP_CAP_CREDIT) && !qp->recv_armed)
+		micscif_qp_set_waiting(&micscif_qp_remote_flag(qp, recv_waiting),
+				&qp->recv_armed);
+}
+
+static __always_inline void
+micscif_qp_wait_send(struct micscif_qp *qp)
+{
+	if ((qp->caps & SCIF_QP_CAP_CREDIT) && !qp->send_armed)
+		micscif_qp_set_waiting(&micscif_qp_remote_flag(qp, send_waiting),
+				&qp->send_armed);
+}
+
+/* Data has been committed to the outbound ring which held @was_used bytes */
+static __always_inline bool
+micscif_qp_need_sent(struct micscif_qp *qp, uint32_t was_used)
+{
+	if (qp->send_armed) {
+		micscif_qp_remote_flag(qp, send_waiting) = 0;
+		qp->send_armed = 0;
+	}
+	if (!(qp->caps & SCIF_QP_CAP_CREDIT) || !ms_info.mi_qp_notify_pct ||
+		(!was_used && !micscif_qp_flag(qp, recv_polling)))
+		return true;
+	/* Flush the write pointer update before sampling the flag */
+	wmb();
+	(void)*qp->outbound_q.write_ptr;
+	smp_mb();
+	return !!micscif_qp_flag(qp, recv_waiting);
+}
+
+/* @len bytes were consumed from the inbound ring which held @was_used bytes */
+static __always_inline bool
+micscif_qp_need_rcvd(struct micscif_qp *qp, uint32_t was_used, uint32_t len)
+{
+	uint32_t size = qp->inbound_q.size;
+
+	if (qp->recv_armed) {
+		micscif_qp_remote_flag(qp, recv_waiting) = 0;
+		qp->recv_armed = 0;
+	}
+	qp->rcvd_pending += len;
+	if (!(qp->caps & SCIF_QP_CAP_CREDIT) || !ms_info.mi_qp_notify_pct ||
+		was_used == size - 1 ||
+		qp->rcvd_pending >= size / 100 * ms_info.mi_qp_notify_pct)
+		goto notify;
+	/* Flush the read pointer update before sampling the flag */
+	wmb();
+	(void)*qp->inbound_q.read_ptr;
+	smp_mb();
+	if (micscif_qp_flag(qp, send_waiting))
+		goto notify;
+	return false;
+notify:
+	qp->rcvd_pending = 0;
+	return true;
+}
+
+/*
+ * micscif_busy_poll() - Spin on the inbound ring before sleeping
+ *
+ * Polls for @len bytes for up to ep->busy_poll_us, advertising in the
+ * peer's copy of the QP that SCIF_CLIENT_SENT is not needed meanwhile.
+ * The flag is only a hint: a sender which sees it still flushes its
+ * write pointer and checks peer_recv_waiting, which we set as usual
+ * before sleeping if the spin times out.
+ *
+ * Called and returns with ep->rx_lock held on a connected endpoint, drops
+ * it while spinning. Returns true if the ring or the endpoint changed.
+ */
+static bool
+micscif_busy_poll(struct endpt *ep, size_t len)
+{
+	struct micscif_qp *qp = ep->qp_info.qp;
+	bool advertise = !!(qp->caps & SCIF_QP_CAP_BUSY_POLL);
+	bool ready = false;
+	s64 end;
+
+	if (advertise)
+		micscif_qp_remote_flag(qp, recv_polling) = 1;
+	spin_unlock(&ep->rx_lock);
+
+	end = ktime_to_ns(ktime_get()) + (s64)ep->busy_poll_us * NSEC_PER_USEC;
+	do {
+		if (SCIFEP_CONNECTED != ep->state ||
+			ep->rndv_rx.state == RNDV_PENDING ||
+			micscif_rb_count(&qp->inbound_q, (int)len) >= len ||
+			!scifdev_alive(ep)) {
+			ready = true;
+			break;
+		}
+		if (signal_pending(current) || need_resched())
+			break;
+		cpu_relax();
+	} while (ktime_to_ns(ktime_get()) < end);
+
+	spin_lock(&ep->rx_lock);
+	if (advertise && SCIFEP_CONNECTED == ep->state)
+		micscif_qp_remote_flag(qp, recv_polling) = 0;
+	return ready;
+}
+
+/*
+ * Account the time from the oldest unanswered send on @ep to data being
+ * read from it. Called with ep->rx_lock held, senders set rtt_start
+ * without it so this is best effort.
+ */
+static void
+micscif_rtt_account(struct endpt *ep, enum micscif_rtt_type type)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), ep->rtt_start));
+
+	ep->rtt_start = ktime_set(0, 0);
+	atomic_long_inc(&ms_info.mi_rtt_cnt[type]);
+	atomic_long_add((long)ns, &ms_info.mi_rtt_ns[type]);
+}
+
+/*
+ * Position in the segment list of a vectored send or receive. Segments are
+ * kernel or user buffers depending on the fromuser/touser argument.
+ */
+struct micscif_iov_iter {
+	struct kvec	*iov;
+	int		nr_segs;
+	size_t		offset;	/* Into iov[0] */
+};
+
+static __always_inline void
+micscif_iov_advance(struct micscif_iov_iter *iter, size_t len)
+{
+	iter->offset += len;
+	while (iter->nr_segs && iter->offset == iter->iov->iov_len) {
+		iter->iov++;
+		iter->nr_segs--;
+		iter->offset = 0;
+	}
+}
+
+static __always_inline void
+micscif_iov_init(struct micscif_iov_iter *iter, struct kvec *iov, int nr_segs)
+{
+	iter->iov = iov;
+	iter->nr_segs = nr_segs;
+	iter->offset = 0;
+	/* Skip leading empty segments */
+	micscif_iov_advance(iter, 0);
+}
+
+static __always_inline void *
+micscif_iov_base(struct micscif_iov_iter *iter)
+{
+	return (char *)iter->iov->iov_base + iter->offset;
+}
+
+static __always_inline size_t
+micscif_iov_seglen(struct micscif_iov_iter *iter)
+{
+	return iter->iov->iov_len - iter->offset;
+}
+
+/*
+ * Gather @len bytes into the ring without committing them. Returns the
+ * number of bytes written which is only short if a user buffer faulted.
+ */
+static size_t
+micscif_rb_write_iov(struct micscif_rb *rb, struct micscif_iov_iter *iter,
+		size_t len, bool fromuser)
+{
+	size_t done = 0, n;
+
+	while (done < len) {
+		n = min(len - done, micscif_iov_seglen(iter));
+		if (micscif_rb_write(rb, micscif_iov_base(iter),
+				(uint32_t)n, fromuser))
+			break;
+		done += n;
+		micscif_iov_advance(iter, n);
+	}
+	return done;
+}
+
+/*
+ * Scatter @len bytes from the ring without releasing them to the peer.
+ * Returns the number of bytes read which is only short if a user buffer
+ * faulted.
+ */
+static size_t
+micscif_rb_read_iov(struct micscif_rb *rb, struct micscif_iov_iter *iter,
+		size_t len, bool touser)
+{
+	size_t done = 0, n;
+
+	while (done < len) {
+		n = min(len - done, micscif_iov_seglen(iter));
+		if (micscif_rb_get_next(rb, micscif_iov_base(iter),
+				(uint32_t)n, touser) != (int)n)
+			break;
+		done += n;
+		micscif_iov_advance(iter, n);
+	}
+	return done;
+}
+
 /**
- * _scif_send() - Send data to connection queue
+ * _scif_sendv() - Send data to connection queue
  * @epd:        The end point address returned from scif_open()
- * @msg:	Address to place data
- * @len:	Length to receive
+ * @iov:	Segments to send
+ * @iovcnt:	Number of segments
+ * @len:	Total length of the segments
  * @flags:	Syncronous or asynchronous access
  * @fromuser: the package is from userspace or kernel
  *
@@ -1205,16 +1512,23 @@ err_ret:
  * If the end point is not in the connect state returns -ENOTCONN;
  *
  * This function may be interrupted by a signal and will return -EINTR.
+ *
+ * The outbound ring is only touched under ep->tx_lock, which keeps
+ * interrupts enabled. The receiver is synchronized with through the ring
+ * pointers alone, and a disconnect through micscif_ep_quiesce().
  */
-int
-_scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
+static int
+_scif_sendv(scif_epd_t epd, struct kvec *iov, int iovcnt, int len, int flags,
+		bool fromuser)
 {
 	struct endpt *ep = (struct endpt *)epd;
+	struct micscif_iov_iter iter;
 	struct nodemsg notif_msg;
-	unsigned long sflags;
 	size_t curr_xfer_len = 0;
 	size_t sent_len = 0;
 	size_t write_count;
+	size_t written;
+	uint32_t was_used;
 	int ret;
 #ifdef SCIF_BLAST
 	int tl;
@@ -1223,21 +1537,23 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 	if (flags & SCIF_SEND_BLOCK)
 		might_sleep();
 
+	micscif_iov_init(&iter, iov, iovcnt);
+
 #ifdef SCIF_BLAST
 	if (flags & SCIF_BLAST) {
 		/*
 		 * Do a decent try to acquire lock (~100 uSec)
 		 */
 		for (ret = tl = 0; ret < 100 && !tl; ret++) {
-			tl = spin_trylock_irqsave(&ep->lock, sflags);
+			tl = spin_trylock(&ep->tx_lock);
 			cpu_relax();
 		}
 	} else {
 		tl = 1;
-		spin_lock_irqsave(&ep->lock, sflags);
+		spin_lock(&ep->tx_lock);
 	}
 #else
-	spin_lock_irqsave(&ep->lock, sflags);
+	spin_lock(&ep->tx_lock);
 #endif
 
 	while (sent_len != len) {
@@ -1253,6 +1569,10 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 			ret = (int) (sent_len ? sent_len : -ENODEV);
 			goto unlock_dec_return;
 		}
+		if (ep->qp_mapped) {
+			ret = (int)(sent_len ? sent_len : -EBUSY);
+			goto unlock_dec_return;
+		}
 		write_count = micscif_rb_space(&ep->qp_info.qp->outbound_q);
 		if (write_count) {
 			/*
@@ -1261,26 +1581,27 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 			 * Non Blocking case.
 			 */
 			curr_xfer_len = min(len - sent_len, write_count);
-			ret = micscif_rb_write(&ep->qp_info.qp->outbound_q, msg,
-						(uint32_t)curr_xfer_len, fromuser);
-			if (ret < 0) {
+			was_used = ep->qp_info.qp->outbound_q.size - 1 -
+				(uint32_t)write_count;
+			/*
+			 * If there is space in the RB and we have the tx lock
+			 * held then writing to the RB can only stop short on a
+			 * fault. Segments copied before it are still sent.
+			 */
+			written = micscif_rb_write_iov(&ep->qp_info.qp->outbound_q,
+					&iter, curr_xfer_len, fromuser);
+			if (!written) {
 				ret = -EFAULT;
 				goto unlock_dec_return;
 			}
-			if (ret) {
-				spin_unlock_irqrestore(&ep->lock, sflags);
-				/*
-				 * If there is space in the RB and we have the
-				 * EP lock held then writing to the RB should
-				 * succeed. Releasing spin lock before asserting
-				 * to avoid deadlocking the system.
-				 */
-				BUG_ON(ret);
-			}
 			/*
-			 * Success. Update write pointer.
+			 * Success. Update write pointer once for all segments.
 			 */
 			micscif_rb_commit(&ep->qp_info.qp->outbound_q);
+			ep->stats.tx_bytes += written;
+			ep->stats.tx_msgs++;
+			if (ms_info.en_rtt_stats && !ktime_to_ns(ep->rtt_start))
+				ep->rtt_start = ktime_get();
 #ifdef SCIF_BLAST
 			if (flags & SCIF_BLAST) {
 				/*
@@ -1293,7 +1614,7 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 				ep->remote_dev->qpairs->remote_qp->blast = 1;
 				smp_wmb();    /* Sufficient or need sfence? */
 				micscif_send_host_intr(ep->remote_dev, 0);
-			} else {
+			} else if (micscif_qp_need_sent(ep->qp_info.qp, was_used)) {
 				/*
 				 * Normal path: send notification on the
 				 * node_qp ring buffer and ring the doorbell.
@@ -1305,25 +1626,34 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 					ret = sent_len ? sent_len : ret;
 					goto unlock_dec_return;
 				}
+				ep->stats.tx_notify++;
 			}
 #else
 			/*
 			 * Send a notification to the peer about the
-			 * produced data message.
+			 * produced data message unless it is not waiting.
 			 */
-			notif_msg.src = ep->port;
-			notif_msg.uop = SCIF_CLIENT_SENT;
-			notif_msg.payload[0] = ep->remote_ep;
-			if ((ret = micscif_nodeqp_send(ep->remote_dev, &notif_msg, ep))) {
-				ret = (int)(sent_len ? sent_len : ret);
-				goto unlock_dec_return;
+			if (micscif_qp_need_sent(ep->qp_info.qp, was_used)) {
+				notif_msg.src = ep->port;
+				notif_msg.uop = SCIF_CLIENT_SENT;
+				notif_msg.payload[0] = ep->remote_ep;
+				if ((ret = micscif_nodeqp_send(ep->remote_dev, &notif_msg, ep))) {
+					ret = (int)(sent_len ? sent_len : ret);
+					goto unlock_dec_return;
+				}
+				ep->stats.tx_notify++;
 			}
 #endif
-			sent_len += curr_xfer_len;
-			msg = (char *)msg + curr_xfer_len;
+			sent_len += written;
+			if (written != curr_xfer_len) {
+				ret = (int)sent_len;
+				goto unlock_dec_return;
+			}
 			continue;
 		}
-		curr_xfer_len = min(len - sent_len, (size_t)(ENDPT_QP_SIZE - 1));
+		curr_xfer_len = min(len - sent_len,
+			(size_t)(ep->qp_info.qp->outbound_q.size - 1));
+		ep->stats.tx_full++;
 		/*
 		 * Not enough space in the RB. Return in the Non Blocking case.
 		 */
@@ -1339,34 +1669,114 @@ _scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
 		 * No need to check variable tl here
 		 */
 #endif
-		spin_unlock_irqrestore(&ep->lock, sflags);
+		micscif_qp_wait_send(ep->qp_info.qp);
+		spin_unlock(&ep->tx_lock);
 		/*
 		 * Wait for a message now in the Blocking case.
 		 */
 		if ((ret = wait_event_interruptible(ep->sendwq, 
-			(SCIFEP_CONNECTED != ep->state) ||
+			(SCIFEP_CONNECTED != ep->state) || ep->qp_mapped ||
 			(micscif_rb_space(&ep->qp_info.qp->outbound_q)
 				>= curr_xfer_len) || (!scifdev_alive(ep))))) {
 			ret = (int) (sent_len ? sent_len : ret);
 			goto dec_return;
 		}
-		spin_lock_irqsave(&ep->lock, sflags);
+		spin_lock(&ep->tx_lock);
 	}
 	ret = len;
 unlock_dec_return:
 #ifdef SCIF_BLAST
 	if (tl)
 #endif
-	spin_unlock_irqrestore(&ep->lock, sflags);
+	spin_unlock(&ep->tx_lock);
 dec_return:
 	return ret;
 }
 
+int
+_scif_send(scif_epd_t epd, void *msg, int len, int flags, bool fromuser)
+{
+	struct kvec iov = { .iov_base = msg, .iov_len = len };
+
+	return _scif_sendv(epd, &iov, 1, len, flags, fromuser);
+}
+
+/*
+ * micscif_rndv_pull() - Copy from a send buffer advertised by the peer
+ *
+ * Pulls up to @len bytes of ep->rndv_rx straight into the user buffer @msg
+ * with RMA. Kernel buffers cannot be handed to scif_vreadfrom() so those
+ * give the whole send back, and the sender finishes it through the ring.
+ * Acknowledges the buffer once it is drained, given back or cancelled.
+ *
+ * Called and returns with ep->rx_lock held, drops it around the copy.
+ * The buffer state itself is protected by ep->lock. Returns the number
+ * of bytes copied or an error, 0 if the caller has to look at the ring
+ * again.
+ */
+static int
+micscif_rndv_pull(struct endpt *ep, void *msg, size_t len, bool touser)
+{
+	struct micscif_rndv *rx = &ep->rndv_rx;
+	struct nodemsg ack;
+	unsigned long sflags;
+	int err = 0;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	/* The sender may have cancelled since the caller looked */
+	if (RNDV_PENDING != rx->state || ep->state != SCIFEP_CONNECTED) {
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		return 0;
+	}
+	/*
+	 * The caller may have found the ring empty before bytes sent ahead
+	 * of the buffer became visible. Those have to be read first.
+	 */
+	smp_rmb();
+	if (micscif_rb_count(&ep->qp_info.qp->inbound_q, 1)) {
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		return 0;
+	}
+	if (touser) {
+		len = min(len, rx->len - rx->done);
+		rx->state = RNDV_PULLING;
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		spin_unlock(&ep->rx_lock);
+		err = __scif_vreadfrom(ep, msg, len,
+				rx->offset + rx->done, SCIF_RMA_SYNC);
+		spin_lock(&ep->rx_lock);
+		spin_lock_irqsave(&ep->lock, sflags);
+		if (!err) {
+			rx->done += len;
+			ep->stats.rx_rndv_bytes += len;
+		}
+	}
+	if (!touser || err || RNDV_PULLING != rx->state ||
+		rx->done == rx->len) {
+		rx->state = RNDV_IDLE;
+		if (ep->state == SCIFEP_CONNECTED) {
+			ack.src = ep->port;
+			ack.uop = SCIF_RNDV_ACK;
+			ack.payload[0] = ep->remote_ep;
+			ack.payload[1] = rx->done;
+			/* No error handling for Notification messages */
+			micscif_nodeqp_send(ep->remote_dev, &ack, ep);
+		}
+	} else {
+		rx->state = RNDV_PENDING;
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	if (err)
+		return err;
+	return touser ? (int)len : 0;
+}
+
 /**
- * _scif_recv() - Recieve data from connection queue
+ * _scif_recvv() - Recieve data from connection queue
  * @epd:        The end point address returned from scif_open()
- * @msg:	Address to place data
- * @len:	Length to receive
+ * @iov:	Segments to place data in
+ * @iovcnt:	Number of segments
+ * @len:	Total length of the segments
  * @flags:	Syncronous or asynchronous access
  * @touser: package send to user buffer or kernel
  *
@@ -1383,24 +1793,32 @@ dec_return:
  * with data prosent it returns -ENOTCONN;
  *
  * This function may be interrupted by a signal and will return -EINTR.
+ *
+ * The inbound ring is only touched under ep->rx_lock, see _scif_sendv().
  */
-int
-_scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
+static int
+_scif_recvv(scif_epd_t epd, struct kvec *iov, int iovcnt, int len, int flags,
+		bool touser)
 {
-	int read_size;
+	size_t read_size;
 	struct endpt *ep = (struct endpt *)epd;
-	unsigned long sflags;
+	struct micscif_iov_iter iter;
 	struct nodemsg notif_msg;
 	size_t curr_recv_len = 0;
 	size_t remaining_len = len;
 	size_t read_count;
+	uint32_t was_used;
+	enum micscif_rtt_type rtt_type = SCIF_RTT_READY;
+	bool polled = false;
 	int ret;
 
 	if (flags & SCIF_RECV_BLOCK)
 		might_sleep();
 
+	micscif_iov_init(&iter, iov, iovcnt);
+
 	micscif_inc_node_refcnt(ep->remote_dev, 1);
-	spin_lock_irqsave(&ep->lock, sflags);
+	spin_lock(&ep->rx_lock);
 	while (remaining_len) {
 		if (ep->state != SCIFEP_CONNECTED &&
 			ep->state != SCIFEP_DISCONNECTED) {
@@ -1408,6 +1826,11 @@ _scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
 				(int) (len - remaining_len) : -ENOTCONN;
 			goto unlock_dec_return;
 		}
+		if (ep->qp_mapped) {
+			ret = (len - (int)remaining_len) ?
+				(len - (int)remaining_len) : -EBUSY;
+			goto unlock_dec_return;
+		}
 		read_count = micscif_rb_count(&ep->qp_info.qp->inbound_q,
 					(int) remaining_len);
 		if (read_count) {
@@ -1417,25 +1840,25 @@ _scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
 			 * important for the Non Blocking case.
 			 */
 			curr_recv_len = min(remaining_len, read_count);
-			read_size = micscif_rb_get_next(
+			was_used = (uint32_t)read_count;
+			/*
+			 * If there are bytes to be read from the RB and we
+			 * have the rx lock held then reading from the RB can
+			 * only stop short when copying to a user buffer faults.
+			 */
+			read_size = micscif_rb_read_iov(
 					&ep->qp_info.qp->inbound_q,
-					msg, (int) curr_recv_len, touser);
-			if (read_size < 0){
-				/* only could happen when copy to USER buffer
-				*/
+					&iter, curr_recv_len, touser);
+			if (!read_size) {
 				ret = -EFAULT;
 				goto unlock_dec_return;
 			}
-			if (read_size != curr_recv_len) {
-				spin_unlock_irqrestore(&ep->lock, sflags);
-				/*
-				 * If there are bytes to be read from the RB and
-				 * we have the EP lock held then reading from
-				 * RB should succeed. Releasing spin lock before
-				 * asserting to avoid deadlocking the system.
-				 */
-				BUG_ON(read_size != curr_recv_len);
-			}
+			ep->stats.rx_bytes += read_size;
+			ep->stats.rx_msgs++;
+			if (ktime_to_ns(ep->rtt_start))
+				micscif_rtt_account(ep, rtt_type);
+			rtt_type = SCIF_RTT_READY;
+			polled = false;
 			if (ep->state == SCIFEP_CONNECTED) {
 				/*
 				 * Update the read pointer only if the endpoint is
@@ -1446,22 +1869,50 @@ _scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
 				/*
 				 * Send a notification to the peer about the
 				 * consumed data message only if the EP is in
-				 * SCIFEP_CONNECTED state.
+				 * SCIFEP_CONNECTED state and the peer needs one.
 				 */
-				notif_msg.src = ep->port;
-				notif_msg.uop = SCIF_CLIENT_RCVD;
-				notif_msg.payload[0] = ep->remote_ep;
-				if ((ret = micscif_nodeqp_send(ep->remote_dev, &notif_msg, ep))) {
-					ret = (len - (int)remaining_len) ?
-						(len - (int)remaining_len) : ret;
-					goto unlock_dec_return;
+				if (micscif_qp_need_rcvd(ep->qp_info.qp, was_used,
+						(uint32_t)read_size)) {
+					notif_msg.src = ep->port;
+					notif_msg.uop = SCIF_CLIENT_RCVD;
+					notif_msg.payload[0] = ep->remote_ep;
+					if ((ret = micscif_nodeqp_send(ep->remote_dev, &notif_msg, ep))) {
+						ret = (len - (int)remaining_len) ?
+							(len - (int)remaining_len) : ret;
+						goto unlock_dec_return;
+					}
+					ep->stats.rx_notify++;
 				}
 			}
-			remaining_len -= curr_recv_len;
-			msg = (char *)msg + curr_recv_len;
+			remaining_len -= read_size;
+			if (read_size != curr_recv_len) {
+				ret = len - (int)remaining_len;
+				goto unlock_dec_return;
+			}
+			continue;
+		}
+		/*
+		 * Everything sent ahead of an advertised send buffer has been
+		 * read from the ring, so it is next in the stream.
+		 */
+		if (ep->rndv_rx.state == RNDV_PENDING &&
+			ep->state == SCIFEP_CONNECTED) {
+			ret = micscif_rndv_pull(ep, micscif_iov_base(&iter),
+					min(remaining_len, micscif_iov_seglen(&iter)),
+					touser);
+			if (ret < 0) {
+				ret = (len - remaining_len) ?
+					(len - (int)remaining_len) : ret;
+				goto unlock_dec_return;
+			}
+			remaining_len -= ret;
+			micscif_iov_advance(&iter, ret);
 			continue;
 		}
-		curr_recv_len = min(remaining_len, (size_t)(ENDPT_QP_SIZE - 1));
+		curr_recv_len = min(remaining_len,
+			(size_t)(ep->qp_info.qp->inbound_q.size - 1));
+		if (!polled)
+			ep->stats.rx_empty++;
 		/*
 		 * Bail out now if the EP is in SCIFEP_DISCONNECTED state else
 		 * we will keep looping forever.
@@ -1479,31 +1930,148 @@ _scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
 			ret = len - (int)remaining_len;
 			goto unlock_dec_return;
 		}
-		spin_unlock_irqrestore(&ep->lock, sflags);
+		/*
+		 * Spin for a while before paying for an interrupt and a
+		 * wakeup, once per wait.
+		 */
+		if (ep->busy_poll_us && !polled) {
+			polled = true;
+			if (micscif_busy_poll(ep, curr_recv_len))
+				rtt_type = SCIF_RTT_POLLED;
+			continue;
+		}
+		micscif_qp_wait_recv(ep->qp_info.qp);
+		spin_unlock(&ep->rx_lock);
 		micscif_dec_node_refcnt(ep->remote_dev, 1);
 		/*
 		 * Wait for a message now in the Blocking case.
 		 * or until other side disconnects.
 		 */
 		if ((ret = wait_event_interruptible(ep->recvwq, 
-				(SCIFEP_CONNECTED != ep->state) ||
+				(SCIFEP_CONNECTED != ep->state) || ep->qp_mapped ||
+				(ep->rndv_rx.state == RNDV_PENDING) ||
 				(micscif_rb_count(&ep->qp_info.qp->inbound_q,
 				 curr_recv_len) >= curr_recv_len) || (!scifdev_alive(ep))))) {
 			ret = (len - remaining_len) ?
 				(len - (int)remaining_len) : ret;
 			goto dec_return;
 		}
+		rtt_type = SCIF_RTT_SLEPT;
 		micscif_inc_node_refcnt(ep->remote_dev, 1);
-		spin_lock_irqsave(&ep->lock, sflags);
+		spin_lock(&ep->rx_lock);
 	}
 	ret = len;
 unlock_dec_return:
-	spin_unlock_irqrestore(&ep->lock, sflags);
+	spin_unlock(&ep->rx_lock);
 	micscif_dec_node_refcnt(ep->remote_dev, 1);
 dec_return:
 	return ret;
 }
 
+int
+_scif_recv(scif_epd_t epd, void *msg, int len, int flags, bool touser)
+{
+	struct kvec iov = { .iov_base = msg, .iov_len = len };
+
+	return _scif_recvv(epd, &iov, 1, len, flags, touser);
+}
+
+/*
+ * micscif_rndv_send() - Let the peer pull a large user send buffer
+ * @done: Returns the number of bytes sent from the start of @msg
+ *
+ * Only whole pages are registered, so the peer never gets to read memory
+ * around @msg which shares a page with it. The partial page in front of
+ * them is sent through the ring first, then the pages are advertised with
+ * SCIF_RNDV_REQ and this waits until the receiver has pulled them with
+ * RMA and sent SCIF_RNDV_ACK. Whatever follows in the stream, the partial
+ * page at the end and anything the receiver did not take, is left for the
+ * caller to send through the ring, which also reports connection errors.
+ * Called with ep->sendlock held so nothing else is queued behind the
+ * buffer.
+ *
+ * Returns 0, or an error if interrupted by a signal.
+ */
+static int
+micscif_rndv_send(struct endpt *ep, void *msg, int len, int flags,
+		size_t *done)
+{
+	struct micscif_rndv *tx = &ep->rndv_tx;
+	void *base = (void *)PAGE_ALIGN((uint64_t)msg);
+	void *end = (void *)(((uint64_t)msg + len) & PAGE_MASK);
+	int head = (int)((char *)base - (char *)msg);
+	size_t reg_len;
+	struct nodemsg req;
+	unsigned long sflags;
+	off_t offset;
+	int err;
+
+	*done = 0;
+	if (end <= base)
+		return 0;
+	reg_len = (char *)end - (char *)base;
+
+	if (head) {
+		if ((err = _scif_send((scif_epd_t)ep, msg, head, flags,
+				IS_USER_BUFFER)) < 0)
+			return err;
+		*done = err;
+		if (err < head)
+			return 0;
+	}
+
+	if ((offset = __scif_register(ep, base, reg_len, 0,
+			SCIF_PROT_READ, 0)) < 0)
+		return 0;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (ep->state != SCIFEP_CONNECTED || ep->qp_mapped) {
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		goto unregister;
+	}
+	tx->offset = offset;
+	tx->len = reg_len;
+	tx->done = 0;
+	tx->state = RNDV_PENDING;
+	req.src = ep->port;
+	req.uop = SCIF_RNDV_REQ;
+	req.payload[0] = ep->remote_ep;
+	req.payload[1] = tx->offset;
+	req.payload[2] = reg_len;
+	if (micscif_nodeqp_send(ep->remote_dev, &req, ep))
+		tx->state = RNDV_IDLE;
+	spin_unlock_irqrestore(&ep->lock, sflags);
+
+	err = wait_event_interruptible(ep->sendwq,
+		(RNDV_PENDING != tx->state) ||
+		(SCIFEP_CONNECTED != ep->state) || (!scifdev_alive(ep)));
+	if (err) {
+		/*
+		 * The receiver may be copying from the buffer right now so
+		 * wait for it to tell us how much it took before unpinning.
+		 * Unregistering the window waits for the peer to stop using
+		 * it anyway, so do not hang forever if the answer never comes.
+		 */
+		req.uop = SCIF_RNDV_CANCEL;
+		if (!micscif_nodeqp_send(ep->remote_dev, &req, ep))
+			wait_event_timeout(ep->sendwq,
+				(RNDV_PENDING != tx->state) ||
+				(SCIFEP_CONNECTED != ep->state) ||
+				(!scifdev_alive(ep)), NODE_ALIVE_TIMEOUT);
+	}
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (RNDV_DONE == tx->state) {
+		*done += tx->done;
+		ep->stats.tx_rndv_bytes += tx->done;
+	}
+	tx->state = RNDV_IDLE;
+	spin_unlock_irqrestore(&ep->lock, sflags);
+unregister:
+	__scif_unregister(ep, offset, reg_len);
+	return err;
+}
+
 /**
  * scif_user_send() - Send data to connection queue
  * @epd:        The end point address returned from scif_open()
@@ -1520,6 +2088,7 @@ scif_user_send(scif_epd_t epd, void *msg, int len, int flags)
 	struct endpt *ep = (struct endpt *)epd;
 	int err = 0;
 	bool isUserBuf = IS_USER_BUFFER;
+	size_t sent = 0;
 
 	pr_debug("SCIFAPI send (U): ep %p %s\n", ep, scif_ep_states[ep->state]);
 
@@ -1538,8 +2107,28 @@ scif_user_send(scif_epd_t epd, void *msg, int len, int flags)
 	 */
 	mutex_lock(&ep->sendlock);
 
-	err = _scif_send(epd, msg, len, flags, isUserBuf);
+	/*
+	 * Large blocking sends are pulled by the receiver with RMA rather
+	 * than being copied through the ring on both sides.
+	 */
+	if (ms_info.mi_rndv_threshold && len >= ms_info.mi_rndv_threshold &&
+		(flags & SCIF_SEND_BLOCK) && ep->state == SCIFEP_CONNECTED &&
+		(ep->qp_info.qp->caps & SCIF_QP_CAP_RNDV)) {
+		if ((err = micscif_rndv_send(ep, msg, len, flags, &sent))) {
+			err = sent ? (int)sent : err;
+			goto unlock;
+		}
+	}
 
+	if (sent < len) {
+		err = _scif_send(epd, (char *)msg + sent, len - (int)sent,
+				flags, isUserBuf);
+		if (sent)
+			err = err < 0 ? (int)sent : err + (int)sent;
+	} else {
+		err = len;
+	}
+unlock:
 	mutex_unlock(&ep->sendlock);
 	micscif_dec_node_refcnt(ep->remote_dev, 1);
 
@@ -1577,11 +2166,11 @@ scif_user_recv(scif_epd_t epd, void *msg, int len, int flags)
 	 * multiple chunks is required to ensure that messages do
 	 * not get fragmented and reordered.
 	 */
-	mutex_lock(&ep->sendlock);
+	mutex_lock(&ep->recvlock);
 
 	err = _scif_recv(epd, msg, len, flags, isUserBuf);
 
-	mutex_unlock(&ep->sendlock);
+	mutex_unlock(&ep->recvlock);
 
 recv_err:
 	return err;
@@ -1738,27 +2327,579 @@ scif_recv(scif_epd_t epd, void *msg, int len, int flags)
 EXPORT_SYMBOL(scif_recv);
 
 /**
- * __scif_pin_pages - __scif_pin_pages() pins the physical pages which back
- * the range of virtual address pages starting at addr and continuing for
- * len bytes. addr and len are constrained to be multiples of the page size.
- * A successful  scif_register() call returns an opaque pointer value
- * which may be used in subsequent calls to scif_register_pinned_pages().
+ * scif_iov_length:
+ * @iov:	Segments passed to scif_sendmsg(..)/scif_recvmsg(..)
+ * @iovcnt:	Number of segments
  *
- * Return Values
- * Upon successful completion, __scif_pin_pages() returns a
- * scif_pinned_pages_t value else an apt error is returned as documented
- * in scif.h. Protections of the set of pinned pages are also returned by
- * reference via out_prot.
+ * Validate a segment list and return its total length, which like the
+ * len argument of scif_send(..) must fit in an int.
  */
-int
-__scif_pin_pages(void *addr, size_t len, int *out_prot,
-		int map_flags, scif_pinned_pages_t *pages)
+static int
+scif_iov_length(struct kvec *iov, int iovcnt)
 {
-	struct scif_pinned_pages *pinned_pages;
-	int nr_pages, err = 0, i;
-	bool vmalloc_addr = false;
-	bool try_upgrade = false;
-	int prot = *out_prot;
+	size_t len = 0;
+	int i;
+
+	if (iovcnt < 0 || iovcnt > UIO_MAXIOV)
+		return -EINVAL;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)INT_MAX - len)
+			return -EINVAL;
+		len += iov[i].iov_len;
+	}
+	return (int)len;
+}
+
+/**
+ * scif_user_sendmsg() - Send a list of buffers to connection queue
+ * @epd:        The end point address returned from scif_open()
+ * @iov:	User mode segments to send
+ * @iovcnt:	Number of segments
+ * @flags:	Syncronous or asynchronous access
+ *
+ * This function is called from the driver IOCTL entry point
+ * only and is a wrapper for _scif_sendv().
+ */
+int
+scif_user_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	int err, len;
+
+	pr_debug("SCIFAPI sendmsg (U): ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	if ((len = scif_iov_length(iov, iovcnt)) <= 0)
+		return len;
+
+	if ((err = scif_msg_param_check(epd, len, flags)))
+		return err;
+
+	micscif_inc_node_refcnt(ep->remote_dev, 1);
+	mutex_lock(&ep->sendlock);
+
+	err = _scif_sendv(epd, iov, iovcnt, len, flags, IS_USER_BUFFER);
+
+	mutex_unlock(&ep->sendlock);
+	micscif_dec_node_refcnt(ep->remote_dev, 1);
+	return err;
+}
+
+/**
+ * scif_user_recvmsg() - Recieve into a list of buffers from connection queue
+ * @epd:        The end point address returned from scif_open()
+ * @iov:	User mode segments to fill
+ * @iovcnt:	Number of segments
+ * @flags:	Syncronous or asynchronous access
+ *
+ * This function is called from the driver IOCTL entry point
+ * only and is a wrapper for _scif_recvv().
+ */
+int
+scif_user_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	int err, len;
+
+	pr_debug("SCIFAPI recvmsg (U): ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	if ((len = scif_iov_length(iov, iovcnt)) <= 0)
+		return len;
+
+	if ((err = scif_msg_param_check(epd, len, flags)))
+		return err;
+
+	mutex_lock(&ep->recvlock);
+
+	err = _scif_recvv(epd, iov, iovcnt, len, flags, IS_USER_BUFFER);
+
+	mutex_unlock(&ep->recvlock);
+	return err;
+}
+
+/**
+ * scif_sendmsg() - Send a list of buffers to connection queue
+ * @epd:        The end point address returned from scif_open()
+ * @iov:	Segments to send
+ * @iovcnt:	Number of segments
+ * @flags:	Syncronous or asynchronous access
+ *
+ * This function is called from the kernel mode only and is
+ * a wrapper for _scif_sendv().
+ */
+int
+__scif_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	int ret, len;
+
+	pr_debug("SCIFAPI sendmsg (K): ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	if ((len = scif_iov_length(iov, iovcnt)) <= 0)
+		return len;
+
+	if ((ret = scif_msg_param_check(epd, len, flags)))
+		return ret;
+
+	/*
+	 * Cannot block while waiting for node to wake up
+	 * if non blocking messaging mode is requested. Return
+	 * ENODEV if the remote node is idle.
+	 */
+	if (!(flags & SCIF_SEND_BLOCK) && ep->remote_dev &&
+		SCIF_NODE_IDLE == atomic_long_read(
+			&ep->remote_dev->scif_ref_cnt))
+		return -ENODEV;
+
+	micscif_inc_node_refcnt(ep->remote_dev, 1);
+
+	if (flags & SCIF_SEND_BLOCK)
+		mutex_lock(&ep->sendlock);
+
+	ret = _scif_sendv(epd, iov, iovcnt, len, flags, !IS_USER_BUFFER);
+
+	if (flags & SCIF_SEND_BLOCK)
+		mutex_unlock(&ep->sendlock);
+
+	micscif_dec_node_refcnt(ep->remote_dev, 1);
+	return ret;
+}
+
+int
+scif_sendmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_sendmsg(epd, iov, iovcnt, flags);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_sendmsg);
+
+/**
+ * scif_recvmsg() - Recieve into a list of buffers from connection queue
+ * @epd:        The end point address returned from scif_open()
+ * @iov:	Segments to fill
+ * @iovcnt:	Number of segments
+ * @flags:	Syncronous or asynchronous access
+ *
+ * This function is called from the kernel mode only and is
+ * a wrapper for _scif_recvv().
+ */
+int
+__scif_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	int ret, len;
+
+	pr_debug("SCIFAPI recvmsg (K): ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	if ((len = scif_iov_length(iov, iovcnt)) <= 0)
+		return len;
+
+	if ((ret = scif_msg_param_check(epd, len, flags)))
+		return ret;
+
+	/*
+	 * Cannot block while waiting for node to wake up
+	 * if non blocking messaging mode is requested. Return
+	 * ENODEV if the remote node is idle.
+	 */
+	if (!flags && ep->remote_dev &&
+		SCIF_NODE_IDLE == atomic_long_read(
+			&ep->remote_dev->scif_ref_cnt))
+		return -ENODEV;
+
+	if (flags & SCIF_RECV_BLOCK)
+		mutex_lock(&ep->recvlock);
+
+	ret = _scif_recvv(epd, iov, iovcnt, len, flags, !IS_USER_BUFFER);
+
+	if (flags & SCIF_RECV_BLOCK)
+		mutex_unlock(&ep->recvlock);
+
+	return ret;
+}
+
+int
+scif_recvmsg(scif_epd_t epd, struct kvec *iov, int iovcnt, int flags)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_recvmsg(epd, iov, iovcnt, flags);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_recvmsg);
+
+/**
+ * scif_busy_poll() - Set how long blocking receives spin before sleeping
+ * @epd:        The end point address returned from scif_open()
+ * @usecs:	Time to poll for, 0 to always sleep
+ *
+ * Endpoints start out with the busy_poll sysfs default. Connections
+ * accepted on a listening end point inherit its setting.
+ */
+int
+__scif_busy_poll(scif_epd_t epd, int usecs)
+{
+	struct endpt *ep = (struct endpt *)epd;
+
+	pr_debug("SCIFAPI busy_poll: ep %p %s usecs %d\n",
+		ep, scif_ep_states[ep->state], usecs);
+
+	if (usecs < 0 || usecs > SCIF_BUSY_POLL_MAX_US)
+		return -EINVAL;
+
+	ep->busy_poll_us = usecs;
+	return 0;
+}
+
+int
+scif_busy_poll(scif_epd_t epd, int usecs)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_busy_poll(epd, usecs);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_busy_poll);
+
+/**
+ * scif_dgram_bind() - Bind an end point to a port for datagrams
+ * @epd:        The end point address returned from scif_open()
+ * @pn:         Port ID (number) to bind to, 0 for any
+ *
+ * The port is allocated exactly as for scif_bind(). The end point is then
+ * put on the datagram list where micscif_dgram_deliver() looks it up.
+ */
+int
+__scif_dgram_bind(scif_epd_t epd, uint16_t pn)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	unsigned long sflags;
+	int ret;
+
+	pr_debug("SCIFAPI dgram_bind: ep %p %s requested port number %d\n",
+		ep, scif_ep_states[ep->state], pn);
+
+	if ((ret = __scif_bind(epd, pn)) < 0)
+		return ret;
+
+	spin_lock_irqsave(&ms_info.mi_eplock, sflags);
+	spin_lock(&ep->lock);
+	if (ep->state != SCIFEP_BOUND) {
+		ret = -EISCONN;
+		goto unlock;
+	}
+	INIT_LIST_HEAD(&ep->dgram_q);
+	ep->dgram_cnt = 0;
+	init_waitqueue_head(&ep->recvwq);
+	ep->state = SCIFEP_DGRAM;
+	list_add_tail(&ep->list, &ms_info.mi_dgram);
+unlock:
+	spin_unlock(&ep->lock);
+	spin_unlock_irqrestore(&ms_info.mi_eplock, sflags);
+	return ret;
+}
+
+int
+scif_dgram_bind(scif_epd_t epd, uint16_t pn)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_dgram_bind(epd, pn);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_dgram_bind);
+
+/**
+ * micscif_dgram_deliver() - Queue a datagram on the end point bound to its port
+ * @dg:		Datagram, freed here if it is dropped
+ *
+ * Called for datagrams from the local node as well as from the datagram
+ * QP of every remote node.
+ */
+void
+micscif_dgram_deliver(struct micscif_dgram *dg)
+{
+	struct endpt *ep;
+	unsigned long sflags;
+	bool queued = false;
+
+	spin_lock_irqsave(&ms_info.mi_eplock, sflags);
+	list_for_each_entry(ep, &ms_info.mi_dgram, list) {
+		if (ep->port.port != dg->dst_port)
+			continue;
+		spin_lock(&ep->lock);
+		if (ep->state == SCIFEP_DGRAM &&
+			ep->dgram_cnt < SCIF_DGRAM_QLEN) {
+			list_add_tail(&dg->list, &ep->dgram_q);
+			ep->dgram_cnt++;
+			queued = true;
+			wake_up_interruptible(&ep->recvwq);
+		}
+		spin_unlock(&ep->lock);
+		break;
+	}
+	spin_unlock_irqrestore(&ms_info.mi_eplock, sflags);
+
+	if (queued) {
+		atomic_long_inc(&ms_info.mi_dgram_rcvd);
+	} else {
+		atomic_long_inc(&ms_info.mi_dgram_drop);
+		kfree(dg);
+	}
+}
+
+static int
+_scif_sendto(struct endpt *ep, void *msg, int len, int flags,
+	struct scif_portID *dst, bool fromuser)
+{
+	struct micscif_dgram *dg;
+	struct micscif_dev *dev;
+	int err = 0;
+
+	if (flags || len <= 0 || len > SCIF_DGRAM_MAX_LEN ||
+		ep->state != SCIFEP_DGRAM)
+		return -EINVAL;
+
+	if (dst->node > MAX_BOARD_SUPPORTED)
+		return -ENODEV;
+
+	if (!(dg = kmalloc(sizeof(*dg) + len, GFP_KERNEL)))
+		return -ENOMEM;
+
+	if (fromuser) {
+		if (copy_from_user(dg->data, msg, len)) {
+			err = -EFAULT;
+			goto free_dg;
+		}
+	} else {
+		memcpy(dg->data, msg, len);
+	}
+	dg->src = ep->port;
+	dg->dst_port = dst->port;
+	dg->len = len;
+
+	if (dst->node == ms_info.mi_nodeid) {
+		atomic_long_inc(&ms_info.mi_dgram_sent);
+		micscif_dgram_deliver(dg);
+		return len;
+	}
+
+	dev = &scif_dev[dst->node];
+#ifdef _MIC_SCIF_
+	if ((SCIFDEV_INIT == dev->sd_state ||
+		SCIFDEV_STOPPED == dev->sd_state) && mic_p2p_enable)
+		if ((err = scif_p2p_connect(dst->node)))
+			goto free_dg;
+#endif
+	if (SCIFDEV_RUNNING != dev->sd_state &&
+		SCIFDEV_SLEEPING != dev->sd_state) {
+		err = -ENODEV;
+		goto free_dg;
+	}
+
+	micscif_inc_node_refcnt(dev, 1);
+	err = micscif_dgram_send(dev, dg);
+	micscif_dec_node_refcnt(dev, 1);
+free_dg:
+	kfree(dg);
+	return err ? err : len;
+}
+
+static int
+_scif_recvfrom(struct endpt *ep, void *msg, int len, int flags,
+	struct scif_portID *src, bool touser)
+{
+	struct micscif_dgram *dg;
+	unsigned long sflags;
+	int err = 0;
+
+	if (len < 0 || (flags & ~SCIF_RECV_BLOCK))
+		return -EINVAL;
+
+	for (;;) {
+		spin_lock_irqsave(&ep->lock, sflags);
+		if (ep->state != SCIFEP_DGRAM) {
+			spin_unlock_irqrestore(&ep->lock, sflags);
+			return -EINVAL;
+		}
+		if (ep->dgram_cnt) {
+			dg = list_first_entry(&ep->dgram_q,
+				struct micscif_dgram, list);
+			list_del(&dg->list);
+			ep->dgram_cnt--;
+			spin_unlock_irqrestore(&ep->lock, sflags);
+			break;
+		}
+		spin_unlock_irqrestore(&ep->lock, sflags);
+
+		if (!(flags & SCIF_RECV_BLOCK))
+			return -EAGAIN;
+		if (wait_event_interruptible(ep->recvwq,
+			ep->dgram_cnt || ep->state != SCIFEP_DGRAM))
+			return -EINTR;
+	}
+
+	len = min(len, dg->len);
+	if (src)
+		*src = dg->src;
+	if (touser) {
+		if (copy_to_user(msg, dg->data, len))
+			err = -EFAULT;
+	} else {
+		memcpy(msg, dg->data, len);
+	}
+	kfree(dg);
+	return err ? err : len;
+}
+
+/**
+ * scif_user_sendto() - Send a datagram
+ * @epd:        The end point address returned from scif_dgram_bind()
+ * @msg:	User address of the data
+ * @len:	Length of the data
+ * @flags:	Must be 0
+ * @dst:	Destination node and port
+ *
+ * This function is called from the driver IOCTL entry point
+ * only and is a wrapper for _scif_sendto().
+ */
+int
+scif_user_sendto(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *dst)
+{
+	pr_debug("SCIFAPI sendto (U): ep %p %s\n", epd,
+		scif_ep_states[((struct endpt *)epd)->state]);
+
+	return _scif_sendto((struct endpt *)epd, msg, len, flags,
+		dst, IS_USER_BUFFER);
+}
+
+/**
+ * scif_user_recvfrom() - Receive a datagram
+ * @epd:        The end point address returned from scif_dgram_bind()
+ * @msg:	User address to place data
+ * @len:	Length to receive
+ * @flags:	Syncronous or asynchronous access
+ * @src:	Returns the sender's node and port
+ *
+ * This function is called from the driver IOCTL entry point
+ * only and is a wrapper for _scif_recvfrom().
+ */
+int
+scif_user_recvfrom(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *src)
+{
+	pr_debug("SCIFAPI recvfrom (U): ep %p %s\n", epd,
+		scif_ep_states[((struct endpt *)epd)->state]);
+
+	return _scif_recvfrom((struct endpt *)epd, msg, len, flags,
+		src, IS_USER_BUFFER);
+}
+
+int
+scif_sendto(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *dst)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = _scif_sendto((struct endpt *)epd, msg, len, flags,
+		dst, !IS_USER_BUFFER);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_sendto);
+
+int
+scif_recvfrom(scif_epd_t epd, void *msg, int len, int flags,
+	struct scif_portID *src)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = _scif_recvfrom((struct endpt *)epd, msg, len, flags,
+		src, !IS_USER_BUFFER);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_recvfrom);
+
+/**
+ * scif_get_stats() - Read the traffic counters of an end point
+ * @epd:        The end point address returned from scif_open()
+ * @stats:	Returns the counters
+ */
+int
+__scif_get_stats(scif_epd_t epd, struct scif_ep_stats *stats)
+{
+	struct endpt *ep = (struct endpt *)epd;
+
+	pr_debug("SCIFAPI get_stats: ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	*stats = ep->stats;
+	return 0;
+}
+
+int
+scif_get_stats(scif_epd_t epd, struct scif_ep_stats *stats)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_get_stats(epd, stats);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_get_stats);
+
+/*
+ * Move the counters of an end point which is being closed to the totals
+ * of the node it was connected to. The ep_stats debugfs file sums both
+ * under mi_connlock so nothing is counted twice.
+ */
+void
+micscif_ep_stats_fold(struct endpt *ep)
+{
+	uint64_t *cnt = (uint64_t *)&ep->stats;
+	unsigned long sflags;
+	int i;
+
+	if (!ep->remote_dev)
+		return;
+	spin_lock_irqsave(&ms_info.mi_connlock, sflags);
+	for (i = 0; i < SCIF_EP_STATS_NR; i++)
+		if (cnt[i])
+			atomic_long_add((long)cnt[i],
+				&ep->remote_dev->sd_ep_stats[i]);
+	memset(&ep->stats, 0, sizeof(ep->stats));
+	spin_unlock_irqrestore(&ms_info.mi_connlock, sflags);
+}
+
+/**
+ * __scif_pin_pages - __scif_pin_pages() pins the physical pages which back
+ * the range of virtual address pages starting at addr and continuing for
+ * len bytes. addr and len are constrained to be multiples of the page size.
+ * A successful  scif_register() call returns an opaque pointer value
+ * which may be used in subsequent calls to scif_register_pinned_pages().
+ *
+ * Return Values
+ * Upon successful completion, __scif_pin_pages() returns a
+ * scif_pinned_pages_t value else an apt error is returned as documented
+ * in scif.h. Protections of the set of pinned pages are also returned by
+ * reference via out_prot.
+ */
+int
+__scif_pin_pages(void *addr, size_t len, int *out_prot,
+		int map_flags, scif_pinned_pages_t *pages)
+{
+	struct scif_pinned_pages *pinned_pages;
+	int nr_pages, err = 0, i;
+	bool vmalloc_addr = false;
+	bool try_upgrade = false;
+	int prot = *out_prot;
 
 	/* Unsupported flags */
 	if (map_flags & ~SCIF_MAP_KERNEL)
@@ -1953,6 +3094,10 @@ __scif_register_pinned_pages(scif_epd_t epd,
 		(offset < 0) ||
 		(offset + (off_t)len < offset)))
 		return -EINVAL;
+	/* scif_mmap() hands offsets from SCIF_QP_MMAP_BASE up to the QP */
+	if ((map_flags & SCIF_MAP_FIXED) &&
+		(uint64_t)offset + len > SCIF_QP_MMAP_BASE)
+		return -EADDRINUSE;
 
 	might_sleep();
 
@@ -2014,7 +3159,8 @@ __scif_register_pinned_pages(scif_epd_t epd,
 	/* No further failures expected. Insert new window */
 	mutex_lock(&ep->rma_info.rma_lock);
 	set_window_ref_count(window, pinned_pages->nr_pages);
-	micscif_insert_window(window, &ep->rma_info.reg_list);
+	micscif_insert_window(window, &ep->rma_info.reg_list,
+				&ep->rma_info.reg_tree);
 	mutex_unlock(&ep->rma_info.rma_lock);
 
 	return computed_offset;
@@ -2077,6 +3223,7 @@ __scif_get_pages(scif_epd_t epd, off_t offset, size_t len, struct scif_range **p
 	req.nr_bytes = len;
 	req.type = WINDOW_SINGLE;
 	req.head = &ep->rma_info.remote_reg_list;
+	req.tree = &ep->rma_info.remote_reg_tree;
 
 	mutex_lock(&ep->rma_info.rma_lock);
 	/* Does a valid window exist? */
@@ -2238,7 +3385,7 @@ __scif_put_pages(struct scif_range *pages)
 		msg.payload[0] = window->peer_window;
 		/* No error handling for notification messages */
 		micscif_nodeqp_send(ep->remote_dev, &msg, ep);
-		list_del(&window->list_member);
+		micscif_remove_window(window);
 		/* Destroy this window from the peer's registered AS */
 		micscif_destroy_remote_window(ep, window);
 	}
@@ -2362,6 +3509,10 @@ __scif_register(scif_epd_t epd, void *addr, size_t len, off_t offset,
 		(offset < 0) ||
 		(offset + (off_t)len < offset)))
 		return -EINVAL;
+	/* scif_mmap() hands offsets from SCIF_QP_MMAP_BASE up to the QP */
+	if ((map_flags & SCIF_MAP_FIXED) &&
+		(uint64_t)offset + len > SCIF_QP_MMAP_BASE)
+		return -EADDRINUSE;
 
 
 	might_sleep();
@@ -2429,7 +3580,8 @@ __scif_register(scif_epd_t epd, void *addr, size_t len, off_t offset,
 	/* No further failures expected. Insert new window */
 	mutex_lock(&ep->rma_info.rma_lock);
 	set_window_ref_count(window, pinned_pages->nr_pages);
-	micscif_insert_window(window, &ep->rma_info.reg_list);
+	micscif_insert_window(window, &ep->rma_info.reg_list,
+				&ep->rma_info.reg_tree);
 	mutex_unlock(&ep->rma_info.rma_lock);
 
 	pr_debug("SCIFAPI register: ep %p %s addr %p"
@@ -2497,6 +3649,7 @@ __scif_unregister(scif_epd_t epd, off_t offset, size_t len)
 	req.nr_bytes = len;
 	req.type = WINDOW_FULL;
 	req.head = &ep->rma_info.reg_list;
+	req.tree = &ep->rma_info.reg_tree;
 
 	micscif_inc_node_refcnt(ep->remote_dev, 1);
 	mutex_lock(&ep->rma_info.rma_lock);
@@ -2558,6 +3711,29 @@ unsigned int __scif_pollfd(struct file *f, poll_table *wait, struct endpt *ep)
 		goto return_scif_poll;
 	}
 
+	/* Datagrams can always be sent, they are dropped if there is no room */
+	if (ep->state == SCIFEP_DGRAM) {
+		if (!wait || wait->key & SCIF_POLLIN) {
+			spin_unlock_irqrestore(&ep->lock, sflags);
+			poll_wait(f, &ep->recvwq, wait);
+			spin_lock_irqsave(&ep->lock, sflags);
+			if (ep->dgram_cnt)
+				mask |= SCIF_POLLIN;
+		}
+		mask |= SCIF_POLLOUT;
+		goto return_scif_poll;
+	}
+
+	if ((!wait || wait->key & SCIF_POLLRMA) &&
+	    (ep->state == SCIFEP_CONNECTED ||
+	     ep->state == SCIFEP_DISCONNECTED)) {
+		spin_unlock_irqrestore(&ep->lock, sflags);
+		poll_wait(f, &ep->rma_info.async_wq, wait);
+		spin_lock_irqsave(&ep->lock, sflags);
+		if (!list_empty(&ep->rma_info.async_cq))
+			mask |= SCIF_POLLRMA;
+	}
+
 	if (!wait || wait->key & SCIF_POLLIN) {
 		if (ep->state != SCIFEP_CONNECTED &&
 		    ep->state != SCIFEP_LISTENING &&
@@ -2568,9 +3744,22 @@ unsigned int __scif_pollfd(struct file *f, poll_table *wait, struct endpt *ep)
 
 		spin_unlock_irqrestore(&ep->lock, sflags);
 		poll_wait(f, &ep->recvwq, wait);
-		spin_lock_irqsave(&ep->lock, sflags);
-		if (micscif_rb_count(&ep->qp_info.qp->inbound_q, 1))
+		spin_lock(&ep->rx_lock);
+		if (ep->qp_mapped) {
+			/* The process moved the ring and cleared the flags */
+			micscif_rb_resync(&ep->qp_info.qp->inbound_q);
+			ep->qp_info.qp->recv_armed = 0;
+		}
+		if (micscif_rb_count(&ep->qp_info.qp->inbound_q, 1) ||
+			ep->rndv_rx.state == RNDV_PENDING)
 			mask |= SCIF_POLLIN;
+		else if (wait && ep->state == SCIFEP_CONNECTED) {
+			micscif_qp_wait_recv(ep->qp_info.qp);
+			if (micscif_rb_count(&ep->qp_info.qp->inbound_q, 1))
+				mask |= SCIF_POLLIN;
+		}
+		spin_unlock(&ep->rx_lock);
+		spin_lock_irqsave(&ep->lock, sflags);
 	}
 
 	if (!wait || wait->key & SCIF_POLLOUT) {
@@ -2582,9 +3771,20 @@ unsigned int __scif_pollfd(struct file *f, poll_table *wait, struct endpt *ep)
 
 		spin_unlock_irqrestore(&ep->lock, sflags);
 		poll_wait(f, &ep->sendwq, wait);
-		spin_lock_irqsave(&ep->lock, sflags);
+		spin_lock(&ep->tx_lock);
+		if (ep->qp_mapped) {
+			micscif_rb_resync(&ep->qp_info.qp->outbound_q);
+			ep->qp_info.qp->send_armed = 0;
+		}
 		if (micscif_rb_space(&ep->qp_info.qp->outbound_q))
 			mask |= SCIF_POLLOUT;
+		else if (wait && ep->state == SCIFEP_CONNECTED) {
+			micscif_qp_wait_send(ep->qp_info.qp);
+			if (micscif_rb_space(&ep->qp_info.qp->outbound_q))
+				mask |= SCIF_POLLOUT;
+		}
+		spin_unlock(&ep->tx_lock);
+		spin_lock_irqsave(&ep->lock, sflags);
 	}
 
 return_scif_poll:
@@ -2599,6 +3799,354 @@ return_scif_poll:
 	return mask;
 }
 
+/*
+ * Endpoint QPs mapped into user space, see SCIF_QP_MMAP_* in scif_ioctl.h.
+ * Each endpoint gets its own SCIF_QP_MMAP_SPAN of file offsets so that a
+ * disconnect can zap its mappings with unmap_mapping_range(). Should the
+ * ids ever wrap onto a live endpoint its pages are merely faulted back in.
+ */
+#define SCIF_QP_MMAP_IDS \
+	((0x8000000000000000ULL - SCIF_QP_MMAP_BASE) / SCIF_QP_MMAP_SPAN)
+#define SCIF_QP_MMAP_REGION(off) \
+	((off) & ~(SCIF_QP_MMAP_REMOTE_CTRL - SCIF_QP_MMAP_LOCAL_CTRL - 1))
+
+static atomic_t micscif_qp_mmap_id = ATOMIC_INIT(0);
+
+/*
+ * Look up the physical range behind a SCIF_QP_MMAP_* region of a connected
+ * endpoint. @remote is set if it lives in the peer's memory.
+ */
+static int
+micscif_qp_region(struct endpt *ep, uint64_t region, phys_addr_t *phys,
+		size_t *size, bool *remote)
+{
+	struct micscif_qp *qp = ep->qp_info.qp;
+
+	switch (region) {
+	case SCIF_QP_MMAP_LOCAL_CTRL:
+		*phys = virt_to_phys((void *)&qp->ctrl);
+		*size = PAGE_SIZE;
+		*remote = false;
+		break;
+	case SCIF_QP_MMAP_REMOTE_CTRL:
+		*phys = get_phys_addr(qp->remote_qp_addr +
+			offsetof(struct micscif_qp, ctrl), ep->remote_dev);
+		*size = PAGE_SIZE;
+		*remote = true;
+		break;
+	case SCIF_QP_MMAP_RECV_RING:
+		*phys = virt_to_phys((void *)qp->inbound_q.rb_base);
+		*size = qp->inbound_q.size;
+		*remote = false;
+		break;
+	case SCIF_QP_MMAP_SEND_RING:
+		*phys = get_phys_addr(qp->remote_buf, ep->remote_dev);
+		*size = qp->outbound_q.size;
+		*remote = true;
+		break;
+	default:
+		return -EINVAL;
+	}
+	/* Neighbouring data must not leak into the mapping */
+	if (!IS_ALIGNED(*phys, PAGE_SIZE) || !IS_ALIGNED(*size, PAGE_SIZE))
+		return -EOPNOTSUPP;
+	return 0;
+}
+
+/*
+ * Insert the faulting page unless the endpoint was disconnected, which
+ * micscif_qp_mmap_revoke() serializes with through qp_mmap_lock.
+ */
+static int
+micscif_qp_vma_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct endpt *ep = vma->vm_private_data;
+	uint64_t off = ((uint64_t)vmf->pgoff << PAGE_SHIFT) - ep->qp_mmap_off;
+	uint64_t region = SCIF_QP_MMAP_REGION(off);
+	int ret = VM_FAULT_SIGBUS;
+	phys_addr_t phys;
+	size_t size;
+	bool remote;
+	int err;
+
+	mutex_lock(&ep->qp_mmap_lock);
+	if (SCIFEP_CONNECTED != ep->state || !scifdev_alive(ep))
+		goto unlock;
+	if (micscif_qp_region(ep, region, &phys, &size, &remote) ||
+		off - region >= size)
+		goto unlock;
+	err = vm_insert_pfn(vma, (unsigned long)vmf->virtual_address,
+			(phys + off - region) >> PAGE_SHIFT);
+	/* -EBUSY: another thread beat us to it */
+	if (!err || -EBUSY == err)
+		ret = VM_FAULT_NOPAGE;
+unlock:
+	mutex_unlock(&ep->qp_mmap_lock);
+	return ret;
+}
+
+static void
+micscif_qp_vma_open(struct vm_area_struct *vma)
+{
+	struct endpt *ep = vma->vm_private_data;
+	unsigned long sflags;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	ep->qp_mmap_cnt++;
+	spin_unlock_irqrestore(&ep->lock, sflags);
+}
+
+/*
+ * Give the QP back to the kernel once the last region is unmapped. The
+ * cached ring offsets are reloaded from wherever the process left the
+ * pointers. Called with mmap_sem held so it must not take the endpoint
+ * mutexes.
+ */
+static void
+micscif_qp_vma_close(struct vm_area_struct *vma)
+{
+	struct endpt *ep = vma->vm_private_data;
+	struct micscif_qp *qp = ep->qp_info.qp;
+	int nr_pages = (int)((vma->vm_end - vma->vm_start) >> PAGE_SHIFT);
+	unsigned long sflags;
+
+	spin_lock(&ep->tx_lock);
+	spin_lock(&ep->rx_lock);
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (!--ep->qp_mmap_cnt) {
+		ep->qp_mapped = false;
+		if (SCIFEP_CONNECTED == ep->state) {
+			micscif_rb_resync(&qp->outbound_q);
+			micscif_rb_resync(&qp->inbound_q);
+			micscif_qp_remote_flag(qp, recv_waiting) = 0;
+			micscif_qp_remote_flag(qp, send_waiting) = 0;
+			micscif_qp_remote_flag(qp, recv_polling) = 0;
+			qp->recv_armed = 0;
+			qp->send_armed = 0;
+			qp->rcvd_pending = 0;
+		}
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	spin_unlock(&ep->rx_lock);
+	spin_unlock(&ep->tx_lock);
+
+	micscif_destroy_node_dep(ep->remote_dev, nr_pages);
+	vma->vm_ops = NULL;
+	vma->vm_private_data = NULL;
+	micscif_rma_put_task(ep, nr_pages);
+}
+
+static const struct vm_operations_struct micscif_qp_vm_ops = {
+	.open = micscif_qp_vma_open,
+	.close = micscif_qp_vma_close,
+	.fault = micscif_qp_vma_fault,
+};
+
+/**
+ * micscif_qp_mmap - Map a region of the endpoint QP into user space
+ *	@vma: VMM memory area.
+ *	@ep: connected endpoint
+ *
+ * Mapping any region hands both rings to the process until the last
+ * region is unmapped again. Kernel send and recv fail with -EBUSY
+ * meanwhile, and large sends from the peer fall back to the ring.
+ */
+static int
+micscif_qp_mmap(struct vm_area_struct *vma, struct endpt *ep)
+{
+	uint64_t off = ((uint64_t)vma->vm_pgoff << PAGE_SHIFT) - ep->qp_mmap_off;
+	int nr_pages = (int)((vma->vm_end - vma->vm_start) >> PAGE_SHIFT);
+	unsigned long sflags;
+	phys_addr_t phys;
+	size_t size;
+	bool remote;
+	int err;
+
+	if (!ep->qp_mmap_off || off >= SCIF_QP_MMAP_SPAN)
+		return -EINVAL;
+	if (SCIFEP_CONNECTED != ep->state)
+		return -ENOTCONN;
+	if (!(ep->qp_info.qp->caps & SCIF_QP_CAP_MMAP))
+		return -EOPNOTSUPP;
+	if ((err = micscif_qp_region(ep, off, &phys, &size, &remote)))
+		return err;
+	if (!(vma->vm_flags & VM_SHARED) ||
+		vma->vm_end - vma->vm_start != size)
+		return -EINVAL;
+	/* Only the peer writes to these */
+	if (!remote) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	if ((err = micscif_rma_get_task(ep, nr_pages)))
+		return err;
+
+	mutex_lock(&ep->qp_mmap_lock);
+	ep->qp_mmap_mapping = vma->vm_file->f_mapping;
+	mutex_unlock(&ep->qp_mmap_lock);
+
+	spin_lock(&ep->tx_lock);
+	spin_lock(&ep->rx_lock);
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (SCIFEP_CONNECTED != ep->state) {
+		err = -ENOTCONN;
+	} else if (RNDV_IDLE != ep->rndv_tx.state ||
+		RNDV_IDLE != ep->rndv_rx.state) {
+		/* The kernel is in the middle of a large send */
+		err = -EBUSY;
+	} else {
+		ep->qp_mapped = true;
+		ep->qp_mmap_cnt++;
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	spin_unlock(&ep->rx_lock);
+	spin_unlock(&ep->tx_lock);
+	if (err) {
+		micscif_rma_put_task(ep, nr_pages);
+		return err;
+	}
+	/* Blocked kernel senders and receivers give up */
+	wake_up_interruptible(&ep->sendwq);
+	wake_up_interruptible(&ep->recvwq);
+
+	micscif_create_node_dep(ep->remote_dev, nr_pages);
+
+	/* Default prot for loopback and our own memory */
+	if (remote && !is_self_scifdev(ep->remote_dev)) {
+#ifdef _MIC_SCIF_
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+#else
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+#endif
+		vma->vm_flags |= VM_IO;
+	}
+	/* See scif_mmap() */
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_RESERVED | VM_PFNMAP;
+	vma->vm_ops = &micscif_qp_vm_ops;
+	vma->vm_private_data = ep;
+	return 0;
+}
+
+/**
+ * micscif_qp_mmap_revoke - Zap user mappings of a disconnected QP
+ *	@ep: endpoint which is no longer SCIFEP_CONNECTED
+ *
+ * Must be called before the peer is told it may free its QP. Faults on
+ * the mappings raise SIGBUS from then on.
+ */
+void
+micscif_qp_mmap_revoke(struct endpt *ep)
+{
+	mutex_lock(&ep->qp_mmap_lock);
+	if (ep->qp_mmap_mapping)
+		unmap_mapping_range(ep->qp_mmap_mapping, ep->qp_mmap_off,
+				SCIF_QP_MMAP_SPAN, 1);
+	mutex_unlock(&ep->qp_mmap_lock);
+}
+
+/**
+ * scif_user_qp_info - Describe the QP of a connected endpoint for mmap
+ *	@epd: endpoint descriptor
+ *	@info: filled in, see struct scifioctl_qp_info
+ */
+int
+scif_user_qp_info(scif_epd_t epd, struct scifioctl_qp_info *info)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	struct micscif_qp *qp = ep->qp_info.qp;
+	unsigned long sflags;
+	int err = 0;
+
+	pr_debug("SCIFAPI qp_info: ep %p %s\n", ep, scif_ep_states[ep->state]);
+
+	BUILD_BUG_ON(sizeof(struct scif_qp_ctrl) != sizeof(struct micscif_qp_ctrl));
+
+	if ((err = verify_epd(ep)))
+		return err;
+
+	spin_lock(&ep->tx_lock);
+	spin_lock(&ep->rx_lock);
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (SCIFEP_CONNECTED != ep->state) {
+		err = -ENOTCONN;
+		goto unlock;
+	}
+	if (!(qp->caps & SCIF_QP_CAP_MMAP)) {
+		err = -EOPNOTSUPP;
+		goto unlock;
+	}
+	if (!ep->qp_mmap_off)
+		ep->qp_mmap_off = SCIF_QP_MMAP_BASE + SCIF_QP_MMAP_SPAN *
+			((uint32_t)atomic_inc_return(&micscif_qp_mmap_id) %
+			 SCIF_QP_MMAP_IDS);
+	info->offset = ep->qp_mmap_off;
+	info->recv_size = qp->inbound_q.size;
+	info->send_size = qp->outbound_q.size;
+	info->flags = 0;
+	if (qp->caps & SCIF_QP_CAP_CREDIT)
+		info->flags |= SCIF_QP_INFO_CREDIT;
+	if (qp->caps & SCIF_QP_CAP_BUSY_POLL)
+		info->flags |= SCIF_QP_INFO_BUSY_POLL;
+	info->recv_read = *qp->inbound_q.read_ptr;
+	info->send_write = *qp->outbound_q.write_ptr;
+unlock:
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	spin_unlock(&ep->rx_lock);
+	spin_unlock(&ep->tx_lock);
+	return err;
+}
+
+static int
+micscif_qp_notify(struct endpt *ep, uint32_t uop)
+{
+	struct nodemsg notif_msg;
+
+	if (SCIFEP_CONNECTED != ep->state)
+		return -ENOTCONN;
+	if (!scifdev_alive(ep))
+		return -ENODEV;
+	notif_msg.src = ep->port;
+	notif_msg.uop = uop;
+	notif_msg.payload[0] = ep->remote_ep;
+	return micscif_nodeqp_send(ep->remote_dev, &notif_msg, ep);
+}
+
+/**
+ * scif_user_qp_notify - Ring the peer's doorbell for a mapped QP
+ *	@epd: endpoint descriptor
+ *	@flags: SCIF_QP_NOTIFY_SENT and/or SCIF_QP_NOTIFY_RCVD
+ *
+ * Sends what _scif_sendv() and _scif_recvv() would have, under the same
+ * locks so the loopback fast path stays usable.
+ */
+int
+scif_user_qp_notify(scif_epd_t epd, int flags)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	int err = 0;
+
+	if (!flags || (flags & ~(SCIF_QP_NOTIFY_SENT | SCIF_QP_NOTIFY_RCVD)))
+		return -EINVAL;
+	if ((err = verify_epd(ep)))
+		return err;
+
+	micscif_inc_node_refcnt(ep->remote_dev, 1);
+	if (flags & SCIF_QP_NOTIFY_SENT) {
+		spin_lock(&ep->tx_lock);
+		err = micscif_qp_notify(ep, SCIF_CLIENT_SENT);
+		spin_unlock(&ep->tx_lock);
+	}
+	if (!err && (flags & SCIF_QP_NOTIFY_RCVD)) {
+		spin_lock(&ep->rx_lock);
+		err = micscif_qp_notify(ep, SCIF_CLIENT_RCVD);
+		spin_unlock(&ep->rx_lock);
+	}
+	micscif_dec_node_refcnt(ep->remote_dev, 1);
+	return err;
+}
+
 /*
  * The private data field of each VMA used to mmap a remote window
  * points to an instance of struct vma_pvt
@@ -2684,6 +4232,7 @@ void scif_munmap(struct vm_area_struct *vma)
 	req.prot = ((vma)->vm_flags) & (VM_READ | VM_WRITE);
 	req.type = WINDOW_PARTIAL;
 	req.head = &ep->rma_info.remote_reg_list;
+	req.tree = &ep->rma_info.remote_reg_tree;
 
 	micscif_inc_node_refcnt(ep->remote_dev, 1);
 	mutex_lock(&ep->rma_info.rma_lock);
@@ -2741,6 +4290,11 @@ scif_mmap(struct vm_area_struct *vma, scif_epd_t epd)
 
 	might_sleep();
 
+	/* No window, fixed or generated, reaches into the QP offsets */
+	BUILD_BUG_ON(VA_GEN_MIN + VA_GEN_RANGE > SCIF_QP_MMAP_BASE);
+	if (start_offset >= SCIF_QP_MMAP_BASE)
+		return micscif_qp_mmap(vma, ep);
+
 	if ((err = micscif_rma_get_task(ep, nr_pages)))
 		return err;
 
@@ -2760,6 +4314,7 @@ scif_mmap(struct vm_area_struct *vma, scif_epd_t epd)
 	req.prot = ((vma)->vm_flags) & (VM_READ | VM_WRITE);
 	req.type = WINDOW_PARTIAL;
 	req.head = &ep->rma_info.remote_reg_list;
+	req.tree = &ep->rma_info.remote_reg_tree;
 
 	micscif_inc_node_refcnt(ep->remote_dev, 1);
 	mutex_lock(&ep->rma_info.rma_lock);
@@ -2876,6 +4431,82 @@ int scif_writeto(scif_epd_t epd, off_t loffset, size_t len,
 }
 EXPORT_SYMBOL(scif_writeto);
 
+/**
+ * scif_readfrom_async() - Queue a copy from the remote connection
+ * @epd:	endpoint descriptor
+ * @loffset:	offset in local registered address space to which to copy
+ * @len:	length of range to copy
+ * @roffset:	offset in remote registered address space from which to copy
+ * @flags:	flags
+ * @cookie:	returns the handle of the RMA
+ *
+ * Return Values
+ *	Upon successful completion, scif_readfrom_async() returns zero
+ *	else an apt error is returned as documented in scif.h.
+ */
+int
+scif_readfrom_async(scif_epd_t epd, off_t loffset, size_t len,
+				off_t roffset, int flags, uint64_t *cookie)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = micscif_rma_async_submit(epd, loffset, len, roffset, flags,
+			REMOTE_TO_LOCAL, cookie);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_readfrom_async);
+
+/**
+ * scif_writeto_async() - Queue a copy to the remote connection
+ * @epd:	endpoint descriptor
+ * @loffset:	offset in local registered address space from which to copy
+ * @len:	length of range to copy
+ * @roffset:	offset in remote registered address space to which to copy
+ * @flags:	flags
+ * @cookie:	returns the handle of the RMA
+ *
+ * Return Values
+ *	Upon successful completion, scif_writeto_async() returns zero
+ *	else an apt error is returned as documented in scif.h.
+ */
+int
+scif_writeto_async(scif_epd_t epd, off_t loffset, size_t len,
+				off_t roffset, int flags, uint64_t *cookie)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = micscif_rma_async_submit(epd, loffset, len, roffset, flags,
+			LOCAL_TO_REMOTE, cookie);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_writeto_async);
+
+/**
+ * scif_rma_completions() - Reap completed asynchronous RMAs
+ * @epd:	endpoint descriptor
+ * @comp:	returns the completions
+ * @nr:		number of entries in comp
+ * @timeout:	milliseconds to wait for one, negative for infinite
+ *
+ * Return Values
+ *	Upon successful completion, scif_rma_completions() returns the number
+ *	of completions stored else an apt error is returned as documented in
+ *	scif.h.
+ */
+int
+scif_rma_completions(scif_epd_t epd, struct scif_rma_completion *comp,
+				int nr, long timeout)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = micscif_rma_async_reap(epd, comp, nr, timeout, false);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_rma_completions);
+
 #define HOST_LOOPB_MAGIC_MARK 0xdead
 
 /**
@@ -3165,6 +4796,24 @@ int micscif_pci_dev(uint16_t node, struct pci_dev **pdev)
 #endif
 }
 
+/**
+ * micscif_numa_node:
+ * @node: node ID
+ *
+ * Return the NUMA node memory shared with a node should be allocated on,
+ * or -1 if there is no preference.
+ */
+int micscif_numa_node(uint16_t node)
+{
+#ifdef _MIC_SCIF_
+	return -1;
+#else
+	if (!node)
+		return -1;
+	return get_per_dev_ctx(node - 1)->numa_node;
+#endif
+}
+
 #ifndef _MIC_SCIF_
 /**
  * micscif_pci_info:
@@ -44,6 +44,7 @@
 #include "scif.h"
 #include <linux/proc_fs.h>
 #include <linux/debugfs.h>
+#include <linux/completion.h>
 
 static char *window_type[] = {
 	"NONE",
@@ -261,6 +262,7 @@ static int
 scif_debug_read(char *buf, char **start, off_t offset, int len, int *eof, void *data)
 {
 	int l = 0;
+	int i;
 
 	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
 		"Num gtt_entries %d\n", ms_info.nr_gtt_entries);
@@ -283,6 +285,31 @@ scif_debug_read(char *buf, char **start, off_t offset, int len, int *eof, void *
 	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
 		"Huge Pages Enabled %d Detected 2mb %lld 4k %lld\n",
 		mic_huge_page_enable, ms_info.nr_2mb_pages, ms_info.nr_4k_pages);
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"Recv busy poll %u usecs rtt stats %s\n", ms_info.mi_busy_poll_us,
+		ms_info.en_rtt_stats ? "enabled" : "disabled");
+	for (i = 0; i < SCIF_RTT_MAX; i++) {
+		static const char *rtt_types[SCIF_RTT_MAX] = {
+			"ready", "polled", "slept"};
+		long cnt = atomic_long_read(&ms_info.mi_rtt_cnt[i]);
+		long ns = atomic_long_read(&ms_info.mi_rtt_ns[i]);
+
+		l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+			"  rtt %-6s count %ld avg %ld ns\n",
+			rtt_types[i], cnt, cnt ? ns / cnt : 0);
+	}
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"Endpoint QP pool size %u hits %ld misses %ld\n",
+		ms_info.mi_qp_pool_size,
+		atomic_long_read(&ms_info.mi_qp_pool_hit),
+		atomic_long_read(&ms_info.mi_qp_pool_miss));
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"Datagrams sent %ld rcvd %ld dropped %ld\n",
+		atomic_long_read(&ms_info.mi_dgram_sent),
+		atomic_long_read(&ms_info.mi_dgram_rcvd),
+		atomic_long_read(&ms_info.mi_dgram_drop));
 #ifdef RMA_DEBUG
 	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
 		"rma_alloc_cnt %ld rma_pin_cnt %ld mmu_notif %ld rma_unaligned_cpu_cnt %ld\n",
@@ -320,19 +347,20 @@ scif_dev_info(char *buf, char **start, off_t offset, int len, int *eof, void *da
 		ms_info.mi_total, ms_info.mi_nodeid, ms_info.mi_maxid);
 
 	l += snprintf(buf + l, len - l > 0 ? len - l : 0 ,
-		"%-16s\t%-16s %-16s\t%-16s\t%-8s\t%-8s\t%-8s\n",
+		"%-16s\t%-16s %-16s\t%-16s\t%-8s\t%-8s\t%-8s\t%-8s\n",
 		"node_id", "state", "scif_ref_cnt", "scif_map_ref_cnt",
-		"wait_status", "conn count", "numa_node");
+		"wait_status", "conn count", "numa_node", "qp_pool");
 
 	for (node = 0; node <= ms_info.mi_maxid; node++)
 		l += snprintf(buf + l, len - l > 0 ? len - l : 0,
-			"%-16d\t%-16s\t0x%-16lx\t%-16d\t%-16lld\t%-16d\t%-16d\n",
+			"%-16d\t%-16s\t0x%-16lx\t%-16d\t%-16lld\t%-16d\t%-16d\t%-16d\n",
 			scif_dev[node].sd_node, scifdev_state[scif_dev[node].sd_state],
 			atomic_long_read(&scif_dev[node].scif_ref_cnt),
 			scif_dev[node].scif_map_ref_cnt,
 			scif_dev[node].sd_wait_status,
 			scif_dev[node].num_active_conn,
-			scif_dev[node].sd_numa_node);
+			scif_dev[node].sd_numa_node,
+			scif_dev[node].sd_qp_pool_cnt);
 #ifdef _MIC_SCIF_
 	mutex_unlock(&ms_info.mi_conflock);
 #endif
@@ -341,6 +369,158 @@ scif_dev_info(char *buf, char **start, off_t offset, int len, int *eof, void *da
 	return l;
 }
 
+static int
+scif_port_bench_read(char *buf, char **start, off_t offset, int len, int *eof, void *data)
+{
+	int l;
+
+	if ((l = scif_port_bench(buf, len)) < 0)
+		return l;
+	*eof = 1;
+	return l;
+}
+
+static int
+scif_window_bench_read(char *buf, char **start, off_t offset, int len, int *eof, void *data)
+{
+	int l;
+
+	if ((l = scif_window_bench(buf, len)) < 0)
+		return l;
+	*eof = 1;
+	return l;
+}
+
+#define SCIF_LOOPB_BENCH_LOOPS	10000
+
+struct scif_loopb_bench {
+	scif_epd_t		lep;
+	int			err;
+	struct completion	done;
+};
+
+/* Accepts one connection and echoes back SCIF_LOOPB_BENCH_LOOPS messages */
+static int scif_loopb_bench_echo(void *arg)
+{
+	struct scif_loopb_bench *bench = arg;
+	struct scif_portID peer;
+	scif_epd_t nep;
+	uint64_t val;
+	int i, err;
+
+	if ((err = scif_accept(bench->lep, &peer, &nep, SCIF_ACCEPT_SYNC)) < 0)
+		goto done;
+	for (i = 0; i < SCIF_LOOPB_BENCH_LOOPS; i++) {
+		if ((err = scif_recv(nep, &val, sizeof(val), SCIF_RECV_BLOCK)) < 0 ||
+			(err = scif_send(nep, &val, sizeof(val), SCIF_SEND_BLOCK)) < 0)
+			break;
+	}
+	scif_close(nep);
+done:
+	bench->err = err < 0 ? err : 0;
+	complete(&bench->done);
+	return 0;
+}
+
+/*
+ * Time a connect and SCIF_LOOPB_BENCH_LOOPS 8 byte round trips between
+ * two endpoints on this node.
+ */
+static int
+scif_loopb_bench_run(long *connect_ns, long *rtt_ns)
+{
+	struct scif_loopb_bench bench;
+	struct scif_portID dst;
+	struct task_struct *task;
+	scif_epd_t cep;
+	uint64_t val = 0;
+	ktime_t start;
+	int i, err;
+
+	init_completion(&bench.done);
+	if (!(bench.lep = scif_open()))
+		return -ENOMEM;
+	if ((err = scif_bind(bench.lep, 0)) < 0)
+		goto close_lep;
+	dst.node = ms_info.mi_nodeid;
+	dst.port = (uint16_t)err;
+	if ((err = scif_listen(bench.lep, 1)) < 0)
+		goto close_lep;
+	if (!(cep = scif_open())) {
+		err = -ENOMEM;
+		goto close_lep;
+	}
+	task = kthread_run(scif_loopb_bench_echo, &bench, "scif_loopb_bench");
+	if (IS_ERR(task)) {
+		err = PTR_ERR(task);
+		goto close_cep;
+	}
+
+	start = ktime_get();
+	if ((err = scif_connect(cep, &dst)) < 0) {
+		/* Let the echo thread out of scif_accept() */
+		scif_close(bench.lep);
+		bench.lep = NULL;
+		goto wait_echo;
+	}
+	*connect_ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < SCIF_LOOPB_BENCH_LOOPS; i++) {
+		if ((err = scif_send(cep, &val, sizeof(val), SCIF_SEND_BLOCK)) < 0 ||
+			(err = scif_recv(cep, &val, sizeof(val), SCIF_RECV_BLOCK)) < 0)
+			break;
+		val++;
+	}
+	*rtt_ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start)) /
+			SCIF_LOOPB_BENCH_LOOPS;
+	if (err > 0)
+		err = 0;
+wait_echo:
+	/* Closing our end also gets the echo thread out of scif_recv() */
+	scif_close(cep);
+	cep = NULL;
+	wait_for_completion(&bench.done);
+	if (!err)
+		err = bench.err;
+close_cep:
+	if (cep)
+		scif_close(cep);
+close_lep:
+	if (bench.lep)
+		scif_close(bench.lep);
+	return err;
+}
+
+/*
+ * Compare loopback connect and round trip latency with messages bounced
+ * through the loopback workqueues and handed to their handler directly.
+ */
+static int
+scif_loopb_bench(char *buf, char **start, off_t offset, int len, int *eof, void *data)
+{
+	static const char *modes[] = {"workqueue", "direct"};
+	uint8_t saved = ms_info.en_loopb_direct;
+	long connect_ns, rtt_ns;
+	int l = 0, i, err;
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"%-10s %-12s %-12s\n", "mode", "connect ns", "rtt ns");
+	for (i = 0; i < ARRAY_SIZE(modes); i++) {
+		ms_info.en_loopb_direct = i;
+		connect_ns = rtt_ns = 0;
+		if ((err = scif_loopb_bench_run(&connect_ns, &rtt_ns)))
+			l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+				"%-10s error %d\n", modes[i], err);
+		else
+			l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+				"%-10s %-12ld %-12ld\n", modes[i], connect_ns, rtt_ns);
+	}
+	ms_info.en_loopb_direct = saved;
+	*eof = 1;
+	return l;
+}
+
 static int
 scif_suspend(char *buf, char **start, off_t offset, int len, int *eof, void *data)
 {
@@ -432,6 +612,20 @@ scif_get_reg_cache_limit(char *buf, char **start, off_t offset, int len, int *eo
 	return l;
 }
 
+static int
+scif_reg_cache_stats(char *buf, char **start, off_t offset, int len, int *eof, void *data)
+{
+	int l = 0;
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+			"hits %ld misses %ld evictions %ld\n",
+			atomic_long_read(&ms_info.mi_rma_tc_hit),
+			atomic_long_read(&ms_info.mi_rma_tc_miss),
+			atomic_long_read(&ms_info.mi_rma_tc_evict));
+	*eof = 1;
+	return l;
+}
+
 static int
 scif_set_reg_cache_limit(struct file *file, const char __user *buffer,
 					unsigned long len, void *unused)
@@ -480,7 +674,8 @@ static int smpt_seq_show(struct seq_file *s, void *pos)
 {
 	uint64_t bid = (uint64_t)s->private;
 	mic_ctx_t *mic_ctx;
-	int i;
+	int i, start, end, in_use, free_runs = 0, largest_run = 0;
+	struct mic_smpt_stats stats;
 	unsigned long flags;
 
 	mic_ctx = get_per_dev_ctx(bid);
@@ -497,7 +692,28 @@ static int smpt_seq_show(struct seq_file *s, void *pos)
 			seq_printf(s,"%9s|%-10d| %-#14llx %-10lld \n",
 			" ",  i, mic_ctx->mic_smpt[i].dma_addr, mic_ctx->mic_smpt[i].ref_count);
 		}
+		/* A free run is a maximal range of unreferenced entries */
+		for (i = 0; i < NUM_SMPT_ENTRIES_IN_USE; i = end) {
+			start = find_next_zero_bit(mic_ctx->smpt_busy,
+					NUM_SMPT_ENTRIES_IN_USE, i);
+			if (start >= NUM_SMPT_ENTRIES_IN_USE)
+				break;
+			end = find_next_bit(mic_ctx->smpt_busy,
+					NUM_SMPT_ENTRIES_IN_USE, start);
+			free_runs++;
+			largest_run = max(largest_run, end - start);
+		}
+		in_use = bitmap_weight(mic_ctx->smpt_busy, NUM_SMPT_ENTRIES_IN_USE);
+		stats = mic_ctx->smpt_stats;
 		spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
+
+		seq_printf(s,
+			"=================================================================\n");
+		seq_printf(s, "Entries in use %d/%d free runs %d largest free run %d\n",
+			in_use, NUM_SMPT_ENTRIES_IN_USE, free_runs, largest_run);
+		seq_printf(s, "map %llu unmap %llu reuse %llu alloc %llu fail %llu\n",
+			stats.map_count, stats.unmap_count, stats.reuse_count,
+			stats.alloc_count, stats.fail_count);
 	}
 
 	seq_printf(s,
@@ -524,6 +740,134 @@ static struct file_operations smpt_file_ops = {
 	.release = smpt_debug_release
 };
 
+static int nodeqp_stats_seq_show(struct seq_file *s, void *pos)
+{
+	struct micscif_msg_stats *stats;
+	long cnt, ns;
+	int i;
+
+	seq_printf(s, "%-24s %4s %12s %12s %10s %10s\n", "Message", "Prio",
+		"Count", "Ahead", "Avg ns", "Max ns");
+	for (i = 1; i <= SCIF_MAX_MSG; i++) {
+		stats = &micscif_msg_stats[i];
+		if (!(cnt = atomic_long_read(&stats->cnt)))
+			continue;
+		ns = atomic_long_read(&stats->ns);
+		seq_printf(s, "%-24s %4s %12ld %12ld %10ld %10ld\n",
+			micscif_msg_name(i),
+			SCIF_MSG_PRIO_HIGH == micscif_msg_prio[i] ? "high" : "low",
+			cnt, atomic_long_read(&stats->ahead),
+			ns / cnt, stats->max_ns);
+	}
+	return 0;
+}
+
+static int nodeqp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nodeqp_stats_seq_show, inode->i_private);
+}
+
+/* Any write clears the statistics */
+static ssize_t nodeqp_stats_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	int i;
+
+	for (i = 0; i <= SCIF_MAX_MSG; i++) {
+		atomic_long_set(&micscif_msg_stats[i].cnt, 0);
+		atomic_long_set(&micscif_msg_stats[i].ahead, 0);
+		atomic_long_set(&micscif_msg_stats[i].ns, 0);
+		micscif_msg_stats[i].max_ns = 0;
+	}
+	return count;
+}
+
+static struct file_operations nodeqp_stats_ops = {
+	.owner   = THIS_MODULE,
+	.open    = nodeqp_stats_open,
+	.read    = seq_read,
+	.write   = nodeqp_stats_write,
+	.llseek  = seq_lseek,
+	.release = single_release
+};
+
+/* In the order of struct scif_ep_stats */
+static const char *ep_stats_names[] = {
+	"tx_bytes", "tx_msgs", "tx_full", "tx_notify", "tx_rndv",
+	"rx_bytes", "rx_msgs", "rx_empty", "rx_notify", "rx_rndv",
+	"rma_calls", "rma_bytes", "rc_hits", "rc_misses"};
+
+static void ep_stats_seq_row(struct seq_file *s, uint64_t *cnt)
+{
+	int i;
+
+	for (i = 0; i < SCIF_EP_STATS_NR; i++)
+		seq_printf(s, " %12llu", cnt[i]);
+	seq_putc(s, '\n');
+}
+
+/*
+ * Counters of the endpoints on the connected and disconnected lists, and
+ * per node the totals of those plus the ones already closed.
+ */
+static int ep_stats_seq_show(struct seq_file *s, void *pos)
+{
+	uint64_t total[SCIF_EP_STATS_NR];
+	struct list_head *lists[] = {
+		&ms_info.mi_connected, &ms_info.mi_disconnected};
+	struct list_head *item;
+	struct endpt *ep;
+	unsigned long sflags;
+	int node, i, j;
+
+	BUILD_BUG_ON(ARRAY_SIZE(ep_stats_names) != SCIF_EP_STATS_NR);
+
+	seq_printf(s, "%-18s %6s %9s", "Endpoint", "Port", "Peer");
+	for (i = 0; i < SCIF_EP_STATS_NR; i++)
+		seq_printf(s, " %12s", ep_stats_names[i]);
+	seq_putc(s, '\n');
+	spin_lock_irqsave(&ms_info.mi_connlock, sflags);
+	for (j = 0; j < ARRAY_SIZE(lists); j++) {
+		list_for_each(item, lists[j]) {
+			ep = list_entry(item, struct endpt, list);
+			seq_printf(s, "%p %6d %2d:%-6d", ep, ep->port.port,
+				ep->peer.node, ep->peer.port);
+			ep_stats_seq_row(s, (uint64_t *)&ep->stats);
+		}
+	}
+
+	for (node = 0; node <= ms_info.mi_maxid; node++) {
+		for (i = 0; i < SCIF_EP_STATS_NR; i++)
+			total[i] = atomic_long_read(&scif_dev[node].sd_ep_stats[i]);
+		for (j = 0; j < ARRAY_SIZE(lists); j++) {
+			list_for_each(item, lists[j]) {
+				ep = list_entry(item, struct endpt, list);
+				if (ep->remote_dev != &scif_dev[node])
+					continue;
+				for (i = 0; i < SCIF_EP_STATS_NR; i++)
+					total[i] += ((uint64_t *)&ep->stats)[i];
+			}
+		}
+		seq_printf(s, "%-18s %6s %2d%7s", "node total", "", node, "");
+		ep_stats_seq_row(s, total);
+	}
+	spin_unlock_irqrestore(&ms_info.mi_connlock, sflags);
+	return 0;
+}
+
+static int ep_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ep_stats_seq_show, inode->i_private);
+}
+
+static struct file_operations ep_stats_ops = {
+	.owner   = THIS_MODULE,
+	.open    = ep_stats_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release
+};
+
 #ifndef _MIC_SCIF_
 static int log_buf_seq_show(struct seq_file *s, void *pos)
 {
@@ -602,6 +946,9 @@ scif_proc_init(void)
 		create_proc_read_entry("suspend", 0444, scif_proc, scif_suspend, NULL);
 		create_proc_read_entry("fail_suspend", 0444, scif_proc, scif_fail_suspend, NULL);
 		create_proc_read_entry("resume", 0444, scif_proc, scif_resume, NULL);
+		create_proc_read_entry("port_bench", 0400, scif_proc, scif_port_bench_read, NULL);
+		create_proc_read_entry("loopb_bench", 0400, scif_proc, scif_loopb_bench, NULL);
+		create_proc_read_entry("window_bench", 0400, scif_proc, scif_window_bench_read, NULL);
 #ifdef _MIC_SCIF_
 		create_proc_read_entry("crash", 0444, scif_proc, scif_crash, NULL);
 		create_proc_read_entry("bugon", 0444, scif_proc, scif_bugon, NULL);
@@ -611,6 +958,7 @@ scif_proc_init(void)
 			temp->read_proc = scif_get_reg_cache_limit;
 			temp->data = NULL;
 		}
+		create_proc_read_entry("reg_cache_stats", 0444, scif_proc, scif_reg_cache_stats, NULL);
 	}
 }
 
@@ -621,6 +969,12 @@ mic_debug_init(void)
 	if ((mic_debug = debugfs_create_dir("mic_debug", NULL))) {
 		debugfs_create_file("smpt", 0444, mic_debug, NULL, &smpt_file_ops);
 		debugfs_create_u8("enable_msg_logging", 0666, mic_debug, &(ms_info.en_msg_log));
+		debugfs_create_u8("enable_rtt_stats", 0666, mic_debug, &(ms_info.en_rtt_stats));
+		debugfs_create_u8("enable_nodeqp_stats", 0666, mic_debug, &(ms_info.en_nodeqp_stats));
+		debugfs_create_file("nodeqp_stats", 0644, mic_debug, NULL, &nodeqp_stats_ops);
+		debugfs_create_file("ep_stats", 0444, mic_debug, NULL, &ep_stats_ops);
+		debugfs_create_u32("qp_pool_size", 0644, mic_debug, &(ms_info.mi_qp_pool_size));
+		debugfs_create_u8("enable_loopb_direct", 0644, mic_debug, &(ms_info.en_loopb_direct));
 	}
 }
 #else
@@ -641,6 +995,13 @@ mic_debug_init(mic_ctx_t *mic_ctx)
 			debugfs_create_file("log_buf", 0444, child, (void*)id, &log_buf_ops);
 		}
 		debugfs_create_u8("enable_msg_logging", 0666, mic_debug, &(ms_info.en_msg_log));
+		debugfs_create_u8("enable_rtt_stats", 0666, mic_debug, &(ms_info.en_rtt_stats));
+		debugfs_create_u8("enable_nodeqp_stats", 0666, mic_debug, &(ms_info.en_nodeqp_stats));
+		debugfs_create_file("nodeqp_stats", 0644, mic_debug, NULL, &nodeqp_stats_ops);
+		debugfs_create_file("ep_stats", 0444, mic_debug, NULL, &ep_stats_ops);
+		debugfs_create_u32("qp_pool_size", 0644, mic_debug, &(ms_info.mi_qp_pool_size));
+		debugfs_create_u8("enable_loopb_direct", 0644, mic_debug, &(ms_info.en_loopb_direct));
+		debugfs_create_u8("enable_rb_nt_copy", 0644, mic_debug, &(ms_info.en_rb_nt_copy));
 	}
 }
 #endif
@@ -656,6 +1017,7 @@ scif_proc_cleanup(void)
 {
 	if (scif_proc) {
 		remove_proc_entry("reg_cache_limit", scif_proc);
+		remove_proc_entry("reg_cache_stats", scif_proc);
 		remove_proc_entry("ep", scif_proc);
 		remove_proc_entry("rma_window", scif_proc);
 		remove_proc_entry("rma_xfer", scif_proc);
@@ -664,6 +1026,9 @@ scif_proc_cleanup(void)
 		remove_proc_entry("suspend", scif_proc);
 		remove_proc_entry("fail_suspend", scif_proc);
 		remove_proc_entry("resume", scif_proc);
+		remove_proc_entry("port_bench", scif_proc);
+		remove_proc_entry("loopb_bench", scif_proc);
+		remove_proc_entry("window_bench", scif_proc);
 #ifdef _MIC_SCIF_
 		remove_proc_entry("crash", scif_proc);
 		remove_proc_entry("bugon", scif_proc);
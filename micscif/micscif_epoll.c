@@ -0,0 +1,370 @@
+/*
+ * Copyright 2010-2013 Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2,
+ * as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Disclaimer: The codes contained in these modules may be specific to
+ * the Intel Software Development Platform codenamed Knights Ferry,
+ * and the Intel product codenamed Knights Corner, and are not backward
+ * compatible with other Intel products. Additionally, Intel will NOT
+ * support the codes or instruction set in future products.
+ *
+ * Intel offers no warranty of any kind regarding the code. This code is
+ * licensed on an "AS IS" basis and Intel is not obligated to provide
+ * any support, assistance, installation, training, or other services
+ * of any kind. Intel is also not obligated to provide any updates,
+ * enhancements or extensions. Intel specifically disclaims any warranty
+ * of merchantability, non-infringement, fitness for any particular
+ * purpose, and any other warranty.
+ *
+ * Further, Intel disclaims all liability of any kind, including but
+ * not limited to liability for infringement of any proprietary rights,
+ * relating to the use of the code, even if Intel is notified of the
+ * possibility of such liability. Except as expressly stated in an Intel
+ * license agreement provided with this code and agreed upon with Intel,
+ * no license, express or implied, by estoppel or otherwise, to any
+ * intellectual property rights is granted herein.
+ */
+
+/*
+ * Endpoint readiness sets.
+ *
+ * Each endpoint in a set has an item hooked on the wait queues its
+ * readiness changes are signalled on, recvwq and sendwq when connected
+ * and conwq when listening. Every wakeup on those queues from
+ * micscif_api.c and micscif_nodeqp.c then moves the item onto the ready
+ * list of its set, and scif_epoll_wait() only re-evaluates __scif_pollfd()
+ * for items on that list. Level triggered items which are still ready
+ * are put back on the list for the next call.
+ */
+
+#include "mic/micscif.h"
+
+static int
+micscif_epoll_wake(wait_queue_t *wait, unsigned mode, int sync, void *key)
+{
+	struct micscif_epitem *epi = wait->private;
+	struct micscif_epset *set = epi->set;
+	unsigned long sflags;
+
+	spin_lock_irqsave(&set->lock, sflags);
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &set->rdllist);
+	spin_unlock_irqrestore(&set->lock, sflags);
+	wake_up(&set->wq);
+	return 0;
+}
+
+/* The items are already on the endpoint wait queues */
+static void
+micscif_epoll_qproc(struct file *filp, wait_queue_head_t *whead,
+		poll_table *pt)
+{
+}
+
+static void
+micscif_epoll_queue(struct micscif_epitem *epi)
+{
+	unsigned long sflags;
+
+	spin_lock_irqsave(&epi->set->lock, sflags);
+	if (list_empty(&epi->rdllink))
+		list_add_tail(&epi->rdllink, &epi->set->rdllist);
+	spin_unlock_irqrestore(&epi->set->lock, sflags);
+	wake_up(&epi->set->wq);
+}
+
+static int
+micscif_epoll_insert(struct micscif_epset *set, struct endpt *ep,
+		struct scif_epoll_event *event)
+{
+	struct micscif_epitem *epi;
+	unsigned long sflags;
+	int i;
+
+	if (!(epi = kzalloc(sizeof(*epi), GFP_KERNEL)))
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&epi->rdllink);
+	epi->set = set;
+	epi->ep = ep;
+	epi->event = *event;
+
+	/*
+	 * The endpoint wait queues are only set up by scif_listen(),
+	 * scif_connect()/scif_accept() and scif_dgram_bind(), and not set up
+	 * again after that.
+	 */
+	spin_lock_irqsave(&ep->lock, sflags);
+	switch (ep->state) {
+	case SCIFEP_LISTENING:
+		epi->whead[epi->nwait++] = &ep->conwq;
+		break;
+	case SCIFEP_CONNECTED:
+	case SCIFEP_DISCONNECTED:
+		epi->whead[epi->nwait++] = &ep->recvwq;
+		epi->whead[epi->nwait++] = &ep->sendwq;
+		epi->whead[epi->nwait++] = &ep->rma_info.async_wq;
+		break;
+	case SCIFEP_DGRAM:
+		epi->whead[epi->nwait++] = &ep->recvwq;
+		break;
+	default:
+		break;
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+
+	if (!epi->nwait) {
+		kfree(epi);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < epi->nwait; i++) {
+		init_waitqueue_func_entry(&epi->wait[i], micscif_epoll_wake);
+		epi->wait[i].private = epi;
+		add_wait_queue(epi->whead[i], &epi->wait[i]);
+	}
+
+	mutex_lock(&set->mtx);
+	list_add_tail(&epi->setlink, &set->items);
+	mutex_unlock(&set->mtx);
+	list_add_tail(&epi->eplink, &ep->epitems);
+
+	/* Let the next scif_epoll_wait() look at its current state */
+	micscif_epoll_queue(epi);
+	return 0;
+}
+
+/* Called with mi_epoll_lock held */
+static void
+micscif_epoll_remove(struct micscif_epitem *epi)
+{
+	struct micscif_epset *set = epi->set;
+	unsigned long sflags;
+	int i;
+
+	/* No wakeup can look at the item once it is off the wait queues */
+	for (i = 0; i < epi->nwait; i++)
+		remove_wait_queue(epi->whead[i], &epi->wait[i]);
+
+	mutex_lock(&set->mtx);
+	spin_lock_irqsave(&set->lock, sflags);
+	list_del_init(&epi->rdllink);
+	spin_unlock_irqrestore(&set->lock, sflags);
+	list_del(&epi->setlink);
+	mutex_unlock(&set->mtx);
+	list_del(&epi->eplink);
+	kfree(epi);
+}
+
+static struct micscif_epitem *
+micscif_epoll_find(struct micscif_epset *set, struct endpt *ep)
+{
+	struct micscif_epitem *epi;
+
+	list_for_each_entry(epi, &ep->epitems, eplink)
+		if (epi->set == set)
+			return epi;
+	return NULL;
+}
+
+scif_epset_t
+scif_epoll_create(void)
+{
+	struct micscif_epset *set;
+
+	if (!(set = kzalloc(sizeof(*set), GFP_KERNEL)))
+		return NULL;
+
+	mutex_init(&set->mtx);
+	spin_lock_init(&set->lock);
+	INIT_LIST_HEAD(&set->rdllist);
+	INIT_LIST_HEAD(&set->items);
+	init_waitqueue_head(&set->wq);
+	return set;
+}
+EXPORT_SYMBOL(scif_epoll_create);
+
+int
+__scif_epoll_ctl(scif_epset_t set, int op, scif_epd_t epd,
+		struct scif_epoll_event *event)
+{
+	struct endpt *ep = (struct endpt *)epd;
+	struct micscif_epitem *epi;
+	int err = 0;
+
+	pr_debug("SCIFAPI epoll_ctl: set %p op %d ep %p %s\n",
+		set, op, ep, scif_ep_states[ep->state]);
+
+	mutex_lock(&ms_info.mi_epoll_lock);
+	epi = micscif_epoll_find(set, ep);
+	switch (op) {
+	case SCIF_EPOLL_CTL_ADD:
+		if (epi)
+			err = -EEXIST;
+		else
+			err = micscif_epoll_insert(set, ep, event);
+		break;
+	case SCIF_EPOLL_CTL_MOD:
+		if (!epi) {
+			err = -ENOENT;
+			break;
+		}
+		mutex_lock(&set->mtx);
+		epi->event = *event;
+		mutex_unlock(&set->mtx);
+		micscif_epoll_queue(epi);
+		break;
+	case SCIF_EPOLL_CTL_DEL:
+		if (epi)
+			micscif_epoll_remove(epi);
+		else
+			err = -ENOENT;
+		break;
+	default:
+		err = -EINVAL;
+	}
+	mutex_unlock(&ms_info.mi_epoll_lock);
+	return err;
+}
+
+int
+scif_epoll_ctl(scif_epset_t set, int op, scif_epd_t epd,
+		struct scif_epoll_event *event)
+{
+	int ret;
+	get_kref_count(epd);
+	ret = __scif_epoll_ctl(set, op, epd, event);
+	put_kref_count(epd);
+	return ret;
+}
+EXPORT_SYMBOL(scif_epoll_ctl);
+
+/*
+ * Report up to @maxevents ready items. Items are taken off the ready list
+ * before being polled, so a wakeup racing with the poll queues them again.
+ * Called with set->mtx held, which keeps the items and their endpoints
+ * from going away.
+ */
+static int
+micscif_epoll_scan(struct micscif_epset *set, struct scif_epoll_event *events,
+		int maxevents, poll_table *pt)
+{
+	struct micscif_epitem *epi;
+	LIST_HEAD(txlist);
+	unsigned long sflags;
+	unsigned int mask;
+	int count = 0;
+
+	spin_lock_irqsave(&set->lock, sflags);
+	while (count < maxevents && !list_empty(&set->rdllist)) {
+		epi = list_first_entry(&set->rdllist, struct micscif_epitem,
+				rdllink);
+		list_del_init(&epi->rdllink);
+		spin_unlock_irqrestore(&set->lock, sflags);
+
+		pt->key = (epi->event.events & ~SCIF_EPOLLET) |
+				SCIF_POLLERR | SCIF_POLLHUP;
+		mask = __scif_pollfd(NULL, pt, epi->ep) & pt->key;
+
+		spin_lock_irqsave(&set->lock, sflags);
+		if (!mask)
+			continue;
+		events[count].events = mask;
+		events[count].pad = 0;
+		events[count].data = epi->event.data;
+		count++;
+		if (!(epi->event.events & SCIF_EPOLLET) &&
+			list_empty(&epi->rdllink))
+			list_add_tail(&epi->rdllink, &txlist);
+	}
+	list_splice_tail(&txlist, &set->rdllist);
+	spin_unlock_irqrestore(&set->lock, sflags);
+	return count;
+}
+
+static bool
+micscif_epoll_has_ready(struct micscif_epset *set)
+{
+	unsigned long sflags;
+	bool ready;
+
+	spin_lock_irqsave(&set->lock, sflags);
+	ready = !list_empty(&set->rdllist);
+	spin_unlock_irqrestore(&set->lock, sflags);
+	return ready;
+}
+
+int
+scif_epoll_wait(scif_epset_t set, struct scif_epoll_event *events,
+		int maxevents, long timeout_msecs)
+{
+	poll_table pt;
+	long timeout;
+	int count;
+
+	if (maxevents <= 0)
+		return -EINVAL;
+
+	timeout = timeout_msecs < 0 ? MAX_SCHEDULE_TIMEOUT :
+			msecs_to_jiffies(timeout_msecs);
+	init_poll_funcptr(&pt, micscif_epoll_qproc);
+
+	for (;;) {
+		mutex_lock(&set->mtx);
+		count = micscif_epoll_scan(set, events, maxevents, &pt);
+		mutex_unlock(&set->mtx);
+		if (count || !timeout)
+			break;
+		if (signal_pending(current)) {
+			count = -EINTR;
+			break;
+		}
+		timeout = wait_event_interruptible_timeout(set->wq,
+				micscif_epoll_has_ready(set), timeout);
+		if (timeout < 0) {
+			count = -EINTR;
+			break;
+		}
+	}
+	return count;
+}
+EXPORT_SYMBOL(scif_epoll_wait);
+
+int
+scif_epoll_close(scif_epset_t set)
+{
+	struct micscif_epitem *epi, *tmp;
+
+	mutex_lock(&ms_info.mi_epoll_lock);
+	list_for_each_entry_safe(epi, tmp, &set->items, setlink)
+		micscif_epoll_remove(epi);
+	mutex_unlock(&ms_info.mi_epoll_lock);
+	mutex_destroy(&set->mtx);
+	kfree(set);
+	return 0;
+}
+EXPORT_SYMBOL(scif_epoll_close);
+
+/* Take a closing endpoint out of every set it is in */
+void
+micscif_epoll_ep_close(struct endpt *ep)
+{
+	struct micscif_epitem *epi, *tmp;
+
+	mutex_lock(&ms_info.mi_epoll_lock);
+	list_for_each_entry_safe(epi, tmp, &ep->epitems, eplink)
+		micscif_epoll_remove(epi);
+	mutex_unlock(&ms_info.mi_epoll_lock);
+}
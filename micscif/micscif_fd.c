@@ -41,9 +41,42 @@
 
 struct mic_priv {
 	scif_epd_t	epd;
+	scif_epset_t	epset;	/* Created by the first SCIF_EPOLL_CTL */
 };
 
 
+/*
+ * Copy in the segment list of SCIF_SENDMSG/SCIF_RECVMSG, using @fast_iov
+ * for short lists. The segments still point to user memory.
+ */
+static int
+scif_iov_from_user(struct scifioctl_iovec __user *uiov, int iovcnt,
+		struct kvec *fast_iov, struct kvec **out_iov)
+{
+	struct scifioctl_iovec seg;
+	struct kvec *iov = fast_iov;
+	int i;
+
+	if (iovcnt < 0 || iovcnt > UIO_MAXIOV)
+		return -EINVAL;
+
+	if (iovcnt > UIO_FASTIOV &&
+		!(iov = kmalloc(iovcnt * sizeof(*iov), GFP_KERNEL)))
+		return -ENOMEM;
+
+	for (i = 0; i < iovcnt; i++) {
+		if (copy_from_user(&seg, &uiov[i], sizeof(seg))) {
+			if (iov != fast_iov)
+				kfree(iov);
+			return -EFAULT;
+		}
+		iov[i].iov_base = seg.base;
+		iov[i].iov_len = (size_t)seg.len;
+	}
+	*out_iov = iov;
+	return 0;
+}
+
 int
 scif_fdopen(struct file *f)
 {
@@ -55,6 +88,8 @@ scif_fdopen(struct file *f)
 	if (!priv)
 		return -ENOMEM;
 
+	priv->epset = NULL;
+
 	/* SCIF device */
 	if (!(priv->epd = __scif_open())) {
 		kfree(priv);
@@ -75,6 +110,8 @@ scif_fdclose(struct file *f)
 	 * count is greater than 1.  This accounts for the fork() issue.
 	 */
 	if (atomic64_read(&f->f_count) == 0) {
+		if (priv->epset)
+			scif_epoll_close(priv->epset);
 		err = __scif_close(priv->epd);
 		kfree(priv);
 	}
@@ -161,8 +198,28 @@ scif_process_ioctl(struct file *f, unsigned int cmd, uint64_t arg)
 
 		return 0;
 	}
+	case SCIF_DGRAM_BIND:
+	{
+		int pn;
+
+		if (copy_from_user(&pn, argp, sizeof(pn))) {
+			return -EFAULT;
+		}
+
+		if ((pn = __scif_dgram_bind(priv->epd, pn)) < 0) {
+			return pn;
+		}
+
+		if (copy_to_user(argp, &pn, sizeof(pn))) {
+			return -EFAULT;
+		}
+
+		return 0;
+	}
 	case SCIF_LISTEN:
 		return __scif_listen(priv->epd, arg);
+	case SCIF_BUSY_POLL:
+		return __scif_busy_poll(priv->epd, (int)arg);
 	case SCIF_CONNECT:
 	{
 		struct scifioctl_connect req;
@@ -319,6 +376,77 @@ recv_err:
 		scif_err_debug(err, "scif_recv");
 		return err;
 	}
+	case SCIF_SENDTO:
+	{
+		struct scifioctl_dgram dgram;
+
+		if (copy_from_user(&dgram, argp,
+			sizeof(struct scifioctl_dgram))) {
+			err = -EFAULT;
+			goto sendto_err;
+		}
+
+		if ((err = scif_user_sendto(priv->epd, dgram.msg,
+			dgram.len, dgram.flags, &dgram.peer)) < 0)
+			goto sendto_err;
+
+		if (copy_to_user(&((struct scifioctl_dgram*)argp)->out_len,
+					&err, sizeof(err))) {
+			err = -EFAULT;
+			goto sendto_err;
+		}
+		err = 0;
+sendto_err:
+		scif_err_debug(err, "scif_sendto");
+		return err;
+	}
+	case SCIF_RECVFROM:
+	{
+		struct scifioctl_dgram dgram;
+
+		if (copy_from_user(&dgram, argp,
+			sizeof(struct scifioctl_dgram))) {
+			err = -EFAULT;
+			goto recvfrom_err;
+		}
+
+		if ((err = scif_user_recvfrom(priv->epd, dgram.msg,
+			dgram.len, dgram.flags, &dgram.peer)) < 0)
+			goto recvfrom_err;
+
+		dgram.out_len = err;
+		if (copy_to_user(argp, &dgram, sizeof(struct scifioctl_dgram))) {
+			err = -EFAULT;
+			goto recvfrom_err;
+		}
+		err = 0;
+recvfrom_err:
+		scif_err_debug(err, "scif_recvfrom");
+		return err;
+	}
+	case SCIF_QP_INFO:
+	{
+		struct scifioctl_qp_info info;
+
+		if ((err = scif_user_qp_info(priv->epd, &info)))
+			goto qp_info_err;
+		if (copy_to_user(argp, &info, sizeof(info)))
+			err = -EFAULT;
+qp_info_err:
+		scif_err_debug(err, "scif_qp_info");
+		return err;
+	}
+	case SCIF_QP_NOTIFY:
+		return scif_user_qp_notify(priv->epd, (int)arg);
+	case SCIF_GET_STATS:
+	{
+		struct scif_ep_stats stats;
+
+		__scif_get_stats(priv->epd, &stats);
+		if (copy_to_user(argp, &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
 	case SCIF_REG:
 	{
 		struct mic_priv *priv = (struct mic_priv *)((f)->private_data);
@@ -435,6 +563,65 @@ vwriteto_err:
 		scif_err_debug(err, "scif_vwriteto");
 		return err;
 	}
+	case SCIF_READFROM_ASYNC:
+	case SCIF_WRITETO_ASYNC:
+	{
+		struct scifioctl_rma_async req;
+
+		if (copy_from_user(&req, argp, sizeof(req))) {
+			err = -EFAULT;
+			goto rma_async_err;
+		}
+		err = micscif_rma_async_submit(priv->epd,
+					req.loffset,
+					req.len,
+					req.roffset,
+					req.flags,
+					cmd == SCIF_READFROM_ASYNC ?
+					REMOTE_TO_LOCAL : LOCAL_TO_REMOTE,
+					&req.cookie);
+		if (err)
+			goto rma_async_err;
+		if (copy_to_user(&((struct scifioctl_rma_async*)argp)->cookie,
+			&req.cookie, sizeof(req.cookie)))
+			err = -EFAULT;
+rma_async_err:
+		scif_err_debug(err, "scif_rma_async");
+		return err;
+	}
+	case SCIF_RMA_COMPLETIONS:
+	{
+		struct scifioctl_rma_completions req;
+		struct scifioctl_rma_completions __user *ureq = argp;
+		int count = 0;
+
+		if (copy_from_user(&req, argp, sizeof(req))) {
+			err = -EFAULT;
+			goto rma_completions_err;
+		}
+
+		/*
+		 * Completions are consumed once copied to req.comp, so make
+		 * sure their number can be returned before reaping any.
+		 */
+		if (copy_to_user(&ureq->out_count, &count, sizeof(count))) {
+			err = -EFAULT;
+			goto rma_completions_err;
+		}
+
+		err = micscif_rma_async_reap(priv->epd, req.comp, req.nr,
+					req.timeout, true);
+		if (err < 0)
+			goto rma_completions_err;
+
+		count = err;
+		err = 0;
+		if (copy_to_user(&ureq->out_count, &count, sizeof(count)))
+			err = -EFAULT;
+rma_completions_err:
+		scif_err_debug(err, "scif_rma_completions");
+		return err;
+	}
 	case SCIF_GET_NODEIDS:
 	{
 		struct scifioctl_nodeIDs nodeIDs;
@@ -521,6 +708,141 @@ fence_signal_err:
 		scif_err_debug(err, "scif_fence_signal");
 		return err;
 	}
+	case SCIF_SENDMSG:
+	case SCIF_RECVMSG:
+	{
+		struct mic_priv *priv = (struct mic_priv *)((f)->private_data);
+		struct scifioctl_msgv msgv;
+		struct kvec fast_iov[UIO_FASTIOV];
+		struct kvec *iov;
+
+		if (copy_from_user(&msgv, argp, sizeof(msgv))) {
+			err = -EFAULT;
+			goto msgv_err;
+		}
+
+		if ((err = scif_iov_from_user(msgv.iov, msgv.iovcnt,
+				fast_iov, &iov)))
+			goto msgv_err;
+
+		if (cmd == SCIF_SENDMSG)
+			err = scif_user_sendmsg(priv->epd, iov, msgv.iovcnt,
+					msgv.flags);
+		else
+			err = scif_user_recvmsg(priv->epd, iov, msgv.iovcnt,
+					msgv.flags);
+		if (iov != fast_iov)
+			kfree(iov);
+		if (err < 0)
+			goto msgv_err;
+
+		if (copy_to_user(&((struct scifioctl_msgv*)argp)->out_len,
+			&err, sizeof(err))) {
+			err = -EFAULT;
+			goto msgv_err;
+		}
+		err = 0;
+msgv_err:
+		scif_err_debug(err, cmd == SCIF_SENDMSG ?
+			"scif_sendmsg" : "scif_recvmsg");
+		return err;
+	}
+	case SCIF_EPOLL_CTL:
+	{
+		struct scifioctl_epoll_ctl ctl;
+		struct scif_epoll_event event;
+		scif_epset_t set;
+		struct file *tf;
+
+		if (copy_from_user(&ctl, argp, sizeof(ctl))) {
+			err = -EFAULT;
+			goto epoll_ctl_err;
+		}
+
+		if (!(tf = fget(ctl.fd))) {
+			err = -EBADF;
+			goto epoll_ctl_err;
+		}
+		/* Only other SCIF endpoints can be watched */
+		if (tf->f_op != f->f_op || tf->f_dentry->d_inode->i_rdev !=
+				f->f_dentry->d_inode->i_rdev) {
+			err = -EBADF;
+			goto epoll_ctl_put;
+		}
+
+		if (!priv->epset) {
+			if (!(set = scif_epoll_create())) {
+				err = -ENOMEM;
+				goto epoll_ctl_put;
+			}
+			if (cmpxchg(&priv->epset, NULL, set))
+				scif_epoll_close(set);
+		}
+
+		event.events = ctl.events;
+		event.pad = 0;
+		event.data = ctl.data;
+		err = __scif_epoll_ctl(priv->epset, ctl.op,
+			((struct mic_priv *)tf->private_data)->epd, &event);
+epoll_ctl_put:
+		fput(tf);
+epoll_ctl_err:
+		scif_err_debug(err, "scif_epoll_ctl");
+		return err;
+	}
+	case SCIF_EPOLL_WAIT:
+	{
+		struct scifioctl_epoll_wait req;
+		struct scifioctl_epoll_event __user *uevents;
+		struct scifioctl_epoll_event uevent;
+		struct scif_epoll_event *events;
+		int i, maxevents;
+
+		if (copy_from_user(&req, argp, sizeof(req))) {
+			err = -EFAULT;
+			goto epoll_wait_err;
+		}
+
+		if (!priv->epset || req.maxevents <= 0) {
+			err = -EINVAL;
+			goto epoll_wait_err;
+		}
+
+		/* Returning fewer events than asked for is always allowed */
+		maxevents = min_t(int, req.maxevents,
+				PAGE_SIZE / sizeof(*events));
+		if (!(events = kmalloc(maxevents * sizeof(*events), GFP_KERNEL))) {
+			err = -ENOMEM;
+			goto epoll_wait_err;
+		}
+
+		err = scif_epoll_wait(priv->epset, events, maxevents, req.timeout);
+		if (err < 0)
+			goto epoll_wait_free;
+
+		uevents = req.events;
+		for (i = 0; i < err; i++) {
+			uevent.events = events[i].events;
+			uevent.pad = 0;
+			uevent.data = events[i].data;
+			if (copy_to_user(&uevents[i], &uevent, sizeof(uevent))) {
+				err = -EFAULT;
+				goto epoll_wait_free;
+			}
+		}
+
+		if (copy_to_user(&((struct scifioctl_epoll_wait*)argp)->out_count,
+			&err, sizeof(err))) {
+			err = -EFAULT;
+			goto epoll_wait_free;
+		}
+		err = 0;
+epoll_wait_free:
+		kfree(events);
+epoll_wait_err:
+		scif_err_debug(err, "scif_epoll_wait");
+		return err;
+	}
 	}
 	return -EINVAL;
 }
@@ -168,6 +168,10 @@ static int micscif_release(struct inode *in, struct file *f)
 static int micscif_uninit_qp(struct micscif_dev *scifdev)
 {
 	int i;
+
+	micscif_nodeqp_lanes_uninit(scifdev);
+	micscif_dgram_stop(scifdev);
+	micscif_qp_pool_drain(scifdev);
 	/* first, iounmap/unmap/free any memory we mapped */
 	for (i = 0; i < scifdev->n_qpairs; i++) {
 		iounmap(scifdev->qpairs[i].remote_qp);
@@ -200,6 +204,8 @@ void micscif_destroy_base(void)
 #ifdef CONFIG_MMU_NOTIFIER
 	destroy_workqueue(ms_info.mi_mmu_notif_wq);
 #endif
+	destroy_workqueue(ms_info.mi_rma_async_wq);
+	destroy_workqueue(ms_info.mi_lane_wq);
 	destroy_workqueue(ms_info.mi_misc_wq);
 	sysfs_remove_group(&micinfo.m_scifdev->kobj, &scif_attr_group);
 	device_destroy(micinfo.m_class, micinfo.m_dev + 1);
@@ -233,6 +239,7 @@ static void _micscif_exit(void)
 		kfree(temp);
 	}
 	mutex_destroy(&ms_info.mi_event_cblock);
+	mutex_destroy(&ms_info.mi_epoll_lock);
 
 #ifdef CONFIG_MK1OM
 	micpm_device_unregister(&mic_deviceevent);
@@ -352,6 +359,7 @@ static int micscif_setup_base(void)
 	mutex_init(&ms_info.mi_fencelock);
 	INIT_LIST_HEAD(&ms_info.mi_uaccept);
 	INIT_LIST_HEAD(&ms_info.mi_listen);
+	INIT_LIST_HEAD(&ms_info.mi_dgram);
 	INIT_LIST_HEAD(&ms_info.mi_zombie);
 	INIT_LIST_HEAD(&ms_info.mi_connected);
 	INIT_LIST_HEAD(&ms_info.mi_disconnected);
@@ -373,6 +381,14 @@ static int micscif_setup_base(void)
 	}
 	INIT_WORK(&ms_info.mi_mmu_notif_work, micscif_mmu_notif_handler);
 #endif
+	if (!(ms_info.mi_lane_wq = create_workqueue("SCIF_LANES"))) {
+		result = -ENOMEM;
+		goto destroy_mmu_wq;
+	}
+	if (!(ms_info.mi_rma_async_wq = create_workqueue("SCIF_RMA_ASYNC"))) {
+		result = -ENOMEM;
+		goto destroy_lane_wq;
+	}
 	ms_info.mi_watchdog_to = DEFAULT_WATCHDOG_TO;
 #ifdef MIC_IS_EMULATION
 	ms_info.mi_watchdog_enabled = 0;
@@ -381,8 +397,26 @@ static int micscif_setup_base(void)
 #endif
 	ms_info.mi_rma_tc_limit = SCIF_RMA_TEMP_CACHE_LIMIT;
 	ms_info.mi_proxy_dma_threshold = SCIF_PROXY_DMA_THRESHOLD;
+	ms_info.mi_endpt_qp_size = ENDPT_QP_DEFAULT_SIZE;
+	ms_info.mi_qp_notify_pct = SCIF_QP_NOTIFY_PCT;
+	ms_info.mi_rndv_threshold = SCIF_RNDV_THRESHOLD;
+	ms_info.mi_busy_poll_us = 0;
+	ms_info.mi_nodeqp_lanes = SCIF_NODEQP_LANES;
+	ms_info.mi_qp_pool_size = SCIF_QP_POOL_DEFAULT;
+	ms_info.mi_rma_dma_chans = SCIF_RMA_DMA_CHANS;
+	ms_info.mi_rma_stripe_threshold = SCIF_RMA_STRIPE_THRESHOLD;
 	ms_info.en_msg_log = 0;
+	ms_info.en_rtt_stats = 0;
+	ms_info.en_nodeqp_stats = 0;
+	ms_info.en_loopb_direct = 1;
+	ms_info.en_rb_nt_copy = 0;
 	return result;
+destroy_lane_wq:
+	destroy_workqueue(ms_info.mi_lane_wq);
+destroy_mmu_wq:
+#ifdef CONFIG_MMU_NOTIFIER
+	destroy_workqueue(ms_info.mi_mmu_notif_wq);
+#endif
 destroy_misc_wq:
 	destroy_workqueue(ms_info.mi_misc_wq);
 remove_group:
@@ -433,6 +467,8 @@ static int micscif_init(void)
 		init_waitqueue_head(&scif_dev[i].sd_mmap_wq);
 		init_waitqueue_head(&scif_dev[i].sd_wq);
 		init_waitqueue_head(&scif_dev[i].sd_p2p_wq);
+		micscif_qp_pool_init(&scif_dev[i]);
+		micscif_dgram_init(&scif_dev[i]);
 	}
 
 	// Setup the host node access information
@@ -449,6 +485,8 @@ static int micscif_init(void)
 	init_waitqueue_head(&scif_dev[SCIF_HOST_NODE].sd_wq);
 	init_waitqueue_head(&scif_dev[SCIF_HOST_NODE].sd_mmap_wq);
 	mutex_init(&scif_dev[SCIF_HOST_NODE].sd_lock);
+	micscif_qp_pool_init(&scif_dev[SCIF_HOST_NODE]);
+	micscif_dgram_init(&scif_dev[SCIF_HOST_NODE]);
 	gtt_phys_base = readl(scif_dev[SCIF_HOST_NODE].mm_sbox + SBOX_GTT_PHY_BASE);
 	gtt_phys_base *= ((4) * 1024);
 	pr_debug("GTT PHY BASE in GDDR 0x%llx\n", gtt_phys_base);
@@ -485,6 +523,7 @@ static int micscif_init(void)
 	pr_debug("micscif_init(): setup_card_qp \n");
 	host_queue_phys = scif_addr;
 	mutex_init(&ms_info.mi_event_cblock);
+	mutex_init(&ms_info.mi_epoll_lock);
 	mutex_init(&ms_info.mi_conflock);
 	INIT_LIST_HEAD(&ms_info.mi_event_cb);
 
@@ -177,6 +177,10 @@ void micscif_cleanup_qp(struct micscif_dev *dev)
 {
 	struct micscif_qp *qp;
 
+	micscif_nodeqp_lanes_uninit(dev);
+	micscif_dgram_stop(dev);
+	micscif_qp_pool_drain(dev);
+
 	qp = &dev->qpairs[0];
 
 	if (!qp)
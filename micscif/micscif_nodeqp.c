@@ -47,6 +47,8 @@
 #include "mic_common.h"
 #endif
 #include "mic/micscif_map.h"
+#include <linux/hash.h>
+#include <linux/rcupdate.h>
 
 #define SBOX_MMIO_LENGTH	0x10000
 /* FIXME: HW spefic, define someplace else */
@@ -60,40 +62,265 @@ static void micscif_qp_testboth(struct micscif_dev *scifdev);
 bool mic_p2p_enable = 1;
 bool mic_p2p_proxy_enable = 1;
 
+/*
+ * Unmap and free the rings of a QP set up with micscif_setup_qp_connect()
+ * or micscif_setup_qp_accept(), but not the QP itself.
+ */
+int micscif_teardown_qp(struct micscif_qp *qp, struct micscif_dev *dev)
+{
+	int err = 0;
+
+	if (qp->outbound_q.rb_base)
+		scif_iounmap((void *)qp->outbound_q.rb_base,
+			qp->outbound_q.size, dev);
+	if (qp->remote_qp)
+		scif_iounmap((void *)qp->remote_qp,
+			sizeof(struct micscif_qp), dev);
+	if (qp->local_buf) {
+		err = unmap_from_aperture(
+			qp->local_buf,
+			dev, qp->inbound_q.size);
+		if (err) {
+			printk(KERN_ERR "%s %d error %d\n", 
+				__func__, __LINE__, err);
+			return err;
+		}
+	}
+	if (qp->local_qp) {
+		err = unmap_from_aperture(qp->local_qp, dev,
+				sizeof(struct micscif_qp));
+		if (err) {
+			printk(KERN_ERR "%s %d error %d\n", 
+				__func__, __LINE__, err);
+			return err;
+		}
+	}
+	if (qp->inbound_q.rb_base)
+		kfree((void *)qp->inbound_q.rb_base);
+	return err;
+}
+
+/*
+ * Endpoint QP pool.
+ *
+ * Mapping the receive ring and the QP of an endpoint into the aperture
+ * of the peer is the expensive part of setting up a connection. Every
+ * remote node keeps up to mi_qp_pool_size QPs which only need the peer's
+ * half mapped to be used. A work item tops the pool up in the background
+ * and micscif_teardown_ep() returns QPs to it.
+ */
+static struct micscif_qp *
+micscif_qp_pool_alloc(struct micscif_dev *scifdev, uint32_t size)
+{
+	int nid = micscif_numa_node(scifdev->sd_node);
+	struct micscif_qp *qp;
+	void *local_q;
+
+	if (!(qp = kzalloc_node(sizeof(*qp), GFP_KERNEL, nid)))
+		return NULL;
+	if (!(local_q = kzalloc_node(size, GFP_KERNEL, nid)))
+		goto free_qp;
+	qp->magic = SCIFEP_MAGIC;
+	qp->inbound_q.rb_base = local_q;
+	qp->inbound_q.size = size;
+	if (map_virt_into_aperture(&qp->local_buf, local_q, scifdev, size) ||
+		map_virt_into_aperture(&qp->local_qp, qp, scifdev,
+			sizeof(struct micscif_qp))) {
+		micscif_teardown_qp(qp, scifdev);
+		goto free_qp;
+	}
+	return qp;
+free_qp:
+	kfree(qp);
+	return NULL;
+}
+
+static void
+micscif_qp_pool_free(struct micscif_dev *scifdev, struct micscif_qp *qp)
+{
+	if (!micscif_teardown_qp(qp, scifdev))
+		kfree(qp);
+}
+
+static void
+micscif_qp_pool_refill(struct work_struct *work)
+{
+	struct micscif_dev *scifdev =
+		container_of(work, struct micscif_dev, sd_qp_pool_work);
+	uint32_t size = ms_info.mi_endpt_qp_size;
+	struct micscif_qp *qp;
+
+	while (SCIFDEV_RUNNING == scifdev->sd_state) {
+		/* Drop QPs sized for an older mi_endpt_qp_size first */
+		spin_lock(&scifdev->sd_qp_pool_lock);
+		qp = NULL;
+		if (scifdev->sd_qp_pool_cnt && scifdev->sd_qp_pool
+			[scifdev->sd_qp_pool_cnt - 1]->inbound_q.size != size)
+			qp = scifdev->sd_qp_pool[--scifdev->sd_qp_pool_cnt];
+		spin_unlock(&scifdev->sd_qp_pool_lock);
+		if (qp) {
+			micscif_qp_pool_free(scifdev, qp);
+			continue;
+		}
+
+		if (!scifdev->sd_qp_pool_on || scifdev->sd_qp_pool_cnt >=
+			min_t(uint32_t, ms_info.mi_qp_pool_size, SCIF_QP_POOL_MAX))
+			break;
+		if (!(qp = micscif_qp_pool_alloc(scifdev, size)))
+			break;
+
+		spin_lock(&scifdev->sd_qp_pool_lock);
+		if (scifdev->sd_qp_pool_on && scifdev->sd_qp_pool_cnt <
+			min_t(uint32_t, ms_info.mi_qp_pool_size, SCIF_QP_POOL_MAX)) {
+			scifdev->sd_qp_pool[scifdev->sd_qp_pool_cnt++] = qp;
+			qp = NULL;
+		}
+		spin_unlock(&scifdev->sd_qp_pool_lock);
+		if (qp) {
+			micscif_qp_pool_free(scifdev, qp);
+			break;
+		}
+	}
+}
+
+void micscif_qp_pool_init(struct micscif_dev *scifdev)
+{
+	spin_lock_init(&scifdev->sd_qp_pool_lock);
+	INIT_WORK(&scifdev->sd_qp_pool_work, micscif_qp_pool_refill);
+}
+
+/*
+ * micscif_qp_pool_fill() - Start pooling QPs for a remote node
+ * @scifdev: Remote node which has just come up
+ */
+void micscif_qp_pool_fill(struct micscif_dev *scifdev)
+{
+	if (is_self_scifdev(scifdev))
+		return;
+	spin_lock(&scifdev->sd_qp_pool_lock);
+	scifdev->sd_qp_pool_on = true;
+	spin_unlock(&scifdev->sd_qp_pool_lock);
+	if (ms_info.mi_qp_pool_size)
+		queue_work(ms_info.mi_misc_wq, &scifdev->sd_qp_pool_work);
+}
+
+/*
+ * micscif_qp_pool_drain() - Stop pooling QPs for a remote node
+ * @scifdev: Remote node going away
+ *
+ * Frees every pooled QP. QPs torn down afterwards are freed right away.
+ */
+void micscif_qp_pool_drain(struct micscif_dev *scifdev)
+{
+	struct micscif_qp *qp;
+
+	if (is_self_scifdev(scifdev))
+		return;
+	spin_lock(&scifdev->sd_qp_pool_lock);
+	scifdev->sd_qp_pool_on = false;
+	spin_unlock(&scifdev->sd_qp_pool_lock);
+	cancel_work_sync(&scifdev->sd_qp_pool_work);
+
+	do {
+		spin_lock(&scifdev->sd_qp_pool_lock);
+		qp = scifdev->sd_qp_pool_cnt ?
+			scifdev->sd_qp_pool[--scifdev->sd_qp_pool_cnt] : NULL;
+		spin_unlock(&scifdev->sd_qp_pool_lock);
+		if (qp)
+			micscif_qp_pool_free(scifdev, qp);
+	} while (qp);
+}
+
+/*
+ * micscif_qp_pool_get() - Take a pre-mapped QP for a new endpoint
+ * @scifdev: Remote node of the endpoint
+ * @size: Size of the receive ring wanted
+ *
+ * Returns a QP with only the receive ring set up and mapped, which
+ * micscif_setup_qp_connect() and micscif_setup_qp_accept() then reuse,
+ * or NULL if the pool has none of that size.
+ */
+struct micscif_qp *micscif_qp_pool_get(struct micscif_dev *scifdev, uint32_t size)
+{
+	struct micscif_qp *qp = NULL;
+	void *local_q;
+	dma_addr_t local_buf, local_qp;
+
+	if (is_self_scifdev(scifdev) || !ms_info.mi_qp_pool_size)
+		return NULL;
+
+	spin_lock(&scifdev->sd_qp_pool_lock);
+	if (scifdev->sd_qp_pool_on && scifdev->sd_qp_pool_cnt &&
+		scifdev->sd_qp_pool[scifdev->sd_qp_pool_cnt - 1]->inbound_q.size == size)
+		qp = scifdev->sd_qp_pool[--scifdev->sd_qp_pool_cnt];
+	spin_unlock(&scifdev->sd_qp_pool_lock);
+
+	if (SCIFDEV_RUNNING == scifdev->sd_state)
+		queue_work(ms_info.mi_misc_wq, &scifdev->sd_qp_pool_work);
+	if (!qp) {
+		atomic_long_inc(&ms_info.mi_qp_pool_miss);
+		return NULL;
+	}
+	atomic_long_inc(&ms_info.mi_qp_pool_hit);
+
+	/* Start from a clean QP but keep the receive ring and mappings */
+	local_q = (void *)qp->inbound_q.rb_base;
+	local_buf = qp->local_buf;
+	local_qp = qp->local_qp;
+	memset(qp, 0, sizeof(*qp));
+	qp->magic = SCIFEP_MAGIC;
+	qp->inbound_q.rb_base = local_q;
+	qp->inbound_q.size = size;
+	qp->local_buf = local_buf;
+	qp->local_qp = local_qp;
+	return qp;
+}
+
+/*
+ * Return the QP of an endpoint to the pool. The mappings of the peer's
+ * half of the QP are dropped here, ours are kept.
+ */
+static bool
+micscif_qp_pool_put(struct micscif_dev *scifdev, struct micscif_qp *qp)
+{
+	bool pooled = false;
+
+	if (!scifdev || is_self_scifdev(scifdev) || !scifdev->sd_qp_pool_on ||
+		!qp->local_buf || !qp->local_qp || !qp->inbound_q.rb_base ||
+		qp->inbound_q.size != ms_info.mi_endpt_qp_size)
+		return false;
+
+	if (qp->outbound_q.rb_base)
+		scif_iounmap((void *)qp->outbound_q.rb_base,
+			qp->outbound_q.size, scifdev);
+	qp->outbound_q.rb_base = NULL;
+	if (qp->remote_qp)
+		scif_iounmap((void *)qp->remote_qp,
+			sizeof(struct micscif_qp), scifdev);
+	qp->remote_qp = NULL;
+
+	spin_lock(&scifdev->sd_qp_pool_lock);
+	if (scifdev->sd_qp_pool_on && scifdev->sd_qp_pool_cnt <
+		min_t(uint32_t, ms_info.mi_qp_pool_size, SCIF_QP_POOL_MAX)) {
+		scifdev->sd_qp_pool[scifdev->sd_qp_pool_cnt++] = qp;
+		pooled = true;
+	}
+	spin_unlock(&scifdev->sd_qp_pool_lock);
+	return pooled;
+}
+
 int micscif_teardown_ep(void *endpt)
 {
 	int err = 0;
 	struct endpt *ep = (struct endpt *)endpt;
 	struct micscif_qp *qp = ep->qp_info.qp;
 	if (qp) {
-		if (qp->outbound_q.rb_base)
-			scif_iounmap((void *)qp->outbound_q.rb_base,
-				qp->outbound_q.size, ep->remote_dev);
-		if (qp->remote_qp)
-			scif_iounmap((void *)qp->remote_qp,
-				sizeof(struct micscif_qp), ep->remote_dev);
-		if (qp->local_buf) {
-			err = unmap_from_aperture(
-				qp->local_buf,
-				ep->remote_dev, ENDPT_QP_SIZE);
-			if (err) {
-				printk(KERN_ERR "%s %d error %d\n", 
-					__func__, __LINE__, err);
-				return err;
-			}
-		}
-		if (qp->local_qp) {
-			err = unmap_from_aperture(qp->local_qp, ep->remote_dev,
-					sizeof(struct micscif_qp));
-			if (err) {
-				printk(KERN_ERR "%s %d error %d\n", 
-					__func__, __LINE__, err);
+		micscif_ep_quiesce(ep);
+		if (!micscif_qp_pool_put(ep->remote_dev, qp)) {
+			if ((err = micscif_teardown_qp(qp, ep->remote_dev)))
 				return err;
-			}
+			kfree(qp);
 		}
-		if (qp->inbound_q.rb_base)
-			kfree((void *)qp->inbound_q.rb_base);
-		kfree(qp);
 #ifdef _MIC_SCIF_
 		micscif_teardown_proxy_dma(endpt);
 #endif
@@ -151,7 +378,8 @@ int micscif_setup_qp_connect(struct micscif_qp *qp, dma_addr_t *qp_offset,
 
 	if (!qp->inbound_q.rb_base) {
 		/* we need to allocate the local buffer for the incoming queue */
-		local_q = kzalloc(local_size, GFP_ATOMIC);
+		local_q = kzalloc_node(local_size, GFP_ATOMIC,
+				micscif_numa_node(scifdev->sd_node));
 		if (!local_q) {
 			printk(KERN_ERR "Ring Buffer Allocation Failed\n");
 			err = -ENOMEM;
@@ -208,6 +436,7 @@ int micscif_setup_qp_accept(struct micscif_qp *qp, dma_addr_t *qp_offset, dma_ad
 	/* Start by figuring out where we need to point */
 	remote_qp = scif_ioremap(phys, sizeof(struct micscif_qp), scifdev);
 	qp->remote_qp = remote_qp;
+	qp->remote_qp_addr = phys;
 	qp->remote_buf = remote_qp->local_buf;
 	/* To setup the outbound_q, the buffer lives in remote memory (at scifdev->bs->buf phys),
 	 * the read pointer is local (in local's local_read)
@@ -218,33 +447,44 @@ int micscif_setup_qp_accept(struct micscif_qp *qp, dma_addr_t *qp_offset, dma_ad
 
 	BUG_ON(qp->remote_qp->magic != SCIFEP_MAGIC);
 
-	qp->remote_qp->local_write = 0;
+	*micscif_qp_remote_write(qp) = 0;
 	micscif_rb_init(&(qp->outbound_q),
-			&(qp->local_read), /*read ptr*/
-			&(qp->remote_qp->local_write), /*write ptr*/
+			micscif_qp_local_read(qp), /*read ptr*/
+			micscif_qp_remote_write(qp), /*write ptr*/
 			remote_q, /*rb_base*/
 			remote_size);
+	micscif_rb_set_nt(&qp->outbound_q,
+			ms_info.en_rb_nt_copy && !is_self_scifdev(scifdev));
 	/* to setup the inbound_q, the buffer lives locally (local_q),
 	 * the read pointer is remote (in remote_qp's local_read)
 	 * the write pointer is local (in local_write)
 	 */
-	local_q = kzalloc(local_size, GFP_KERNEL);
+	/* A QP from micscif_qp_pool_get() comes with its ring mapped */
+	if (!(local_q = (void *)qp->inbound_q.rb_base))
+		local_q = kzalloc_node(local_size, GFP_KERNEL,
+				micscif_numa_node(scifdev->sd_node));
 	if (!local_q) {
 		printk(KERN_ERR "Ring Buffer Allocation Failed\n");
 		err = -ENOMEM;
 		return err;
 	}
 
-	qp->remote_qp->local_read = 0;
+	*micscif_qp_remote_read(qp) = 0;
 	micscif_rb_init(&(qp->inbound_q),
-			&(qp->remote_qp->local_read),
-			&(qp->local_write),
+			micscif_qp_remote_read(qp),
+			micscif_qp_local_write(qp),
 			local_q,
 			local_size);
-	err = map_virt_into_aperture(&qp->local_buf, local_q, scifdev, local_size);
-	if (err) {
-		printk(KERN_ERR "%s %d error %d\n", 
-				__func__, __LINE__, err);
+	if (!qp->local_buf) {
+		err = map_virt_into_aperture(&qp->local_buf, local_q, scifdev, local_size);
+		if (err) {
+			printk(KERN_ERR "%s %d error %d\n", 
+					__func__, __LINE__, err);
+			return err;
+		}
+	}
+	if (qp->local_qp) {
+		*qp_offset = qp->local_qp;
 		return err;
 	}
 	err = map_virt_into_aperture(qp_offset, qp, scifdev, sizeof(struct micscif_qp));
@@ -270,6 +510,7 @@ int micscif_setup_qp_connect_response(struct micscif_dev *scifdev, struct micsci
 		err = -ENOMEM;
 		goto error;
 	}
+	qp->remote_qp_addr = payload;
 
 	if (qp->remote_qp->magic != SCIFEP_MAGIC) {
 		printk(KERN_ERR "SCIFEP_MAGIC doesnot match between node %d "
@@ -283,6 +524,7 @@ int micscif_setup_qp_connect_response(struct micscif_dev *scifdev, struct micsci
 	tmp_phys = readq(&(qp->remote_qp->local_buf));
 	remote_size = readl(&qp->remote_qp->inbound_q.size);
 	r_buf = scif_ioremap(tmp_phys, remote_size, scifdev);
+	qp->remote_buf = tmp_phys;
 
 #if 0
 	pr_debug("payload = 0x%llx remote_qp = 0x%p tmp_phys=0x%llx \
@@ -291,14 +533,16 @@ int micscif_setup_qp_connect_response(struct micscif_dev *scifdev, struct micsci
 #endif
 
 	micscif_rb_init(&(qp->outbound_q),
-			&(qp->local_read),
-			&(qp->remote_qp->local_write),
+			micscif_qp_local_read(qp),
+			micscif_qp_remote_write(qp),
 			r_buf,
 			remote_size);
+	micscif_rb_set_nt(&qp->outbound_q,
+			ms_info.en_rb_nt_copy && !is_self_scifdev(scifdev));
 	/* resetup the inbound_q now that we know where the inbound_read really is */
 	micscif_rb_init(&(qp->inbound_q),
-			&(qp->remote_qp->local_read),
-			&(qp->local_write),
+			micscif_qp_remote_read(qp),
+			micscif_qp_local_write(qp),
 			qp->inbound_q.rb_base,
 			qp->inbound_q.size);
 error:
@@ -384,6 +628,8 @@ int micscif_setup_card_qp(phys_addr_t host_phys, struct micscif_dev *scifdev)
 		pr_debug("micscif_setup_card_qp: micscif_setup_qp_accept, INIT message\n");
 		err = micscif_nodeqp_send(scifdev, &tmp_msg, NULL);
 	}
+	if (!err)
+		micscif_qp_pool_fill(scifdev);
 	if (err)
 		printk(KERN_ERR "%s %d error %d\n", 
 				__func__, __LINE__, err);
@@ -420,7 +666,8 @@ int micscif_setup_host_qp(mic_ctx_t *mic_ctx, struct micscif_dev *scifdev)
 
 	/* for now, assume that we only have one queue-pair -- with the host */
 	scifdev->n_qpairs = 1;
-	scifdev->qpairs = (struct micscif_qp *)kzalloc(sizeof(struct micscif_qp), GFP_ATOMIC);
+	scifdev->qpairs = (struct micscif_qp *)kzalloc_node(sizeof(struct micscif_qp),
+			GFP_ATOMIC, mic_ctx->numa_node);
 	if (!scifdev->qpairs) {
 		printk(KERN_ERR "Node QP Allocation failed\n");
 		err = -ENOMEM;
@@ -552,6 +799,9 @@ int micscif_setuphost_response(struct micscif_dev *scifdev, uint64_t payload)
 	mutex_unlock(&ms_info.mi_conflock);
 
 	micscif_node_add_callback(scifdev->sd_node);
+	micscif_qp_pool_fill(scifdev);
+	micscif_nodeqp_lanes_init(scifdev);
+	micscif_dgram_start(scifdev);
 	return err;
 }
 
@@ -666,7 +916,16 @@ static char *message_types[] = {"BAD",
 				"SCIF_NODE_CONNECT_NACK",
 				"SCIF_NODE_ADD_NACK",
 				"SCIF_GET_NODE_INFO",
-				"TEST"};
+				"TEST",
+				"RNDV_REQ",
+				"RNDV_ACK",
+				"RNDV_CANCEL",
+				"NODEQP_ADD",
+				"NODEQP_ADD_ACK",
+				"NODEQP_ADD_NACK",
+				"DGRAM_QP",
+				"DGRAM_QP_ACK",
+				"DGRAM_SENT"};
 
 static void
 micscif_display_message(struct micscif_dev *scifdev, struct nodemsg *msg,
@@ -689,6 +948,83 @@ micscif_display_message(struct micscif_dev *scifdev, struct nodemsg *msg,
 		msg->payload[2], msg->payload[3]);
 }
 
+const char *micscif_msg_name(uint32_t uop)
+{
+	return uop > SCIF_MAX_MSG ? "UNKNOWN" : message_types[uop];
+}
+
+struct micscif_msg_stats micscif_msg_stats[SCIF_MAX_MSG + 1];
+
+/*
+ * Data path notifications and fence signals. Each of them is only sent
+ * once whatever it refers to has been set up and acknowledged, so it can
+ * safely overtake control messages written to the ring before it. Being
+ * handled earlier, it never finds the endpoint torn down by one of them:
+ * the notification handlers check the endpoint state, the signal handlers
+ * look the window up under rma_lock and NACK if it is gone, and the
+ * ACK/NACK handlers complete a fence request its sender still waits on.
+ */
+const uint8_t micscif_msg_prio[SCIF_MAX_MSG + 1] = {
+	[SCIF_CLIENT_SENT]	= SCIF_MSG_PRIO_HIGH,
+	[SCIF_CLIENT_RCVD]	= SCIF_MSG_PRIO_HIGH,
+	[SCIF_SIG_LOCAL]	= SCIF_MSG_PRIO_HIGH,
+	[SCIF_SIG_REMOTE]	= SCIF_MSG_PRIO_HIGH,
+	[SCIF_SIG_ACK]		= SCIF_MSG_PRIO_HIGH,
+	[SCIF_SIG_NACK]		= SCIF_MSG_PRIO_HIGH,
+};
+
+/*
+ * Loopback messages which the sender may hand to their handler itself.
+ * The handlers neither sleep nor allocate: they only update endpoint or
+ * window state under spinlocks and wake up waiters. SCIF_CNCT_REQ is not
+ * one of them since scif_cnctreq_resp() allocates with GFP_KERNEL.
+ */
+static const bool micscif_msg_loopb_direct[SCIF_MAX_MSG + 1] = {
+	[SCIF_CNCT_GNT]		= true,
+	[SCIF_CNCT_GNTACK]	= true,
+	[SCIF_CNCT_GNTNACK]	= true,
+	[SCIF_CNCT_REJ]		= true,
+	[SCIF_REGISTER_ACK]	= true,
+	[SCIF_REGISTER_NACK]	= true,
+	[SCIF_UNREGISTER_ACK]	= true,
+	[SCIF_UNREGISTER_NACK]	= true,
+	[SCIF_CLIENT_SENT]	= true,
+	[SCIF_CLIENT_RCVD]	= true,
+};
+
+static void
+micscif_nodeqp_msg_handler(struct micscif_dev *scifdev, struct micscif_qp *qp, struct nodemsg *msg);
+
+/*
+ * Handle a loopback message in the context of the sender instead of
+ * bouncing it through the RB and two workqueues. Only done when nothing
+ * sent earlier is still queued, so messages are handled in order, and
+ * when the sender is preemptible, i.e. holds no spinlock the handler
+ * might want and is not in atomic context. Kernels which cannot tell
+ * (no CONFIG_PREEMPT) always take the RB.
+ */
+static __always_inline bool
+micscif_loopb_direct(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct nodemsg copy;
+
+	if (!ms_info.en_loopb_direct || msg->uop > SCIF_MAX_MSG ||
+		!micscif_msg_loopb_direct[msg->uop] || !preemptible() ||
+		atomic_read(&scifdev->sd_loopb_pending))
+		return false;
+	/* Handlers reuse the message for their reply */
+	copy = *msg;
+	micscif_nodeqp_msg_handler(scifdev, &scifdev->qpairs[0], &copy);
+	return true;
+}
+
+/* Only wakeups which do not depend on the order of other messages */
+static __always_inline bool
+micscif_nodeqp_laned(uint32_t uop)
+{
+	return SCIF_CLIENT_SENT == uop || SCIF_CLIENT_RCVD == uop;
+}
+
 /**
  * micscif_nodeqp_send - Send a message on the Node Qp.
  * @scifdev: Scif Device.
@@ -701,7 +1037,8 @@ int micscif_nodeqp_send(struct micscif_dev *scifdev,
 			struct nodemsg *msg, struct endpt *ep)
 {
 	struct micscif_qp *qp;
-	int err = -ENOMEM, loop_cnt = 0;
+	struct micscif_nodeqp_lane *lane;
+	int err = -ENOMEM, loop_cnt = 0, nr_lanes;
 
 	if (oops_in_progress ||
 		(SCIF_INIT != msg->uop &&
@@ -715,12 +1052,28 @@ int micscif_nodeqp_send(struct micscif_dev *scifdev,
 
 	micscif_display_message(scifdev, msg, "Sent");
 
+	if (is_self_scifdev(scifdev) && micscif_loopb_direct(scifdev, msg))
+		return 0;
+
 	qp = micscif_nodeqp_find(scifdev, (uint8_t)msg->dst.node);
 	if (!qp) {
 		err = -EINVAL;
 		goto error;
 	}
+	/* Lanes are not freed before senders leave the RCU read side */
+	rcu_read_lock();
+	/* Keep all notifications for an endpoint on the same lane */
+	if (ep && micscif_nodeqp_laned(msg->uop) &&
+		(nr_lanes = scifdev->sd_nr_lanes)) {
+		smp_rmb();
+		lane = rcu_dereference(
+			scifdev->sd_lanes[hash_ptr(ep, 32) % nr_lanes]);
+		if (lane)
+			qp = lane->qp;
+	}
 	spin_lock(&qp->qp_send_lock);
+	if (is_self_scifdev(scifdev))
+		atomic_inc(&scifdev->sd_loopb_pending);
 
 	while ((err = micscif_rb_write(&qp->outbound_q,
 			msg, sizeof(struct nodemsg), !IS_USER_BUFFER))) {
@@ -733,7 +1086,10 @@ int micscif_nodeqp_send(struct micscif_dev *scifdev,
 	}
 	if (!err)
 		micscif_rb_commit(&qp->outbound_q);
+	else if (is_self_scifdev(scifdev))
+		atomic_dec(&scifdev->sd_loopb_pending);
 	spin_unlock(&qp->qp_send_lock);
+	rcu_read_unlock();
 	if (!err) {
 		if (is_self_scifdev(scifdev))
 			/*
@@ -927,6 +1283,7 @@ scif_nodeadd_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
 	msg->payload[2] = get_rdmasr_offset(newdev->sd_intr_handle);
 	msg->payload[3] = scif_dev[ms_info.mi_nodeid].sd_numa_node;
 	micscif_nodeqp_send(&scif_dev[SCIF_HOST_NODE], msg, NULL);
+	micscif_qp_pool_fill(newdev);
 	return;
 
 qp_connect_error:
@@ -1067,6 +1424,9 @@ scif_nodeaddack_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
 
 	micscif_dec_node_refcnt(peerdev, 1);
 	wake_up(&peerdev->sd_p2p_wq);
+	micscif_qp_pool_fill(peerdev);
+	micscif_nodeqp_lanes_init(peerdev);
+	micscif_dgram_start(peerdev);
 	return;
 
 remote_error:
@@ -1153,6 +1513,7 @@ scif_cnctgnt_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
 		ep->peer.node = msg->src.node;
 		ep->peer.port = msg->src.port;
 		ep->qp_info.cnct_gnt_payload = msg->payload[1];
+		ep->qp_info.cnct_gnt_caps = micscif_decode_qp_caps(msg->payload[2]);
 		ep->state = SCIFEP_MAPPING;
 
 		wake_up_interruptible(&ep->conwq);
@@ -1327,10 +1688,14 @@ scif_discnct_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
 
 	// TODO Cause associated resources to be freed.
 	// First step: wake up threads blocked in send and recv
-	wake_up_interruptible(&ep->sendwq);
+	wake_up(&ep->sendwq);
 	wake_up_interruptible(&ep->recvwq);
 	wake_up_interruptible(&ep->conwq);
 	spin_unlock_irqrestore(&ep->lock, sflags);
+	/* Our senders and receivers may still be in the peer's QP */
+	micscif_ep_quiesce(ep);
+	/* And so may a process which has it mapped */
+	micscif_qp_mmap_revoke(ep);
 
 discnct_resp_ack:
 	msg->uop = SCIF_DISCNT_ACK;
@@ -1380,10 +1745,99 @@ scif_clientrcvd_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
 	struct endpt *ep = (struct endpt *)msg->payload[0];
 
 	if (SCIFEP_CONNECTED == ep->state) {
-		wake_up_interruptible(&ep->sendwq);
+		wake_up(&ep->sendwq);
 	}
 }
 
+/**
+ * scif_rndv_req_resp() - Respond to SCIF_RNDV_REQ interrupt message
+ * @msg:        Interrupt message
+ *
+ * The peer registered a send buffer for us to pull. Record it and wake up
+ * any receiver, which copies it out once the data ahead of it in the
+ * endpoint ring has been consumed.
+ */
+static __always_inline void
+scif_rndv_req_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct endpt *ep = (struct endpt *)msg->payload[0];
+	struct nodemsg ack;
+	unsigned long sflags;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (ep->qp_mapped) {
+		/*
+		 * Nobody in the kernel will pull it while the QP is mapped,
+		 * give it all back so it is sent through the ring.
+		 */
+		ack.src = ep->port;
+		ack.uop = SCIF_RNDV_ACK;
+		ack.payload[0] = ep->remote_ep;
+		ack.payload[1] = 0;
+		/* No error handling for Notification messages */
+		micscif_nodeqp_send(scifdev, &ack, ep);
+	} else if (SCIFEP_CONNECTED == ep->state) {
+		ep->rndv_rx.offset = (off_t)msg->payload[1];
+		ep->rndv_rx.len = (size_t)msg->payload[2];
+		ep->rndv_rx.done = 0;
+		ep->rndv_rx.state = RNDV_PENDING;
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	wake_up_interruptible(&ep->recvwq);
+}
+
+/**
+ * scif_rndv_ack_resp() - Respond to SCIF_RNDV_ACK interrupt message
+ * @msg:        Interrupt message
+ *
+ * The peer will not touch our advertised send buffer again and has
+ * consumed payload[1] bytes of it.
+ */
+static __always_inline void
+scif_rndv_ack_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct endpt *ep = (struct endpt *)msg->payload[0];
+	unsigned long sflags;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (RNDV_PENDING == ep->rndv_tx.state) {
+		ep->rndv_tx.done = (size_t)msg->payload[1];
+		ep->rndv_tx.state = RNDV_DONE;
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+	/* The sender may be in an uninterruptible wait after a cancel */
+	wake_up(&ep->sendwq);
+}
+
+/**
+ * scif_rndv_cancel_resp() - Respond to SCIF_RNDV_CANCEL interrupt message
+ * @msg:        Interrupt message
+ *
+ * The sender was interrupted. Acknowledge right away unless a receiver is
+ * copying, in which case it acknowledges once its copy is done.
+ */
+static __always_inline void
+scif_rndv_cancel_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct endpt *ep = (struct endpt *)msg->payload[0];
+	struct nodemsg ack;
+	unsigned long sflags;
+
+	spin_lock_irqsave(&ep->lock, sflags);
+	if (RNDV_PULLING == ep->rndv_rx.state) {
+		ep->rndv_rx.state = RNDV_CANCEL;
+	} else if (RNDV_PENDING == ep->rndv_rx.state) {
+		ep->rndv_rx.state = RNDV_IDLE;
+		ack.src = ep->port;
+		ack.uop = SCIF_RNDV_ACK;
+		ack.payload[0] = ep->remote_ep;
+		ack.payload[1] = ep->rndv_rx.done;
+		/* No error handling for Notification messages */
+		micscif_nodeqp_send(scifdev, &ack, ep);
+	}
+	spin_unlock_irqrestore(&ep->lock, sflags);
+}
+
 /**
  * scif_alloc_req: Respond to SCIF_ALLOC_REQ interrupt message
  * @msg:        Interrupt message
@@ -1525,7 +1979,8 @@ scif_recv_register(struct micscif_dev *scifdev, struct nodemsg *msg)
 		micscif_set_nr_pages(ep->remote_dev, window);
 		/* No further failures expected. Insert new window */
 		micscif_insert_window(window,
-			&ep->rma_info.remote_reg_list);
+			&ep->rma_info.remote_reg_list,
+			&ep->rma_info.remote_reg_tree);
 	} else {
 		msg->uop = SCIF_REGISTER_NACK;
 		micscif_nodeqp_send(ep->remote_dev, msg, ep);
@@ -1570,6 +2025,7 @@ scif_recv_unregister(struct micscif_dev *scifdev, struct nodemsg *msg)
 	req.nr_bytes = recv_window->nr_pages << PAGE_SHIFT;
 	req.type = WINDOW_FULL;
 	req.head = &ep->rma_info.remote_reg_list;
+	req.tree = &ep->rma_info.remote_reg_tree;
 	msg->payload[0] = ep->remote_ep;
 
 	mutex_lock(&ep->rma_info.rma_lock);
@@ -1591,7 +2047,7 @@ scif_recv_unregister(struct micscif_dev *scifdev, struct nodemsg *msg)
 			atomic_inc(&ep->rma_info.tw_refcount);
 			atomic_add_return((int32_t)window->nr_pages, &ep->rma_info.tw_total_pages);
 			ep->rma_info.async_list_del = 1;
-			list_del(&window->list_member);
+			micscif_remove_window(window);
 			window->offset = INVALID_VA_GEN_ADDRESS;
 			del_window = 1;
 		} else
@@ -1696,6 +2152,7 @@ scif_recv_munmap(struct micscif_dev *scifdev, struct nodemsg *msg)
 	req.nr_bytes = recv_window->nr_pages << PAGE_SHIFT;
 	req.type = WINDOW_FULL;
 	req.head = &ep->rma_info.reg_list;
+	req.tree = &ep->rma_info.reg_tree;
 	msg->payload[0] = ep->remote_ep;
 
 	mutex_lock(&ep->rma_info.rma_lock);
@@ -1717,7 +2174,7 @@ scif_recv_munmap(struct micscif_dev *scifdev, struct nodemsg *msg)
 		atomic_inc(&ep->rma_info.tw_refcount);
 		atomic_add_return((int32_t)window->nr_pages, &ep->rma_info.tw_total_pages);
 		ep->rma_info.async_list_del = 1;
-		list_del(&window->list_member);
+		micscif_remove_window(window);
 		micscif_free_window_offset(ep, window->offset,
 				window->nr_pages << PAGE_SHIFT);
 		window->offset_freed = true;
@@ -2591,6 +3048,607 @@ scif_msg_unknown(struct micscif_dev *scifdev, struct nodemsg *msg)
 	BUG_ON(1);
 }
 
+/*
+ * Node QP lanes.
+ *
+ * The side with the lower node id offers lane 0 with SCIF_NODEQP_ADD once
+ * qpairs[0] is running and the next one on every SCIF_NODEQP_ADD_ACK, up
+ * to its mi_nodeqp_lanes. The peer accepts up to its own limit. Both
+ * cards of a peer to peer pair see the node come up, so a fixed offering
+ * side keeps them from offering the same lane to each other. Lanes
+ * are set up like endpoint QPs and share the doorbell of qpairs[0]. The
+ * interrupt handler for qpairs[0] queues the work of every lane with
+ * messages pending, and drains the lanes itself before handling each of
+ * its own messages. Notifications sent on a lane before a message on
+ * qpairs[0] are therefore handled before it, as they were when everything
+ * went through one ring.
+ */
+static void
+micscif_nodeqp_lane_drain(struct micscif_nodeqp_lane *lane)
+{
+	struct micscif_dev *scifdev = lane->scifdev;
+	struct micscif_qp *qp = lane->qp;
+	struct nodemsg msg;
+
+	mutex_lock(&lane->lock);
+	/* Pairs with the commit of whatever message got us here */
+	smp_rmb();
+	while (SCIFDEV_STOPPED != scifdev->sd_state && !oops_in_progress &&
+		micscif_rb_get_next(&qp->inbound_q, &msg, sizeof(msg),
+			!IS_USER_BUFFER) == sizeof(msg)) {
+		micscif_inc_node_refcnt(scifdev, 1);
+		micscif_nodeqp_msg_handler(scifdev, qp, &msg);
+		micscif_rb_update_read_ptr(&qp->inbound_q);
+		micscif_dec_node_refcnt(scifdev, 1);
+	}
+	mutex_unlock(&lane->lock);
+}
+
+/* Runs in the context of mi_lane_wq */
+static void
+micscif_nodeqp_lane_handler(struct work_struct *work)
+{
+	micscif_nodeqp_lane_drain(
+		container_of(work, struct micscif_nodeqp_lane, work));
+}
+
+/*
+ * Take a reference to online lane idx, NULL if the lanes are being torn
+ * down. For users which sleep, others only need rcu_read_lock().
+ */
+static struct micscif_nodeqp_lane *
+micscif_nodeqp_lane_get(struct micscif_dev *scifdev, int idx)
+{
+	struct micscif_nodeqp_lane *lane;
+
+	rcu_read_lock();
+	lane = rcu_dereference(scifdev->sd_lanes[idx]);
+	if (lane && !atomic_inc_not_zero(&lane->ref))
+		lane = NULL;
+	rcu_read_unlock();
+	return lane;
+}
+
+static void
+micscif_nodeqp_lane_put(struct micscif_nodeqp_lane *lane)
+{
+	if (atomic_dec_and_test(&lane->ref))
+		complete(&lane->released);
+}
+
+static void
+micscif_nodeqp_lanes_drain(struct micscif_dev *scifdev)
+{
+	struct micscif_nodeqp_lane *lane;
+	int i;
+
+	for (i = 0; i < scifdev->sd_nr_lanes; i++) {
+		if (!(lane = micscif_nodeqp_lane_get(scifdev, i)))
+			continue;
+		micscif_nodeqp_lane_drain(lane);
+		micscif_nodeqp_lane_put(lane);
+	}
+}
+
+static void
+micscif_nodeqp_lanes_kick(struct micscif_dev *scifdev)
+{
+	struct micscif_nodeqp_lane *lane;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < scifdev->sd_nr_lanes; i++) {
+		lane = rcu_dereference(scifdev->sd_lanes[i]);
+		if (!lane || lane->qp->local_write ==
+			lane->qp->inbound_q.current_read_offset)
+			continue;
+		if (cpu_online(lane->cpu))
+			queue_work_on(lane->cpu, ms_info.mi_lane_wq, &lane->work);
+		else
+			queue_work(ms_info.mi_lane_wq, &lane->work);
+	}
+	rcu_read_unlock();
+}
+
+/* Spread the lanes of all nodes over the online CPUs */
+static int
+micscif_nodeqp_lane_cpu(struct micscif_dev *scifdev, int idx)
+{
+	int cpu, n = (scifdev->sd_node * SCIF_NODEQP_MAX_LANES + idx) %
+			num_online_cpus();
+
+	for_each_online_cpu(cpu)
+		if (!n--)
+			return cpu;
+	return cpumask_first(cpu_online_mask);
+}
+
+static struct micscif_nodeqp_lane *
+micscif_nodeqp_lane_alloc(struct micscif_dev *scifdev, int idx)
+{
+	int nid = micscif_numa_node(scifdev->sd_node);
+	struct micscif_nodeqp_lane *lane;
+
+	if (!(lane = kzalloc_node(sizeof(*lane), GFP_KERNEL, nid)))
+		return NULL;
+	if (!(lane->qp = kzalloc_node(sizeof(struct micscif_qp),
+			GFP_KERNEL, nid))) {
+		kfree(lane);
+		return NULL;
+	}
+	lane->qp->magic = SCIFEP_MAGIC;
+	lane->scifdev = scifdev;
+	lane->idx = idx;
+	lane->cpu = micscif_nodeqp_lane_cpu(scifdev, idx);
+	mutex_init(&lane->lock);
+	INIT_WORK(&lane->work, micscif_nodeqp_lane_handler);
+	atomic_set(&lane->ref, 1);
+	init_completion(&lane->released);
+	return lane;
+}
+
+static void
+micscif_nodeqp_lane_free(struct micscif_nodeqp_lane *lane)
+{
+	cancel_work_sync(&lane->work);
+	if (!micscif_teardown_qp(lane->qp, lane->scifdev))
+		kfree(lane->qp);
+	mutex_destroy(&lane->lock);
+	kfree(lane);
+}
+
+static void
+micscif_nodeqp_lane_online(struct micscif_dev *scifdev,
+		struct micscif_nodeqp_lane *lane)
+{
+	rcu_assign_pointer(scifdev->sd_lanes[lane->idx], lane);
+	/* Senders look at sd_lanes[] only below sd_nr_lanes */
+	smp_wmb();
+	scifdev->sd_nr_lanes = lane->idx + 1;
+	pr_debug("SCIF node %d lane %d online on cpu %d\n",
+		scifdev->sd_node, lane->idx, lane->cpu);
+}
+
+static void
+micscif_nodeqp_lane_offer(struct micscif_dev *scifdev, int idx)
+{
+	struct micscif_nodeqp_lane *lane;
+	struct nodemsg msg;
+	dma_addr_t qp_offset;
+
+	if (idx >= ms_info.mi_nodeqp_lanes || idx >= SCIF_NODEQP_MAX_LANES ||
+		!(lane = micscif_nodeqp_lane_alloc(scifdev, idx)))
+		return;
+
+	if (micscif_setup_qp_connect(lane->qp, &qp_offset,
+			NODE_QP_SIZE, scifdev))
+		goto free_lane;
+
+	scifdev->sd_lanes[idx] = lane;
+	msg.uop = SCIF_NODEQP_ADD;
+	msg.src.node = ms_info.mi_nodeid;
+	msg.dst.node = scifdev->sd_node;
+	msg.payload[0] = idx;
+	msg.payload[1] = qp_offset;
+	if (!micscif_nodeqp_send(scifdev, &msg, NULL))
+		return;
+	scifdev->sd_lanes[idx] = NULL;
+free_lane:
+	micscif_nodeqp_lane_free(lane);
+}
+
+/*
+ * micscif_nodeqp_lanes_init() - Start negotiating lanes with a node
+ * @scifdev: Remote node which has just become SCIFDEV_RUNNING
+ *
+ * Only offers anything if this node has the lower id of the pair.
+ */
+void micscif_nodeqp_lanes_init(struct micscif_dev *scifdev)
+{
+	if (is_self_scifdev(scifdev) || scifdev->sd_nr_lanes ||
+		ms_info.mi_nodeid > scifdev->sd_node)
+		return;
+	micscif_nodeqp_lane_offer(scifdev, 0);
+}
+
+void micscif_nodeqp_lanes_uninit(struct micscif_dev *scifdev)
+{
+	struct micscif_nodeqp_lane *lanes[SCIF_NODEQP_MAX_LANES];
+	int i;
+
+	scifdev->sd_nr_lanes = 0;
+	for (i = 0; i < SCIF_NODEQP_MAX_LANES; i++) {
+		lanes[i] = scifdev->sd_lanes[i];
+		rcu_assign_pointer(scifdev->sd_lanes[i], NULL);
+	}
+	/* Wait for senders and kicks, then for users holding a reference */
+	synchronize_rcu();
+	for (i = 0; i < SCIF_NODEQP_MAX_LANES; i++) {
+		if (!lanes[i])
+			continue;
+		micscif_nodeqp_lane_put(lanes[i]);
+		wait_for_completion(&lanes[i]->released);
+		micscif_nodeqp_lane_free(lanes[i]);
+	}
+}
+
+/**
+ * scif_nodeqp_add_resp() - Respond to SCIF_NODEQP_ADD interrupt message
+ * @msg:        Interrupt message
+ *
+ * Set up our end of the lane the peer offered, or decline it.
+ */
+static void
+scif_nodeqp_add_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct micscif_nodeqp_lane *lane;
+	int idx = (int)msg->payload[0];
+	dma_addr_t qp_offset;
+
+	msg->dst.node = msg->src.node;
+	msg->src.node = ms_info.mi_nodeid;
+
+	/* Never accept a lane while offering it ourselves */
+	if (idx != scifdev->sd_nr_lanes || idx >= ms_info.mi_nodeqp_lanes ||
+		idx >= SCIF_NODEQP_MAX_LANES || scifdev->sd_lanes[idx] ||
+		!(lane = micscif_nodeqp_lane_alloc(scifdev, idx)))
+		goto nack;
+
+	if (micscif_setup_qp_accept(lane->qp, &qp_offset, msg->payload[1],
+			NODE_QP_SIZE, scifdev)) {
+		micscif_nodeqp_lane_free(lane);
+		goto nack;
+	}
+
+	msg->uop = SCIF_NODEQP_ADD_ACK;
+	msg->payload[1] = qp_offset;
+	if (micscif_nodeqp_send(scifdev, msg, NULL)) {
+		micscif_nodeqp_lane_free(lane);
+		return;
+	}
+	micscif_nodeqp_lane_online(scifdev, lane);
+	return;
+nack:
+	msg->uop = SCIF_NODEQP_ADD_NACK;
+	micscif_nodeqp_send(scifdev, msg, NULL);
+}
+
+/**
+ * scif_nodeqp_add_ack_resp() - Respond to SCIF_NODEQP_ADD_ACK interrupt message
+ * @msg:        Interrupt message
+ *
+ * The peer set up its end of the lane we offered. Finish ours, pick up
+ * anything the peer already sent on it and offer the next one.
+ */
+static void
+scif_nodeqp_add_ack_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	int idx = (int)msg->payload[0];
+	struct micscif_nodeqp_lane *lane;
+
+	if (idx < 0 || idx >= SCIF_NODEQP_MAX_LANES ||
+		idx != scifdev->sd_nr_lanes || !(lane = scifdev->sd_lanes[idx]))
+		return;
+
+	if (micscif_setup_qp_connect_response(scifdev, lane->qp,
+			msg->payload[1])) {
+		scifdev->sd_lanes[idx] = NULL;
+		micscif_nodeqp_lane_free(lane);
+		return;
+	}
+	micscif_nodeqp_lane_online(scifdev, lane);
+	micscif_nodeqp_lanes_kick(scifdev);
+	micscif_nodeqp_lane_offer(scifdev, idx + 1);
+}
+
+/**
+ * scif_nodeqp_add_nack_resp() - Respond to SCIF_NODEQP_ADD_NACK interrupt message
+ * @msg:        Interrupt message
+ *
+ * The peer declined the lane we offered, so this node uses the ones it has.
+ */
+static void
+scif_nodeqp_add_nack_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	int idx = (int)msg->payload[0];
+	struct micscif_nodeqp_lane *lane;
+
+	if (idx < 0 || idx >= SCIF_NODEQP_MAX_LANES ||
+		idx != scifdev->sd_nr_lanes || !(lane = scifdev->sd_lanes[idx]))
+		return;
+
+	scifdev->sd_lanes[idx] = NULL;
+	micscif_nodeqp_lane_free(lane);
+}
+
+/*
+ * Datagram endpoints share one QP per node pair, offered and accepted
+ * like a lane by the same side with SCIF_DGRAM_QP and SCIF_DGRAM_QP_ACK.
+ * Each datagram is a struct micscif_dgram_hdr followed by its data,
+ * committed to the RB together. A sender which finds no room drops the
+ * datagram, otherwise it rings the peer with SCIF_DGRAM_SENT whose handler
+ * moves everything in the RB onto the receiving endpoints.
+ */
+void micscif_dgram_init(struct micscif_dev *scifdev)
+{
+	spin_lock_init(&scifdev->sd_dgram_lock);
+	mutex_init(&scifdev->sd_dgram_mutex);
+}
+
+static struct micscif_qp *
+micscif_dgram_qp_alloc(struct micscif_dev *scifdev)
+{
+	struct micscif_qp *qp;
+
+	if (!(qp = kzalloc_node(sizeof(*qp), GFP_KERNEL,
+			micscif_numa_node(scifdev->sd_node))))
+		return NULL;
+	qp->magic = SCIFEP_MAGIC;
+	return qp;
+}
+
+static void
+micscif_dgram_qp_free(struct micscif_dev *scifdev, struct micscif_qp *qp)
+{
+	if (!micscif_teardown_qp(qp, scifdev))
+		kfree(qp);
+}
+
+static void
+micscif_dgram_online(struct micscif_dev *scifdev, struct micscif_qp *qp)
+{
+	mutex_lock(&scifdev->sd_dgram_mutex);
+	spin_lock(&scifdev->sd_dgram_lock);
+	scifdev->sd_dgram_qp = qp;
+	spin_unlock(&scifdev->sd_dgram_lock);
+	mutex_unlock(&scifdev->sd_dgram_mutex);
+}
+
+/* Consume len bytes of the inbound RB without keeping them */
+static int
+micscif_dgram_skip(struct micscif_rb *rb, uint32_t len)
+{
+	char scratch[64];
+	uint32_t n;
+
+	for (; len; len -= n) {
+		n = min_t(uint32_t, sizeof(scratch), len);
+		if (micscif_rb_get_next(rb, scratch, n, !IS_USER_BUFFER) != n)
+			return -EIO;
+	}
+	return 0;
+}
+
+/* Hand every datagram in the inbound RB to its endpoint */
+static void
+micscif_dgram_drain(struct micscif_dev *scifdev)
+{
+	struct micscif_dgram_hdr hdr;
+	struct micscif_dgram *dg;
+	struct micscif_qp *qp;
+	struct micscif_rb *rb;
+
+	mutex_lock(&scifdev->sd_dgram_mutex);
+	if (!(qp = scifdev->sd_dgram_qp))
+		goto unlock;
+	rb = &qp->inbound_q;
+
+	while (micscif_rb_get_next(rb, &hdr, sizeof(hdr),
+			!IS_USER_BUFFER) == sizeof(hdr)) {
+		/*
+		 * The sender commits a header and its data together, so a
+		 * length it could not have sent or data that is not there
+		 * means the RB is out of sync. Drop everything committed so
+		 * far, which puts the read side back on a record boundary.
+		 */
+		if (WARN_ON_ONCE(hdr.len > SCIF_DGRAM_MAX_LEN))
+			goto resync;
+		if ((dg = kmalloc(sizeof(*dg) + hdr.len, GFP_KERNEL))) {
+			if (micscif_rb_get_next(rb, dg->data, hdr.len,
+					!IS_USER_BUFFER) != hdr.len) {
+				kfree(dg);
+				goto resync;
+			}
+		} else if (micscif_dgram_skip(rb, hdr.len)) {
+			/* Consumed anyway so the RB does not stall */
+			goto resync;
+		}
+		micscif_rb_update_read_ptr(rb);
+
+		if (!dg) {
+			atomic_long_inc(&ms_info.mi_dgram_drop);
+			continue;
+		}
+		dg->src.node = scifdev->sd_node;
+		dg->src.port = hdr.src_port;
+		dg->dst_port = hdr.dst_port;
+		dg->len = hdr.len;
+		micscif_dgram_deliver(dg);
+	}
+	goto unlock;
+resync:
+	atomic_long_inc(&ms_info.mi_dgram_drop);
+	micscif_dgram_skip(rb, micscif_rb_count(rb, rb->size));
+	micscif_rb_update_read_ptr(rb);
+unlock:
+	mutex_unlock(&scifdev->sd_dgram_mutex);
+}
+
+/*
+ * micscif_dgram_start() - Offer a datagram QP to a node
+ * @scifdev: Remote node which has just become SCIFDEV_RUNNING
+ *
+ * Like the lanes, only offered if this node has the lower id of the pair,
+ * so the two sides never offer each other a QP at the same time.
+ */
+void micscif_dgram_start(struct micscif_dev *scifdev)
+{
+	struct micscif_qp *qp;
+	struct nodemsg msg;
+	dma_addr_t qp_offset;
+
+	if (is_self_scifdev(scifdev) || scifdev->sd_dgram_qp ||
+		scifdev->sd_dgram_offer ||
+		ms_info.mi_nodeid > scifdev->sd_node ||
+		!(qp = micscif_dgram_qp_alloc(scifdev)))
+		return;
+
+	if (micscif_setup_qp_connect(qp, &qp_offset,
+			SCIF_DGRAM_QP_SIZE, scifdev))
+		goto free_qp;
+
+	spin_lock(&scifdev->sd_dgram_lock);
+	scifdev->sd_dgram_offer = qp;
+	spin_unlock(&scifdev->sd_dgram_lock);
+	msg.uop = SCIF_DGRAM_QP;
+	msg.src.node = ms_info.mi_nodeid;
+	msg.dst.node = scifdev->sd_node;
+	msg.payload[0] = qp_offset;
+	if (!micscif_nodeqp_send(scifdev, &msg, NULL))
+		return;
+	/* micscif_dgram_stop() may have taken the offer meanwhile */
+	spin_lock(&scifdev->sd_dgram_lock);
+	if (scifdev->sd_dgram_offer != qp)
+		qp = NULL;
+	else
+		scifdev->sd_dgram_offer = NULL;
+	spin_unlock(&scifdev->sd_dgram_lock);
+	if (!qp)
+		return;
+free_qp:
+	micscif_dgram_qp_free(scifdev, qp);
+}
+
+void micscif_dgram_stop(struct micscif_dev *scifdev)
+{
+	struct micscif_qp *qp, *offer;
+
+	if (is_self_scifdev(scifdev))
+		return;
+
+	/* Whoever clears sd_dgram_offer under sd_dgram_lock frees it */
+	mutex_lock(&scifdev->sd_dgram_mutex);
+	spin_lock(&scifdev->sd_dgram_lock);
+	qp = scifdev->sd_dgram_qp;
+	scifdev->sd_dgram_qp = NULL;
+	offer = scifdev->sd_dgram_offer;
+	scifdev->sd_dgram_offer = NULL;
+	spin_unlock(&scifdev->sd_dgram_lock);
+	mutex_unlock(&scifdev->sd_dgram_mutex);
+
+	if (qp)
+		micscif_dgram_qp_free(scifdev, qp);
+	if (offer)
+		micscif_dgram_qp_free(scifdev, offer);
+}
+
+/*
+ * micscif_dgram_send() - Queue a datagram for a remote node
+ * @scifdev: Destination node
+ * @dg:      Datagram, still owned by the caller
+ *
+ * Never blocks. The datagram is dropped if the RB is full or the QP to the
+ * node is not up yet.
+ */
+int micscif_dgram_send(struct micscif_dev *scifdev, struct micscif_dgram *dg)
+{
+	struct micscif_dgram_hdr hdr;
+	struct micscif_qp *qp;
+	struct nodemsg msg;
+
+	hdr.src_port = dg->src.port;
+	hdr.dst_port = dg->dst_port;
+	hdr.len = dg->len;
+
+	spin_lock(&scifdev->sd_dgram_lock);
+	if (!(qp = scifdev->sd_dgram_qp) ||
+		micscif_rb_space(&qp->outbound_q) < (int)(sizeof(hdr) + dg->len)) {
+		spin_unlock(&scifdev->sd_dgram_lock);
+		atomic_long_inc(&ms_info.mi_dgram_drop);
+		return 0;
+	}
+	micscif_rb_write(&qp->outbound_q, &hdr, sizeof(hdr), !IS_USER_BUFFER);
+	micscif_rb_write(&qp->outbound_q, dg->data, dg->len, !IS_USER_BUFFER);
+	micscif_rb_commit(&qp->outbound_q);
+	spin_unlock(&scifdev->sd_dgram_lock);
+	atomic_long_inc(&ms_info.mi_dgram_sent);
+
+	msg.uop = SCIF_DGRAM_SENT;
+	msg.src.node = ms_info.mi_nodeid;
+	msg.dst.node = scifdev->sd_node;
+	return micscif_nodeqp_send(scifdev, &msg, NULL);
+}
+
+/**
+ * scif_dgram_qp_resp() - Respond to SCIF_DGRAM_QP interrupt message
+ * @msg:        Interrupt message
+ *
+ * Set up our end of the datagram QP the peer offered. There is no NACK,
+ * the peer simply has no datagram QP to this node if this fails. Offers
+ * only come from the lower id of the pair, so one crossing our own is
+ * ignored.
+ */
+static void
+scif_dgram_qp_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct micscif_qp *qp;
+	dma_addr_t qp_offset;
+
+	if (scifdev->sd_dgram_qp || scifdev->sd_dgram_offer ||
+		ms_info.mi_nodeid < scifdev->sd_node ||
+		!(qp = micscif_dgram_qp_alloc(scifdev)))
+		return;
+
+	if (micscif_setup_qp_accept(qp, &qp_offset, msg->payload[0],
+			SCIF_DGRAM_QP_SIZE, scifdev))
+		goto free_qp;
+
+	msg->uop = SCIF_DGRAM_QP_ACK;
+	msg->dst.node = msg->src.node;
+	msg->src.node = ms_info.mi_nodeid;
+	msg->payload[0] = qp_offset;
+	if (micscif_nodeqp_send(scifdev, msg, NULL))
+		goto free_qp;
+	micscif_dgram_online(scifdev, qp);
+	return;
+free_qp:
+	micscif_dgram_qp_free(scifdev, qp);
+}
+
+/**
+ * scif_dgram_qp_ack_resp() - Respond to SCIF_DGRAM_QP_ACK interrupt message
+ * @msg:        Interrupt message
+ */
+static void
+scif_dgram_qp_ack_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	struct micscif_qp *qp;
+
+	spin_lock(&scifdev->sd_dgram_lock);
+	qp = scifdev->sd_dgram_offer;
+	scifdev->sd_dgram_offer = NULL;
+	spin_unlock(&scifdev->sd_dgram_lock);
+	if (!qp)
+		return;
+
+	if (micscif_setup_qp_connect_response(scifdev, qp, msg->payload[0])) {
+		micscif_dgram_qp_free(scifdev, qp);
+		return;
+	}
+	micscif_dgram_online(scifdev, qp);
+	micscif_dgram_drain(scifdev);
+}
+
+/**
+ * scif_dgram_sent_resp() - Respond to SCIF_DGRAM_SENT interrupt message
+ * @msg:        Interrupt message
+ */
+static void
+scif_dgram_sent_resp(struct micscif_dev *scifdev, struct nodemsg *msg)
+{
+	micscif_dgram_drain(scifdev);
+}
+
 #ifdef _MIC_SCIF_
 static void
 smpt_set(struct micscif_dev *scifdev, struct nodemsg *msg)
@@ -2722,10 +3780,19 @@ void (*scif_intr_func[SCIF_MAX_MSG + 1])(struct micscif_dev *, struct nodemsg *m
 	scif_node_add_nack_resp,	//SCIF_NODE_ADD_NACK
 	scif_get_node_info_resp,	//SCIF_GET_NODE_INFO
 #ifdef ENABLE_TEST
-	scif_test			// SCIF_TEST
+	scif_test,			// SCIF_TEST
 #else
-	scif_msg_unknown
+	scif_msg_unknown,
 #endif
+	scif_rndv_req_resp,		// SCIF_RNDV_REQ
+	scif_rndv_ack_resp,		// SCIF_RNDV_ACK
+	scif_rndv_cancel_resp,		// SCIF_RNDV_CANCEL
+	scif_nodeqp_add_resp,		// SCIF_NODEQP_ADD
+	scif_nodeqp_add_ack_resp,	// SCIF_NODEQP_ADD_ACK
+	scif_nodeqp_add_nack_resp,	// SCIF_NODEQP_ADD_NACK
+	scif_dgram_qp_resp,		// SCIF_DGRAM_QP
+	scif_dgram_qp_ack_resp,		// SCIF_DGRAM_QP_ACK
+	scif_dgram_sent_resp		// SCIF_DGRAM_SENT
 };
 
 /**
@@ -2751,7 +3818,54 @@ micscif_nodeqp_msg_handler(struct micscif_dev *scifdev, struct micscif_qp *qp, s
 		BUG_ON(1);
 	}
 
-	scif_intr_func[msg->uop](scifdev, msg);
+	if (ms_info.en_nodeqp_stats) {
+		struct micscif_msg_stats *stats = &micscif_msg_stats[msg->uop];
+		ktime_t start = ktime_get();
+		long ns;
+
+		scif_intr_func[msg->uop](scifdev, msg);
+		ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start));
+		atomic_long_add(ns, &stats->ns);
+		if (ns > stats->max_ns)
+			stats->max_ns = ns;
+	} else {
+		scif_intr_func[msg->uop](scifdev, msg);
+	}
+	atomic_long_inc(&micscif_msg_stats[msg->uop].cnt);
+}
+
+/*
+ * micscif_nodeqp_lookahead() - Handle high priority messages out of order
+ * @ahead: Bit i set if the i-th message past the read offset was handled
+ * @scanned: Number of messages past the read offset looked at so far
+ *
+ * Picks SCIF_MSG_PRIO_HIGH messages out of the ring ahead of the message
+ * at the read offset, which micscif_nodeqp_intrhandler() handles next.
+ * They stay in the ring so that the read pointer only ever moves forward
+ * and are skipped when their turn comes.
+ */
+static void
+micscif_nodeqp_lookahead(struct micscif_dev *scifdev, struct micscif_qp *qp,
+			unsigned long *ahead, uint32_t *scanned)
+{
+	struct nodemsg msg;
+
+	for (; *scanned < SCIF_NODEQP_LOOKAHEAD; (*scanned)++) {
+		if (SCIFDEV_RUNNING != scifdev->sd_state || oops_in_progress)
+			break;
+		if (micscif_rb_peek(&qp->inbound_q, *scanned * sizeof(msg),
+				&msg, sizeof(msg)) != sizeof(msg))
+			break;
+		if (msg.uop > SCIF_MAX_MSG ||
+			SCIF_MSG_PRIO_HIGH != micscif_msg_prio[msg.uop])
+			continue;
+		micscif_inc_node_refcnt(scifdev, 1);
+		micscif_nodeqp_msg_handler(scifdev, qp, &msg);
+		micscif_dec_node_refcnt(scifdev, 1);
+		if (*scanned)
+			atomic_long_inc(&micscif_msg_stats[msg.uop].ahead);
+		*ahead |= 1UL << *scanned;
+	}
 }
 
 /**
@@ -2768,6 +3882,9 @@ micscif_nodeqp_intrhandler(struct micscif_dev *scifdev, struct micscif_qp *qp)
 {
 	struct nodemsg msg;
 	int read_size;
+	unsigned long ahead = 0;
+	uint32_t scanned = 0;
+	bool handled;
 
 	do {
 #ifndef _MIC_SCIF_
@@ -2778,6 +3895,7 @@ micscif_nodeqp_intrhandler(struct micscif_dev *scifdev, struct micscif_qp *qp)
 #endif
 		if (SCIFDEV_STOPPED == scifdev->sd_state)
 			return 0;
+		micscif_nodeqp_lookahead(scifdev, qp, &ahead, &scanned);
 		read_size = micscif_rb_get_next(&qp->inbound_q, &msg,
 							sizeof(msg), !IS_USER_BUFFER);
 		/* Stop handling messages if an oops is in progress */
@@ -2786,6 +3904,16 @@ micscif_nodeqp_intrhandler(struct micscif_dev *scifdev, struct micscif_qp *qp)
 #ifndef _MIC_SCIF_
 		atomic_set(&scifdev->sd_node_alive, 1);
 #endif
+		handled = ahead & 1;
+		ahead >>= 1;
+		if (scanned)
+			scanned--;
+		if (handled) {
+			micscif_rb_update_read_ptr(&qp->inbound_q);
+			continue;
+		}
+		/* Anything sent on a lane before this message goes first */
+		micscif_nodeqp_lanes_drain(scifdev);
 
 		micscif_inc_node_refcnt(scifdev, 1);
 		micscif_nodeqp_msg_handler(scifdev, qp, &msg);
@@ -2803,6 +3931,7 @@ micscif_nodeqp_intrhandler(struct micscif_dev *scifdev, struct micscif_qp *qp)
 		micscif_rb_update_read_ptr(&qp->inbound_q);
 		micscif_dec_node_refcnt(scifdev, 1);
 	} while (read_size == sizeof(msg));
+	micscif_nodeqp_lanes_kick(scifdev);
 #ifdef _MIC_SCIF_
 	/*
 	 * Keep polling the Node QP RB in case there are active SCIF
@@ -2848,6 +3977,11 @@ static void micscif_loopb_wq_handler(struct work_struct *work)
 
 		if (msg) {
 			micscif_nodeqp_msg_handler(scifdev, qp, &msg->msg);
+			/*
+			 * Only now may later messages be handled directly, or
+			 * they could overtake this one while it is handled.
+			 */
+			atomic_dec(&scifdev->sd_loopb_pending);
 			kfree(msg);
 		}
 	} while (msg);
@@ -2933,6 +4067,7 @@ int micscif_setup_loopback_qp(struct micscif_dev *scifdev)
 		goto error;
 
 	INIT_LIST_HEAD(&scifdev->sd_loopb_recv_q);
+	atomic_set(&scifdev->sd_loopb_pending, 0);
 	snprintf(scifdev->sd_loopb_wqname, sizeof(scifdev->sd_loopb_wqname),
 			"SCIF LOOPB %d", scifdev->sd_node);
 	if (!(scifdev->sd_loopb_wq =
@@ -41,8 +41,8 @@
  * Port reservation mechnism.
  * Since this goes with SCIF it must be available for any OS
  * and should not consume IP ports. Therefore, roll our own.
- * This is not required to be high performance, so a simple bit
- * array should do just fine.
+ * Each port is one bit of port_map, set while the port is in use.
+ * Bits are claimed with atomic bit operations, so there is no lock.
  *
  * API specification (loosely):
  *
@@ -63,6 +63,11 @@
  * Reserved ports comes from the lower end of the allocatable range,
  * and is reserved only in the sense that get_scif_port() won't use
  * them and there is only a predefined count of them available.
+ *
+ * get_scif_port() searches from a per CPU hint just past the last port
+ * it handed out on that CPU. CPUs start at different points of the range
+ * so they rarely compete for the same bits, and a released port is not
+ * handed out again until the search has gone round the whole range.
  */
 
 #include <mic/micscif.h>
@@ -83,204 +88,25 @@
 #endif
 
 #include <linux/bitops.h>
-#include <linux/spinlock_types.h>
-static spinlock_t port_lock = __SPIN_LOCK_UNLOCKED(port_lock);
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 
 /*
  * Data structures
- *  init_array	Flag for initialize (mark as init_code?)
- *  port_bits	1 bit representing each possible port.
- *  first_free	Index into port_bits for free area
- *  port_lock	Lock for exclusive access
+ *  port_map	1 bit representing each possible port, set if in use.
+ *  port_hint	Per CPU index into port_map to start searching at.
  *  port_rsvd	Total of successful "get/resv" calls.
  *  port_free	Total of successful "free" calls.
  *  port_err	Total of unsuccessfull calls.
  */
 
-#define BITS_PR_PORT	 (8 * sizeof(uint64_t))
-#define PORTS_ARRAY_SIZE ((SCIF_PORT_COUNT + (BITS_PR_PORT - 1)) / BITS_PR_PORT)
-
-
-static int	init_array = 1;
-static uint16_t	first_free;
-static uint64_t	port_bits[PORTS_ARRAY_SIZE];
-static uint64_t	port_rsvd;
-static uint64_t	port_free;
-static uint64_t	port_err;
-
-
-/*
- * Bitfield handlers.
- *
- * Need 3 bit-fiddlers to operate on individual bits within
- * one 64 bit word in memory (always passing a pointer).
- * Individual bits are enumerated from 1, allowing for use
- * of value 0 to indicate an error condition.
- *
- * 1) __scif_ffsclr() returns index of first set bit in the
- *    64 bit word and clears it. A return value 0 means there
- *    were no set bits in the word.
- *
- * 2) __scif_clrbit() clears a specified bit in the 64 bit word
- *    The bit index is returned if bit was previously set and a
- *    value 0 is returned if it was previously clear.
- *
- * 3) __scif_setbit() sets a specified bit in the 64 bit word.
- *
- * Two versions, one should work for you.
- */
-
-#if 1 && (defined(__GNUC__) || defined(ICC))
-/*
- * Use GNU style inline assembly for bit operations.
- *
- * Gcc complains about uninitialized use of variables
- * big_bit in ffsclr and avl in clrbit. Generated code
- * is correct, just haven't figured out the correct
- * contraints yet.
- *
- * gcc -O2:
- *  __scif_ffsclr:  40 bytes
- *  __scif_clrbit:  34 bytes
- *  __scif_setbit:  17 bytes
- */
-
-static int
-__scif_ffsclr(uint64_t *word)
-{
-	uint64_t  big_bit = 0;
-	uint64_t  field = *word;
-
-	asm volatile (
-		"bsfq %1,%0\n\t"
-		"jnz 1f\n\t"
-		"movq $-1,%0\n"
-		"jmp 2f\n\t"
-		"1:\n\t"
-		"btrq %2,%1\n\t"
-		"2:"
-		: "=r" (big_bit), "=r" (field)
-		: "0" (big_bit),  "1" (field)
-	);
+#define SCIF_PORT_EPHEMERAL	(SCIF_PORT_COUNT - SCIF_PORT_RSVD)
 
-	if (big_bit == -1)
-		return 0;
-
-	*word = field;
-	return big_bit + 1;
-}
-
-static int
-__scif_clrbit(uint64_t *word, uint16_t bit)
-{
-	uint64_t  field = *word;
-	uint64_t  big_bit = bit;
-	int  avl = 0;
-
-	big_bit--;
-	asm volatile (
-		"xorl %2,%2\n\t"
-		"btrq %3,%1\n\t"
-		"rcll $1,%2\n\t"
-		: "=Ir" (big_bit), "=r" (field), "=r" (avl)
-		: "0" (big_bit),   "1" (field),  "2" (avl)
-	);
-
-	*word = field;
-	return avl ? bit : 0;
-}
-
-static void
-__scif_setbit(uint64_t *word, uint16_t bit)
-{
-	uint64_t  field = *word;
-	uint64_t  big_bit = bit;
-
-	big_bit--;
-	asm volatile (
-		"btsq %2,%1"
-		: "=r" (field)
-		: "0" (field), "Jr" (big_bit)
-	);
-
-	*word = field;
-}
-#else
-/*
- * C inliners for bit operations.
- *
- * gcc -O2:
- *  __scif_ffsclr:  50 bytes
- *  __scif_clrbit:  45 bytes
- *  __scif_setbit:  18 bytes
- *
- * WARNING:
- *  1) ffsll() may be glibc specific
- *  2) kernel ffs() use cmovz instruction that may not
- *     work in uOS kernel (see arch/x86/include/asm/bitops.h)
- *
- */
-
-
-static int
-__scif_ffsclr(uint64_t *word)
-{
-	int	bit;
-/*
- *  ffsll()		Find 1st bit in 64 bit word
- */
-
-	bit = ffsll(*word);
-	if (bit)
-		*word &= ~(1LL << (bit - 1));
-
-	return bit;
-}
-
-static int
-__scif_clrbit(uint64_t *word, uint16_t bit)
-{
-	uint64_t msk = (1LL << (bit - 1));
-
-	if (*word & msk) {
-		*word &= ~msk;
-		return bit;
-	}
-	return 0;
-}
-
-static void
-__scif_setbit(uint64_t *word, uint16_t bit)
-{
-	*word |= (1LL << (bit - 1));
-}
-#endif
-
-
-static void
-init_scif_array(void)
-{
-	spin_lock(&port_lock);
-	if (init_array) {
-		int i;
-		for (i = 0; i < PORTS_ARRAY_SIZE; i++)
-			port_bits[i] = ~0;
-		first_free = SCIF_PORT_RSVD / BITS_PR_PORT;
-		if (!SCIF_PORT_BASE)
-			port_bits[0] ^= 1;
-		port_rsvd = 0;
-		port_free = 0;
-		port_err = 0;
-		init_array = 0;
-	}
-	spin_unlock(&port_lock);
-	pr_debug("SCIF port array init:\n"
-			"  %d ports available starting at %d, %d reserved\n"
-			"  Array consists of %ld %ld-bit wide integers\n", 
-			SCIF_PORT_BASE ? SCIF_PORT_COUNT : SCIF_PORT_COUNT - 1, 
-			SCIF_PORT_BASE ? SCIF_PORT_BASE : 1, SCIF_PORT_RSVD, 
-			PORTS_ARRAY_SIZE, BITS_PR_PORT);
-}
+static DECLARE_BITMAP(port_map, SCIF_PORT_COUNT);
+static DEFINE_PER_CPU(uint32_t, port_hint);
+static atomic_long_t	port_rsvd;
+static atomic_long_t	port_free;
+static atomic_long_t	port_err;
 
 
 /*
@@ -290,30 +116,17 @@ init_scif_array(void)
 uint16_t
 rsrv_scif_port(uint16_t port)
 {
-	uint16_t port_ix;
-
 	if (!port) {
 		pr_debug("rsrv_scif_port: invalid port %d\n", port);
-		port_err++;
+		atomic_long_inc(&port_err);
 		return 0;
 	}
 
-	if (init_array)
-		init_scif_array();
-
-	port -= SCIF_PORT_BASE;
-	port_ix = port / BITS_PR_PORT;
-
-	spin_lock(&port_lock);
-	port = __scif_clrbit(port_bits + port_ix, 1 + (port % BITS_PR_PORT));
-	if (port) {
-		port = port - 1 + BITS_PR_PORT * port_ix + SCIF_PORT_BASE;
-		port_rsvd++;
-	} else {
-		port_err++;
+	if (test_and_set_bit(port - SCIF_PORT_BASE, port_map)) {
+		atomic_long_inc(&port_err);
+		return 0;
 	}
-	spin_unlock(&port_lock);
-
+	atomic_long_inc(&port_rsvd);
 	return port;
 }
 
@@ -325,28 +138,40 @@ rsrv_scif_port(uint16_t port)
 uint16_t
 get_scif_port(void)
 {
-	uint16_t	port;
-
-	if (init_array)
-		init_scif_array();
+	uint32_t *hint = &get_cpu_var(port_hint);
+	unsigned long bit, start = *hint, searched = 0;
+
+	if (start >= SCIF_PORT_COUNT)
+		start = SCIF_PORT_RSVD;
+	else if (start < SCIF_PORT_RSVD)	/* First use on this CPU */
+		start = SCIF_PORT_RSVD + (smp_processor_id() *
+			(SCIF_PORT_EPHEMERAL / num_possible_cpus())) %
+			SCIF_PORT_EPHEMERAL;
+
+	bit = start;
+	while (searched < SCIF_PORT_EPHEMERAL) {
+		bit = find_next_zero_bit(port_map, SCIF_PORT_COUNT, bit);
+		if (bit >= SCIF_PORT_COUNT) {
+			/* Wrap around to the first ephemeral port */
+			searched += SCIF_PORT_COUNT - start;
+			start = bit = SCIF_PORT_RSVD;
+			continue;
+		}
+		if (!test_and_set_bit(bit, port_map))
+			break;
+		/* Lost it to another CPU, keep looking past it */
+		bit++;
+	}
 
-	spin_lock(&port_lock);
-	if (first_free == PORTS_ARRAY_SIZE) {	/* Pool is empty */
-		port = 0;
-		port_err++;
-		goto out;
+	if (searched >= SCIF_PORT_EPHEMERAL) {	/* Pool is empty */
+		put_cpu_var(port_hint);
+		atomic_long_inc(&port_err);
+		return 0;
 	}
-	port = __scif_ffsclr(port_bits + first_free);
-	if (port) {
-		port = port - 1 + BITS_PR_PORT * first_free + SCIF_PORT_BASE;
-		while ((first_free < PORTS_ARRAY_SIZE) && !port_bits[first_free])
-			first_free++;
-		port_rsvd++;
-	} else
-		port_err++;
-out:
-	spin_unlock(&port_lock);
-	return port;
+	*hint = bit + 1;
+	put_cpu_var(port_hint);
+	atomic_long_inc(&port_rsvd);
+	return (uint16_t)(bit + SCIF_PORT_BASE);
 }
 
 
@@ -359,22 +184,72 @@ out:
 void
 put_scif_port(uint16_t port)
 {
-	uint16_t port_ix;
-
 	if (!port) {
 		pr_debug("put_scif_port: invalid port %d\n", port);
-		port_err++;
+		atomic_long_inc(&port_err);
 		return;
 	}
 
-	port -= SCIF_PORT_BASE;
-	port_ix = port / BITS_PR_PORT;
-
-	spin_lock(&port_lock);
-	__scif_setbit(port_bits + port_ix, 1 + (port % BITS_PR_PORT));
-	if (port >= SCIF_PORT_RSVD && port_ix < first_free)
-		first_free = port_ix;
-	port_free++;
-	spin_unlock(&port_lock);
+	clear_bit(port - SCIF_PORT_BASE, port_map);
+	atomic_long_inc(&port_free);
 }
 
+
+#define SCIF_PORT_BENCH_LOOPS	10000
+
+/*
+ * Time get_scif_port()/put_scif_port() pairs with the ephemeral range
+ * filled to a few levels of occupancy, for /proc/scif/port_bench.
+ * The ports used to fill the range are taken for real for the duration.
+ */
+int
+scif_port_bench(char *buf, int len)
+{
+	static const int pct[] = {0, 50, 90, 99, 100};
+	uint16_t *held, port;
+	int i, j, l = 0, nr_held = 0, fails;
+	ktime_t start;
+	long ns;
+
+	if (!(held = vmalloc(SCIF_PORT_EPHEMERAL * sizeof(*held))))
+		return -ENOMEM;
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"SCIF ports reserved %ld freed %ld failed %ld\n",
+		atomic_long_read(&port_rsvd), atomic_long_read(&port_free),
+		atomic_long_read(&port_err));
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"%-10s %-10s %-12s %-10s\n",
+		"occupied", "in use", "ns/get+put", "failed");
+
+	for (i = 0; i < ARRAY_SIZE(pct); i++) {
+		/* 100% leaves a single free port for the loop below */
+		int want = pct[i] < 100 ? SCIF_PORT_EPHEMERAL / 100 * pct[i] :
+				SCIF_PORT_EPHEMERAL - 1;
+
+		while (nr_held < want && (port = get_scif_port()))
+			held[nr_held++] = port;
+
+		fails = 0;
+		start = ktime_get();
+		for (j = 0; j < SCIF_PORT_BENCH_LOOPS; j++) {
+			if ((port = get_scif_port()))
+				put_scif_port(port);
+			else
+				fails++;
+		}
+		ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+			"%-9d%% %-10d %-12ld %-10d\n", pct[i],
+			bitmap_weight(port_map + BIT_WORD(SCIF_PORT_RSVD),
+				SCIF_PORT_EPHEMERAL),
+			ns / SCIF_PORT_BENCH_LOOPS, fails);
+		schedule();
+	}
+
+	while (nr_held)
+		put_scif_port(held[--nr_held]);
+	vfree(held);
+	return l;
+}
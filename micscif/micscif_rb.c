@@ -41,11 +41,28 @@
 #include "mic/micscif_rb.h"
 
 #include <linux/circ_buf.h>
+#include <linux/uaccess.h>
+#include <asm/unaligned.h>
 #define count_in_ring(head, tail, size)    CIRC_CNT(head, tail, size)
 #define space_in_ring(head, tail, size)    CIRC_SPACE(head, tail, size)
 
 MODULE_LICENSE("GPL");
 
+/*
+ * The read and write pointers hand ring space between the one producer
+ * and the one consumer of a ring, which need no other synchronization.
+ * Loading the other side's pointer is an acquire: nothing it guards may
+ * be touched before it. Publishing our own is a release and done with a
+ * full barrier in micscif_rb_commit() and micscif_rb_update_read_ptr().
+ * x86 and K1OM never reorder a load with later loads or stores so the
+ * acquire only has to stop the compiler there.
+ */
+#ifdef CONFIG_X86
+#define micscif_rb_acquire()	barrier()
+#else
+#define micscif_rb_acquire()	smp_mb()
+#endif
+
 static void *micscif_rb_get(struct micscif_rb *rb, uint32_t size);
 
 /**
@@ -75,9 +92,32 @@ void micscif_rb_init(struct micscif_rb *rb,
 	rb->write_ptr = write_ptr;
 	rb->current_read_offset = *read_ptr;
 	rb->current_write_offset = *write_ptr;
+	rb->nt_copy = 0;
 }
 EXPORT_SYMBOL(micscif_rb_init);
 
+/**
+ * micscif_rb_set_nt - Select non-temporal stores for writing to the RB
+ * @rb: The RingBuffer context
+ * @nt_copy: true if rb_base is the peer's memory mapped write combining
+ *
+ * Messages written to a ring living in the peer's memory only ever go
+ * across the bus, so there is no point in dragging the lines they are
+ * written to through the local cache. With nt_copy set memcpy_torb()
+ * uses movnti and micscif_rb_commit() drains the stores with a single
+ * fence before the write pointer is published.
+ */
+void micscif_rb_set_nt(struct micscif_rb *rb, bool nt_copy)
+{
+#if defined(CONFIG_X86_64) && !defined(_MIC_SCIF_)
+	rb->nt_copy = nt_copy;
+#else
+	/* K1OM has no movnti, stick with memcpy_toio() */
+	rb->nt_copy = 0;
+#endif
+}
+EXPORT_SYMBOL(micscif_rb_set_nt);
+
 /**
  * micscif_rb_reset - To reset the RingBuffer
  * @rb - The RingBuffer context
@@ -98,12 +138,80 @@ void micscif_rb_reset(struct micscif_rb *rb)
 }
 EXPORT_SYMBOL(micscif_rb_reset);
 
+/**
+ * micscif_rb_resync - Reload the cached offsets from the RB pointers
+ * @rb - The RingBuffer context
+ *
+ * Used when the ring was driven by someone else for a while, i.e. by a
+ * process which had the endpoint QP mapped, and the kernel takes it back.
+ */
+void micscif_rb_resync(struct micscif_rb *rb)
+{
+	smp_mb();
+	rb->current_read_offset = *rb->read_ptr & (rb->size - 1);
+	rb->current_write_offset = *rb->write_ptr & (rb->size - 1);
+	rb->old_current_read_offset = rb->current_read_offset;
+	rb->old_current_write_offset = rb->current_write_offset;
+}
+EXPORT_SYMBOL(micscif_rb_resync);
+
+#if defined(CONFIG_X86_64) && !defined(_MIC_SCIF_)
+/*
+ * Copy to the ring bypassing the cache. The stores are weakly ordered,
+ * micscif_rb_commit() fences them before the write pointer moves.
+ */
+static void memcpy_nt(void *dst, const void *src, uint32_t size)
+{
+	char *d = dst;
+	const char *s = src;
+
+	while (size && ((unsigned long)d & 7)) {
+		*d++ = *s++;
+		size--;
+	}
+	for (; size >= 8; size -= 8, d += 8, s += 8)
+		asm volatile("movnti %1, %0"
+			: "=m" (*(uint64_t *)d)
+			: "r" (get_unaligned((uint64_t *)s)));
+	while (size--)
+		*d++ = *s++;
+}
+
+static int memcpy_torb_nt(struct micscif_rb *rb, void *header,
+			void *msg, uint32_t size, bool fromuser)
+{
+	uint32_t size1 = size, size2 = 0;
+
+	if ((char*)header + size >= (char*)rb->rb_base + rb->size) {
+		size1 = (uint32_t) ( ((char*)rb->rb_base + rb->size) - (char*)header);
+		size2 = size - size1;
+	}
+	if (!fromuser) {
+		memcpy_nt(header, msg, size1);
+		memcpy_nt((void *)rb->rb_base, (char*)msg+size1, size2);
+		return 0;
+	}
+	if (!access_ok(VERIFY_READ, msg, size))
+		return -EFAULT;
+	if (__copy_from_user_nocache(header, msg, size1))
+		return -EFAULT;
+	if (size2 && __copy_from_user_nocache((void *)rb->rb_base,
+					(char *)msg+size1, size2))
+		return -EFAULT;
+	return 0;
+}
+#endif
+
 /* Copies a message to the ring buffer -- handles the wrap around case */
 static int memcpy_torb(struct micscif_rb *rb, void *header,
 			void *msg, uint32_t size , bool fromuser)
 {
 	/* Need to call two copies if it wraps around */
 	uint32_t size1, size2;
+#if defined(CONFIG_X86_64) && !defined(_MIC_SCIF_)
+	if (rb->nt_copy)
+		return memcpy_torb_nt(rb, header, msg, size, fromuser);
+#endif
 	if ((char*)header + size >= (char*)rb->rb_base + rb->size) {
 		size1 = (uint32_t) ( ((char*)rb->rb_base + rb->size) - (char*)header);
 		size2 = size - size1;
@@ -169,6 +277,7 @@ int micscif_rb_space(struct micscif_rb *rb)
 	rb->old_current_read_offset = rb->current_read_offset;
 
 	rb->current_read_offset = *rb->read_ptr;
+	micscif_rb_acquire();
 	return space_in_ring(rb->current_write_offset,
 		rb->current_read_offset, rb->size);
 }
@@ -228,16 +337,40 @@ int micscif_rb_get_next (struct micscif_rb *rb, void *msg, uint32_t size, bool t
 	if (header) {
 		uint32_t next_cmd_offset =
 			(rb->current_read_offset + size) & (rb->size - 1);
+		/* Leave the bytes in the ring if they could not be copied */
+		if (memcpy_fromrb(rb, header, msg, size, touser))
+			return -EFAULT;
 		read_size = size;
 		rb->old_current_read_offset = rb->current_read_offset;
 		rb->current_read_offset = next_cmd_offset;
-		if (memcpy_fromrb(rb, header, msg, size, touser))  // add check here
-			return -EFAULT;
 	}
 	return read_size;
 }
 EXPORT_SYMBOL(micscif_rb_get_next);
 
+/*
+ * micscif_rb_peek
+ * Read a message further down the ring buffer without consuming it.
+ * @rb - The RingBuffer context
+ * @skip - Bytes past the current read offset where the message starts
+ * @msg - buffer to hold the message.  Must be at least size bytes long
+ * @size - Size to be read out
+ * RETURN:
+ * size if the message has been written to the RB, 0 otherwise.
+ */
+int micscif_rb_peek(struct micscif_rb *rb, uint32_t skip, void *msg, uint32_t size)
+{
+	void *header;
+
+	if (skip + size >= rb->size || micscif_rb_count(rb, skip + size) < skip + size)
+		return 0;
+	header = (char*)rb->rb_base +
+		((rb->current_read_offset + skip) & (rb->size - 1));
+	memcpy_fromrb(rb, header, msg, size, false);
+	return size;
+}
+EXPORT_SYMBOL(micscif_rb_peek);
+
 /**
  * micscif_rb_update_read_ptr
  * @rb - The RingBuffer context
@@ -304,6 +437,7 @@ uint32_t micscif_rb_count(struct micscif_rb *rb, uint32_t size)
 		 */
 		rb->old_current_write_offset = rb->current_write_offset;
 		rb->current_write_offset = *rb->write_ptr;
+		micscif_rb_acquire();
 	}
 	return count_in_ring(rb->current_write_offset,
 			rb->current_read_offset,
@@ -340,7 +474,10 @@ void micscif_rb_commit(struct micscif_rb *rb)
 	 * and the deadlock. Must put another memory barrier after readback --
 	 * revents read-passing-read from later read
 	 */
-	smp_mb();
+	if (rb->nt_copy)
+		mb();	/* drains the movnti stores from memcpy_torb() too */
+	else
+		smp_mb();
 #ifdef CONFIG_ML1OM
 	/*
 	 * Also makes sure the following read is not reordered
@@ -154,6 +154,7 @@ static void init_mmu_notifier(struct rma_mmu_notifier *mmn, struct mm_struct *mm
 	mmn->ep_mmu_notifier.ops = &scif_mmu_notifier_ops;
 	INIT_LIST_HEAD(&mmn->list_member);
 	INIT_LIST_HEAD(&mmn->tc_reg_list);
+	mmn->tc_reg_tree = RB_ROOT;
 }
 
 static struct rma_mmu_notifier *find_mmu_notifier(struct mm_struct *mm, struct endpt_rma_info *rma)
@@ -170,6 +171,9 @@ static struct rma_mmu_notifier *find_mmu_notifier(struct mm_struct *mm, struct e
 }
 #endif
 
+static void micscif_rma_async_work(struct work_struct *work);
+static void micscif_rma_async_dma_cb(uint64_t cookie);
+
 /**
  * micscif_rma_ep_init:
  * @ep: end point
@@ -186,10 +190,14 @@ int micscif_rma_ep_init(struct endpt *ep)
 		VA_GEN_MIN, VA_GEN_RANGE)) < 0)
 		goto init_err;
 	spin_lock_init(&rma->tc_lock);
+	INIT_LIST_HEAD(&rma->tc_lru);
+	rma->tc_lru_pages = 0;
 	mutex_init (&rma->mmn_lock);
 	mutex_init (&rma->va_lock);
 	INIT_LIST_HEAD(&rma->reg_list);
 	INIT_LIST_HEAD(&rma->remote_reg_list);
+	rma->reg_tree = RB_ROOT;
+	rma->remote_reg_tree = RB_ROOT;
 	atomic_set(&rma->tw_refcount, 0);
 	atomic_set(&rma->tw_total_pages, 0);
 	atomic_set(&rma->tcw_refcount, 0);
@@ -197,6 +205,21 @@ int micscif_rma_ep_init(struct endpt *ep)
 	init_waitqueue_head(&rma->fence_wq);
 	rma->fence_refcount = 0;
 	rma->async_list_del = 0;
+	spin_lock_init(&rma->async_lock);
+	INIT_LIST_HEAD(&rma->async_pending);
+	INIT_LIST_HEAD(&rma->async_inflight);
+	INIT_LIST_HEAD(&rma->async_cq);
+	rma->async_cookie = 0;
+	rma->async_nr = 0;
+	rma->async_busy = 0;
+	rma->async_again = 0;
+	INIT_WORK(&rma->async_work, micscif_rma_async_work);
+	init_waitqueue_head(&rma->async_wq);
+	memset(&rma->async_dma_cb, 0, sizeof(rma->async_dma_cb));
+	rma->async_dma_cb.dma_completion_func = micscif_rma_async_dma_cb;
+	rma->async_dma_cb.cb_cookie = (uint64_t)rma;
+	atomic_set(&rma->async_dma_cbs, 1);
+	init_completion(&rma->async_dma_done);
 	rma->dma_chan = NULL;
 	INIT_LIST_HEAD(&rma->mmn_list);
 	INIT_LIST_HEAD(&rma->task_list);
@@ -1083,7 +1106,7 @@ done:
 	if (!window->ref_count) {
 		atomic_inc(&ep->rma_info.tw_refcount);
 		atomic_add_return((int32_t)window->nr_pages, &ep->rma_info.tw_total_pages);
-		list_del(&window->list_member);
+		micscif_remove_window(window);
 		micscif_free_window_offset(ep, window->offset,
 				window->nr_pages << PAGE_SHIFT);
 		window->offset_freed = true;
@@ -1500,9 +1523,6 @@ error_unpin:
 void micscif_rma_completion_cb(uint64_t data)
 {
 	struct dma_completion_cb *comp_cb = (struct dma_completion_cb *)data;
-#ifndef _MIC_SCIF_
-	struct pci_dev *pdev;
-#endif
 
 	/* Free DMA Completion CB. */
 	if (comp_cb && comp_cb->temp_buf) {
@@ -1512,33 +1532,45 @@ void micscif_rma_completion_cb(uint64_t data)
 				comp_cb->len, false);
 		}
 #ifndef _MIC_SCIF_
-		micscif_pci_dev(comp_cb->remote_node, &pdev);
-		mic_ctx_unmap_single(get_per_dev_ctx(comp_cb->remote_node - 1), 
-			comp_cb->temp_phys, KMEM_UNALIGNED_BUF_SIZE);
-#endif
+		mic_dma_buf_put(get_per_dev_ctx(comp_cb->remote_node - 1),
+			comp_cb->dma_buf);
+#else
 		if (comp_cb->is_cache)
 			micscif_kmem_cache_free(comp_cb->temp_buf_to_free);
 		else
 			kfree(comp_cb->temp_buf_to_free);
+#endif
 	}
 	kfree(comp_cb);
 }
 
-static void __micscif_rma_destroy_tcw_ep(struct endpt *ep);
+/*
+ * Make room for cur_bytes in the temp registration cache of ep by evicting
+ * only as many least recently used windows as needed to stay within
+ * mi_rma_tc_limit. Returns false if cur_bytes can never be cached.
+ */
 static
 bool micscif_rma_tc_can_cache(struct endpt *ep, size_t cur_bytes)
 {
-	if ((cur_bytes >> PAGE_SHIFT) > ms_info.mi_rma_tc_limit)
+	struct endpt_rma_info *rma = &ep->rma_info;
+	struct reg_range_t *window;
+	int64_t nr_pages = cur_bytes >> PAGE_SHIFT;
+
+	if (nr_pages > ms_info.mi_rma_tc_limit)
 		return false;
-	if ((atomic_read(&ep->rma_info.tcw_total_pages)
-			+ (cur_bytes >> PAGE_SHIFT)) >
+	if ((atomic_read(&rma->tcw_total_pages) + nr_pages) >
 			ms_info.mi_rma_tc_limit) {
-		printk(KERN_ALERT "%s %d total=%d, current=%zu reached max\n", 
-				__func__, __LINE__, 
-				atomic_read(&ep->rma_info.tcw_total_pages), 
-				(1 + (cur_bytes >> PAGE_SHIFT)));
+		spin_lock(&rma->tc_lock);
+		while (!list_empty(&rma->tc_lru) &&
+			rma->tc_lru_pages + nr_pages > ms_info.mi_rma_tc_limit) {
+			window = list_first_entry(&rma->tc_lru,
+					struct reg_range_t, tc_lru);
+			__micscif_rma_destroy_tcw_helper(window);
+			atomic_long_inc(&ms_info.mi_rma_tc_evict);
+		}
+		spin_unlock(&rma->tc_lock);
+		/* Unpin the evicted windows and any invalidated earlier */
 		micscif_rma_destroy_tcw_invalid(&ms_info.mi_rma_tc);
-		__micscif_rma_destroy_tcw_ep(ep);
 	}
 	return true;
 }
@@ -1623,6 +1655,7 @@ int micscif_rma_copy(scif_epd_t epd, off_t loffset, void *addr, size_t len,
 	remote_req.prot = LOCAL_TO_REMOTE == dir ? VM_WRITE : VM_READ;
 	remote_req.type = WINDOW_PARTIAL;
 	remote_req.head = &ep->rma_info.remote_reg_list;
+	remote_req.tree = &ep->rma_info.remote_reg_tree;
 
 #ifdef CONFIG_MMU_NOTIFIER
 	if (addr && cache) {
@@ -1676,8 +1709,10 @@ int micscif_rma_copy(scif_epd_t epd, off_t loffset, void *addr, size_t len,
 	if (addr) {
 		req.out_window = &window;
 		req.nr_bytes = ALIGN(len + ((uint64_t)addr & ~PAGE_MASK), PAGE_SIZE);
-		if (mmn)
+		if (mmn) {
 			req.head = &mmn->tc_reg_list;
+			req.tree = &mmn->tc_reg_tree;
+		}
 		req.va_for_temp = (void*)((uint64_t)addr & PAGE_MASK);
 		req.prot = (LOCAL_TO_REMOTE == dir ? VM_READ : VM_WRITE | VM_READ);
 		/* Does a valid local window exist? */
@@ -1700,19 +1735,30 @@ int micscif_rma_copy(scif_epd_t epd, off_t loffset, void *addr, size_t len,
 			}
 			mutex_lock(&ep->rma_info.rma_lock);
 			pr_debug("New temp window created addr %p\n", addr);
+			if (mmn) {
+				ep->stats.reg_cache_misses++;
+				atomic_long_inc(&ms_info.mi_rma_tc_miss);
+			}
 			if (cache) {
 				atomic_inc(&ep->rma_info.tcw_refcount);
 				atomic_add_return((int32_t)window->nr_pages, &ep->rma_info.tcw_total_pages);
 				if (mmn) {
 					spin_lock(&ep->rma_info.tc_lock);
-					micscif_insert_tcw(window, &mmn->tc_reg_list);
+					micscif_insert_tcw(window, &mmn->tc_reg_list,
+						&mmn->tc_reg_tree);
+					list_add_tail(&window->tc_lru,
+						&ep->rma_info.tc_lru);
+					ep->rma_info.tc_lru_pages += window->nr_pages;
 					spin_unlock(&ep->rma_info.tc_lock);
 				}
 			}
 			insert_window = true;
 		} else {
+			list_move_tail(&window->tc_lru, &ep->rma_info.tc_lru);
+			ep->stats.reg_cache_hits++;
 			spin_unlock(&ep->rma_info.tc_lock);
 			pr_debug("window found for addr %p\n", addr);
+			atomic_long_inc(&ms_info.mi_rma_tc_hit);
 			BUG_ON(window->va_for_temp > addr);
 		}
 		loffset = window->offset + ((uint64_t)addr - (uint64_t)window->va_for_temp);
@@ -1741,6 +1787,7 @@ int micscif_rma_copy(scif_epd_t epd, off_t loffset, void *addr, size_t len,
 		req.nr_bytes = len;
 		req.type = WINDOW_PARTIAL;
 		req.head = &ep->rma_info.reg_list;
+		req.tree = &ep->rma_info.reg_tree;
 		/* Does a valid local window exist? */
 		if ((err = micscif_query_window(&req))) {
 			printk(KERN_ERR "%s %d err %d\n", __func__, __LINE__, err);
@@ -1789,6 +1836,9 @@ int micscif_rma_copy(scif_epd_t epd, off_t loffset, void *addr, size_t len,
 		atomic_inc(&ep->rma_info.tw_refcount);
 		atomic_add_return((int32_t)window->nr_pages, &ep->rma_info.tw_total_pages);
 	}
+	ep->stats.rma_bytes += len;
+	if (last_chunk)
+		ep->stats.rma_calls++;
 
 	mutex_unlock(&ep->rma_info.rma_lock);
 
@@ -2040,6 +2090,311 @@ error:
 	return mark;
 }
 
+/*
+ * micscif_rma_async_dma_cb:
+ *
+ * Called from the DMA interrupt handler once the engine has passed the mark
+ * of an asynchronous RMA. Lets the worker move it to the completion queue.
+ */
+static void micscif_rma_async_dma_cb(uint64_t cookie)
+{
+	struct endpt_rma_info *rma = (struct endpt_rma_info *)cookie;
+
+	queue_work(ms_info.mi_rma_async_wq, &rma->async_work);
+	/* Last access, micscif_rma_async_drain() may free rma after it */
+	if (atomic_dec_and_test(&rma->async_dma_cbs))
+		complete(&rma->async_dma_done);
+}
+
+/*
+ * micscif_rma_async_mark:
+ *
+ * Mark the DMA channel after an asynchronous RMA and have the interrupt
+ * handler queue the worker once the engine gets there. Sets mark to -1 if
+ * the DMA had to be waited for here instead.
+ */
+static int micscif_rma_async_mark(struct endpt *ep, int *mark)
+{
+	struct endpt_rma_info *rma = &ep->rma_info;
+	struct dma_channel *chan = rma->dma_chan;
+	int err;
+
+	if ((err = request_dma_channel(chan)))
+		return err;
+	if ((*mark = program_dma_mark(chan)) < 0) {
+		free_dma_channel(chan);
+		return *mark;
+	}
+	atomic_inc(&rma->async_dma_cbs);
+	err = do_dma(chan, DO_DMA_INTR, 0, 0, 0, &rma->async_dma_cb);
+	if (err < 0)
+		atomic_dec(&rma->async_dma_cbs);
+	free_dma_channel(chan);
+	if (err >= 0)
+		return 0;
+
+	/* No callback to come */
+	if ((err = dma_mark_wait(chan, *mark, false)))
+		return err;
+	*mark = -1;
+	return 0;
+}
+
+/*
+ * micscif_rma_async_start:
+ *
+ * Perform the copy of an asynchronous RMA, without waiting for its DMA to
+ * complete, and mark the DMA channel so that the worker can tell when it has.
+ */
+static void micscif_rma_async_start(struct endpt *ep,
+	struct micscif_rma_async *req)
+{
+	int mark;
+
+	req->mark = -1;
+	if (req->dir == REMOTE_TO_LOCAL)
+		req->status = __scif_readfrom(ep, req->loffset, req->len,
+				req->roffset, req->flags);
+	else
+		req->status = __scif_writeto(ep, req->loffset, req->len,
+				req->roffset, req->flags);
+	if (req->status || !ep->rma_info.dma_chan)
+		return;
+#ifndef _MIC_SCIF_
+	/* Host loopback copies with the CPU */
+	if (is_self_scifdev(ep->remote_dev))
+		return;
+#endif
+	if (!(req->status = micscif_rma_async_mark(ep, &mark)))
+		req->mark = mark;
+}
+
+/*
+ * micscif_rma_async_work:
+ *
+ * Start the queued asynchronous RMAs of an endpoint in order and move them to
+ * the completion queue as their DMA marks are processed. Never waits for the
+ * DMA engine, micscif_rma_async_dma_cb() queues it again once the oldest RMA
+ * in flight may have completed. Only one instance runs per endpoint at a
+ * time, one queued while it does makes the running one look again.
+ */
+static void micscif_rma_async_work(struct work_struct *work)
+{
+	struct endpt_rma_info *rma =
+		container_of(work, struct endpt_rma_info, async_work);
+	struct endpt *ep = container_of(rma, struct endpt, rma_info);
+	struct micscif_rma_async *req;
+
+	spin_lock(&rma->async_lock);
+	if (rma->async_busy) {
+		rma->async_again = 1;
+		spin_unlock(&rma->async_lock);
+		return;
+	}
+	rma->async_busy = 1;
+	for (;;) {
+		if (!list_empty(&rma->async_inflight)) {
+			req = list_first_entry(&rma->async_inflight,
+				struct micscif_rma_async, list_member);
+			if (is_dma_mark_processed(rma->dma_chan, req->mark)) {
+				list_move_tail(&req->list_member, &rma->async_cq);
+				wake_up(&rma->async_wq);
+				continue;
+			}
+		}
+		if (!list_empty(&rma->async_pending)) {
+			req = list_first_entry(&rma->async_pending,
+				struct micscif_rma_async, list_member);
+			list_del(&req->list_member);
+			spin_unlock(&rma->async_lock);
+			micscif_rma_async_start(ep, req);
+			spin_lock(&rma->async_lock);
+			if (req->mark >= 0) {
+				list_add_tail(&req->list_member,
+					&rma->async_inflight);
+			} else {
+				list_add_tail(&req->list_member, &rma->async_cq);
+				wake_up(&rma->async_wq);
+			}
+		} else if (rma->async_again) {
+			rma->async_again = 0;
+		} else {
+			break;
+		}
+	}
+	rma->async_busy = 0;
+	spin_unlock(&rma->async_lock);
+	/* For micscif_rma_async_drain() */
+	wake_up(&rma->async_wq);
+}
+
+/*
+ * micscif_rma_async_submit:
+ *
+ * Queue an RMA for the endpoint's asynchronous RMA worker and return its
+ * cookie. The checks which need rma_lock are left to the worker.
+ */
+int micscif_rma_async_submit(struct endpt *ep, off_t loffset, size_t len,
+	off_t roffset, int flags, enum rma_direction dir, uint64_t *cookie)
+{
+	struct endpt_rma_info *rma = &ep->rma_info;
+	struct micscif_rma_async *req;
+	int err;
+
+	if ((err = verify_epd(ep)))
+		return err;
+
+	if (flags && !(flags & (SCIF_RMA_USECPU | SCIF_RMA_USECACHE | SCIF_RMA_SYNC | SCIF_RMA_ORDERED)))
+		return -EINVAL;
+
+	if (!(req = kmalloc(sizeof(*req), GFP_KERNEL)))
+		return -ENOMEM;
+	req->loffset = loffset;
+	req->len = len;
+	req->roffset = roffset;
+	/* The worker waits for the DMA mark instead */
+	req->flags = flags & ~SCIF_RMA_SYNC;
+	req->dir = dir;
+	req->status = 0;
+
+	spin_lock(&rma->async_lock);
+	if (rma->async_nr >= SCIF_RMA_ASYNC_MAX) {
+		spin_unlock(&rma->async_lock);
+		kfree(req);
+		return -EAGAIN;
+	}
+	rma->async_nr++;
+	req->cookie = ++rma->async_cookie;
+	*cookie = req->cookie;
+	list_add_tail(&req->list_member, &rma->async_pending);
+	spin_unlock(&rma->async_lock);
+
+	queue_work(ms_info.mi_rma_async_wq, &rma->async_work);
+	return 0;
+}
+
+static int micscif_rma_async_has_cq(struct endpt_rma_info *rma)
+{
+	int ret;
+
+	spin_lock(&rma->async_lock);
+	ret = !list_empty(&rma->async_cq);
+	spin_unlock(&rma->async_lock);
+	return ret;
+}
+
+/*
+ * micscif_rma_async_reap:
+ *
+ * Copy up to nr entries of the completion queue to comp, a user buffer if
+ * touser is set, waiting up to timeout milliseconds for the first one.
+ * Entries are only consumed once copied, those a fault stopped short of go
+ * back to the head of the queue. Returns the number copied.
+ */
+int micscif_rma_async_reap(struct endpt *ep,
+	struct scif_rma_completion *comp, int nr, long timeout, bool touser)
+{
+	struct endpt_rma_info *rma = &ep->rma_info;
+	struct micscif_rma_async *req, *tmp;
+	struct scif_rma_completion entry;
+	LIST_HEAD(done);
+	long jiffies_left;
+	int count = 0, copied;
+
+	if (nr <= 0)
+		return -EINVAL;
+
+	jiffies_left = timeout < 0 ? MAX_SCHEDULE_TIMEOUT :
+			msecs_to_jiffies(timeout);
+	for (;;) {
+		spin_lock(&rma->async_lock);
+		while (count < nr && !list_empty(&rma->async_cq)) {
+			list_move_tail(rma->async_cq.next, &done);
+			count++;
+		}
+		spin_unlock(&rma->async_lock);
+		if (count || !jiffies_left)
+			break;
+		if (signal_pending(current))
+			return -EINTR;
+		jiffies_left = wait_event_interruptible_timeout(rma->async_wq,
+				micscif_rma_async_has_cq(rma), jiffies_left);
+		if (jiffies_left < 0)
+			return -EINTR;
+	}
+
+	copied = 0;
+	list_for_each_entry(req, &done, list_member) {
+		entry.cookie = req->cookie;
+		entry.status = req->status;
+		entry.reserved = 0;
+		if (!touser)
+			comp[copied] = entry;
+		else if (copy_to_user(&comp[copied], &entry, sizeof(entry)))
+			break;
+		copied++;
+	}
+
+	spin_lock(&rma->async_lock);
+	count = copied;
+	list_for_each_entry_safe(req, tmp, &done, list_member) {
+		if (!count--)
+			break;
+		list_del(&req->list_member);
+		rma->async_nr--;
+		kfree(req);
+	}
+	/* Whatever is left was not copied */
+	if (!list_empty(&done)) {
+		list_splice(&done, &rma->async_cq);
+		wake_up(&rma->async_wq);
+		if (!copied)
+			copied = -EFAULT;
+	}
+	spin_unlock(&rma->async_lock);
+	return copied;
+}
+
+static int micscif_rma_async_idle(struct endpt_rma_info *rma)
+{
+	int ret;
+
+	spin_lock(&rma->async_lock);
+	ret = list_empty(&rma->async_pending) &&
+		list_empty(&rma->async_inflight) && !rma->async_busy;
+	spin_unlock(&rma->async_lock);
+	return ret;
+}
+
+/*
+ * micscif_rma_async_drain:
+ *
+ * Called when the endpoint is closed. Wait for the queued asynchronous RMAs
+ * to complete, as for those scif_readfrom() and friends leave in flight, and
+ * discard the completions nobody reaped.
+ */
+void micscif_rma_async_drain(struct endpt *ep)
+{
+	struct endpt_rma_info *rma = &ep->rma_info;
+	struct micscif_rma_async *req, *tmp;
+
+	might_sleep();
+	wait_event(rma->async_wq, micscif_rma_async_idle(rma));
+	/* Callbacks the engine reached just after its mark may still run */
+	if (!atomic_dec_and_test(&rma->async_dma_cbs))
+		wait_for_completion(&rma->async_dma_done);
+	/* Instances which found the worker busy may still be running */
+	cancel_work_sync(&rma->async_work);
+
+	spin_lock(&rma->async_lock);
+	list_for_each_entry_safe(req, tmp, &rma->async_cq, list_member) {
+		list_del(&req->list_member);
+		kfree(req);
+	}
+	rma->async_nr = 0;
+	spin_unlock(&rma->async_lock);
+}
+
 /**
  * micscif_rma_destroy_temp_windows:
  *
@@ -2152,19 +2507,6 @@ void micscif_rma_destroy_tcw(struct rma_mmu_notifier *mmn,
 	spin_unlock_irqrestore(&ep->rma_info.tc_lock, sflags);
 }
 
-static void __micscif_rma_destroy_tcw_ep(struct endpt *ep)
-{
-	struct list_head *item, *tmp;
-	struct rma_mmu_notifier *mmn;
-	spin_lock(&ep->rma_info.tc_lock);
-	list_for_each_safe(item, tmp, &ep->rma_info.mmn_list) {
-		mmn = list_entry(item, 
-			struct rma_mmu_notifier, list_member);
-		__micscif_rma_destroy_tcw(mmn, ep, false, 0, 0);
-	}
-	spin_unlock(&ep->rma_info.tc_lock);
-}
-
 void micscif_rma_destroy_tcw_ep(struct endpt *ep)
 {
 	struct list_head *item, *tmp;
@@ -2306,7 +2648,9 @@ restart:
  *
  * This routine reserves a DMA channel for a particular
  * endpoint. All DMA transfers for an endpoint are always
- * programmed on the same DMA channel.
+ * programmed on the same DMA channel, except for the parts
+ * of large RMAs striped across the extra channels reserved
+ * here as well.
  */
 int micscif_reserve_dma_chan(struct endpt *ep)
 {
@@ -2322,20 +2666,21 @@ int micscif_reserve_dma_chan(struct endpt *ep)
 	mutex_lock(&ep->rma_info.rma_lock);
 	if (!ep->rma_info.dma_chan) {
 		struct dma_channel **chan = &ep->rma_info.dma_chan;
+		struct dma_channel **extra = ep->rma_info.dma_chan_extra;
 		unsigned long ts = jiffies;
+		int i, nr_extra;
 #ifndef _MIC_SCIF_
 		mic_ctx_t *mic_ctx =
 			get_per_dev_ctx(ep->remote_dev->sd_node - 1);
+		struct mic_dma_ctx_t *dma_handle =
+			(struct mic_dma_ctx_t *)mic_ctx->dma_handle;
 		BUG_ON(!ep->remote_dev->sd_node);
-#endif
-		while (true) {
-			if (!(err = allocate_dma_channel((struct mic_dma_ctx_t *)
-#ifdef _MIC_SCIF_
-				mic_dma_handle,
 #else
-				mic_ctx->dma_handle,
+		struct mic_dma_ctx_t *dma_handle =
+			(struct mic_dma_ctx_t *)mic_dma_handle;
 #endif
-				chan)))
+		while (true) {
+			if (!(err = allocate_dma_channel(dma_handle, chan)))
 				break;
 			schedule();
 			if (time_after(jiffies,
@@ -2344,6 +2689,19 @@ int micscif_reserve_dma_chan(struct endpt *ep)
 				goto error;
 			}
 		}
+		/*
+		 * Pick the extra channels while still holding the first one
+		 * so that they are all different. None being free right now
+		 * only means fewer of them.
+		 */
+		nr_extra = min_t(int, ms_info.mi_rma_dma_chans,
+				SCIF_RMA_DMA_CHAN_MAX) - 1;
+		for (i = 0; i < nr_extra; i++)
+			if (allocate_dma_channel(dma_handle, &extra[i]))
+				break;
+		ep->rma_info.nr_dma_chan_extra = i;
+		while (i--)
+			mic_dma_thread_free_chan(extra[i]);
 		mic_dma_thread_free_chan(*chan);
 	}
 error:
@@ -2377,10 +2735,13 @@ int micscif_prog_signal(scif_epd_t epd, off_t offset, uint64_t val,
 	req.nr_bytes = sizeof(uint64_t);
 	req.prot = SCIF_PROT_WRITE;
 	req.type = WINDOW_SINGLE;
-	if (RMA_WINDOW_SELF == type)
+	if (RMA_WINDOW_SELF == type) {
 		req.head = &ep->rma_info.reg_list;
-	else
+		req.tree = &ep->rma_info.reg_tree;
+	} else {
 		req.head = &ep->rma_info.remote_reg_list;
+		req.tree = &ep->rma_info.remote_reg_tree;
+	}
 	/* Does a valid window exist? */
 	if ((err = micscif_query_window(&req))) {
 		printk(KERN_ERR "%s %d err %d\n", 
@@ -2543,7 +2904,7 @@ static void __micscif_cleanup_rma_for_zombies(struct endpt *ep)
 			atomic_inc(&ep->rma_info.tw_refcount);
 			atomic_add_return((int32_t)window->nr_pages, 
 				&ep->rma_info.tw_total_pages);
-			list_del(&window->list_member);
+			micscif_remove_window(window);
 			micscif_queue_for_cleanup(window, &ms_info.mi_rma);
 		}
 	}
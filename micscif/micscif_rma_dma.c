@@ -755,6 +755,93 @@ static int micscif_rma_list_dma_copy_aligned(struct mic_copy_work *work, struct
 	return ret;
 }
 
+/* Window of the list starting at window which holds offset */
+static struct reg_range_t *
+micscif_window_at(struct reg_range_t *window, uint64_t offset)
+{
+	while (offset >= window->offset + (window->nr_pages << PAGE_SHIFT))
+		window = list_entry(window->list_member.next,
+				struct reg_range_t, list_member);
+	return window;
+}
+
+/*
+ * micscif_rma_list_dma_copy_striped:
+ *
+ * Split a large cache line aligned DMA copy into equal page multiple parts,
+ * one for each extra DMA channel of the endpoint which is idle right now,
+ * with the remainder for chan, the endpoint's own channel. Busy extra
+ * channels are skipped rather than waited for so that one endpoint striping
+ * does not hold up the others sharing the engines. The extra channels are
+ * drained before returning, with rma_lock still held, so the fences and
+ * DMA marks on chan keep covering the whole transfer.
+ */
+static int micscif_rma_list_dma_copy_striped(struct endpt *ep,
+		struct mic_copy_work *work, struct dma_channel *chan)
+{
+	struct dma_channel *extra[SCIF_RMA_DMA_CHAN_MAX - 1];
+	int mark[SCIF_RMA_DMA_CHAN_MAX - 1];
+	struct mic_copy_work part;
+	size_t stripe, done = 0;
+	int i, nr = 0, ret = 0, err;
+
+	for (i = 0; i < ep->rma_info.nr_dma_chan_extra; i++)
+		if (!try_request_dma_channel(ep->rma_info.dma_chan_extra[i]))
+			extra[nr++] = ep->rma_info.dma_chan_extra[i];
+
+	stripe = (work->len / (nr + 1)) & PAGE_MASK;
+	if (!nr || !stripe) {
+		while (nr--)
+			free_dma_channel(extra[nr]);
+		return micscif_rma_list_dma_copy_aligned(work, chan);
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (ret >= 0) {
+			part = *work;
+			part.len = stripe;
+			part.src_offset = work->src_offset + done;
+			part.dst_offset = work->dst_offset + done;
+			part.src_window = micscif_window_at(work->src_window,
+						part.src_offset);
+			part.dst_window = micscif_window_at(work->dst_window,
+						part.dst_offset);
+			ret = micscif_rma_list_dma_copy_aligned(&part, extra[i]);
+			done += stripe;
+		}
+		mark[i] = program_dma_mark(extra[i]);
+		free_dma_channel(extra[i]);
+	}
+
+	if (ret >= 0) {
+		part = *work;
+		part.len = work->len - done;
+		part.src_offset = work->src_offset + done;
+		part.dst_offset = work->dst_offset + done;
+		part.src_window = micscif_window_at(work->src_window,
+					part.src_offset);
+		part.dst_window = micscif_window_at(work->dst_window,
+					part.dst_offset);
+		ret = micscif_rma_list_dma_copy_aligned(&part, chan);
+		work->dma_chan_released = part.dma_chan_released;
+	}
+	/* Let others program chan while waiting for the extra channels */
+	if (!work->dma_chan_released) {
+		free_dma_channel(chan);
+		work->dma_chan_released = true;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (mark[i] < 0)
+			err = drain_dma_intr(extra[i]);
+		else
+			err = dma_mark_wait(extra[i], mark[i], false);
+		if (err && ret >= 0)
+			ret = err;
+	}
+	return ret;
+}
+
 int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *work, struct dma_channel *chan, off_t loffset)
 {
 	int src_cache_off, dst_cache_off;
@@ -763,14 +850,22 @@ int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *w
 	bool src_local = true, dst_local = false;
 	struct dma_completion_cb *comp_cb;
 	dma_addr_t src_dma_addr, dst_dma_addr;
-#ifndef _MIC_SCIF_
-	struct pci_dev *pdev;
-#endif
 
 	src_cache_off = src_offset & (L1_CACHE_BYTES - 1);
 	dst_cache_off = dst_offset & (L1_CACHE_BYTES - 1);
-	if (dst_cache_off == src_cache_off)
+	if (dst_cache_off == src_cache_off) {
+		/*
+		 * Only stripe copies without head and tail bytes, those are
+		 * done with the CPU and on KNF may drop rma_lock to map the
+		 * GTT while the extra channels are still busy.
+		 */
+		if (epd->rma_info.nr_dma_chan_extra && !work->ordered &&
+			ms_info.mi_rma_stripe_threshold &&
+			work->len >= ms_info.mi_rma_stripe_threshold &&
+			!((src_offset | work->len) & (L1_CACHE_BYTES - 1)))
+			return micscif_rma_list_dma_copy_striped(epd, work, chan);
 		return micscif_rma_list_dma_copy_aligned(work, chan);
+	}
 
 	if (work->loopback) {
 #ifdef _MIC_SCIF_
@@ -805,6 +900,14 @@ int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *w
 	comp_cb->cb_cookie = (uint64_t)comp_cb;
 	comp_cb->dma_completion_func = &micscif_rma_completion_cb;
 
+#ifndef _MIC_SCIF_
+	/* Pool buffers are page aligned and already mapped for the card */
+	if (!(comp_cb->dma_buf = mic_dma_buf_get(
+			get_per_dev_ctx(work->remote_dev->sd_node - 1),
+			work->len + (L1_CACHE_BYTES << 1))))
+		goto free_comp_cb;
+	temp = comp_cb->dma_buf->va;
+#else
 	if (work->len + (L1_CACHE_BYTES << 1) < KMEM_UNALIGNED_BUF_SIZE) {
 		comp_cb->is_cache = false;
 		if (!(temp = kmalloc(work->len + (L1_CACHE_BYTES << 1), GFP_KERNEL)))
@@ -819,6 +922,7 @@ int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *w
 			goto free_comp_cb;
 		comp_cb->temp_buf_to_free = temp;
 	}
+#endif
 
 	if (src_local) {
 		temp += dst_cache_off;
@@ -835,14 +939,8 @@ int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *w
 	comp_cb->temp_buf = temp;
 
 #ifndef _MIC_SCIF_
-	micscif_pci_dev(work->remote_dev->sd_node, &pdev);
-	comp_cb->temp_phys = mic_map_single(work->remote_dev->sd_node - 1,
-			pdev, temp, KMEM_UNALIGNED_BUF_SIZE);
-
-	if (mic_map_error(comp_cb->temp_phys)) {
-		goto free_temp_buf;
-	}
-
+	comp_cb->temp_phys = comp_cb->dma_buf->mic_addr +
+		(temp - (uint8_t *)comp_cb->dma_buf->va);
 	comp_cb->remote_node = work->remote_dev->sd_node;
 #endif
 	if (0 > micscif_rma_list_dma_copy_unaligned(work, temp, chan, src_local))
@@ -851,10 +949,14 @@ int micscif_rma_list_dma_copy_wrapper(struct endpt *epd, struct mic_copy_work *w
 		work->fence_type = DO_DMA_INTR;
 	return 0;
 free_temp_buf:
+#ifndef _MIC_SCIF_
+	mic_dma_buf_put(get_per_dev_ctx(comp_cb->remote_node - 1), comp_cb->dma_buf);
+#else
 	if (comp_cb->is_cache)
 		micscif_kmem_cache_free(comp_cb->temp_buf_to_free);
 	else
 		kfree(comp_cb->temp_buf_to_free);
+#endif
 free_comp_cb:
 	kfree(comp_cb);
 error:
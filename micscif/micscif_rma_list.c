@@ -51,6 +51,161 @@
 #endif
 #include "mic/micscif_map.h"
 
+/*
+ * The registration lists are mirrored by an rbtree ordered like the list
+ * (by start, equal starts in insertion order) and augmented with the
+ * largest end in each subtree, so lookups are O(log n) in the number of
+ * windows while the list stays for the walkers which continue from a
+ * window to its neighbours. Temp windows may overlap, hence the interval
+ * tree rather than a plain search tree.
+ *
+ * lib/rbtree.c has no augmented variants in the kernels we support, so
+ * the rb_augment_*() helpers of later kernels are open coded here: a
+ * rotation only moves nodes by one level, so fixing up every node on the
+ * path to the root and its sibling is enough after insert and erase.
+ */
+static void micscif_window_augment(struct rb_node *node)
+{
+	struct reg_range_t *window = rb_entry(node, struct reg_range_t, rb_node);
+	uint64_t max_end = window->rb_end;
+	struct reg_range_t *child;
+
+	if (node->rb_left) {
+		child = rb_entry(node->rb_left, struct reg_range_t, rb_node);
+		max_end = max(max_end, child->rb_max_end);
+	}
+	if (node->rb_right) {
+		child = rb_entry(node->rb_right, struct reg_range_t, rb_node);
+		max_end = max(max_end, child->rb_max_end);
+	}
+	window->rb_max_end = max_end;
+}
+
+static void micscif_window_augment_path(struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	for (;;) {
+		micscif_window_augment(node);
+		if (!(parent = rb_parent(node)))
+			return;
+		if (node == parent->rb_left && parent->rb_right)
+			micscif_window_augment(parent->rb_right);
+		else if (parent->rb_left)
+			micscif_window_augment(parent->rb_left);
+		node = parent;
+	}
+}
+
+/* Deepest node whose subtree changes when node is erased */
+static struct rb_node *micscif_window_erase_begin(struct rb_node *node)
+{
+	struct rb_node *deepest;
+
+	if (!node->rb_right && !node->rb_left)
+		deepest = rb_parent(node);
+	else if (!node->rb_right)
+		deepest = node->rb_left;
+	else if (!node->rb_left)
+		deepest = node->rb_right;
+	else {
+		deepest = rb_next(node);
+		if (deepest->rb_right)
+			deepest = deepest->rb_right;
+		else if (rb_parent(deepest) != node)
+			deepest = rb_parent(deepest);
+	}
+	return deepest;
+}
+
+static void micscif_window_link(struct reg_range_t *window,
+			struct list_head *head, struct rb_root *tree, uint64_t start)
+{
+	struct rb_node **link = &tree->rb_node, *parent = NULL, *node;
+	struct reg_range_t *curr;
+
+	window->rb_start = start;
+	window->rb_end = start + (window->nr_pages << PAGE_SHIFT);
+	window->rb_max_end = window->rb_end;
+	while (*link) {
+		parent = *link;
+		curr = rb_entry(parent, struct reg_range_t, rb_node);
+		if (start < curr->rb_start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&window->rb_node, parent, link);
+	rb_insert_color(&window->rb_node, tree);
+	node = &window->rb_node;
+	if (node->rb_left)
+		node = node->rb_left;
+	else if (node->rb_right)
+		node = node->rb_right;
+	micscif_window_augment_path(node);
+	window->rb_tree = tree;
+
+	/* Keep the list in tree order */
+	INIT_LIST_HEAD(&window->list_member);
+	if ((node = rb_prev(&window->rb_node))) {
+		curr = rb_entry(node, struct reg_range_t, rb_node);
+		list_add(&window->list_member, &curr->list_member);
+	} else {
+		list_add(&window->list_member, head);
+	}
+}
+
+/*
+ * micscif_window_first:
+ *
+ * Return the first window in list order which starts at or below addr and
+ * ends above it, or at it too if inclusive is set, NULL if there is none.
+ */
+static struct reg_range_t *
+micscif_window_first(struct rb_root *tree, uint64_t addr, bool inclusive)
+{
+	struct rb_node *node = tree->rb_node;
+	struct reg_range_t *window;
+
+	while (node) {
+		if (node->rb_left) {
+			window = rb_entry(node->rb_left, struct reg_range_t, rb_node);
+			if (window->rb_max_end > addr ||
+				(inclusive && window->rb_max_end == addr)) {
+				node = node->rb_left;
+				continue;
+			}
+		}
+		window = rb_entry(node, struct reg_range_t, rb_node);
+		if (window->rb_start > addr)
+			return NULL;
+		if (window->rb_end > addr ||
+			(inclusive && window->rb_end == addr))
+			return window;
+		node = node->rb_right;
+	}
+	return NULL;
+}
+
+/* Return the first window in list order which starts above addr */
+static struct reg_range_t *
+micscif_window_next(struct rb_root *tree, uint64_t addr)
+{
+	struct rb_node *node = tree->rb_node;
+	struct reg_range_t *window, *next = NULL;
+
+	while (node) {
+		window = rb_entry(node, struct reg_range_t, rb_node);
+		if (window->rb_start > addr) {
+			next = window;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return next;
+}
+
 /*
  * micscif_insert_tcw:
  *
@@ -58,62 +213,43 @@
  * RMA lock must be held.
  */
 void micscif_insert_tcw(struct reg_range_t *window,
-					struct list_head *head)
+			struct list_head *head, struct rb_root *tree)
 {
-	struct reg_range_t *curr = NULL, *prev = NULL;
-	struct list_head *item;
 	BUG_ON(!window);
-	INIT_LIST_HEAD(&window->list_member);
-	/*
-	 * HSD 4845254
-	 * Hack for worst case performance
-	 * Compare with tail and if the new entry is new tail add it to the end
-	 */
-	if (!list_empty(head)) {
-		curr = list_entry(head->prev, struct reg_range_t, list_member);
-		if ((uint64_t) curr->va_for_temp < (uint64_t) window->va_for_temp) {
-			list_add_tail(&window->list_member, head);
-			return;
-		}
-	}
-	/*
-	 * We don't need the if(!prev) code but I am gonna leave it as
-	 * is for now. If someone touches the above code it is likely that they
-	 * will miss that they have to add if(!prev) block
-	 */
-	list_for_each(item, head) {
-		curr = list_entry(item, struct reg_range_t, list_member);
-		if ((uint64_t) curr->va_for_temp > (uint64_t) window->va_for_temp)
-			break;
-		prev = curr;
-	}
-	if (!prev)
-		list_add(&window->list_member, head);
-	else
-		list_add(&window->list_member, &prev->list_member);
+	micscif_window_link(window, head, tree, (uint64_t)window->va_for_temp);
 }
+
 /*
  * micscif_insert_window:
  *
  * Insert a window to the self registration list sorted by offset.
  * RMA lock must be held.
  */
-void micscif_insert_window(struct reg_range_t *window, struct list_head *head)
+void micscif_insert_window(struct reg_range_t *window, struct list_head *head,
+				struct rb_root *tree)
 {
-	struct reg_range_t *curr = NULL, *prev = NULL;
-	struct list_head *item;
 	BUG_ON(!window);
-	INIT_LIST_HEAD(&window->list_member);
-	list_for_each(item, head) {
-		curr = list_entry(item, struct reg_range_t, list_member);
-		if (curr->offset > window->offset)
-			break;
-		prev = curr;
-	}
-	if (!prev)
-		list_add(&window->list_member, head);
-	else
-		list_add(&window->list_member, &prev->list_member);
+	micscif_window_link(window, head, tree, window->offset);
+}
+
+/*
+ * micscif_remove_window:
+ *
+ * Remove a window from the registration list and tree it was inserted on.
+ * The lock protecting that list must be held.
+ */
+void micscif_remove_window(struct reg_range_t *window)
+{
+	struct rb_node *deepest;
+
+	list_del(&window->list_member);
+	if (!window->rb_tree)
+		return;
+	deepest = micscif_window_erase_begin(&window->rb_node);
+	rb_erase(&window->rb_node, window->rb_tree);
+	if (deepest)
+		micscif_window_augment_path(deepest);
+	window->rb_tree = NULL;
 }
 
 /*
@@ -127,71 +263,51 @@ void micscif_insert_window(struct reg_range_t *window, struct list_head *head)
  */
 int micscif_query_tcw(struct endpt *ep, struct micscif_rma_req *req)
 {
-	struct list_head *item, *temp;
 	struct reg_range_t *window;
 	uint64_t start_va_window, start_va_req = (uint64_t) req->va_for_temp;
 	uint64_t end_va_window, end_va_req = start_va_req + req->nr_bytes;
 
 	/*
-	 * HSD 4845254
-	 * Hack for the worst case scenario
-	 * Avoid traversing the entire list to find out that there is no
-	 * entry that matches
+	 * The list walk this replaces skipped windows ending below
+	 * start_va_req and stopped at the first one either reaching it
+	 * or starting above it.
 	 */
-	if (!list_empty(req->head)) {
-		temp = req->head->prev;
-		window = list_entry(temp, 
-			struct reg_range_t, list_member);
-		end_va_window = (uint64_t) window->va_for_temp +
-			(window->nr_pages << PAGE_SHIFT);
-		if (start_va_req > end_va_window)
-			return -ENXIO;
+	if (!(window = micscif_window_first(req->tree, start_va_req, true)) &&
+		!(window = micscif_window_next(req->tree, start_va_req))) {
+		pr_debug("%s %d ENXIO\n", __func__, __LINE__);
+		return -ENXIO;
 	}
-	list_for_each_safe(item, temp, req->head) {
-		window = list_entry(item, 
-			struct reg_range_t, list_member);
-		start_va_window = (uint64_t) window->va_for_temp;
-		end_va_window = (uint64_t) window->va_for_temp +
-			(window->nr_pages << PAGE_SHIFT);
-		pr_debug("%s %d start_va_window 0x%llx end_va_window 0x%llx"
-			" start_va_req 0x%llx end_va_req 0x%llx req->nr_bytes 0x%lx\n", 
-			__func__, __LINE__, start_va_window, end_va_window, 
-			start_va_req, end_va_req, req->nr_bytes);
-		if (start_va_req < start_va_window) {
-			if (end_va_req < start_va_window) {
-				/* No overlap */
-			} else {
-				if ((window->prot & req->prot) != req->prot) {
-					
-				} else {
-					req->nr_bytes += ((end_va_req > end_va_window) ? 0:(end_va_window - end_va_req));
-					pr_debug("%s %d Extend req->va_for_temp %p req->nr_byte 0x%lx\n", 
-						__func__, __LINE__, req->va_for_temp, req->nr_bytes);
-				}
-				__micscif_rma_destroy_tcw_helper(window);
-			}
-			break;
+	start_va_window = (uint64_t) window->va_for_temp;
+	end_va_window = (uint64_t) window->va_for_temp +
+		(window->nr_pages << PAGE_SHIFT);
+	pr_debug("%s %d start_va_window 0x%llx end_va_window 0x%llx"
+		" start_va_req 0x%llx end_va_req 0x%llx req->nr_bytes 0x%lx\n", 
+		__func__, __LINE__, start_va_window, end_va_window, 
+		start_va_req, end_va_req, req->nr_bytes);
+	if (start_va_req < start_va_window) {
+		if (end_va_req < start_va_window) {
+			/* No overlap */
 		} else {
-			if (start_va_req > end_va_window) {
-				/* No overlap */
-				continue;
-			} else {
-				if ((window->prot & req->prot) != req->prot) {
-					__micscif_rma_destroy_tcw_helper(window);
-					break;
-				}
-				if (end_va_req > end_va_window) {
-					req->va_for_temp = (void*) start_va_window;
-					req->nr_bytes = end_va_req - start_va_window;
-					pr_debug("%s %d Extend req->va_for_temp %p req->nr_byte 0x%lx\n", 
-						__func__, __LINE__, req->va_for_temp, req->nr_bytes);
-					__micscif_rma_destroy_tcw_helper(window);
-					return -ENXIO;
-				} else {
-					*(req->out_window) = window;
-					return 0;
-				}
+			if ((window->prot & req->prot) == req->prot) {
+				req->nr_bytes += ((end_va_req > end_va_window) ? 0:(end_va_window - end_va_req));
+				pr_debug("%s %d Extend req->va_for_temp %p req->nr_byte 0x%lx\n", 
+					__func__, __LINE__, req->va_for_temp, req->nr_bytes);
 			}
+			__micscif_rma_destroy_tcw_helper(window);
+		}
+	} else {
+		if ((window->prot & req->prot) != req->prot) {
+			__micscif_rma_destroy_tcw_helper(window);
+		} else if (end_va_req > end_va_window) {
+			req->va_for_temp = (void*) start_va_window;
+			req->nr_bytes = end_va_req - start_va_window;
+			pr_debug("%s %d Extend req->va_for_temp %p req->nr_byte 0x%lx\n", 
+				__func__, __LINE__, req->va_for_temp, req->nr_bytes);
+			__micscif_rma_destroy_tcw_helper(window);
+			return -ENXIO;
+		} else {
+			*(req->out_window) = window;
+			return 0;
 		}
 	}
 	pr_debug("%s %d ENXIO\n", __func__, __LINE__);
@@ -207,14 +323,19 @@ int micscif_query_tcw(struct endpt *ep, struct micscif_rma_req *req)
  */
 int micscif_query_window(struct micscif_rma_req *req)
 {
-	struct list_head *item;
 	struct reg_range_t *window;
 	uint64_t end_offset, offset = req->offset;
 	uint64_t tmp_min, nr_bytes_left = req->nr_bytes;
 
-	list_for_each(item, req->head) {
-		window = list_entry(item, 
-			struct reg_range_t, list_member);
+	/* Windows ahead of the first one covering offset are never used */
+	if (!(window = micscif_window_first(req->tree, offset, false))) {
+		if (micscif_window_next(req->tree, offset))
+			/* Offset not found! */
+			return -ENXIO;
+		goto not_found;
+	}
+
+	list_for_each_entry_from(window, req->head, list_member) {
 		end_offset = window->offset +
 			(window->nr_pages << PAGE_SHIFT);
 		if (offset < window->offset)
@@ -250,6 +371,7 @@ int micscif_query_window(struct micscif_rma_req *req)
 				break;
 		}
 	}
+not_found:
 	printk(KERN_ERR "%s %d ENXIO\n", __func__, __LINE__);
 	return -ENXIO;
 }
@@ -627,7 +749,7 @@ void micscif_rma_list_munmap(struct reg_range_t *start_window,
 			msg.payload[0] = window->peer_window;
 			/* No error handling for Notification messages. */
 			micscif_nodeqp_send(ep->remote_dev, &msg, ep);
-			list_del(&window->list_member);
+			micscif_remove_window(window);
 			/* Destroy this window from the peer's registered AS */
 			micscif_destroy_remote_window(ep, window);
 		}
@@ -759,6 +881,82 @@ int micscif_rma_list_get_pages_check(struct endpt *ep)
 	return err;
 }
 
+#define SCIF_WINDOW_BENCH_LOOPS	10000
+
+/*
+ * Time micscif_query_window() against a walk of the sorted window list,
+ * which is what a lookup cost before the interval tree, with a growing
+ * number of windows for /proc/scif/window_bench. The windows are one
+ * page each with a one page hole in between and are never seen by RMA.
+ */
+int scif_window_bench(char *buf, int len)
+{
+	static const int nr[] = {1, 16, 256, 4096, 16384};
+	struct reg_range_t *windows, *window, *out;
+	struct micscif_rma_req req;
+	struct rb_root tree = RB_ROOT;
+	LIST_HEAD(head);
+	uint64_t offset;
+	int i, j, l = 0, nr_windows = 0, misses;
+	ktime_t start;
+	long tree_ns, list_ns;
+
+	if (!(windows = vmalloc(nr[ARRAY_SIZE(nr) - 1] * sizeof(*windows))))
+		return -ENOMEM;
+	memset(windows, 0, nr[ARRAY_SIZE(nr) - 1] * sizeof(*windows));
+
+	req.out_window = &out;
+	req.nr_bytes = PAGE_SIZE;
+	req.prot = SCIF_PROT_READ;
+	req.type = WINDOW_SINGLE;
+	req.head = &head;
+	req.tree = &tree;
+
+	l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+		"%-10s %-12s %-12s %-10s\n",
+		"windows", "ns/tree", "ns/list", "misses");
+
+	for (i = 0; i < ARRAY_SIZE(nr); i++) {
+		while (nr_windows < nr[i]) {
+			window = &windows[nr_windows];
+			window->nr_pages = 1;
+			window->offset = (uint64_t)nr_windows++ << (PAGE_SHIFT + 1);
+			window->prot = SCIF_PROT_READ | SCIF_PROT_WRITE;
+			micscif_insert_window(window, &head, &tree);
+		}
+
+		misses = 0;
+		start = ktime_get();
+		for (j = 0; j < SCIF_WINDOW_BENCH_LOOPS; j++) {
+			req.offset = (uint64_t)(j * 7919 % nr_windows) << (PAGE_SHIFT + 1);
+			if (micscif_query_window(&req) || out->offset != req.offset)
+				misses++;
+		}
+		tree_ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (j = 0; j < SCIF_WINDOW_BENCH_LOOPS; j++) {
+			offset = (uint64_t)(j * 7919 % nr_windows) << (PAGE_SHIFT + 1);
+			list_for_each_entry(window, &head, list_member)
+				if (offset < window->offset +
+					(window->nr_pages << PAGE_SHIFT))
+					break;
+			if (&window->list_member == &head || window->offset != offset)
+				misses++;
+		}
+		list_ns = (long)ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		l += snprintf(buf + l, len - l > 0 ? len - l : 0,
+			"%-10d %-12ld %-12ld %-10d\n", nr_windows,
+			tree_ns / SCIF_WINDOW_BENCH_LOOPS,
+			list_ns / SCIF_WINDOW_BENCH_LOOPS, misses);
+		schedule();
+	}
+
+	vfree(windows);
+	return l;
+}
+
 /* Only debug API's below */
 void micscif_display_all_windows(struct list_head *head)
 {
@@ -37,6 +37,8 @@
  * intellectual property rights is granted herein.
  */
 
+#include <linux/hash.h>
+#include <linux/scatterlist.h>
 #include <mic/micscif.h>
 #include <mic/micscif_smpt.h>
 #if defined(HOST) || defined(WINDOWS)
@@ -81,6 +83,42 @@ void mic_smpt_set(volatile void *mm_sbox, uint64_t dma_addr, uint64_t index)
 }
 
 #if defined(HOST)
+static inline int smpt_hash_fn(dma_addr_t dma_addr)
+{
+	return hash_long((unsigned long)(dma_addr >> MIC_SYSTEM_PAGE_SHIFT),
+			 SMPT_HASH_BITS);
+}
+
+static void smpt_hash_add(mic_ctx_t *mic_ctx, int index)
+{
+	int *head = &mic_ctx->smpt_hash[smpt_hash_fn(mic_ctx->mic_smpt[index].dma_addr)];
+
+	mic_ctx->mic_smpt[index].hash_next = *head;
+	*head = index;
+}
+
+static void smpt_hash_del(mic_ctx_t *mic_ctx, int index)
+{
+	int *link = &mic_ctx->smpt_hash[smpt_hash_fn(mic_ctx->mic_smpt[index].dma_addr)];
+
+	while (*link != -1) {
+		if (*link == index) {
+			*link = mic_ctx->mic_smpt[index].hash_next;
+			break;
+		}
+		link = &mic_ctx->mic_smpt[*link].hash_next;
+	}
+	mic_ctx->mic_smpt[index].hash_next = -1;
+}
+
+/* Point SMPT entry index at a new dma_addr in the SW shadow table */
+static void smpt_set_dma_addr(mic_ctx_t *mic_ctx, int index, dma_addr_t dma_addr)
+{
+	smpt_hash_del(mic_ctx, index);
+	mic_ctx->mic_smpt[index].dma_addr = dma_addr;
+	smpt_hash_add(mic_ctx, index);
+}
+
 /*
  * Called once per board as part of starting a MIC
  * to restore the SMPT state to the previous values
@@ -122,11 +160,17 @@ void mic_smpt_init(mic_ctx_t *mic_ctx)
 	spin_lock_init(&mic_ctx->smpt_lock);
 	mic_ctx->mic_smpt = kmalloc(sizeof(mic_smpt_t)
 					* NUM_SMPT_ENTRIES_IN_USE, GFP_KERNEL);
+	bitmap_zero(mic_ctx->smpt_busy, NUM_SMPT_ENTRIES_IN_USE);
+	for (i = 0; i < SMPT_HASH_SIZE; i++)
+		mic_ctx->smpt_hash[i] = -1;
+	memset(&mic_ctx->smpt_stats, 0, sizeof(mic_ctx->smpt_stats));
 
 	for (i = 0; i < NUM_SMPT_ENTRIES_IN_USE; i++) {
 		dma_addr = i * MIC_SYSTEM_PAGE_SIZE;
 		mic_ctx->mic_smpt[i].dma_addr = dma_addr;
 		mic_ctx->mic_smpt[i].ref_count = 0;
+		mic_ctx->mic_smpt[i].hash_next = -1;
+		smpt_hash_add(mic_ctx, i);
 		if (mic_ctx->bi_family == FAMILY_KNC) {
 			smpt_reg_val = BUILD_SMPT(SNOOP_ON,
 					dma_addr >> MIC_SYSTEM_PAGE_SHIFT);
@@ -262,41 +306,46 @@ void add_smpt_entry(int spt, int64_t *ref, uint64_t dma_addr, int entries, mic_c
 			}
 			else
 				mic_smpt_set(mm_sbox, addr, i);
-			mic_smpt[i].dma_addr = addr;
+			smpt_set_dma_addr(mic_ctx, i, addr);
 		}
 		mic_smpt[i].ref_count += ref[i - spt];
+		if (mic_smpt[i].ref_count)
+			__set_bit(i, mic_ctx->smpt_busy);
 	}
 }
 
-dma_addr_t smpt_op(int bid, uint64_t dma_addr,
-				int entries, int64_t *ref)
+/*
+ * Look for entries already pointing at dma_addr .. dma_addr + entries SMPT
+ * pages. Returns the first entry or -1. Called with smpt_lock held.
+ */
+static int smpt_find_existing(mic_ctx_t *mic_ctx, uint64_t dma_addr, int entries)
 {
-	int spt = -1;   /* smpt index */
-	int ee = 0; 	/* existing entries */
-	int fe = 0;     /* free entries */
-	int i;
-	unsigned long flags;
-	dma_addr_t mic_addr = 0;
-	dma_addr_t addr = dma_addr;
-	mic_ctx_t *mic_ctx = get_per_dev_ctx(bid);
 	mic_smpt_t *mic_smpt = mic_ctx->mic_smpt;
-
-	spin_lock_irqsave(&mic_ctx->smpt_lock, flags);
-
-	/* find existing entries */
-	for (i = 0; i < NUM_SMPT_ENTRIES_IN_USE; i++) {
-		if (mic_smpt[i].dma_addr == addr) {
-			ee++;
-			addr += MIC_SYSTEM_PAGE_SIZE;
-		}
-		else if (ee) /* cannot find contiguous entries */
-			goto not_found;
-
-		if (ee == entries)
-			goto found;
+	int i, j;
+
+	for (i = mic_ctx->smpt_hash[smpt_hash_fn(dma_addr)]; i != -1;
+	     i = mic_smpt[i].hash_next) {
+		if (mic_smpt[i].dma_addr != dma_addr ||
+		    i + entries > NUM_SMPT_ENTRIES_IN_USE)
+			continue;
+		for (j = 1; j < entries; j++)
+			if (mic_smpt[i + j].dma_addr !=
+			    dma_addr + j * MIC_SYSTEM_PAGE_SIZE)
+				break;
+		if (j == entries)
+			return i;
 	}
+	return -1;
+}
 
-	/* find free entry */
+/*
+ * First fit search for entries contiguous free SMPT entries in the busy
+ * bitmap. Returns the first entry or -1. Called with smpt_lock held.
+ */
+static int smpt_find_free(mic_ctx_t *mic_ctx, int entries)
+{
+	unsigned long *busy = mic_ctx->smpt_busy;
+	int start, end;
 #ifdef CONFIG_ML1OM
 	/*
 	 * For KNF the SMPT registers are not host accessible so we maintain a
@@ -307,28 +356,58 @@ dma_addr_t smpt_op(int bid, uint64_t dma_addr,
 	 * entries are setup after SCIF driver load/reload via SCIF Node QP
 	 * SMPT_SET messages.
 	 */
-	for (i = NUM_SMPT_ENTRIES_IN_USE / 2 ; i < NUM_SMPT_ENTRIES_IN_USE; i++) {
+	int first = NUM_SMPT_ENTRIES_IN_USE / 2;
 #else
-	for (i = 0 ; i < NUM_SMPT_ENTRIES_IN_USE; i++) {
+	int first = 0;
 #endif
-		fe = (mic_smpt[i].ref_count == 0) ? fe + 1: 0;
-		if (fe == entries)
-			goto found;
-	}
 
-not_found:
-	spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
-	return mic_addr;
+	start = find_next_zero_bit(busy, NUM_SMPT_ENTRIES_IN_USE, first);
+	while (start + entries <= NUM_SMPT_ENTRIES_IN_USE) {
+		end = find_next_bit(busy, NUM_SMPT_ENTRIES_IN_USE, start);
+		if (end - start >= entries)
+			return start;
+		if (end >= NUM_SMPT_ENTRIES_IN_USE)
+			break;
+		start = find_next_zero_bit(busy, NUM_SMPT_ENTRIES_IN_USE, end);
+	}
+	return -1;
+}
 
-found:
-	spt = i - entries + 1;
-	mic_addr = SMPT_TO_MIC_PA(spt);
+/*
+ * Find or allocate SMPT entries for dma_addr and take references on them.
+ * Returns the MIC address of the first entry or 0. Called with smpt_lock held.
+ */
+static dma_addr_t smpt_op_locked(mic_ctx_t *mic_ctx, uint64_t dma_addr,
+				int entries, int64_t *ref)
+{
+	int spt;
+
+	if ((spt = smpt_find_existing(mic_ctx, dma_addr, entries)) != -1) {
+		mic_ctx->smpt_stats.reuse_count++;
+	} else if ((spt = smpt_find_free(mic_ctx, entries)) != -1) {
+		mic_ctx->smpt_stats.alloc_count++;
+	} else {
+		mic_ctx->smpt_stats.fail_count++;
+		return 0;
+	}
 	add_smpt_entry(spt, ref, dma_addr, entries, mic_ctx);
+	mic_ctx->smpt_stats.map_count++;
+	return SMPT_TO_MIC_PA(spt);
+}
+
+dma_addr_t smpt_op(int bid, uint64_t dma_addr,
+				int entries, int64_t *ref)
+{
+	unsigned long flags;
+	dma_addr_t mic_addr;
+	mic_ctx_t *mic_ctx = get_per_dev_ctx(bid);
+
+	spin_lock_irqsave(&mic_ctx->smpt_lock, flags);
+	mic_addr = smpt_op_locked(mic_ctx, dma_addr, entries, ref);
 	spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
 	return mic_addr;
 }
 
-
 /*
  * Returns number of smpt entries needed for dma_addr to dma_addr + size
  * also returns the reference count array for each of those entries
@@ -396,6 +475,21 @@ dma_addr_t mic_map(int bid, dma_addr_t dma_addr, size_t size)
 		return (mic_addr + (dma_addr & MIC_SYSTEM_PAGE_MASK));
 }
 
+/* Drop references on num_smpt entries starting at spt, smpt_lock held */
+static void __mic_unmap_locked(mic_ctx_t *mic_ctx, int spt, int64_t *ref, int num_smpt)
+{
+	mic_smpt_t *mic_smpt = mic_ctx->mic_smpt;
+	int i;
+
+	for (i = spt; i < spt + num_smpt; i++) {
+		mic_smpt[i].ref_count -= ref[i - spt];
+		WARN_ON(mic_smpt[i].ref_count < 0);
+		if (mic_smpt[i].ref_count <= 0)
+			__clear_bit(i, mic_ctx->smpt_busy);
+	}
+	mic_ctx->smpt_stats.unmap_count++;
+}
+
 /*
  * Unmaps mic_addr to mic_addr + size memory in the smpt table
  * of board bid
@@ -403,11 +497,9 @@ dma_addr_t mic_map(int bid, dma_addr_t dma_addr, size_t size)
 void mic_unmap(int bid, dma_addr_t mic_addr, size_t size)
 {
 	mic_ctx_t *mic_ctx = get_per_dev_ctx(bid);
-	mic_smpt_t *mic_smpt = mic_ctx->mic_smpt;
 	int64_t ref[NUM_SMPT_ENTRIES_IN_USE];
 	int num_smpt;
 	int spt = HOSTMIC_PA_TO_SMPT(mic_addr);
-	int i;
 	unsigned long flags;
 
 	if (!size)
@@ -428,11 +520,95 @@ void mic_unmap(int bid, dma_addr_t mic_addr, size_t size)
 	smpt_ref_count_g[bid] -= (int64_t)size;
 #endif
 
-	for (i = spt; i < spt + num_smpt; i++) {
-         	mic_smpt[i].ref_count -= ref[i - spt];
-		WARN_ON(mic_smpt[i].ref_count < 0);
+	__mic_unmap_locked(mic_ctx, spt, ref, num_smpt);
+	spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
+}
+
+/* Undo the SMPT part of mic_map_sg for count segments, smpt_lock held */
+static void mic_unmap_sg_locked(mic_ctx_t *mic_ctx, struct scatterlist *sg, int count)
+{
+	int64_t ref[NUM_SMPT_ENTRIES_IN_USE];
+	struct scatterlist *s;
+	dma_addr_t mic_addr;
+	int i, spt, num_smpt;
+
+	for_each_sg(sg, s, count, i) {
+		if (!sg_dma_len(s))
+			continue;
+		mic_addr = sg_dma_address(s);
+		spt = HOSTMIC_PA_TO_SMPT(mic_addr);
+		num_smpt = get_smpt_ref_count(ref, mic_addr, sg_dma_len(s), NULL);
+		sg_dma_address(s) = mic_ctx->mic_smpt[spt].dma_addr + SMPT_OFFSET(mic_addr);
+#if SMPT_LOGGING
+		unmap_count_g++;
+		smpt_ref_count_g[mic_ctx->bi_id] -= (int64_t)sg_dma_len(s);
+#endif
+		__mic_unmap_locked(mic_ctx, spt, ref, num_smpt);
+	}
+}
+
+/*
+ * mic_map_sg - Map a scatterlist for DMA by board bid
+ *
+ * Maps the list with a single pci_map_sg() call and then translates every
+ * mapped segment into a MIC address with one acquisition of smpt_lock.
+ * On success sg_dma_address() of each segment holds the MIC address.
+ *
+ * Returns the number of mapped segments or 0 on failure. The same nents
+ * and the returned count must be passed to mic_unmap_sg().
+ */
+int mic_map_sg(int bid, struct pci_dev *hwdev, struct scatterlist *sg, int nents)
+{
+	mic_ctx_t *mic_ctx = get_per_dev_ctx(bid);
+	int64_t ref[NUM_SMPT_ENTRIES_IN_USE];
+	struct scatterlist *s;
+	uint64_t smpt_start;
+	dma_addr_t dma_addr, mic_addr;
+	unsigned long flags;
+	int i, entries, mapped;
+
+	if (!(mapped = pci_map_sg(hwdev, sg, nents, PCI_DMA_BIDIRECTIONAL)))
+		return 0;
+
+	spin_lock_irqsave(&mic_ctx->smpt_lock, flags);
+	for_each_sg(sg, s, mapped, i) {
+		if (!sg_dma_len(s))
+			continue;
+		dma_addr = sg_dma_address(s);
+		entries = get_smpt_ref_count(ref, dma_addr, sg_dma_len(s), &smpt_start);
+		if (!(mic_addr = smpt_op_locked(mic_ctx, smpt_start, entries, ref))) {
+			printk(KERN_ERR "%s failed board id %d addr %#016llx size %#x\n",
+				__func__, bid, dma_addr, sg_dma_len(s));
+			mic_unmap_sg_locked(mic_ctx, sg, i);
+			spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
+			pci_unmap_sg(hwdev, sg, nents, PCI_DMA_BIDIRECTIONAL);
+			return 0;
+		}
+		sg_dma_address(s) = mic_addr + (dma_addr & MIC_SYSTEM_PAGE_MASK);
+#if SMPT_LOGGING
+		map_count_g++;
+		smpt_ref_count_g[bid] += (int64_t)sg_dma_len(s);
+#endif
 	}
 	spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
+	return mapped;
+}
+
+/*
+ * mic_unmap_sg - Unmap a scatterlist mapped with mic_map_sg
+ * @nents: number of entries passed to mic_map_sg
+ * @mapped: number of segments returned by mic_map_sg
+ */
+void mic_unmap_sg(int bid, struct pci_dev *hwdev, struct scatterlist *sg,
+		int nents, int mapped)
+{
+	mic_ctx_t *mic_ctx = get_per_dev_ctx(bid);
+	unsigned long flags;
+
+	spin_lock_irqsave(&mic_ctx->smpt_lock, flags);
+	mic_unmap_sg_locked(mic_ctx, sg, mapped);
+	spin_unlock_irqrestore(&mic_ctx->smpt_lock, flags);
+	pci_unmap_sg(hwdev, sg, nents, PCI_DMA_BIDIRECTIONAL);
 }
 
 dma_addr_t mic_to_dma_addr(int bid, dma_addr_t mic_addr)
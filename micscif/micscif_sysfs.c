@@ -222,6 +222,232 @@ bail:
 }
 static DEVICE_ATTR(proxy_dma_threshold, S_IRUGO | S_IWUSR, show_proxy_dma_threshold, store_proxy_dma_threshold);
 
+static ssize_t show_endpt_qp_size(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_endpt_qp_size);
+}
+
+static ssize_t store_endpt_qp_size(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1)
+		goto invalid;
+
+	/* Rings are indexed with a mask so the size must be a power of 2 */
+	if (i < ENDPT_QP_SIZE || i > ENDPT_QP_MAX_SIZE || (i & (i - 1)))
+		goto invalid;
+
+	ms_info.mi_endpt_qp_size = i;
+	ret = strlen(buf);
+	printk("SCIF endpoint QP size = %u bytes\n", ms_info.mi_endpt_qp_size);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(endpt_qp_size, S_IRUGO | S_IWUSR, show_endpt_qp_size, store_endpt_qp_size);
+
+static ssize_t show_qp_notify_pct(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_qp_notify_pct);
+}
+
+static ssize_t store_qp_notify_pct(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1 || i > 100)
+		goto invalid;
+
+	ms_info.mi_qp_notify_pct = i;
+	ret = strlen(buf);
+	printk("SCIF QP notify threshold = %u%%\n", ms_info.mi_qp_notify_pct);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(qp_notify_pct, S_IRUGO | S_IWUSR, show_qp_notify_pct, store_qp_notify_pct);
+
+static ssize_t show_rndv_threshold(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_rndv_threshold);
+}
+
+static ssize_t store_rndv_threshold(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1)
+		goto invalid;
+
+	/* Anything smaller is cheaper to copy through the ring */
+	if (i && i < PAGE_SIZE)
+		goto invalid;
+
+	ms_info.mi_rndv_threshold = i;
+	ret = strlen(buf);
+	printk("SCIF rendezvous send threshold = %u bytes\n", ms_info.mi_rndv_threshold);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(rndv_threshold, S_IRUGO | S_IWUSR, show_rndv_threshold, store_rndv_threshold);
+
+static ssize_t show_busy_poll(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_busy_poll_us);
+}
+
+static ssize_t store_busy_poll(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1)
+		goto invalid;
+
+	if (i > SCIF_BUSY_POLL_MAX_US)
+		goto invalid;
+
+	ms_info.mi_busy_poll_us = i;
+	ret = strlen(buf);
+	printk("SCIF recv busy poll = %u usecs\n", ms_info.mi_busy_poll_us);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(busy_poll, S_IRUGO | S_IWUSR, show_busy_poll, store_busy_poll);
+
+static ssize_t show_nodeqp_lanes(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_nodeqp_lanes);
+}
+
+static ssize_t store_nodeqp_lanes(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1)
+		goto invalid;
+
+	if (i > SCIF_NODEQP_MAX_LANES)
+		goto invalid;
+
+	/* Applies to nodes coming up from now on */
+	ms_info.mi_nodeqp_lanes = i;
+	ret = strlen(buf);
+	printk("SCIF node QP lanes = %u\n", ms_info.mi_nodeqp_lanes);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(nodeqp_lanes, S_IRUGO | S_IWUSR, show_nodeqp_lanes, store_nodeqp_lanes);
+
+static ssize_t show_rma_dma_chans(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", ms_info.mi_rma_dma_chans);
+}
+
+static ssize_t store_rma_dma_chans(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	uint32_t i;
+
+	if (sscanf(buf, "%u", &i) != 1)
+		goto invalid;
+
+	if (!i || i > SCIF_RMA_DMA_CHAN_MAX)
+		goto invalid;
+
+	/* Applies to endpoints connecting from now on */
+	ms_info.mi_rma_dma_chans = i;
+	ret = strlen(buf);
+	printk("SCIF RMA DMA channels per endpoint = %u\n", ms_info.mi_rma_dma_chans);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(rma_dma_chans, S_IRUGO | S_IWUSR, show_rma_dma_chans, store_rma_dma_chans);
+
+static ssize_t show_rma_stripe_threshold(struct device *dev,
+		struct device_attribute *attr,
+		char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%llu\n", ms_info.mi_rma_stripe_threshold);
+}
+
+static ssize_t store_rma_stripe_threshold(struct device *dev,
+		struct device_attribute *attr,
+		const char *buf,
+		size_t count)
+{
+	int ret;
+	unsigned long long i;
+
+	if (sscanf(buf, "%llu", &i) != 1)
+		goto invalid;
+
+	/* Stripes are whole pages, 0 disables striping */
+	if (i && i < 2 * PAGE_SIZE)
+		goto invalid;
+
+	ms_info.mi_rma_stripe_threshold = i;
+	ret = strlen(buf);
+	printk("SCIF RMA stripe threshold = %llu bytes\n", ms_info.mi_rma_stripe_threshold);
+	goto bail;
+invalid:
+	ret = -EINVAL;
+bail:
+	return ret;
+}
+static DEVICE_ATTR(rma_stripe_threshold, S_IRUGO | S_IWUSR, show_rma_stripe_threshold, store_rma_stripe_threshold);
+
 static struct attribute *scif_attributes[] = {
 	&dev_attr_maxnode.attr,
 	&dev_attr_total.attr,
@@ -230,6 +456,13 @@ static struct attribute *scif_attributes[] = {
 	&dev_attr_watchdog_enabled.attr,
 	&dev_attr_watchdog_auto_reboot.attr,
 	&dev_attr_proxy_dma_threshold.attr,
+	&dev_attr_endpt_qp_size.attr,
+	&dev_attr_qp_notify_pct.attr,
+	&dev_attr_rndv_threshold.attr,
+	&dev_attr_busy_poll.attr,
+	&dev_attr_nodeqp_lanes.attr,
+	&dev_attr_rma_dma_chans.attr,
+	&dev_attr_rma_stripe_threshold.attr,
 	NULL
 };
 
@@ -627,8 +627,7 @@ micvnet_dma_cb_bh(struct work_struct *work)
 
 		micvnet_dec_cnt_tx_pending(vnet_info);
 #ifdef HOST
-		mic_ctx_unmap_single(vnet_to_ctx(vnet_info),
-				snode->dma_src_phys, snode->dma_size);
+		mic_dma_buf_put(vnet_to_ctx(vnet_info), snode->dma_buf);
 		micpm_put_reference(vnet_to_ctx(vnet_info));
 #endif
 		kfree_skb(snode->skb);
@@ -720,22 +719,22 @@ micvnet_schedule_dma(struct micvnet_info *vnet_info)
 		= ALIGN((skb->len + (skb->data - snode->skb_data_aligned)), 
 			      DMA_ALIGNMENT);
 #ifdef HOST
-	snode->dma_src_phys = mic_ctx_map_single(vnet_to_ctx(vnet_info),
-			snode->skb_data_aligned,
-			snode->dma_size);
-	if (mic_map_error(snode->dma_src_phys)) {
+	/* Copy into a pre-mapped buffer rather than mapping every skb */
+	if (!(snode->dma_buf = mic_dma_buf_get(vnet_to_ctx(vnet_info),
+					       snode->dma_size))) {
 		kfree(snode);
 		ret = -ENOMEM;
 		goto err_exit;
 	}
+	memcpy(snode->dma_buf->va, snode->skb_data_aligned, snode->dma_size);
+	snode->dma_src_phys = snode->dma_buf->mic_addr;
 #else
 	snode->dma_src_phys = virt_to_phys(snode->skb_data_aligned);
 #endif
 
 	if ((ret = micvnet_do_dma(vnet_info, snode))) {
 #ifdef HOST
-		mic_ctx_unmap_single(vnet_to_ctx(vnet_info),
-				       snode->dma_src_phys, snode->dma_size);
+		mic_dma_buf_put(vnet_to_ctx(vnet_info), snode->dma_buf);
 #endif
 		kfree(snode);
 		goto err_exit;
@@ -1135,8 +1134,7 @@ micvnet_deinit_lists(struct micvnet_info *vnet_info)
 		snode = list_entry(pos, struct sched_node, list);
 		list_del(&snode->list);
 #ifdef HOST
-		mic_ctx_unmap_single(vnet_to_ctx(vnet_info), snode->dma_src_phys,
-				snode->dma_size);
+		mic_dma_buf_put(vnet_to_ctx(vnet_info), snode->dma_buf);
 		micpm_put_reference(vnet_to_ctx(vnet_info));
 #endif
 		kfree_skb(snode->skb);
@@ -1212,7 +1210,15 @@ micvnet_alloc_rx_node(struct micvnet_info *vnet_info, struct rx_node **node)
 
 	rnode->size = vnet_info->vi_netdev->mtu + 3 * DMA_ALIGNMENT + ETH_HLEN;
 
-	if (!(rnode->skb = dev_alloc_skb(rnode->size))) {
+#ifdef HOST
+	/* Receive buffers are DMA targets, keep them next to the card */
+	if ((rnode->skb = __alloc_skb(rnode->size + NET_SKB_PAD, GFP_KERNEL, 0,
+				      vnet_to_ctx(vnet_info)->numa_node)))
+		skb_reserve(rnode->skb, NET_SKB_PAD);
+#else
+	rnode->skb = dev_alloc_skb(rnode->size);
+#endif
+	if (!rnode->skb) {
 		kfree(rnode);
 		return -ENOMEM;
 	}